@@ -0,0 +1,75 @@
+#include "Bench.h"
+#include "Client.h"
+#include "BatchDecryptor.h"
+#include "AESWrapper.h"
+#include "RSAWrapper.h"
+#include "Utils.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+namespace Bench {
+	void runBatchDecrypt(const args_t& args) {
+		auto msgCount = static_cast<size_t>(std::stoul(getOpt(args, "--messages", "10000")));
+		auto msgSz = static_cast<size_t>(std::stoul(getOpt(args, "--msg-size", "1024")));
+		auto peerCount = std::max<size_t>(1, std::stoul(getOpt(args, "--peers", "16")));
+		auto maxWorkers = static_cast<size_t>(std::stoul(getOpt(args, "--workers", std::to_string(Utils::workerCount()))));
+
+		// Every peer starts the poll with its symmetric key wrapped with our public key, followed by its texts
+		ClientState state{ "batch_decrypt_bench.info" };
+		RSAPrivateWrapper ourKeys;
+		RSAPublicWrapper ourPubKey{ ourKeys.getPublicKey() };
+		state.setPrivKey(ourKeys.getPrivateKey());
+
+		std::vector<std::pair<BatchDecryptor::msg_header_t, std::string>> messages;
+		std::string plain(msgSz, 'x');
+
+		for (size_t peer = 0; peer < peerCount; peer++) {
+			auto name = "peer" + std::to_string(peer);
+			auto uuid = "uuid" + std::to_string(peer);
+			state.addClient(name, uuid);
+
+			AESWrapper aes;
+			std::string symKey(reinterpret_cast<const char*>(aes.getKey()), AESWrapper::DEFAULT_KEYLENGTH);
+			messages.push_back({ { uuid, 0, MessageTypes::SEND_SYM_KEY, 0 }, ourPubKey.encrypt(symKey) });
+
+			for (size_t i = peer; i < msgCount; i += peerCount) {
+				messages.push_back({ { uuid, static_cast<uint32_t>(i), MessageTypes::SEND_TXT, 0 }, aes.encrypt(plain.c_str(), static_cast<unsigned int>(plain.size())) });
+			}
+		}
+
+		std::cout << messages.size() << " messages of " << formatBytes(static_cast<double>(msgSz)) << " from " << peerCount << " peers\n";
+		std::cout << std::left << std::setw(10) << "workers" << std::setw(14) << "time" << std::setw(10) << "speedup" << '\n';
+
+		double baseNs{ 0 };
+		for (size_t workers = 1; workers <= maxWorkers; workers *= 2) {
+			BatchDecryptor::pool_t pool{ workers };
+
+			// The output is discarded, only the decryption is measured
+			auto stats = measure(1, [&]() {
+				BatchDecryptor batch{ state, pool, workers };
+				for (const auto& [msg, content] : messages) {
+					batch.add(msg, content);
+				}
+
+				std::ostringstream out;
+				batch.flush(out);
+			});
+			pool.join();
+
+			if (workers == 1) {
+				baseNs = stats.nsPerIter;
+			}
+
+			std::cout << std::left << std::setw(10) << workers
+				<< std::setw(14) << (std::to_string(static_cast<uint64_t>(stats.nsPerIter / 1000000)) + " ms")
+				<< std::setw(10) << std::setprecision(3) << (baseNs / stats.nsPerIter) << '\n';
+
+			// Make sure the largest worker count is always measured
+			if (workers < maxWorkers && workers * 2 > maxWorkers) {
+				workers = maxWorkers / 2;
+			}
+		}
+	}
+}
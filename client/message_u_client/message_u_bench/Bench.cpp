@@ -0,0 +1,74 @@
+#include "Bench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// Counters for the replaced global operator new
+static std::atomic<uint64_t> g_allocCount{ 0 };
+static std::atomic<uint64_t> g_allocBytes{ 0 };
+
+void* operator new(std::size_t sz)
+{
+	g_allocCount.fetch_add(1, std::memory_order_relaxed);
+	g_allocBytes.fetch_add(sz, std::memory_order_relaxed);
+
+	if (void* ptr = std::malloc(sz == 0 ? 1 : sz)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+namespace Bench {
+	AllocStats allocStats() {
+		return { g_allocCount.load(std::memory_order_relaxed), g_allocBytes.load(std::memory_order_relaxed) };
+	}
+
+	std::string getOpt(const args_t& args, const std::string& name, const std::string& fallback) {
+		for (size_t i = 0; i + 1 < args.size(); i++) {
+			if (args[i] == name) {
+				return args[i + 1];
+			}
+		}
+
+		return fallback;
+	}
+
+	std::string formatBytes(double bytes) {
+		static const char* units[] = { "B", "KiB", "MiB", "GiB" };
+		size_t unit{ 0 };
+
+		while (bytes >= 1024 && unit + 1 < std::size(units)) {
+			bytes /= 1024;
+			unit++;
+		}
+
+		std::stringstream ss;
+		ss << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << bytes << ' ' << units[unit];
+		return ss.str();
+	}
+
+	double percentile(std::vector<double>& samples, double p) {
+		if (samples.empty()) {
+			return 0;
+		}
+
+		// nth_element is enough for a single rank, the samples are left partially sorted
+		auto rank = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+		std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+		return samples[rank];
+	}
+}
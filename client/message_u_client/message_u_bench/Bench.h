@@ -0,0 +1,126 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace Bench {
+	using args_t = std::vector<std::string>;
+	using bench_fn_t = std::function<void(const args_t&)>;
+
+	// A benchmark that can be selected from the command line
+	struct BenchEntry {
+		std::string description;
+		bench_fn_t run;
+	};
+
+	using bench_map_t = std::map<std::string, BenchEntry>;
+
+	// Heap allocations counted by the replaced global operator new
+	struct AllocStats {
+		uint64_t count{};
+		uint64_t bytes{};
+	};
+
+	// Averages of a measured run, per iteration
+	struct RunStats {
+		double nsPerIter{};
+		double allocsPerIter{};
+		double allocBytesPerIter{};
+	};
+
+	/**
+	 * Gets the allocations done by the process so far
+	 */
+	AllocStats allocStats();
+
+	/**
+	 * Runs 'fn' 'iters' times and returns the average time and allocations of a single run
+	 */
+	template<typename Fn>
+	RunStats measure(size_t iters, Fn&& fn) {
+		auto allocsBefore = allocStats();
+		auto start = std::chrono::steady_clock::now();
+
+		for (size_t i = 0; i < iters; i++) {
+			fn();
+		}
+
+		auto elapsed = std::chrono::steady_clock::now() - start;
+		auto allocsAfter = allocStats();
+
+		RunStats stats;
+		stats.nsPerIter = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iters;
+		stats.allocsPerIter = static_cast<double>(allocsAfter.count - allocsBefore.count) / iters;
+		stats.allocBytesPerIter = static_cast<double>(allocsAfter.bytes - allocsBefore.bytes) / iters;
+		return stats;
+	}
+
+	/**
+	 * Gets the value of a '--name value' option, or 'fallback' if it isn't given
+	 */
+	std::string getOpt(const args_t& args, const std::string& name, const std::string& fallback);
+
+	/**
+	 * Formats a byte count with a binary unit suffix
+	 */
+	std::string formatBytes(double bytes);
+
+	/**
+	 * Gets the value below which a fraction 'p' (0 to 1) of the samples fall, reorders the samples
+	 */
+	double percentile(std::vector<double>& samples, double p);
+
+	/**
+	 * Builds a POLL_MSGS payload of 'count' messages with contents of 'contentSz' bytes, in the protocol 'version'
+	 */
+	std::vector<uint8_t> makePollPayload(size_t count, size_t contentSz, uint8_t version);
+
+	/**
+	 * Builds a USRS_LIST payload of 'count' users with short names, in the protocol 'version'
+	 */
+	std::vector<uint8_t> makeUsersPayload(size_t count, uint8_t version);
+
+	// Compares Request::toBytes with the gathered Request::toBuffers for SEND_MSG requests of different sizes
+	void runSerialize(const args_t& args);
+
+	// Compares building the AES and RSA objects per message with the cached ones of ClientState
+	void runCryptoCache(const args_t& args);
+
+	// Measures the decryption of a large poll by BatchDecryptor with a growing number of workers
+	void runBatchDecrypt(const args_t& args);
+
+	// Measures the bytes saved by compressing contents before they are encrypted and what it costs to send and receive them
+	void runCompression(const args_t& args);
+
+	// Compares the CBC and GCM throughput of AESWrapper by content size and number of workers
+	void runCipher(const args_t& args);
+
+	// Compares the startup of a client from the text me.info with the binary identity file
+	void runIdentity(const args_t& args);
+
+	// Measures the cost of a timed phase with the metrics on and off, and prints the histograms of known latencies
+	void runMetrics(const args_t& args);
+
+	// Compares parsing large responses into owning payloads with parsing them into views of the payload bytes, in protocol v2 and v3
+	void runParse(const args_t& args);
+
+	// Measures opening and using a PeerStore with a growing number of peers
+	void runPeerStore(const args_t& args);
+
+	// Counts the allocations of request/response cycles against a loopback server that answers with canned responses,
+	// and compares the cycles of large responses in protocol v2 and v3
+	void runIo(const args_t& args);
+
+	// Compares sending a text to every member with its own key against sending it once to a group, by the number of members
+	void runGroup(const args_t& args);
+
+	// Compares registration and session setup with RSA-1024 key transport against X25519 key agreement
+	void runKeyExchange(const args_t& args);
+
+	// Drives simulated users against a running server and reports the latency of every request code
+	void runLoad(const args_t& args);
+}
@@ -0,0 +1,66 @@
+#include "Bench.h"
+#include "AESWrapper.h"
+#include "Utils.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+namespace Bench {
+	void runCipher(const args_t& args) {
+		auto maxSize = std::max<size_t>(1024, std::stoul(getOpt(args, "--size", "16777216")));
+		auto maxWorkers = std::max<size_t>(1, std::stoul(getOpt(args, "--workers", std::to_string(Utils::workerCount()))));
+
+		AESWrapper aes;
+		AESWrapper::pool_t pool{ maxWorkers };
+		size_t sink{ 0 };
+
+		auto mbps = [](size_t size, const RunStats& stats) {
+			std::ostringstream out;
+			out << std::fixed << std::setprecision(0) << size / (stats.nsPerIter / 1e9) / (1024 * 1024) << " MiB/s";
+			return out.str();
+		};
+
+		std::cout << std::left << std::setw(12) << "size" << std::setw(10) << "workers"
+			<< std::setw(16) << "enc (CBC)" << std::setw(16) << "enc (GCM)" << std::setw(16) << "dec (CBC)" << std::setw(16) << "dec (GCM)" << '\n';
+
+		for (size_t size = 1024; size <= maxSize; size *= 16) {
+			std::string plain(size, 'x');
+			// Every size moves about the same number of bytes
+			auto iters = std::max<size_t>(4, 256 * 1024 * 1024 / size / 4);
+
+			auto cbcCipher = aes.encrypt(plain.data(), size, AESWrapper::Mode::CBC);
+			auto encCbc = measure(iters, [&]() {
+				sink += aes.encrypt(plain.data(), size, AESWrapper::Mode::CBC).size();
+			});
+			auto decCbc = measure(iters, [&]() {
+				sink += aes.decrypt(cbcCipher.data(), cbcCipher.size(), AESWrapper::Mode::CBC).size();
+			});
+
+			// CBC chains every block to the one before it, so only GCM runs on more workers
+			for (size_t workers = 1; workers <= maxWorkers; workers *= 2) {
+				auto gcmCipher = aes.encrypt(plain.data(), size, AESWrapper::Mode::GCM, &pool, workers);
+				if (aes.decrypt(gcmCipher.data(), gcmCipher.size(), AESWrapper::Mode::GCM, &pool, workers) != plain) {
+					throw std::runtime_error("Error: GCM changed a content of " + formatBytes(static_cast<double>(size)) + " in the round trip");
+				}
+
+				auto encGcm = measure(iters, [&]() {
+					sink += aes.encrypt(plain.data(), size, AESWrapper::Mode::GCM, &pool, workers).size();
+				});
+				auto decGcm = measure(iters, [&]() {
+					sink += aes.decrypt(gcmCipher.data(), gcmCipher.size(), AESWrapper::Mode::GCM, &pool, workers).size();
+				});
+
+				std::cout << std::left << std::setw(12) << formatBytes(static_cast<double>(size)) << std::setw(10) << workers
+					<< std::setw(16) << (workers == 1 ? mbps(size, encCbc) : "") << std::setw(16) << mbps(size, encGcm)
+					<< std::setw(16) << (workers == 1 ? mbps(size, decCbc) : "") << std::setw(16) << mbps(size, decGcm) << '\n';
+			}
+		}
+
+		pool.join();
+
+		if (sink == 0) {
+			std::cout << "unreachable\n";
+		}
+	}
+}
@@ -0,0 +1,168 @@
+#include "Bench.h"
+#include "AESWrapper.h"
+#include "DeflateWrapper.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <filesystem>
+
+namespace Bench {
+	namespace {
+		// A named content of the corpus
+		struct Sample {
+			std::string name;
+			std::string content;
+		};
+
+		// Application log lines, timestamps and levels repeat with small changes
+		std::string makeLog(size_t size, std::mt19937_64& rng) {
+			static const char* levels[] = { "INFO", "DEBUG", "WARN", "ERROR" };
+			static const char* events[] = { "request handled", "cache miss for key", "retrying connection to", "user logged in", "job finished in" };
+			std::ostringstream out;
+			for (uint64_t i = 0; out.tellp() < static_cast<std::streamoff>(size); i++) {
+				out << "2024-05-" << std::setw(2) << std::setfill('0') << (1 + i / 100000 % 28) << " 12:"
+					<< std::setw(2) << (i / 60 % 60) << ':' << std::setw(2) << (i % 60) << '.' << std::setw(3) << rng() % 1000
+					<< " [" << levels[rng() % 4] << "] worker-" << rng() % 16 << ": " << events[rng() % 5] << ' ' << rng() % 100000 << '\n';
+			}
+			return out.str().substr(0, size);
+		}
+
+		// An array of JSON records of the same shape
+		std::string makeJson(size_t size, std::mt19937_64& rng) {
+			std::ostringstream out;
+			out << '[';
+			for (uint64_t i = 0; out.tellp() < static_cast<std::streamoff>(size); i++) {
+				out << (i ? "," : "") << "{\"id\":" << i << ",\"user\":\"user_" << rng() % 1000 << "\",\"active\":" << (rng() % 2 ? "true" : "false")
+					<< ",\"score\":" << rng() % 10000 / 100.0 << ",\"tags\":[\"alpha\",\"beta\"],\"updated\":\"2024-05-01T12:00:00Z\"}";
+			}
+			return out.str().substr(0, size);
+		}
+
+		// A text report, words picked from a small vocabulary
+		std::string makeText(size_t size, std::mt19937_64& rng) {
+			static const char* words[] = { "the", "system", "message", "client", "server", "latency", "was", "measured", "during",
+				"quarter", "and", "results", "show", "improvement", "of", "throughput", "under", "load", "report", "summary" };
+			std::string out;
+			while (out.size() < size) {
+				out += words[rng() % 20];
+				out += (rng() % 12 == 0) ? ".\n" : " ";
+			}
+			return out.substr(0, size);
+		}
+
+		// Random bytes, stand in for already compressed files (archives, images, video)
+		std::string makeRandom(size_t size, std::mt19937_64& rng) {
+			std::string out(size, '\0');
+			for (auto& c : out) {
+				c = static_cast<char>(rng());
+			}
+			return out;
+		}
+
+		// The generated corpus, or the files of a directory
+		std::vector<Sample> loadCorpus(const std::string& dir, size_t size) {
+			std::vector<Sample> corpus;
+			if (!dir.empty()) {
+				for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+					if (entry.is_regular_file()) {
+						std::ifstream file{ entry.path(), std::ios::binary };
+						corpus.push_back({ entry.path().filename().string(), std::string(std::istreambuf_iterator<char>(file), {}) });
+					}
+				}
+				return corpus;
+			}
+
+			std::mt19937_64 rng{ 11 };
+			for (auto sz : { size_t{ 200 }, size_t{ 4 * 1024 }, size }) {
+				auto suffix = " " + formatBytes(static_cast<double>(sz));
+				corpus.push_back({ "log" + suffix, makeLog(sz, rng) });
+				corpus.push_back({ "json" + suffix, makeJson(sz, rng) });
+				corpus.push_back({ "text" + suffix, makeText(sz, rng) });
+				corpus.push_back({ "random" + suffix, makeRandom(sz, rng) });
+			}
+			return corpus;
+		}
+	}
+
+	void runCompression(const args_t& args) {
+		auto size = std::max<size_t>(1024, std::stoul(getOpt(args, "--size", "1048576")));
+		auto minIters = std::max<size_t>(1, std::stoul(getOpt(args, "--iters", "20")));
+		auto corpus = loadCorpus(getOpt(args, "--dir", ""), size);
+
+		AESWrapper aes;
+		size_t sink{ 0 };
+		uint64_t rawTotal{ 0 }, wireTotal{ 0 };
+
+		std::cout << std::left << std::setw(16) << "content" << std::setw(12) << "raw" << std::setw(12) << "wire"
+			<< std::setw(10) << "saved" << std::setw(16) << "send (plain)" << std::setw(16) << "send (deflate)"
+			<< std::setw(16) << "recv (plain)" << std::setw(16) << "recv (deflate)" << '\n';
+
+		for (const auto& sample : corpus) {
+			const auto& content = sample.content;
+			// Small contents get more iterations, so every row takes about the same time
+			auto iters = std::max<size_t>(minIters, 64 * 1024 * 1024 / std::max<size_t>(content.size(), 1) / 16);
+
+			// Sending, what onCliSendTextMsg does with and without the compression stage
+			auto plainCipher = aes.encrypt(content.data(), static_cast<unsigned int>(content.size()));
+			auto sendPlain = measure(iters, [&]() {
+				sink += aes.encrypt(content.data(), static_cast<unsigned int>(content.size())).size();
+			});
+
+			auto compressed = DeflateWrapper::compress(content.data(), content.size());
+			const auto& wirePlain = compressed ? *compressed : content;
+			auto wireCipher = aes.encrypt(wirePlain.data(), static_cast<unsigned int>(wirePlain.size()));
+			auto sendDeflate = measure(iters, [&]() {
+				auto packed = DeflateWrapper::compress(content.data(), content.size());
+				const auto& plain = packed ? *packed : content;
+				sink += aes.encrypt(plain.data(), static_cast<unsigned int>(plain.size())).size();
+			});
+
+			// Receiving, what BatchDecryptor does with the content that was sent
+			auto recvPlain = measure(iters, [&]() {
+				sink += aes.decrypt(plainCipher.data(), static_cast<unsigned int>(plainCipher.size())).size();
+			});
+			auto recvDeflate = measure(iters, [&]() {
+				auto plain = aes.decrypt(wireCipher.data(), static_cast<unsigned int>(wireCipher.size()));
+				if (compressed) {
+					plain = DeflateWrapper::decompress(plain.data(), plain.size());
+				}
+				sink += plain.size();
+			});
+
+			// The content has to survive the round trip
+			if (compressed && DeflateWrapper::decompress(compressed->data(), compressed->size()) != content) {
+				throw std::runtime_error("Error: '" + sample.name + "' changed in the round trip");
+			}
+
+			auto rawSz = AESWrapper::cipherSize(content.size());
+			auto wireSz = AESWrapper::cipherSize(wirePlain.size());
+			rawTotal += rawSz;
+			wireTotal += wireSz;
+
+			auto us = [](const RunStats& stats) {
+				std::ostringstream out;
+				out << std::fixed << std::setprecision(1) << stats.nsPerIter / 1000 << " us";
+				return out.str();
+			};
+			std::ostringstream saved;
+			saved << std::fixed << std::setprecision(1) << 100.0 * (1.0 - static_cast<double>(wireSz) / rawSz) << '%';
+
+			std::cout << std::left << std::setw(16) << sample.name
+				<< std::setw(12) << formatBytes(static_cast<double>(rawSz))
+				<< std::setw(12) << formatBytes(static_cast<double>(wireSz))
+				<< std::setw(10) << saved.str()
+				<< std::setw(16) << us(sendPlain) << std::setw(16) << us(sendDeflate)
+				<< std::setw(16) << us(recvPlain) << std::setw(16) << us(recvDeflate) << '\n';
+		}
+
+		std::cout << "\nwire bytes: " << formatBytes(static_cast<double>(wireTotal)) << " of " << formatBytes(static_cast<double>(rawTotal))
+			<< " (" << std::fixed << std::setprecision(1) << 100.0 * (1.0 - static_cast<double>(wireTotal) / std::max<uint64_t>(rawTotal, 1)) << "% saved)\n";
+
+		if (sink == 0) {
+			std::cout << "unreachable\n";
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#include "Bench.h"
+#include "Client.h"
+#include "Request.h"
+#include "AESWrapper.h"
+#include "RSAWrapper.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+
+namespace Bench {
+	void runCryptoCache(const args_t& args) {
+		auto iters = std::max<size_t>(1, static_cast<size_t>(std::stod(getOpt(args, "--iters", "2000"))));
+		auto msgSz = static_cast<size_t>(std::stoul(getOpt(args, "--msg-size", "1024")));
+
+		// A state with a single peer that we share keys with, the path doesn't exist so nothing is loaded
+		ClientState state{ "crypto_cache_bench.info" };
+		RSAPrivateWrapper ourKeys;
+		RSAPrivateWrapper peerKeys;
+		state.setPrivKey(ourKeys.getPrivateKey());
+		state.addClient("peer", std::string(Config::CLIENT_ID_SZ * 2, 'a'));
+		state.setPubKey("peer", peerKeys.getPublicKey(), KeyTypes::RSA);
+
+		unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
+		AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH);
+		std::string symKey(reinterpret_cast<const char*>(key), AESWrapper::DEFAULT_KEYLENGTH);
+		state.setSymKey("peer", symKey);
+
+		std::string msg(msgSz, 'x');
+		auto wrappedKey = RSAPublicWrapper(ourKeys.getPublicKey()).encrypt(symKey);
+		size_t sink{ 0 };
+
+		std::cout << std::left << std::setw(18) << "operation" << std::setw(14) << "uncached" << std::setw(14) << "cached" << '\n';
+
+		auto print = [&](const std::string& op, const RunStats& uncached, const RunStats& cached) {
+			std::cout << std::left << std::setw(18) << op
+				<< std::setw(14) << (std::to_string(static_cast<uint64_t>(uncached.nsPerIter)) + " ns")
+				<< std::setw(14) << (std::to_string(static_cast<uint64_t>(cached.nsPerIter)) + " ns") << '\n';
+		};
+
+		// Text message to a peer, a fresh key schedule per message against the cached one
+		auto aesUncached = measure(iters, [&]() {
+			const auto& peerKey = state.getSymKey("peer").value();
+			AESWrapper aes(reinterpret_cast<const uint8_t*>(peerKey.c_str()), static_cast<unsigned int>(peerKey.size()));
+			sink += aes.encrypt(msg.c_str(), static_cast<unsigned int>(msg.size())).size();
+		});
+		auto aesCached = measure(iters, [&]() {
+			sink += state.getSymCipher("peer")->encrypt(msg.c_str(), static_cast<unsigned int>(msg.size())).size();
+		});
+		print("aes encrypt", aesUncached, aesCached);
+
+		// Wrapping our symmetric key for a peer, parsing the BER key and seeding a pool per message against the cached wrapper
+		auto wrapUncached = measure(iters, [&]() {
+			sink += RSAPublicWrapper(state.getPubKey("peer").value()).encrypt(symKey).size();
+		});
+		auto wrapCached = measure(iters, [&]() {
+			sink += state.getRSAPublic("peer")->encrypt(symKey).size();
+		});
+		print("rsa wrap", wrapUncached, wrapCached);
+
+		// Unwrapping a received symmetric key, the private key dominates so it is measured with fewer iterations
+		auto unwrapIters = std::max<size_t>(1, iters / 10);
+		auto unwrapUncached = measure(unwrapIters, [&]() {
+			sink += RSAPrivateWrapper(state.getPrivKey()).decrypt(wrappedKey).size();
+		});
+		auto unwrapCached = measure(unwrapIters, [&]() {
+			sink += state.getRSAPrivate()->decrypt(wrappedKey).size();
+		});
+		print("rsa unwrap", unwrapUncached, unwrapCached);
+
+		if (sink == 0) {
+			std::cout << "unreachable\n";
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#include "Bench.h"
+#include "ReqPayload.h"
+#include "AESWrapper.h"
+#include "Config.h"
+#include "Utils.h"
+
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <tuple>
+
+namespace Bench {
+	void runGroup(const args_t& args) {
+		auto iters = std::max<size_t>(1, std::stoul(getOpt(args, "--iters", "200")));
+		auto msgSz = std::max<size_t>(1, std::stoul(getOpt(args, "--msg-size", "1024")));
+		auto memberCounts = Utils::splitStr(getOpt(args, "--members", "5,50,500"), ',');
+		auto mode = Config::ENCRYPT_GCM ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+		std::string msg(msgSz, 'x');
+		size_t sink{ 0 };
+
+		std::cout << std::left << std::setw(10) << "members" << std::setw(12) << "path" << std::setw(14) << "upload" << std::setw(14) << "time/send" << '\n';
+
+		for (const auto& memberCount : memberCounts) {
+			auto members = std::max<size_t>(1, std::stoul(memberCount));
+
+			// Every member has its own key for the fan-out, the group shares one
+			std::vector<std::unique_ptr<AESWrapper>> memberCiphers;
+			std::vector<std::string> memberIds;
+			for (size_t i = 0; i < members; i++) {
+				memberCiphers.push_back(std::make_unique<AESWrapper>());
+				memberIds.push_back(std::string(Config::CLIENT_ID_SZ, static_cast<char>(i)));
+			}
+			AESWrapper groupCipher;
+
+			// A text encrypted for each member and sent in a single SEND_MULTI_MSG
+			uint32_t fanOutSz{ 0 };
+			auto fanOut = measure(iters, [&]() {
+				MultiMessageReqPayload payload;
+				for (size_t i = 0; i < members; i++) {
+					payload.addMessage(memberIds[i], MessageTypes::SEND_TXT, memberCiphers[i]->encrypt(msg.data(), msg.size(), mode));
+				}
+				fanOutSz = payload.getSize();
+				sink += fanOutSz;
+			});
+
+			// The same text encrypted once with the group key and sent in a SEND_GROUP_MSG
+			uint32_t groupSz{ 0 };
+			auto group = measure(iters, [&]() {
+				SendGroupMessageReqPayload payload{ 1, MessageTypes::SEND_GROUP_TXT, groupCipher.encrypt(msg.data(), msg.size(), mode) };
+				groupSz = payload.getSize();
+				sink += groupSz;
+			});
+
+			for (const auto& [name, stats, size] : { std::make_tuple("fan-out", fanOut, fanOutSz), std::make_tuple("group", group, groupSz) }) {
+				std::cout << std::left << std::setw(10) << members << std::setw(12) << name << std::setw(14) << formatBytes(static_cast<double>(size))
+					<< std::setw(14) << (std::to_string(static_cast<uint64_t>(stats.nsPerIter / 1000)) + " us") << '\n';
+			}
+		}
+
+		std::cout << "\nThe member keys of a group are wrapped once when it is created, they aren't part of a send\n";
+
+		if (sink == 0) {
+			std::cout << "unreachable\n";
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#include "Bench.h"
+#include "Client.h"
+#include "RSAWrapper.h"
+#include "Base64Wrapper.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <boost/algorithm/hex.hpp>
+
+namespace Bench {
+	void runIdentity(const args_t& args) {
+		auto iters = std::max<size_t>(1, std::stoul(getOpt(args, "--iters", "500")));
+		std::filesystem::path legacyPath = getOpt(args, "--legacy-path", "identity_bench.info");
+		std::filesystem::path identityPath = getOpt(args, "--path", "identity_bench.id");
+
+		// A client info file the way older clients wrote it, name, hexed UUID and the Base64 BER private key
+		RSAPrivateWrapper keys;
+		std::string uuid(Config::CLIENT_ID_SZ, '\x5a');
+		{
+			std::ofstream out{ legacyPath };
+			out << "bench_user" << std::endl;
+			out << boost::algorithm::hex(uuid) << std::endl;
+			out << Base64Wrapper::encode(keys.getPrivateKey());
+		}
+
+		// Migrate it, the same as a client of this version does on its first start
+		std::filesystem::remove(identityPath);
+		{
+			ClientState state{ identityPath, legacyPath };
+		}
+
+		auto wrappedKey = RSAPublicWrapper(keys.getPublicKey()).encrypt(std::string(16, 'k'));
+		size_t sink{ 0 };
+
+		// Startup alone and startup followed by the first decrypt, which needs the parsed private key
+		auto legacyLoad = measure(iters, [&]() {
+			ClientState state{ "identity_bench.missing" };
+			state.loadFromFile(legacyPath);
+			sink += state.getUsername().size();
+		});
+		auto legacyDecrypt = measure(iters, [&]() {
+			ClientState state{ "identity_bench.missing" };
+			state.loadFromFile(legacyPath);
+			sink += state.getRSAPrivate()->decrypt(wrappedKey).size();
+		});
+		auto identityLoad = measure(iters, [&]() {
+			ClientState state{ identityPath };
+			sink += state.getUsername().size();
+		});
+		auto identityDecrypt = measure(iters, [&]() {
+			ClientState state{ identityPath };
+			sink += state.getRSAPrivate()->decrypt(wrappedKey).size();
+		});
+
+		std::cout << std::left << std::setw(14) << "loader" << std::setw(14) << "startup" << std::setw(22) << "startup + decrypt" << '\n';
+
+		auto print = [](const std::string& loader, const RunStats& load, const RunStats& decrypt) {
+			std::cout << std::left << std::setw(14) << loader
+				<< std::setw(14) << (std::to_string(static_cast<uint64_t>(load.nsPerIter / 1000)) + " us")
+				<< std::setw(22) << (std::to_string(static_cast<uint64_t>(decrypt.nsPerIter / 1000)) + " us") << '\n';
+		};
+
+		print("me.info", legacyLoad, legacyDecrypt);
+		print("identity", identityLoad, identityDecrypt);
+
+		std::filesystem::remove(legacyPath);
+		std::filesystem::remove(identityPath);
+
+		if (sink == 0) {
+			std::cout << "unreachable\n";
+		}
+	}
+}
@@ -0,0 +1,159 @@
+#include "Bench.h"
+#include "Connection.h"
+#include "Request.h"
+#include "ReqPayload.h"
+#include "Response.h"
+#include "Protocol.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <boost/asio.hpp>
+
+namespace Bench {
+	using tcp = boost::asio::ip::tcp;
+
+	// Reads the payload size from the header of the next request, the first header of a connection is full and the rest are compact in v3
+	static uint32_t readPayloadSz(tcp::socket& socket, std::vector<uint8_t>& header, bool isFirst, boost::system::error_code& ec) {
+		if (isFirst || Config::VERSION < Protocol::VERSION_3) {
+			header.resize(Config::HEADER_BYTES_SZ);
+			boost::asio::read(socket, boost::asio::buffer(header), ec);
+			return ec ? 0 : std::get<3>(Protocol::RequestHeader::decode(header.data()));
+		}
+
+		header.resize(Protocol::V3::CompactHeader::SIZE);
+		boost::asio::read(socket, boost::asio::buffer(header), ec);
+		if (ec) {
+			return 0;
+		}
+
+		auto [version, code] = Protocol::V3::CompactHeader::decode(header.data());
+		header.resize((version & Protocol::V3::ID_FOLLOWS) ? Protocol::ClientId::SIZE : 0);
+		boost::asio::read(socket, boost::asio::buffer(header), ec);
+
+		// The payload size is a VarInt, read a byte at a time
+		header.clear();
+		uint8_t byte{ 0x80 };
+		while (!ec && (byte & 0x80)) {
+			boost::asio::read(socket, boost::asio::buffer(&byte, 1), ec);
+			header.push_back(byte);
+		}
+
+		size_t offset{ 0 };
+		return ec ? 0 : Protocol::VarInt::decode<uint32_t>(header, offset);
+	}
+
+	// Answers every request on 'socket' with 'response' until the socket is closed, the buffers are allocated up front
+	static void serveCanned(tcp::socket socket, const std::vector<uint8_t>& response) {
+		std::vector<uint8_t> header;
+		header.reserve(Config::HEADER_MAX_BYTES_SZ);
+		std::vector<uint8_t> payload(64 * 1024);
+		boost::system::error_code ec;
+
+		for (bool isFirst = true;; isFirst = false) {
+			auto payloadSz = readPayloadSz(socket, header, isFirst, ec);
+			if (ec) {
+				return;
+			}
+
+			for (uint32_t left = payloadSz; left > 0 && !ec;) {
+				left -= static_cast<uint32_t>(boost::asio::read(socket, boost::asio::buffer(payload.data(), std::min<size_t>(left, payload.size())), ec));
+			}
+
+			boost::asio::write(socket, boost::asio::buffer(response), ec);
+			if (ec) {
+				return;
+			}
+		}
+	}
+
+	// Builds a response of 'code' around a payload in the protocol 'version'
+	static std::vector<uint8_t> makeResponse(ResponseCodes code, const std::vector<uint8_t>& payload, uint8_t version = Config::VERSION) {
+		std::vector<uint8_t> bytes(Protocol::ResponseHeader::SIZE + payload.size());
+		Protocol::ResponseHeader::encode(bytes.data(), version, static_cast<uint16_t>(code), static_cast<uint32_t>(payload.size()));
+		std::copy(payload.begin(), payload.end(), bytes.begin() + Protocol::ResponseHeader::SIZE);
+		return bytes;
+	}
+
+	void runIo(const args_t& args) {
+		auto iters = std::max<size_t>(1, std::stoul(getOpt(args, "--iters", "20000")));
+		auto largeSz = std::max<size_t>(1, std::stoul(getOpt(args, "--large", "1048576")));
+		auto users = std::max<size_t>(1, std::stoul(getOpt(args, "--users", "1000")));
+		auto msgs = std::max<size_t>(1, std::stoul(getOpt(args, "--msgs", "1000")));
+		std::string id(Config::CLIENT_ID_SZ, 'i');
+
+		// A public key in the version the client speaks
+		std::string pubKey(Config::PUB_KEY_SZ, 'k');
+		std::vector<uint8_t> keyPayload(Protocol::PublicKeyRes::SIZE + Protocol::VarInt::MAX_SIZE);
+		if (Config::VERSION >= Protocol::VERSION_3) {
+			Protocol::V3::PublicKeyPrefix::encode(keyPayload.data(), id);
+			keyPayload.resize(Protocol::V3::PublicKeyPrefix::SIZE + Protocol::VarString::encode(keyPayload.data() + Protocol::V3::PublicKeyPrefix::SIZE, pubKey));
+		}
+		else {
+			Protocol::PublicKeyRes::encode(keyPayload.data(), id, pubKey);
+			keyPayload.resize(Protocol::PublicKeyRes::SIZE);
+		}
+
+		struct Case {
+			std::string name;
+			RequestCodes code;
+			std::vector<uint8_t> response;
+			size_t iters;
+		};
+		std::vector<Case> cases{
+			{ "pub key", RequestCodes::GET_PUB_KEY, makeResponse(ResponseCodes::PUB_KEY, keyPayload), iters },
+			{ formatBytes(static_cast<double>(largeSz)) + " poll", RequestCodes::POLL_MSGS, makeResponse(ResponseCodes::POLL_MSGS, makePollPayload(1, largeSz, Config::VERSION)), std::max<size_t>(1, iters / 100) },
+		};
+
+		// The same large lists in both versions, the client reads either
+		for (auto version : { Protocol::VERSION_2, Protocol::VERSION_3 }) {
+			auto suffix = " v" + std::to_string(version);
+			cases.push_back({ std::to_string(users) + " users" + suffix, RequestCodes::USRS_LIST, makeResponse(ResponseCodes::USRS_LIST, makeUsersPayload(users, version), version), std::max<size_t>(1, iters / 20) });
+			cases.push_back({ std::to_string(msgs) + " msgs" + suffix, RequestCodes::POLL_MSGS, makeResponse(ResponseCodes::POLL_MSGS, makePollPayload(msgs, 64, version), version), std::max<size_t>(1, iters / 20) });
+		}
+
+		std::cout << std::left << std::setw(18) << "response" << std::setw(12) << "wire" << std::setw(14) << "time/cycle" << std::setw(14) << "allocs/cycle" << std::setw(14) << "pool allocs" << '\n';
+
+		for (const auto& test : cases) {
+			boost::asio::io_context ctx;
+			tcp::acceptor acceptor{ ctx, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0) };
+			tcp::socket client{ ctx };
+			client.connect(acceptor.local_endpoint());
+			std::thread server{ serveCanned, acceptor.accept(), std::cref(test.response) };
+
+			{
+				Connection conn{ ctx, std::move(client) };
+				Request::payload_t payload;
+				if (test.code == RequestCodes::GET_PUB_KEY) {
+					payload = std::make_unique<GetPublicKeyReqPayload>(id);
+				}
+				else if (test.code == RequestCodes::USRS_LIST) {
+					payload = std::make_unique<UsersListReqPayload>();
+				}
+				else {
+					payload = std::make_unique<PollMessagesReqPayload>();
+				}
+				Request req{ id, test.code, std::move(payload) };
+
+				// Every buffer the cycle needs is in its pool after the first round
+				auto cycle = [&]() {
+					conn.send(req);
+					auto res = conn.recvResponse();
+				};
+				cycle();
+
+				auto stats = measure(test.iters, cycle);
+				std::cout << std::left << std::setw(18) << test.name << std::setw(12) << formatBytes(static_cast<double>(test.response.size()))
+					<< std::setw(14) << (std::to_string(static_cast<uint64_t>(stats.nsPerIter / 1000)) + " us")
+					<< std::setw(14) << stats.allocsPerIter << std::setw(14) << conn.getPoolAllocations() << '\n';
+
+				conn.close();
+			}
+
+			server.join();
+		}
+
+		std::cout << "\nA view holds its entries in a vector, that is its single allocation\n";
+	}
+}
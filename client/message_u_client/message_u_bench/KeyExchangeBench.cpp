@@ -0,0 +1,76 @@
+#include "Bench.h"
+#include "RSAWrapper.h"
+#include "ECWrapper.h"
+#include "AESWrapper.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+#include <tuple>
+
+namespace Bench {
+	void runKeyExchange(const args_t& args) {
+		auto iters = std::max<size_t>(1, std::stoul(getOpt(args, "--iters", "500")));
+		auto rsaKeyIters = std::max<size_t>(1, std::stoul(getOpt(args, "--rsa-keygen-iters", "20")));
+		auto rttMs = std::stod(getOpt(args, "--rtt-ms", "20"));
+		std::string aliceId(Config::CLIENT_ID_SZ, 'a');
+		std::string bobId(Config::CLIENT_ID_SZ, 'b');
+		std::string salt = aliceId + bobId;
+		size_t sink{ 0 };
+
+		// Registration, the key pair is generated before the REGISTER request is sent (RSA key generation is slow, so it runs fewer times)
+		auto rsaKeygen = measure(rsaKeyIters, [&]() {
+			RSAPrivateWrapper keys;
+			sink += keys.getPublicKey().size();
+		});
+		auto ecKeygen = measure(iters, [&]() {
+			ECPrivateWrapper keys;
+			sink += keys.getPublicKey().size();
+		});
+
+		// Session setup, the work both clients do once each has the other's public key.
+		// RSA: Alice parses Bob's key and wraps a fresh key for him, Bob unwraps it with his (cached) private key
+		RSAPrivateWrapper bobRsa;
+		auto bobRsaPub = bobRsa.getPublicKey();
+		auto rsaSetup = measure(iters, [&]() {
+			unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
+			AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH);
+			auto wrapped = RSAPublicWrapper(bobRsaPub).encrypt(std::string(std::begin(key), std::end(key)));
+			sink += bobRsa.decrypt(wrapped).size();
+		});
+
+		// X25519: each side verifies the other's key and derives the same key from it, nothing is sent
+		ECPrivateWrapper aliceEc;
+		ECPrivateWrapper bobEc;
+		auto alicePub = aliceEc.getPublicKey();
+		auto bobPub = bobEc.getPublicKey();
+		auto ecSetup = measure(iters, [&]() {
+			sink += aliceEc.deriveSymKey(ECPublicWrapper(bobPub), salt, AESWrapper::DEFAULT_KEYLENGTH).size();
+			sink += bobEc.deriveSymKey(ECPublicWrapper(alicePub), salt, AESWrapper::DEFAULT_KEYLENGTH).size();
+		});
+
+		// Round trips before both sides can encrypt: RSA is GET_PUB_KEY, SEND_MSG of the wrapped key and the peer's poll one after the other,
+		// X25519 is a GET_PUB_KEY by each side, which don't wait on each other
+		const size_t rsaRoundTrips = 3;
+		const size_t ecRoundTrips = 1;
+
+		std::cout << std::left << std::setw(10) << "scheme" << std::setw(12) << "pub key" << std::setw(14) << "keygen" << std::setw(14) << "setup cpu"
+			<< std::setw(14) << "round trips" << "setup @ " << rttMs << " ms rtt" << '\n';
+
+		for (const auto& [name, keySz, keygen, setup, roundTrips] : {
+			std::make_tuple("RSA-1024", static_cast<size_t>(Config::PUB_KEY_SZ), rsaKeygen, rsaSetup, rsaRoundTrips),
+			std::make_tuple("X25519", static_cast<size_t>(ECPublicWrapper::KEYSIZE), ecKeygen, ecSetup, ecRoundTrips) }) {
+			auto setupMs = setup.nsPerIter / 1e6 + roundTrips * rttMs;
+			std::cout << std::left << std::setw(10) << name << std::setw(12) << formatBytes(static_cast<double>(keySz))
+				<< std::setw(14) << (std::to_string(static_cast<uint64_t>(keygen.nsPerIter / 1000)) + " us")
+				<< std::setw(14) << (std::to_string(static_cast<uint64_t>(setup.nsPerIter / 1000)) + " us")
+				<< std::setw(14) << roundTrips << std::fixed << std::setprecision(2) << setupMs << " ms" << '\n';
+		}
+
+		std::cout << "\nThe RSA setup also waits for the peer to poll, which the round trips above count as one\n";
+
+		if (sink == 0) {
+			std::cout << "unreachable\n";
+		}
+	}
+}
@@ -0,0 +1,293 @@
+#include "Bench.h"
+#include "Connection.h"
+#include "Request.h"
+#include "ReqPayload.h"
+#include "ResPayload.h"
+#include "AESWrapper.h"
+#include "RSAWrapper.h"
+#include "Utils.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <sstream>
+
+namespace Bench {
+	namespace {
+		using load_clock_t = std::chrono::steady_clock;
+
+		// A simulated user, its connection and the key it shares with its peer
+		struct LoadUser {
+			std::unique_ptr<Connection> conn;
+			std::string name;
+			std::string uuid; // Raw UUID, as it is sent in requests
+			std::unique_ptr<RSAPrivateWrapper> rsaPriv;
+			std::unique_ptr<AESWrapper> aes; // Key sent to the peer, encrypts the texts sent to it
+			size_t peer{};
+			uint64_t directoryVersion{}; // Directory version the user's delta requests are up to date with
+		};
+
+		// Latencies (ms) and failures of a single request code
+		struct CodeSamples {
+			std::vector<double> latencies;
+			size_t errors{};
+		};
+
+		using samples_t = std::map<RequestCodes, CodeSamples>;
+
+		// The kinds of traffic, picked by the weights of the mix
+		enum class LoadOp { SEND, POLL, LIST, DELTA };
+
+		std::string codeName(RequestCodes code) {
+			switch (code) {
+			case RequestCodes::REGISTER: return "REGISTER";
+			case RequestCodes::USRS_LIST: return "USRS_LIST";
+			case RequestCodes::USRS_DELTA: return "USRS_DELTA";
+			case RequestCodes::GET_PUB_KEY: return "GET_PUB_KEY";
+			case RequestCodes::SEND_MSG: return "SEND_MSG";
+			case RequestCodes::POLL_MSGS: return "POLL_MSGS";
+			default: return std::to_string(Utils::EnumToUint16(code));
+			}
+		}
+
+		// Sends a request and waits for its response, the round trip is recorded under the request code
+		Response timedRequest(LoadUser& user, Request& req, samples_t& samples) {
+			auto start = load_clock_t::now();
+			user.conn->send(req);
+			auto res = user.conn->recvResponse();
+			std::chrono::duration<double, std::milli> elapsed = load_clock_t::now() - start;
+
+			auto& codeSamples = samples[req.getCode()];
+			codeSamples.latencies.push_back(elapsed.count());
+			if (res.getHeader().code == ResponseCodes::ERR) {
+				codeSamples.errors++;
+			}
+
+			return res;
+		}
+
+		// Registers the user with a fresh RSA key pair
+		void registerUser(LoadUser& user, samples_t& samples) {
+			user.rsaPriv = std::make_unique<RSAPrivateWrapper>();
+			Request req{ Config::EMPTY_UUID,
+				RequestCodes::REGISTER,
+				std::make_unique<RegisterReqPayload>(user.name, user.rsaPriv->getPublicKey()) };
+
+			auto res = timedRequest(user, req, samples);
+			if (res.getHeader().code != ResponseCodes::REG_OK) {
+				throw std::runtime_error("Error: Registration of '" + user.name + "' failed");
+			}
+
+			user.uuid = dynamic_cast<RegistrationResPayload&>(res.getPayload()).getUUID();
+		}
+
+		// Fetches the public key of the peer and sends it a new symmetric key wrapped with it
+		void sendSymKey(LoadUser& user, const LoadUser& peer, samples_t& samples) {
+			Request keyReq{ user.uuid,
+				RequestCodes::GET_PUB_KEY,
+				std::make_unique<GetPublicKeyReqPayload>(peer.uuid) };
+
+			auto res = timedRequest(user, keyReq, samples);
+			if (res.getHeader().code != ResponseCodes::PUB_KEY) {
+				throw std::runtime_error("Error: Getting the public key of '" + peer.name + "' failed");
+			}
+
+			user.aes = std::make_unique<AESWrapper>();
+			RSAPublicWrapper rsaPub{ dynamic_cast<PublicKeyResPayload&>(res.getPayload()).getPubKeyEntry().pubKey };
+			auto wrappedKey = rsaPub.encrypt(reinterpret_cast<const char*>(user.aes->getKey()), AESWrapper::DEFAULT_KEYLENGTH);
+
+			Request sendReq{ user.uuid,
+				RequestCodes::SEND_MSG,
+				std::make_unique<SendMessageReqPayload>(peer.uuid, MessageTypes::SEND_SYM_KEY, static_cast<uint32_t>(wrappedKey.size()), std::move(wrappedKey)) };
+			timedRequest(user, sendReq, samples);
+		}
+
+		// Runs a single operation of the traffic mix for the user
+		void runOp(LoadOp op, LoadUser& user, const LoadUser& peer, const std::string& text, samples_t& samples) {
+			switch (op) {
+			case LoadOp::SEND: {
+				auto encrypted = user.aes->encrypt(text.c_str(), static_cast<unsigned int>(text.size()));
+				Request req{ user.uuid,
+					RequestCodes::SEND_MSG,
+					std::make_unique<SendMessageReqPayload>(peer.uuid, MessageTypes::SEND_TXT, static_cast<uint32_t>(encrypted.size()), std::move(encrypted)) };
+				timedRequest(user, req, samples);
+				break;
+			}
+			case LoadOp::POLL: {
+				Request req{ user.uuid, RequestCodes::POLL_MSGS, std::make_unique<PollMessagesReqPayload>() };
+				timedRequest(user, req, samples);
+				break;
+			}
+			case LoadOp::LIST: {
+				Request req{ user.uuid, RequestCodes::USRS_LIST, std::make_unique<UsersListReqPayload>() };
+				timedRequest(user, req, samples);
+				break;
+			}
+			case LoadOp::DELTA: {
+				Request req{ user.uuid, RequestCodes::USRS_DELTA, std::make_unique<UsersDeltaReqPayload>(user.directoryVersion) };
+				auto res = timedRequest(user, req, samples);
+				if (res.getHeader().code == ResponseCodes::USRS_DELTA) {
+					user.directoryVersion = dynamic_cast<UsersDeltaResPayload&>(res.getPayload()).getVersion();
+				}
+				break;
+			}
+			}
+		}
+
+		// Parses a mix like "send=70,poll=20,list=10" into the weights of SEND, POLL, LIST and DELTA
+		std::vector<double> parseMix(const std::string& mix) {
+			std::vector<double> weights(4, 0);
+			for (const auto& part : Utils::splitStr(mix, ',')) {
+				auto eq = part.find('=');
+				if (eq == std::string::npos) {
+					throw std::runtime_error("Error: '" + part + "' is not a valid mix entry, expected name=weight");
+				}
+
+				auto name = part.substr(0, eq);
+				auto weight = std::stod(part.substr(eq + 1));
+				if (name == "send") {
+					weights[static_cast<size_t>(LoadOp::SEND)] = weight;
+				}
+				else if (name == "poll") {
+					weights[static_cast<size_t>(LoadOp::POLL)] = weight;
+				}
+				else if (name == "list") {
+					weights[static_cast<size_t>(LoadOp::LIST)] = weight;
+				}
+				else if (name == "delta") {
+					weights[static_cast<size_t>(LoadOp::DELTA)] = weight;
+				}
+				else {
+					throw std::runtime_error("Error: '" + name + "' is not a valid mix entry, expected send, poll, list or delta");
+				}
+			}
+
+			return weights;
+		}
+
+		// Runs 'fn(thread index, samples)' on every thread and merges the samples they recorded
+		template<typename Fn>
+		samples_t forEachThread(size_t threadCount, Fn fn) {
+			std::vector<samples_t> threadSamples(threadCount);
+			std::vector<std::exception_ptr> errors(threadCount);
+			std::vector<std::thread> threads;
+
+			for (size_t t = 0; t < threadCount; t++) {
+				threads.emplace_back([&, t]() {
+					try {
+						fn(t, threadSamples[t]);
+					}
+					catch (...) {
+						errors[t] = std::current_exception();
+					}
+				});
+			}
+
+			for (auto& thread : threads) {
+				thread.join();
+			}
+
+			for (const auto& error : errors) {
+				if (error) {
+					std::rethrow_exception(error);
+				}
+			}
+
+			// Merge the samples of the threads
+			samples_t merged;
+			for (auto& samples : threadSamples) {
+				for (auto& [code, codeSamples] : samples) {
+					auto& into = merged[code];
+					into.latencies.insert(into.latencies.end(), codeSamples.latencies.begin(), codeSamples.latencies.end());
+					into.errors += codeSamples.errors;
+				}
+			}
+
+			return merged;
+		}
+
+		void report(const std::string& phase, samples_t& samples, double seconds) {
+			std::cout << '\n' << phase << " (" << std::fixed << std::setprecision(1) << seconds << " s)\n";
+			std::cout << std::left << std::setw(14) << "code" << std::setw(10) << "count" << std::setw(8) << "errors"
+				<< std::setw(12) << "req/s" << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << std::setw(12) << "p999 ms" << '\n';
+
+			size_t total{ 0 };
+			for (auto& [code, codeSamples] : samples) {
+				auto count = codeSamples.latencies.size();
+				total += count;
+
+				std::cout << std::left << std::setw(14) << codeName(code) << std::setw(10) << count << std::setw(8) << codeSamples.errors
+					<< std::setw(12) << std::setprecision(0) << (count / seconds)
+					<< std::setprecision(3) << std::setw(12) << percentile(codeSamples.latencies, 0.5)
+					<< std::setw(12) << percentile(codeSamples.latencies, 0.99)
+					<< std::setw(12) << percentile(codeSamples.latencies, 0.999) << '\n';
+			}
+
+			std::cout << std::left << std::setw(14) << "total" << std::setw(10) << total << std::setw(8) << ""
+				<< std::setw(12) << std::setprecision(0) << (total / seconds) << '\n';
+		}
+	}
+
+	void runLoad(const args_t& args) {
+		auto addr = getOpt(args, "--addr", Config::SERVER_ADDR);
+		auto port = getOpt(args, "--port", Config::SERVER_PORT);
+		auto userCount = std::max<size_t>(2, std::stoul(getOpt(args, "--users", "50")));
+		auto threadCount = std::min(userCount, static_cast<size_t>(std::stoul(getOpt(args, "--threads", std::to_string(Utils::workerCount())))));
+		auto duration = std::chrono::duration<double>(std::stod(getOpt(args, "--duration", "10")));
+		auto weights = parseMix(getOpt(args, "--mix", "send=70,poll=20,list=10"));
+		std::string text(std::stoul(getOpt(args, "--msg-size", "256")), 'x');
+
+		// Usernames are unique per run, so the benchmark can run again against the same database
+		std::stringstream runId;
+		runId << std::hex << std::random_device{}();
+
+		boost::asio::io_context ctx;
+		std::vector<LoadUser> users(userCount);
+		for (size_t i = 0; i < userCount; i++) {
+			users[i].conn = std::make_unique<Connection>(ctx, addr, port);
+			users[i].name = "load_" + runId.str() + "_" + std::to_string(i);
+			users[i].peer = (i + 1) % userCount;
+		}
+
+		std::cout << userCount << " users on " << threadCount << " threads against " << addr << ':' << port << '\n';
+
+		// Every thread owns the users whose index matches it modulo the thread count
+		auto setupStart = load_clock_t::now();
+		auto setupSamples = forEachThread(threadCount, [&](size_t t, samples_t& samples) {
+			for (size_t i = t; i < userCount; i += threadCount) {
+				registerUser(users[i], samples);
+			}
+		});
+
+		// The peers have to be registered before the keys can be exchanged
+		auto exchangeSamples = forEachThread(threadCount, [&](size_t t, samples_t& samples) {
+			for (size_t i = t; i < userCount; i += threadCount) {
+				sendSymKey(users[i], users[users[i].peer], samples);
+			}
+		});
+		for (auto& [code, codeSamples] : exchangeSamples) {
+			auto& into = setupSamples[code];
+			into.latencies.insert(into.latencies.end(), codeSamples.latencies.begin(), codeSamples.latencies.end());
+			into.errors += codeSamples.errors;
+		}
+		report("setup", setupSamples, std::chrono::duration<double>(load_clock_t::now() - setupStart).count());
+
+		// Closed loop traffic, every thread cycles through its users until the time is up
+		auto trafficStart = load_clock_t::now();
+		auto deadline = trafficStart + std::chrono::duration_cast<load_clock_t::duration>(duration);
+		auto trafficSamples = forEachThread(threadCount, [&](size_t t, samples_t& samples) {
+			std::mt19937 rng{ static_cast<uint32_t>(std::random_device{}() + t) };
+			std::discrete_distribution<size_t> pickOp(weights.begin(), weights.end());
+
+			while (load_clock_t::now() < deadline) {
+				for (size_t i = t; i < userCount && load_clock_t::now() < deadline; i += threadCount) {
+					runOp(static_cast<LoadOp>(pickOp(rng)), users[i], users[users[i].peer], text, samples);
+				}
+			}
+		});
+		report("traffic", trafficSamples, std::chrono::duration<double>(load_clock_t::now() - trafficStart).count());
+	}
+}
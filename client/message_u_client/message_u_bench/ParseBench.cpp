@@ -0,0 +1,131 @@
+#include "Bench.h"
+#include "ResView.h"
+#include "ResPayload.h"
+#include "Response.h"
+#include "Request.h"
+#include "ReqPayload.h"
+#include "Protocol.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+#include <variant>
+
+namespace Bench {
+	static constexpr uint32_t FIRST_MSG_ID = 100000; // Message IDs of a server that has been up for a while
+
+	std::vector<uint8_t> makePollPayload(size_t count, size_t contentSz, uint8_t version) {
+		std::vector<uint8_t> bytes(Protocol::VarInt::MAX_SIZE + count * (Protocol::PollMessageHeader::SIZE + contentSz));
+		std::string sender(Config::CLIENT_ID_SZ, 's');
+		auto type = static_cast<uint8_t>(MessageTypes::SEND_TXT);
+		uint8_t* out = bytes.data();
+
+		if (version >= Protocol::VERSION_3) {
+			out += Protocol::VarInt::encode(out, count);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			auto msgId = static_cast<uint32_t>(FIRST_MSG_ID + i);
+			if (version >= Protocol::VERSION_3) {
+				Protocol::V3::PollMessagePrefix::encode(out, sender, type);
+				out += Protocol::V3::PollMessagePrefix::SIZE;
+				out += Protocol::VarInt::encode(out, msgId);
+				out += Protocol::VarInt::encode(out, contentSz);
+			}
+			else {
+				Protocol::PollMessageHeader::encode(out, sender, msgId, type, static_cast<uint32_t>(contentSz));
+				out += Protocol::PollMessageHeader::SIZE;
+			}
+			std::fill(out, out + contentSz, static_cast<uint8_t>('c'));
+			out += contentSz;
+		}
+
+		bytes.resize(out - bytes.data());
+		return bytes;
+	}
+
+	std::vector<uint8_t> makeUsersPayload(size_t count, uint8_t version) {
+		std::vector<uint8_t> bytes(Protocol::VarInt::MAX_SIZE + count * Protocol::UserEntry::SIZE);
+		std::string id(Config::CLIENT_ID_SZ, 'u');
+		uint8_t* out = bytes.data();
+
+		if (version >= Protocol::VERSION_3) {
+			out += Protocol::VarInt::encode(out, count);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			auto name = "user" + std::to_string(i);
+			if (version >= Protocol::VERSION_3) {
+				Protocol::V3::UserEntryPrefix::encode(out, id);
+				out += Protocol::V3::UserEntryPrefix::SIZE;
+				out += Protocol::VarString::encode(out, name);
+			}
+			else {
+				Protocol::UserEntry::encode(out, id, name);
+				out += Protocol::UserEntry::SIZE;
+			}
+		}
+
+		bytes.resize(out - bytes.data());
+		return bytes;
+	}
+
+	void runParse(const args_t& args) {
+		auto msgs = std::max<size_t>(1, std::stoul(getOpt(args, "--msgs", "10000")));
+		auto contentSz = std::stoul(getOpt(args, "--content", "256"));
+		auto users = std::max<size_t>(1, std::stoul(getOpt(args, "--users", "1000")));
+		auto iters = std::max<size_t>(1, std::stoul(getOpt(args, "--iters", "200")));
+
+		struct Case {
+			std::string name;
+			ResponseCodes code;
+			uint8_t version;
+			std::vector<uint8_t> bytes;
+		};
+		std::vector<Case> cases;
+		for (auto version : { Protocol::VERSION_2, Protocol::VERSION_3 }) {
+			cases.push_back({ std::to_string(msgs) + " msgs", ResponseCodes::POLL_MSGS, version, makePollPayload(msgs, contentSz, version) });
+		}
+		for (auto version : { Protocol::VERSION_2, Protocol::VERSION_3 }) {
+			cases.push_back({ std::to_string(users) + " users", ResponseCodes::USRS_LIST, version, makeUsersPayload(users, version) });
+		}
+
+		std::cout << std::left << std::setw(14) << "payload" << std::setw(4) << "v" << std::setw(12) << "wire" << std::setw(10) << "path"
+			<< std::setw(14) << "time/parse" << std::setw(14) << "allocs/parse" << std::setw(14) << "alloc/parse" << '\n';
+
+		size_t sink{ 0 };
+		for (const auto& test : cases) {
+			// The owning payloads copy every field into a string of its own
+			auto owning = measure(iters, [&]() {
+				sink += ResPayload::fromBytes(test.bytes, test.code, test.version) != nullptr;
+			});
+
+			// The views point into the bytes, only the vector of entries is allocated
+			auto views = measure(iters, [&]() {
+				sink += parseResView(test.bytes, test.code, test.version).index();
+			});
+
+			auto print = [&](const std::string& path, const RunStats& stats) {
+				std::cout << std::left << std::setw(14) << test.name << std::setw(4) << static_cast<int>(test.version)
+					<< std::setw(12) << formatBytes(static_cast<double>(test.bytes.size())) << std::setw(10) << path
+					<< std::setw(14) << (std::to_string(static_cast<uint64_t>(stats.nsPerIter / 1000)) + " us")
+					<< std::setw(14) << stats.allocsPerIter << std::setw(14) << formatBytes(stats.allocBytesPerIter) << '\n';
+			};
+
+			print("payload", owning);
+			print("view", views);
+		}
+
+		// Every request after the first one of a connection has a compact header in v3
+		Request poll{ std::string(Config::CLIENT_ID_SZ, 'i'), RequestCodes::POLL_MSGS, std::make_unique<PollMessagesReqPayload>() };
+		Request::buffers_t full, compact;
+		poll.toBuffers(full);
+		poll.toBuffers(compact, Request::HeaderForm::COMPACT);
+		std::cout << "\nPOLL_MSGS request: " << boost::asio::buffer_size(full) << " bytes with the full header, "
+			<< boost::asio::buffer_size(compact) << " bytes with the compact one\n";
+
+		if (sink == 0) {
+			std::cout << "unreachable\n";
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#include "Bench.h"
+#include "PeerStore.h"
+#include "Request.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+namespace Bench {
+	namespace {
+		// Name and raw UUID of the i'th simulated peer
+		std::string peerName(size_t i) {
+			return "peer_" + std::to_string(i);
+		}
+
+		std::string peerUUID(size_t i) {
+			std::string uuid(Config::CLIENT_ID_SZ, '\0');
+			for (size_t b = 0; b < sizeof(i); b++) {
+				uuid[b] = static_cast<char>((i >> (8 * b)) & 0xff);
+			}
+			return uuid;
+		}
+	}
+
+	void runPeerStore(const args_t& args) {
+		auto maxPeers = std::max<size_t>(1000, std::stoul(getOpt(args, "--peers", "100000")));
+		auto lookups = std::max<size_t>(1, std::stoul(getOpt(args, "--lookups", "100000")));
+		auto path = getOpt(args, "--path", "peer_store_bench.bin");
+
+		std::string owner(Config::CLIENT_ID_SZ, 'o');
+		std::string privKey(1200, 'k');
+		std::string pubKey(Config::PUB_KEY_SZ, 'p');
+		std::string symKey(CryptoPP::AES::BLOCKSIZE, 's');
+		std::mt19937_64 rng{ 7 };
+
+		std::cout << std::left << std::setw(10) << "peers" << std::setw(12) << "file" << std::setw(12) << "open"
+			<< std::setw(16) << "find by name" << std::setw(16) << "find by uuid" << std::setw(14) << "set sym key" << '\n';
+
+		for (size_t peers = 1000; peers <= maxPeers; peers *= 10) {
+			std::filesystem::remove(path);
+
+			// Fill the store the way a client does over time, every peer with its keys
+			{
+				PeerStore store{ path, owner, privKey };
+				for (size_t i = 0; i < peers; i++) {
+					store.put(peerName(i), peerUUID(i));
+					store.setPubKey(peerName(i), pubKey, KeyTypes::RSA);
+					store.setSymKey(peerName(i), symKey);
+				}
+			}
+
+			// Opening maps the file and checks its header, nothing is read per peer
+			auto open = measure(20, [&]() {
+				PeerStore store{ path, owner, privKey };
+			});
+
+			PeerStore store{ path, owner, privKey };
+			std::uniform_int_distribution<size_t> pick(0, peers - 1);
+			std::vector<size_t> order(lookups);
+			for (auto& i : order) {
+				i = pick(rng);
+			}
+
+			std::vector<std::string> names, uuids;
+			for (auto i : order) {
+				names.push_back(peerName(i));
+				uuids.push_back(peerUUID(i));
+			}
+
+			size_t found{ 0 }, next{ 0 };
+			auto byName = measure(lookups, [&]() {
+				found += store.findByName(names[next++ % lookups]).has_value();
+			});
+			next = 0;
+			auto byUUID = measure(lookups, [&]() {
+				found += store.findByUUID(uuids[next++ % lookups]).has_value();
+			});
+			next = 0;
+			auto setKey = measure(lookups, [&]() {
+				store.setSymKey(names[next++ % lookups], symKey);
+			});
+
+			if (found != 2 * lookups) {
+				throw std::runtime_error("Error: Peer store lost some of the peers");
+			}
+
+			std::cout << std::left << std::setw(10) << peers
+				<< std::setw(12) << formatBytes(static_cast<double>(std::filesystem::file_size(path)))
+				<< std::setw(12) << (std::to_string(static_cast<uint64_t>(open.nsPerIter / 1000)) + " us")
+				<< std::setw(16) << (std::to_string(static_cast<uint64_t>(byName.nsPerIter)) + " ns")
+				<< std::setw(16) << (std::to_string(static_cast<uint64_t>(byUUID.nsPerIter)) + " ns")
+				<< std::setw(14) << (std::to_string(static_cast<uint64_t>(setKey.nsPerIter)) + " ns") << '\n';
+		}
+
+		std::filesystem::remove(path);
+	}
+}
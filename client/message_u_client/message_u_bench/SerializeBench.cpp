@@ -0,0 +1,54 @@
+#include "Bench.h"
+#include "Request.h"
+#include "ReqPayload.h"
+#include "Config.h"
+
+#include <iostream>
+#include <iomanip>
+
+namespace Bench {
+	void runSerialize(const args_t& args) {
+		// Message sizes and the number of requests serialized for each one
+		const std::vector<std::pair<size_t, size_t>> cases{
+			{ 1024, 100000 },
+			{ 1024 * 1024, 1000 },
+			{ 100 * 1024 * 1024, 10 },
+		};
+		auto scale = std::stod(getOpt(args, "--scale", "1"));
+
+		std::cout << std::left << std::setw(10) << "msg size" << std::setw(12) << "path"
+			<< std::setw(14) << "time/req" << std::setw(14) << "copied/req" << std::setw(12) << "allocs/req" << '\n';
+
+		for (const auto& [msgSz, baseIters] : cases) {
+			auto iters = std::max<size_t>(1, static_cast<size_t>(baseIters * scale));
+			Request req{ std::string(Config::CLIENT_ID_SZ, 'a'),
+				RequestCodes::SEND_MSG,
+				std::make_unique<SendMessageReqPayload>(std::string(Config::CLIENT_ID_SZ, 'b'), MessageTypes::SEND_TXT, static_cast<uint32_t>(msgSz), std::string(msgSz, 'x')) };
+
+			// Every allocated byte of the toBytes path is filled by a copy
+			size_t sink{ 0 };
+			auto bytesStats = measure(iters, [&]() { sink += req.toBytes().size(); });
+
+			// The buffers path only serializes the header and the fixed payload fields, the message is referenced in place
+			size_t copiedSz{ 0 };
+			auto buffersStats = measure(iters, [&]() {
+				auto buffers = req.toBuffers();
+				copiedSz = buffers[0].size() + buffers[1].size();
+				sink += buffers.size();
+			});
+
+			auto print = [&](const std::string& path, const RunStats& stats, double copied) {
+				std::cout << std::left << std::setw(10) << formatBytes(static_cast<double>(msgSz)) << std::setw(12) << path
+					<< std::setw(14) << (std::to_string(static_cast<uint64_t>(stats.nsPerIter)) + " ns")
+					<< std::setw(14) << formatBytes(copied) << std::setw(12) << stats.allocsPerIter << '\n';
+			};
+
+			print("toBytes", bytesStats, bytesStats.allocBytesPerIter);
+			print("toBuffers", buffersStats, static_cast<double>(copiedSz));
+
+			if (sink == 0) {
+				std::cout << "unreachable\n";
+			}
+		}
+	}
+}
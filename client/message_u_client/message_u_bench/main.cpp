@@ -0,0 +1,42 @@
+#include "Bench.h"
+
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+	// Each benchmark is a sub command, the rest of the arguments are passed to it
+	Bench::bench_map_t benches{
+		{ "batch-decrypt", { "Speedup of BatchDecryptor on a large poll by the number of workers", Bench::runBatchDecrypt } },
+		{ "cipher", { "CBC vs segmented GCM throughput of AESWrapper by content size and number of workers", Bench::runCipher } },
+		{ "compression", { "Wire bytes saved and send/receive latency of compressing contents before encrypting them", Bench::runCompression } },
+		{ "crypto-cache", { "Per message AES/RSA objects vs the cached ones of ClientState", Bench::runCryptoCache } },
+		{ "group", { "Upload bytes and send time of a text fanned out to every member vs sent once to a group", Bench::runGroup } },
+		{ "identity", { "Client startup (and first decrypt) from the text me.info vs the binary identity file", Bench::runIdentity } },
+		{ "io", { "Time and allocations of a request/response cycle on a loopback connection", Bench::runIo } },
+		{ "key-exchange", { "Key generation and session setup latency of RSA-1024 key transport vs X25519 key agreement", Bench::runKeyExchange } },
+		{ "load", { "Simulated users against a running server, throughput and latency per request code", Bench::runLoad } },
+		{ "metrics", { "Cost of a timed phase with the metrics on and off, percentiles of known latencies", Bench::runMetrics } },
+		{ "parse", { "Owning ResPayload vs ResView parsing of a large poll and users list, in protocol v2 and v3", Bench::runParse } },
+		{ "peer-store", { "Open time and lookups of the memory-mapped PeerStore by the number of peers", Bench::runPeerStore } },
+		{ "serialize", { "Request::toBytes vs the gathered Request::toBuffers for SEND_MSG", Bench::runSerialize } },
+	};
+
+	if (argc < 2 || benches.find(argv[1]) == benches.end()) {
+		std::cout << "Usage: message_u_bench <benchmark> [options]\n\n";
+		for (const auto& [name, entry] : benches) {
+			std::cout << "  " << name << "\t" << entry.description << '\n';
+		}
+		return 1;
+	}
+
+	try {
+		Bench::args_t args(argv + 2, argv + argc);
+		benches.at(argv[1]).run(args);
+	}
+	catch (const std::exception& e) {
+		std::cout << e.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
@@ -1,13 +1,101 @@
 #include "AESWrapper.h"
-
-#include <modes.h>
-#include <aes.h>
-#include <filters.h>
+#include "Config.h"
+#include "Utils.h"
 
 #include <stdexcept>
+#include <algorithm>
 #include <immintrin.h>	// _rdrand32_step
 
 
+// Moves the output that is ready in a filter with no attached sink to the end of 'out'
+static void drainFilter(CryptoPP::BufferedTransformation& filter, std::string& out)
+{
+	size_t ready = static_cast<size_t>(filter.MaxRetrievable());
+	size_t offset = out.size();
+	out.resize(offset + ready);
+	filter.Get(reinterpret_cast<CryptoPP::byte*>(&out[offset]), ready);
+}
+
+
+// Size of a sealed GCM segment of full size
+static constexpr size_t GCM_FULL_SZ = Config::GCM_SEGMENT_SZ + AESWrapper::GCM_TAG_SZ;
+
+// Gets the number of GCM segments of a plain text, an empty one still has its (empty) last segment
+static uint64_t gcmSegments(uint64_t length)
+{
+	return std::max<uint64_t>(1, (length + Config::GCM_SEGMENT_SZ - 1) / Config::GCM_SEGMENT_SZ);
+}
+
+// Builds the IV of a segment, the nonce of the message with the segment index xored into its last bytes
+static void gcmSegmentIV(const CryptoPP::byte* nonce, uint64_t index, CryptoPP::byte* iv)
+{
+	std::copy(nonce, nonce + AESWrapper::GCM_NONCE_SZ, iv);
+	for (size_t b = 0; b < sizeof(index); b++) {
+		iv[AESWrapper::GCM_NONCE_SZ - 1 - b] ^= static_cast<CryptoPP::byte>(index >> (8 * b));
+	}
+}
+
+// Keys a GCM object per worker, keying computes the hash tables so it is done once per message (or stream), not per segment
+template<typename Gcm>
+static std::vector<std::unique_ptr<Gcm>> gcmWorkers(const unsigned char* key, size_t workers)
+{
+	std::vector<std::unique_ptr<Gcm>> gcms;
+	for (size_t i = 0; i < std::max<size_t>(workers, 1); i++) {
+		gcms.push_back(std::make_unique<Gcm>());
+		gcms.back()->SetKey(key, AESWrapper::DEFAULT_KEYLENGTH);
+	}
+	return gcms;
+}
+
+// Runs fn(segment, worker) for 'count' segments, on the pool when there is more than one segment and worker
+template<typename Fn>
+static void forSegments(AESWrapper::pool_t* pool, size_t workers, size_t count, Fn&& fn)
+{
+	if (pool == nullptr || workers < 2 || count < 2) {
+		for (size_t i = 0; i < count; i++) {
+			fn(i, 0);
+		}
+		return;
+	}
+
+	Utils::parallelFor(*pool, workers, count, fn);
+}
+
+// Seals 'count' segments that follow each other in 'plain' into 'out', the first one has index 'first' and all but the last one are full
+static void gcmSeal(std::vector<std::unique_ptr<AESWrapper::gcm_enc_t>>& gcms, AESWrapper::pool_t* pool, const CryptoPP::byte* nonce,
+	uint64_t first, size_t count, size_t lastSz, bool isFinal, const char* plain, char* out)
+{
+	forSegments(pool, gcms.size(), count, [&](size_t i, size_t worker) {
+		auto sz = (i + 1 == count) ? lastSz : Config::GCM_SEGMENT_SZ;
+		auto src = reinterpret_cast<const CryptoPP::byte*>(plain + i * Config::GCM_SEGMENT_SZ);
+		auto dst = reinterpret_cast<CryptoPP::byte*>(out + i * GCM_FULL_SZ);
+		CryptoPP::byte iv[AESWrapper::GCM_NONCE_SZ];
+		CryptoPP::byte isLast = (isFinal && i + 1 == count) ? 1 : 0;
+
+		gcmSegmentIV(nonce, first + i, iv);
+		gcms[worker]->EncryptAndAuthenticate(dst, dst + sz, AESWrapper::GCM_TAG_SZ, iv, AESWrapper::GCM_NONCE_SZ, &isLast, 1, src, sz);
+	});
+}
+
+// Opens 'count' sealed segments that follow each other in 'cipher' into 'out', the first one has index 'first' and all but the last one are full
+static void gcmOpen(std::vector<std::unique_ptr<AESWrapper::gcm_dec_t>>& gcms, AESWrapper::pool_t* pool, const CryptoPP::byte* nonce,
+	uint64_t first, size_t count, size_t lastSz, bool isFinal, const char* cipher, char* out)
+{
+	forSegments(pool, gcms.size(), count, [&](size_t i, size_t worker) {
+		auto sz = ((i + 1 == count) ? lastSz : GCM_FULL_SZ) - AESWrapper::GCM_TAG_SZ;
+		auto src = reinterpret_cast<const CryptoPP::byte*>(cipher + i * GCM_FULL_SZ);
+		auto dst = reinterpret_cast<CryptoPP::byte*>(out + i * Config::GCM_SEGMENT_SZ);
+		CryptoPP::byte iv[AESWrapper::GCM_NONCE_SZ];
+		CryptoPP::byte isLast = (isFinal && i + 1 == count) ? 1 : 0;
+
+		gcmSegmentIV(nonce, first + i, iv);
+		if (!gcms[worker]->DecryptAndVerify(dst, src + sz, AESWrapper::GCM_TAG_SZ, iv, AESWrapper::GCM_NONCE_SZ, &isLast, 1, src, sz)) {
+			throw std::runtime_error("Error: The message was changed on its way, it can't be decrypted");
+		}
+	});
+}
+
+
 unsigned char* AESWrapper::GenerateKey(unsigned char* buffer, unsigned int length)
 {
 	for (size_t i = 0; i < length; i += sizeof(unsigned int))
@@ -18,6 +106,8 @@ unsigned char* AESWrapper::GenerateKey(unsigned char* buffer, unsigned int lengt
 AESWrapper::AESWrapper()
 {
 	GenerateKey(_key, DEFAULT_KEYLENGTH);
+	_enc.SetKey(_key, DEFAULT_KEYLENGTH);
+	_dec.SetKey(_key, DEFAULT_KEYLENGTH);
 }
 
 AESWrapper::AESWrapper(const unsigned char* key, unsigned int length)
@@ -25,6 +115,8 @@ AESWrapper::AESWrapper(const unsigned char* key, unsigned int length)
 	if (length != DEFAULT_KEYLENGTH)
 		throw std::length_error("key length must be 16 bytes");
 	memcpy_s(_key, DEFAULT_KEYLENGTH, key, length);
+	_enc.SetKey(_key, DEFAULT_KEYLENGTH);
+	_dec.SetKey(_key, DEFAULT_KEYLENGTH);
 }
 
 AESWrapper::~AESWrapper()
@@ -40,8 +132,7 @@ std::string AESWrapper::encrypt(const char* plain, unsigned int length)
 {
 	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// for practical use iv should never be a fixed value!
 
-	CryptoPP::AES::Encryption aesEncryption(_key, DEFAULT_KEYLENGTH);
-	CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption(aesEncryption, iv);
+	CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption(_enc, iv);
 
 	std::string cipher;
 	CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, new CryptoPP::StringSink(cipher));
@@ -56,8 +147,7 @@ std::string AESWrapper::decrypt(const char* cipher, unsigned int length)
 {
 	CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = { 0 };	// for practical use iv should never be a fixed value!
 
-	CryptoPP::AES::Decryption aesDecryption(_key, DEFAULT_KEYLENGTH);
-	CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(aesDecryption, iv);
+	CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(_dec, iv);
 
 	std::string decrypted;
 	CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, new CryptoPP::StringSink(decrypted));
@@ -66,3 +156,189 @@ std::string AESWrapper::decrypt(const char* cipher, unsigned int length)
 
 	return decrypted;
 }
+
+std::string AESWrapper::encrypt(const char* plain, size_t length, Mode mode, pool_t* pool, size_t workers)
+{
+	if (mode == Mode::CBC) {
+		return encrypt(plain, static_cast<unsigned int>(length));
+	}
+
+	std::string cipher(cipherSize(length, Mode::GCM), '\0');
+	seal(plain, length, &cipher[0], pool, workers);
+	return cipher;
+}
+
+std::string AESWrapper::decrypt(const char* cipher, size_t length, Mode mode, pool_t* pool, size_t workers)
+{
+	if (mode == Mode::CBC) {
+		return decrypt(cipher, static_cast<unsigned int>(length));
+	}
+
+	std::string plain(gcmPlainSize(length), '\0');
+	open(cipher, length, &plain[0], pool, workers);
+	return plain;
+}
+
+void AESWrapper::seal(const char* plain, size_t length, char* out, pool_t* pool, size_t workers)
+{
+	auto count = gcmSegments(length);
+	auto gcms = gcmWorkers<gcm_enc_t>(_key, std::min<uint64_t>(workers, count));
+
+	// A fresh nonce for every message, the key is shared by all the messages between two clients
+	auto nonce = reinterpret_cast<CryptoPP::byte*>(out);
+	GenerateKey(nonce, GCM_NONCE_SZ);
+
+	gcmSeal(gcms, pool, nonce, 0, count, length - (count - 1) * Config::GCM_SEGMENT_SZ, true, plain, out + GCM_NONCE_SZ);
+}
+
+void AESWrapper::open(const char* cipher, size_t length, char* out, pool_t* pool, size_t workers)
+{
+	auto plainSz = gcmPlainSize(length);
+	auto count = gcmSegments(plainSz);
+	auto gcms = gcmWorkers<gcm_dec_t>(_key, std::min<uint64_t>(workers, count));
+	auto lastSz = length - GCM_NONCE_SZ - (count - 1) * GCM_FULL_SZ;
+
+	gcmOpen(gcms, pool, reinterpret_cast<const CryptoPP::byte*>(cipher), 0, count, lastSz, true, cipher + GCM_NONCE_SZ, out);
+}
+
+uint64_t AESWrapper::cipherSize(uint64_t length)
+{
+	// CBC with PKCS padding always adds between 1 and BLOCKSIZE bytes
+	return (length / CryptoPP::AES::BLOCKSIZE + 1) * CryptoPP::AES::BLOCKSIZE;
+}
+
+uint64_t AESWrapper::cipherSize(uint64_t length, Mode mode)
+{
+	if (mode == Mode::CBC) {
+		return cipherSize(length);
+	}
+
+	return GCM_NONCE_SZ + length + gcmSegments(length) * GCM_TAG_SZ;
+}
+
+uint64_t AESWrapper::gcmPlainSize(uint64_t length)
+{
+	if (length < GCM_NONCE_SZ + GCM_TAG_SZ) {
+		throw std::length_error("Error: GCM content of " + std::to_string(length) + " bytes is too short");
+	}
+
+	// Every segment but the last is full, the last one has at least its tag
+	auto sealedSz = length - GCM_NONCE_SZ;
+	auto count = (sealedSz + GCM_FULL_SZ - 1) / GCM_FULL_SZ;
+	if (sealedSz - (count - 1) * GCM_FULL_SZ < GCM_TAG_SZ) {
+		throw std::length_error("Error: GCM content of " + std::to_string(length) + " bytes ends in the middle of a tag");
+	}
+
+	return sealedSz - count * GCM_TAG_SZ;
+}
+
+AESWrapper::Encryptor::Encryptor(AESWrapper& aes, Mode mode, pool_t* pool, size_t workers)
+	: _iv{ 0 }, _cbc{ aes._enc, _iv }, _filter{ _cbc }, _mode{ mode }, _pool{ pool }, _nonce{ 0 }, _index{ 0 }
+{
+	if (_mode == Mode::GCM) {
+		_gcms = gcmWorkers<gcm_enc_t>(aes._key, workers);
+		GenerateKey(_nonce, GCM_NONCE_SZ);
+	}
+}
+
+void AESWrapper::Encryptor::sealPending(size_t count, size_t lastSz, bool isFinal, std::string& out)
+{
+	// The nonce leads the cipher text
+	if (_index == 0) {
+		out.append(reinterpret_cast<const char*>(_nonce), GCM_NONCE_SZ);
+	}
+
+	auto offset = out.size();
+	out.resize(offset + (count - 1) * GCM_FULL_SZ + lastSz + GCM_TAG_SZ);
+	gcmSeal(_gcms, _pool, _nonce, _index, count, lastSz, isFinal, _pending.data(), &out[offset]);
+
+	_index += count;
+	_pending.erase(0, (count - 1) * Config::GCM_SEGMENT_SZ + lastSz);
+}
+
+void AESWrapper::Encryptor::update(const char* plain, size_t length, std::string& out)
+{
+	if (_mode == Mode::CBC) {
+		_filter.Put(reinterpret_cast<const CryptoPP::byte*>(plain), length);
+		drainFilter(_filter, out);
+		return;
+	}
+
+	// A full segment is only sealed once more plain text follows it, the last segment is sealed differently
+	_pending.append(plain, length);
+	auto ready = _pending.empty() ? 0 : (_pending.size() - 1) / Config::GCM_SEGMENT_SZ;
+	if (ready >= _gcms.size()) {
+		sealPending(ready, Config::GCM_SEGMENT_SZ, false, out);
+	}
+}
+
+void AESWrapper::Encryptor::final(std::string& out)
+{
+	if (_mode == Mode::CBC) {
+		_filter.MessageEnd();
+		drainFilter(_filter, out);
+		return;
+	}
+
+	auto count = gcmSegments(_pending.size());
+	sealPending(count, _pending.size() - (count - 1) * Config::GCM_SEGMENT_SZ, true, out);
+}
+
+AESWrapper::Decryptor::Decryptor(AESWrapper& aes, Mode mode, pool_t* pool, size_t workers)
+	: _iv{ 0 }, _cbc{ aes._dec, _iv }, _filter{ _cbc }, _mode{ mode }, _pool{ pool }, _index{ 0 }
+{
+	if (_mode == Mode::GCM) {
+		_gcms = gcmWorkers<gcm_dec_t>(aes._key, workers);
+	}
+}
+
+void AESWrapper::Decryptor::openPending(size_t count, size_t lastSz, bool isFinal, std::string& out)
+{
+	auto offset = out.size();
+	out.resize(offset + (count - 1) * Config::GCM_SEGMENT_SZ + lastSz - GCM_TAG_SZ);
+	gcmOpen(_gcms, _pool, reinterpret_cast<const CryptoPP::byte*>(_nonce.data()), _index, count, lastSz, isFinal, _pending.data(), &out[offset]);
+
+	_index += count;
+	_pending.erase(0, (count - 1) * GCM_FULL_SZ + lastSz);
+}
+
+void AESWrapper::Decryptor::update(const char* cipher, size_t length, std::string& out)
+{
+	if (_mode == Mode::CBC) {
+		_filter.Put(reinterpret_cast<const CryptoPP::byte*>(cipher), length);
+		drainFilter(_filter, out);
+		return;
+	}
+
+	// The nonce may arrive split over several parts
+	auto nonceSz = std::min<size_t>(length, GCM_NONCE_SZ - _nonce.size());
+	_nonce.append(cipher, nonceSz);
+	_pending.append(cipher + nonceSz, length - nonceSz);
+
+	// A full segment is only known not to be the last one once more cipher text follows it
+	auto ready = _pending.empty() ? 0 : (_pending.size() - 1) / GCM_FULL_SZ;
+	if (ready >= _gcms.size()) {
+		openPending(ready, GCM_FULL_SZ, false, out);
+	}
+}
+
+void AESWrapper::Decryptor::final(std::string& out)
+{
+	if (_mode == Mode::CBC) {
+		_filter.MessageEnd();
+		drainFilter(_filter, out);
+		return;
+	}
+
+	if (_nonce.size() < GCM_NONCE_SZ || _pending.size() < GCM_TAG_SZ) {
+		throw std::length_error("Error: GCM content is cut off");
+	}
+
+	auto count = (_pending.size() + GCM_FULL_SZ - 1) / GCM_FULL_SZ;
+	auto lastSz = _pending.size() - (count - 1) * GCM_FULL_SZ;
+	if (lastSz < GCM_TAG_SZ) {
+		throw std::length_error("Error: GCM content ends in the middle of a tag");
+	}
+
+	openPending(count, lastSz, true, out);
+}
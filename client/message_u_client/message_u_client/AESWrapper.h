@@ -1,14 +1,41 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <boost/asio/thread_pool.hpp>
 
+#include <modes.h>
+#include <aes.h>
+#include <gcm.h>
+#include <filters.h>
 
+
+// Symmetric encryption of the message contents.
+// CBC is the original mode. GCM splits the plain text into segments of Config::GCM_SEGMENT_SZ that are sealed independently,
+// so a large content is encrypted on several threads, and CryptoPP uses AES-NI and PCLMULQDQ for them when the CPU has them.
+// A GCM content is a random nonce followed by the segments, each with its tag. A segment's IV is the nonce with the segment index
+// xored in, and its authenticated data tells if it is the last one, so segments can't be reordered, dropped or cut off.
 class AESWrapper
 {
 public:
 	static const unsigned int DEFAULT_KEYLENGTH = 16;
+	static const unsigned int GCM_NONCE_SZ = 12;
+	static const unsigned int GCM_TAG_SZ = 16;
+
+	using pool_t = boost::asio::thread_pool;
+	using gcm_enc_t = CryptoPP::GCM<CryptoPP::AES>::Encryption;
+	using gcm_dec_t = CryptoPP::GCM<CryptoPP::AES>::Decryption;
+
+	enum class Mode {
+		CBC,
+		GCM,
+	};
 private:
 	unsigned char _key[DEFAULT_KEYLENGTH];
+	CryptoPP::AES::Encryption _enc;	// Key schedules are expanded once and reused by every operation
+	CryptoPP::AES::Decryption _dec;
 	AESWrapper(const AESWrapper& aes);
 public:
 	static unsigned char* GenerateKey(unsigned char* buffer, unsigned int length);
@@ -21,4 +48,89 @@ public:
 
 	std::string encrypt(const char* plain, unsigned int length);
 	std::string decrypt(const char* cipher, unsigned int length);
+
+	// Encrypts with the given mode, the GCM segments are sealed on up to 'workers' threads of 'pool' when there is one
+	std::string encrypt(const char* plain, size_t length, Mode mode, pool_t* pool = nullptr, size_t workers = 1);
+
+	// Decrypts with the given mode, throws if a GCM content was changed
+	std::string decrypt(const char* cipher, size_t length, Mode mode, pool_t* pool = nullptr, size_t workers = 1);
+
+	// Encrypts with GCM into 'out', which has room for cipherSize(length, Mode::GCM) bytes
+	void seal(const char* plain, size_t length, char* out, pool_t* pool = nullptr, size_t workers = 1);
+
+	// Decrypts a GCM content into 'out', which has room for gcmPlainSize(length) bytes, throws if the content was changed
+	void open(const char* cipher, size_t length, char* out, pool_t* pool = nullptr, size_t workers = 1);
+
+	// Returns the size of the CBC cipher text produced for 'length' bytes of plain text
+	static uint64_t cipherSize(uint64_t length);
+
+	// Returns the size of the cipher text produced for 'length' bytes of plain text
+	static uint64_t cipherSize(uint64_t length, Mode mode);
+
+	// Returns the size of the plain text of a GCM content of 'length' bytes, throws if no content has that size
+	static uint64_t gcmPlainSize(uint64_t length);
+
+	// Encrypts a plain text incrementally, so it never has to be held in memory as a whole
+	// In GCM mode the segments are sealed once 'workers' of them are ready, on the threads of 'pool' when there is one
+	class Encryptor
+	{
+	private:
+		CryptoPP::byte _iv[CryptoPP::AES::BLOCKSIZE];
+		CryptoPP::CBC_Mode_ExternalCipher::Encryption _cbc;
+		CryptoPP::StreamTransformationFilter _filter;
+
+		Mode _mode;
+		pool_t* _pool;
+		std::vector<std::unique_ptr<gcm_enc_t>> _gcms; // One per worker
+		CryptoPP::byte _nonce[GCM_NONCE_SZ];
+		uint64_t _index; // Index of the next segment
+		std::string _pending; // Plain text that wasn't sealed yet
+
+		Encryptor(const Encryptor& enc);
+		Encryptor& operator=(const Encryptor& enc);
+
+		// Seals the first 'count' segments of the pending plain text and appends them to 'out', 'lastSz' is the size of the last of them
+		void sealPending(size_t count, size_t lastSz, bool isFinal, std::string& out);
+	public:
+		// Uses the key schedule of 'aes', which must outlive the encryptor
+		explicit Encryptor(AESWrapper& aes, Mode mode = Mode::CBC, pool_t* pool = nullptr, size_t workers = 1);
+
+		// Encrypts the next part of the plain text, appends the cipher text that is ready to 'out'
+		void update(const char* plain, size_t length, std::string& out);
+
+		// Pads and encrypts (or seals) the remaining plain text, appends it to 'out'
+		void final(std::string& out);
+	};
+
+	// Decrypts a cipher text incrementally, so it can be processed while it is still arriving
+	// In GCM mode only authenticated plain text is output, a segment is opened once the bytes after it show it isn't the last one
+	class Decryptor
+	{
+	private:
+		CryptoPP::byte _iv[CryptoPP::AES::BLOCKSIZE];
+		CryptoPP::CBC_Mode_ExternalCipher::Decryption _cbc;
+		CryptoPP::StreamTransformationFilter _filter;
+
+		Mode _mode;
+		pool_t* _pool;
+		std::vector<std::unique_ptr<gcm_dec_t>> _gcms; // One per worker
+		std::string _nonce; // Filled from the first bytes of the cipher text
+		uint64_t _index; // Index of the next segment
+		std::string _pending; // Cipher text that wasn't opened yet
+
+		Decryptor(const Decryptor& dec);
+		Decryptor& operator=(const Decryptor& dec);
+
+		// Opens the first 'count' segments of the pending cipher text and appends them to 'out', 'lastSz' is the (cipher) size of the last of them
+		void openPending(size_t count, size_t lastSz, bool isFinal, std::string& out);
+	public:
+		// Uses the key schedule of 'aes', which must outlive the decryptor
+		explicit Decryptor(AESWrapper& aes, Mode mode = Mode::CBC, pool_t* pool = nullptr, size_t workers = 1);
+
+		// Decrypts the next part of the cipher text, appends the plain text that is ready to 'out'
+		void update(const char* cipher, size_t length, std::string& out);
+
+		// Checks and strips the padding (or opens the last segments), appends the remaining plain text to 'out'
+		void final(std::string& out);
+	};
 };
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "BatchDecryptor.h"
+#include "Client.h"
+#include "Utils.h"
+#include "RSAWrapper.h"
+#include "AESWrapper.h"
+#include "DeflateWrapper.h"
+#include "Metrics.h"
+#include "Protocol.h"
+
+BatchDecryptor::BatchDecryptor(ClientState& state, pool_t& pool, size_t workers)
+	: m_state{ state }, m_pool{ pool }, m_workers{ workers }
+{
+}
+
+void BatchDecryptor::add(const msg_header_t& msg, std::string content)
+{
+	// The sender is resolved now, so an unknown sender fails on its own message
+	auto username = m_state.getNameByUUID(msg.senderId);
+
+	// So does a group message that is too short for the group ID (and name) before its cipher text
+	if ((msg.msgType == MessageTypes::SEND_GROUP_KEY && content.size() < Protocol::GroupKeyPrefix::SIZE) ||
+		(msg.msgType == MessageTypes::SEND_GROUP_TXT && content.size() < Protocol::GroupTextPrefix::SIZE)) {
+		throw std::runtime_error("Error: Group message '" + std::to_string(msg.msgId) + "' is too short");
+	}
+
+	m_contentSz += content.size();
+	m_entries.push_back({ msg, std::move(username), std::move(content), nullptr, "" });
+}
+
+size_t BatchDecryptor::getContentSize() const
+{
+	return m_contentSz;
+}
+
+bool BatchDecryptor::isEmpty() const
+{
+	return m_entries.empty();
+}
+
+void BatchDecryptor::flush(std::ostream& out)
+{
+	if (isEmpty()) {
+		return;
+	}
+
+	Metrics::Timer decrypt{ MetricPhase::DECRYPT };
+	unwrapSymKeys();
+	decryptTexts();
+	decrypt.stop();
+
+	Metrics::Timer render{ MetricPhase::RENDER };
+	for (const auto& entry : m_entries) {
+		out << "From: " << entry.username << '\n';
+		out << "Content:\n";
+		out << entry.output;
+		out << "\n-----<EOM>-----\n\n";
+	}
+	render.stop();
+
+	m_entries.clear();
+	m_contentSz = 0;
+}
+
+void BatchDecryptor::unwrapSymKeys()
+{
+	// Only an RSA key unwraps keys, an X25519 client derives its symmetric keys and gets group keys under them
+	bool isRSA = m_state.getKeyType() == KeyTypes::RSA;
+
+	std::vector<size_t> symKeys;
+	for (size_t i = 0; isRSA && i < m_entries.size(); i++) {
+		if (m_entries[i].msg.msgType == MessageTypes::SEND_SYM_KEY || m_entries[i].msg.msgType == MessageTypes::SEND_GROUP_KEY) {
+			symKeys.push_back(i);
+		}
+	}
+
+	// A group key is wrapped after the group ID and name
+	auto wrappedKey = [this](size_t i) {
+		const auto& entry = m_entries[i];
+		size_t offset = entry.msg.msgType == MessageTypes::SEND_GROUP_KEY ? Protocol::GroupKeyPrefix::SIZE : 0;
+		return std::string_view(entry.content).substr(offset);
+	};
+
+	// The unwrapped keys are kept aside, the state is only updated below in message order
+	std::vector<std::string> keys(symKeys.size());
+	std::vector<std::string> errors(symKeys.size());
+
+	if (symKeys.size() == 1) {
+		// A single key isn't worth a private key per worker, use the cached one
+		try {
+			auto wrapped = wrappedKey(symKeys[0]);
+			keys[0] = m_state.getRSAPrivate()->decrypt(wrapped.data(), static_cast<unsigned int>(wrapped.size()));
+		}
+		catch (const std::exception& e) {
+			errors[0] = e.what();
+		}
+	}
+	else if (!symKeys.empty()) {
+		// RSAPrivateWrapper isn't thread safe (it owns its random pool), so every worker restores its own copy of the key once
+		auto keyParams = m_state.getRSAPrivate()->getParams();
+		std::vector<std::unique_ptr<RSAPrivateWrapper>> rsaPrivs(m_workers);
+
+		Utils::parallelFor(m_pool, m_workers, symKeys.size(), [&](size_t i, size_t worker) {
+			try {
+				if (!rsaPrivs[worker]) {
+					rsaPrivs[worker] = std::make_unique<RSAPrivateWrapper>(keyParams);
+				}
+				auto wrapped = wrappedKey(symKeys[i]);
+				keys[i] = rsaPrivs[worker]->decrypt(wrapped.data(), static_cast<unsigned int>(wrapped.size()));
+			}
+			catch (const std::exception& e) {
+				errors[i] = e.what();
+			}
+		});
+	}
+
+	// Walk the batch in order, every message gets the cipher its sender (or group) had at that point
+	size_t keyIdx{ 0 };
+	for (auto& entry : m_entries) {
+		switch (entry.msg.msgType) {
+		case MessageTypes::GET_SYM_KEY:
+			entry.output = "Request for symmetric key";
+			break;
+		case MessageTypes::SEND_SYM_KEY:
+			if (!isRSA) {
+				entry.output = "can't decrypt message";
+			}
+			else if (errors[keyIdx].empty()) {
+				m_state.setSymKey(entry.username, keys[keyIdx]);
+				entry.output = "Symmetric key received";
+			}
+			else {
+				entry.output = errors[keyIdx];
+			}
+			keyIdx += isRSA ? 1 : 0;
+			break;
+		case MessageTypes::SEND_TXT:
+			if (m_state.hasSymKey(entry.username)) {
+				entry.cipher = m_state.getSymCipher(entry.username);
+			}
+			else {
+				entry.output = "can't decrypt message";
+			}
+			break;
+		case MessageTypes::SEND_GROUP_KEY:
+			if (!isRSA) {
+				openGroupKey(entry);
+			}
+			else if (errors[keyIdx].empty()) {
+				auto [groupId, name] = Protocol::GroupKeyPrefix::decode(reinterpret_cast<const uint8_t*>(entry.content.data()));
+				try {
+					entry.output = "Group key received for '" + m_state.setGroupKey(groupId, std::string(name), entry.msg.senderId, keys[keyIdx]) + "'";
+				}
+				catch (const std::exception& e) {
+					entry.output = e.what();
+				}
+			}
+			else {
+				entry.output = errors[keyIdx];
+			}
+			keyIdx += isRSA ? 1 : 0;
+			break;
+		case MessageTypes::SEND_GROUP_TXT: {
+			// The group ID is stripped, the rest is the cipher text of the group key
+			auto [groupId] = Protocol::GroupTextPrefix::decode(reinterpret_cast<const uint8_t*>(entry.content.data()));
+			entry.content.erase(0, Protocol::GroupTextPrefix::SIZE);
+			if (m_state.hasGroupKey(groupId)) {
+				entry.username += " [" + m_state.getGroupName(groupId) + "]";
+				entry.cipher = m_state.getGroupCipher(groupId);
+			}
+			else {
+				entry.output = "can't decrypt message";
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+void BatchDecryptor::openGroupKey(Entry& entry)
+{
+	// A short content under the sender's cipher, decrypted here since the later messages of the group need the key
+	if (!m_state.hasSymKey(entry.username)) {
+		entry.output = "can't decrypt message";
+		return;
+	}
+
+	try {
+		auto [groupId, name] = Protocol::GroupKeyPrefix::decode(reinterpret_cast<const uint8_t*>(entry.content.data()));
+		auto encryptedKey = std::string_view(entry.content).substr(Protocol::GroupKeyPrefix::SIZE);
+		auto mode = (entry.msg.flags & MessageFlags::GCM) ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+		auto key = m_state.getSymCipher(entry.username)->decrypt(encryptedKey.data(), encryptedKey.size(), mode);
+		entry.output = "Group key received for '" + m_state.setGroupKey(groupId, std::string(name), entry.msg.senderId, key) + "'";
+	}
+	catch (const std::exception& e) {
+		entry.output = e.what();
+	}
+}
+
+void BatchDecryptor::decryptTexts()
+{
+	std::vector<size_t> texts;
+	for (size_t i = 0; i < m_entries.size(); i++) {
+		if (m_entries[i].cipher) {
+			texts.push_back(i);
+		}
+	}
+
+	// The ciphers only read their key schedules, so a cipher is shared by all the messages of its sender
+	Utils::parallelFor(m_pool, m_workers, texts.size(), [&](size_t i, size_t) {
+		auto& entry = m_entries[texts[i]];
+		try {
+			// The batch is already spread over the workers, so a single message is decrypted on one thread
+			auto mode = (entry.msg.flags & MessageFlags::GCM) ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+			entry.output = entry.cipher->decrypt(entry.content.data(), entry.content.size(), mode);
+			if (entry.msg.flags & MessageFlags::COMPRESSED) {
+				entry.output = DeflateWrapper::decompress(entry.output.data(), entry.output.size());
+			}
+		}
+		catch (const std::exception& e) {
+			entry.output = e.what();
+		}
+
+		// The cipher text isn't needed anymore, release it while the rest of the batch is decrypted
+		std::string().swap(entry.content);
+	});
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <boost/asio/thread_pool.hpp>
+
+#include "Connection.h"
+
+// Forward declarations
+class ClientState;
+class AESWrapper;
+
+// Decrypts a batch of polled messages on a pool of worker threads.
+// The RSA unwraps of the symmetric and group keys (the group keys of an X25519 client are decrypted with the sender's key instead) run first, since they decide which key decrypts the later messages of the same sender or group,
+// then the AES decrypts run in parallel and the output is written back in the order the messages arrived.
+class BatchDecryptor
+{
+public:
+	using msg_header_t = MessageReader::MessageHeader;
+	using pool_t = boost::asio::thread_pool;
+
+	BatchDecryptor(ClientState& state, pool_t& pool, size_t workers);
+
+	// Adds a message and its (encrypted) content to the batch
+	void add(const msg_header_t& msg, std::string content);
+
+	// Gets the number of content bytes in the batch
+	size_t getContentSize() const;
+
+	// Checks if the batch is empty
+	bool isEmpty() const;
+
+	// Decrypts the batch, writes the messages to 'out' in their original order and clears the batch
+	void flush(std::ostream& out);
+
+private:
+	// A message of the batch and its decrypted output
+	struct Entry {
+		msg_header_t msg;
+		std::string username;
+		std::string content;
+		std::shared_ptr<AESWrapper> cipher; // The sender's (or group's) cipher at the position of the message
+		std::string output;
+	};
+
+	// Unwraps the symmetric and group keys of the batch in parallel and stores them in order
+	void unwrapSymKeys();
+
+	// Decrypts a group key that an X25519 member got under the symmetric key it shares with the sender, and stores it
+	void openGroupKey(Entry& entry);
+
+	// Decrypts the text messages of the batch in parallel
+	void decryptTexts();
+
+private:
+	ClientState& m_state; // Reference to the client state, reads the private key and the ciphers and stores new symmetric keys
+	pool_t& m_pool; // Worker threads
+	size_t m_workers; // Number of threads in the pool
+	std::vector<Entry> m_entries;
+	size_t m_contentSz{ 0 };
+};
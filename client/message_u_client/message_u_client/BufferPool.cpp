@@ -0,0 +1,136 @@
+#include "BufferPool.h"
+
+BufferPool::Buffer::Buffer(bytes_t bytes)
+	: m_bytes{ std::move(bytes) }
+{
+}
+
+BufferPool::Buffer::Buffer(std::weak_ptr<BufferPool> pool, bytes_t bytes)
+	: m_pool{ std::move(pool) }, m_bytes{ std::move(bytes) }
+{
+}
+
+BufferPool::Buffer::Buffer(Buffer&& other) noexcept
+	: m_pool{ std::move(other.m_pool) }, m_bytes{ std::move(other.m_bytes) }
+{
+	other.m_pool.reset();
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept
+{
+	if (this != &other) {
+		release();
+		m_pool = std::move(other.m_pool);
+		m_bytes = std::move(other.m_bytes);
+		other.m_pool.reset();
+	}
+
+	return *this;
+}
+
+BufferPool::bytes_t& BufferPool::Buffer::bytes()
+{
+	return m_bytes;
+}
+
+const BufferPool::bytes_t& BufferPool::Buffer::bytes() const
+{
+	return m_bytes;
+}
+
+BufferPool::Buffer::~Buffer()
+{
+	release();
+}
+
+void BufferPool::Buffer::release()
+{
+	if (auto pool = m_pool.lock()) {
+		pool->release(std::move(m_bytes));
+	}
+
+	m_pool.reset();
+	m_bytes = bytes_t();
+}
+
+std::shared_ptr<BufferPool> BufferPool::create()
+{
+	std::shared_ptr<BufferPool> pool{ new BufferPool() };
+
+	// Room for every buffer a class may keep, so releasing one never allocates
+	for (auto& free : pool->m_free) {
+		free.reserve(MAX_FREE_PER_CLASS);
+	}
+
+	return pool;
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t size)
+{
+	if (size == 0) {
+		return Buffer();
+	}
+
+	bytes_t bytes;
+	auto cls = classOf(size);
+
+	// Buffers past the largest class aren't kept, their allocation is small next to reading them anyway
+	if (cls == CLASSES) {
+		bytes.resize(size);
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_allocations++;
+		return Buffer(std::move(bytes));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		auto& free = m_free[cls];
+		if (!free.empty()) {
+			bytes = std::move(free.back());
+			free.pop_back();
+		}
+		else {
+			m_allocations++;
+		}
+	}
+
+	// Reserving the whole class lets the buffer be reused for any size of its class, resizing within the capacity doesn't allocate
+	bytes.reserve(size_t{ 1 } << (cls + MIN_CLASS_BITS));
+	bytes.resize(size);
+	return Buffer(weak_from_this(), std::move(bytes));
+}
+
+uint64_t BufferPool::getAllocations() const
+{
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	return m_allocations;
+}
+
+size_t BufferPool::classOf(size_t size)
+{
+	if (size > (size_t{ 1 } << MAX_CLASS_BITS)) {
+		return CLASSES;
+	}
+
+	size_t bits{ MIN_CLASS_BITS };
+	while ((size_t{ 1 } << bits) < size) {
+		bits++;
+	}
+
+	return bits - MIN_CLASS_BITS;
+}
+
+void BufferPool::release(bytes_t bytes)
+{
+	// Only buffers that were reserved for a class go back to it
+	auto cls = classOf(bytes.capacity());
+	if (cls == CLASSES || bytes.capacity() != (size_t{ 1 } << (cls + MIN_CLASS_BITS))) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock{ m_mutex };
+	auto& free = m_free[cls];
+	if (free.size() < MAX_FREE_PER_CLASS) {
+		free.push_back(std::move(bytes));
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+// Recycles the byte buffers of the responses a connection reads.
+// Buffers come in power of two size classes, a released buffer keeps its capacity and is handed out again for any size of its class,
+// so once every class in use has a buffer in the pool, reading a response allocates nothing.
+// Buffers may be released from any thread, and may outlive the pool (they are then simply freed).
+class BufferPool : public std::enable_shared_from_this<BufferPool>
+{
+public:
+	using bytes_t = std::vector<uint8_t>;
+
+	static constexpr size_t MIN_CLASS_BITS = 8; // 256 bytes, smaller buffers are taken from this class
+	static constexpr size_t MAX_CLASS_BITS = 22; // 4 MiB, larger buffers are allocated and freed as they are used
+	static constexpr size_t CLASSES = MAX_CLASS_BITS - MIN_CLASS_BITS + 1;
+	static constexpr size_t MAX_FREE_PER_CLASS = 4; // More than that are freed, so a burst doesn't pin its memory
+
+	// A buffer that goes back to its pool when it is destroyed
+	class Buffer
+	{
+	public:
+		Buffer() = default;
+
+		// Wraps bytes that don't come from a pool
+		explicit Buffer(bytes_t bytes);
+
+		Buffer(Buffer&& other) noexcept;
+		Buffer& operator=(Buffer&& other) noexcept;
+
+		// The bytes, sized as they were acquired. Moving the buffer keeps them in place
+		bytes_t& bytes();
+		const bytes_t& bytes() const;
+
+		~Buffer();
+
+	private:
+		friend class BufferPool;
+
+		Buffer(std::weak_ptr<BufferPool> pool, bytes_t bytes);
+
+		// Hands the bytes back to the pool, if it is still alive
+		void release();
+
+	private:
+		std::weak_ptr<BufferPool> m_pool;
+		bytes_t m_bytes;
+	};
+
+	static std::shared_ptr<BufferPool> create();
+
+	// Gets a buffer of 'size' bytes, its contents are unspecified
+	Buffer acquire(size_t size);
+
+	// Gets the number of buffers that were allocated rather than reused
+	uint64_t getAllocations() const;
+
+private:
+	BufferPool() = default;
+	BufferPool(const BufferPool& pool);
+	BufferPool& operator=(const BufferPool& pool);
+
+	// Gets the size class of a buffer size, CLASSES if it is too large to be pooled
+	static size_t classOf(size_t size);
+
+	void release(bytes_t bytes);
+
+private:
+	mutable std::mutex m_mutex;
+	std::array<std::vector<bytes_t>, CLASSES> m_free; // Released buffers by size class, their capacity is exactly the size of the class
+	uint64_t m_allocations{ 0 };
+};
@@ -16,6 +16,11 @@ enum class CLIMenuOpts : uint16_t {
 	REQ_SYM_KEY = 151,
 	SEND_SYM_KEY = 152,
 	SEND_FILE = 153,
+	SEND_MULTI_TEXT = 154,
+	CREATE_GROUP = 155,
+	SEND_GROUP_TEXT = 156,
+	RESEND_GROUP_KEY = 157,
+	SHOW_STATS = 160,
 	EXIT = 0,
 	INVALID = 0xffff,
 };
@@ -1,45 +1,79 @@
 #include "Client.h"
 #include "CLI.h"
 #include "Connection.h"
+#include "ConnectionManager.h"
 #include "Request.h"
 #include "ResPayload.h"
 #include "ReqPayload.h"
 #include "Base64Wrapper.h"
 #include "RSAWrapper.h"
+#include "ECWrapper.h"
 #include "AESWrapper.h"
+#include "DeflateWrapper.h"
+#include "MessageHandler.h"
+#include "MailboxReader.h"
+#include "PushListener.h"
+#include "PeerStore.h"
+#include "Metrics.h"
+#include "Utils.h"
 
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <filesystem>
+#include <variant>
 #include <boost/algorithm/hex.hpp>
 
-Client::Client(context_t& ctx, const std::string& addr, const std::string& port)
+namespace {
+	// Compressed and GCM contents are flagged in the message type byte, which a v2 client reads as part of the type,
+	// so a client that speaks v2 sends plain CBC contents only (the server holds flagged messages back from v2 sessions)
+	constexpr bool IS_COMPRESSING = Config::COMPRESS_MESSAGES && Config::VERSION >= Protocol::VERSION_3;
+	constexpr bool IS_GCM = Config::ENCRYPT_GCM && Config::VERSION >= Protocol::VERSION_3;
+}
+
+Client::Client(context_t& ctx, const ConnectionOptions& options)
 	: m_cli{ std::make_unique<CLI>("MessageU client at your service", "?") },
-	m_conn{ std::make_unique<Connection>(ctx, addr, port) },
-	m_state{ Config::ME_DOT_INFO_PATH }
+	m_conn{ std::make_unique<ConnectionManager>(ctx, options) },
+	m_state{ Config::IDENTITY_PATH, Config::ME_DOT_INFO_PATH },
+	m_workers{ Utils::workerCount() },
+	m_listener{ std::make_unique<PushListener>(options, m_state, m_stateMutex, m_workers) }
 {
+	// A registered client picks up the clients and keys it knew in its last run
+	if (m_state.isInitialized()) {
+		m_state.openPeerStore(Config::PEERS_PATH);
+	}
 	// Setting up the cli handlers.
 	setupCliHandlers();
 }
 
 void Client::run()
 {
+	// A registered client starts receiving messages right away.
+	if (getState().isInitialized()) {
+		m_listener->start();
+	}
+
 	// Getting the cli and running it, to enable client interaction.
 	getCLI().run();
+	m_listener->stop();
 }
 
 void Client::setupCliHandlers()
 {
 	// Binding the cli events to their handlers.
-	getCLI().addHandler(CLIMenuOpts::REGISTER, "Register", std::bind(&Client::onCliRegister, this));
-	getCLI().addHandler(CLIMenuOpts::REQ_CLIENT_LIST, "Request for clients list", std::bind(&Client::onCliReqClientList, this));
-	getCLI().addHandler(CLIMenuOpts::REQ_PUB_KEY, "Request for public key", std::bind(&Client::onCliReqPubKey, this));
-	getCLI().addHandler(CLIMenuOpts::REQ_PENDING_MSGS, "Request for waiting messages", std::bind(&Client::onCliReqPendingMsgs, this));
-	getCLI().addHandler(CLIMenuOpts::SEND_TEXT, "Send a text message", std::bind(&Client::onCliSendTextMsg, this));
-	getCLI().addHandler(CLIMenuOpts::REQ_SYM_KEY, "Send a request for symmetric key", std::bind(&Client::onCliReqSymKey, this));
-	getCLI().addHandler(CLIMenuOpts::SEND_SYM_KEY, "Send your symmetric key", std::bind(&Client::onCliSendSymKey, this));
-	getCLI().addHandler(CLIMenuOpts::SEND_FILE, "Send a file", std::bind(&Client::onCliSendFile, this));
+	getCLI().addHandler(CLIMenuOpts::REGISTER, "Register", [this]() { onCliRegister(); });
+	getCLI().addHandler(CLIMenuOpts::REQ_CLIENT_LIST, "Request for clients list", [this]() { onCliReqClientList(); });
+	getCLI().addHandler(CLIMenuOpts::REQ_PUB_KEY, "Request for public key", [this]() { onCliReqPubKey(); });
+	getCLI().addHandler(CLIMenuOpts::REQ_PENDING_MSGS, "Request for waiting messages", [this]() { onCliReqPendingMsgs(); });
+	getCLI().addHandler(CLIMenuOpts::SEND_TEXT, "Send a text message", [this]() { onCliSendTextMsg(); });
+	getCLI().addHandler(CLIMenuOpts::REQ_SYM_KEY, "Send a request for symmetric key", [this]() { onCliReqSymKey(); });
+	getCLI().addHandler(CLIMenuOpts::SEND_SYM_KEY, "Send your symmetric key", [this]() { onCliSendSymKey(); });
+	getCLI().addHandler(CLIMenuOpts::SEND_FILE, "Send a file", [this]() { onCliSendFile(); });
+	getCLI().addHandler(CLIMenuOpts::SEND_MULTI_TEXT, "Send a text message to several users", [this]() { onCliSendMultiTextMsg(); });
+	getCLI().addHandler(CLIMenuOpts::CREATE_GROUP, "Create a group", [this]() { onCliCreateGroup(); });
+	getCLI().addHandler(CLIMenuOpts::SEND_GROUP_TEXT, "Send a text message to a group", [this]() { onCliSendGroupTextMsg(); });
+	getCLI().addHandler(CLIMenuOpts::RESEND_GROUP_KEY, "Send the key of a group again", [this]() { onCliResendGroupKey(); });
+	getCLI().addHandler(CLIMenuOpts::SHOW_STATS, "Show statistics", [this]() { onCliShowStats(); });
 	getCLI().addHandler(CLIMenuOpts::EXIT, "Exit client", []() {});
 }
 
@@ -53,51 +87,85 @@ void Client::onCliRegister()
 		throw std::logic_error("Error: Name length is '" + std::to_string(username.length()) + "' but the max is '" + std::to_string(Config::NAME_MAX_SZ) + "'");
 	}
 
-	// Creating a new RSA key pair.
-	RSAPrivateWrapper rsapriv;
-	std::string pubKey = rsapriv.getPublicKey();
+	// Creating a new key pair, X25519 from v4 on, it takes microseconds where an RSA key takes milliseconds.
+	auto keyType = Config::VERSION >= Protocol::VERSION_4 ? KeyTypes::X25519 : KeyTypes::RSA;
+	std::string pubKey;
+	std::string privKey;
+	if (keyType == KeyTypes::X25519) {
+		ECPrivateWrapper ecpriv;
+		pubKey = ecpriv.getPublicKey();
+		privKey = ecpriv.getPrivateKey();
+	}
+	else {
+		RSAPrivateWrapper rsapriv;
+		pubKey = rsapriv.getPublicKey();
+		privKey = rsapriv.getPrivateKey();
+	}
 
-	Request req{ getState().getUUIDUnhexed(),
+	Request req{ getUUIDUnhexed(),
 		RequestCodes::REGISTER,
 		std::make_unique<RegisterReqPayload>(username, pubKey) };
 
-	getConn().send(req);
-	auto res = getConn().recvResponse();
+	auto res = getConns().request(req);
+	bool isRegistered = res.getHeader().code == ResponseCodes::REG_OK;
 
 	// Getting the payload of the response, if the response is successful, save the user info to a file.
 	// Else, print the error message.
-	auto payloadVisitor = std::make_unique<ToStringVisitor>(getState());
-	res.getPayload().accept(*payloadVisitor);
-
-	if (res.getHeader().code == ResponseCodes::REG_OK) {
-		auto uuid = payloadVisitor->getString();
-
-		getState().setUsername(username);
-		getState().setPubKey(pubKey);
-		getState().setPrivKey(rsapriv.getPrivateKey());
-		getState().setUUID(uuid);
-		getState().saveToFile(Config::ME_DOT_INFO_PATH);
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		Metrics::Timer render{ MetricPhase::RENDER };
+		auto payloadVisitor = std::make_unique<ToStringVisitor>(getState());
+		std::visit(*payloadVisitor, res.getView());
+		render.stop();
+
+		if (isRegistered) {
+			auto uuid = payloadVisitor->getString();
+
+			getState().setUsername(username);
+			getState().setPubKey(pubKey);
+			getState().setPrivKey(privKey);
+			getState().setKeyType(keyType);
+			getState().setUUID(uuid);
+			getState().saveIdentity(Config::IDENTITY_PATH);
+			getState().openPeerStore(Config::PEERS_PATH);
+		}
+		else {
+			std::cout << payloadVisitor->getString() << "\n\n";
+		}
 	}
-	else {
-		std::cout << payloadVisitor->getString() << "\n\n";
+
+	// Now that the server knows us, start receiving messages in the background.
+	if (isRegistered) {
+		m_listener->start();
 	}
 }
 
 void Client::onCliReqClientList()
 {
-	Request req{ getState().getUUIDUnhexed(),
-		RequestCodes::USRS_LIST,
-		std::make_unique<UsersListReqPayload>() };
+	// Only ask for the clients that changed since the last request, the rest are already in the client state
+	std::string uuid;
+	uint64_t directoryVersion;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		directoryVersion = getState().getDirectoryVersion();
+	}
 
-	getConn().send(req);
-	auto res = getConn().recvResponse();
+	Request req{ uuid,
+		RequestCodes::USRS_DELTA,
+		std::make_unique<UsersDeltaReqPayload>(directoryVersion) };
 
-	// Visiting the payload using the ToStringVisitor to print the clients list and the ClientStateVisitor to update the client state.
+	auto res = getConns().request(req, ConnectionManager::Retry::ALWAYS);
+
+	// Visiting the payload using the ClientStateVisitor to update the client state and the ToStringVisitor to print the changes.
+	std::lock_guard<std::mutex> lock{ m_stateMutex };
 	auto stringVisitor = std::make_unique<ToStringVisitor>(getState());
 	auto stateVisitor = std::make_unique<ClientStateVisitor>(getState());
 
-	res.getPayload().accept(*stringVisitor);
-	res.getPayload().accept(*stateVisitor);
+	std::visit(*stateVisitor, res.getView());
+
+	Metrics::Timer render{ MetricPhase::RENDER };
+	std::visit(*stringVisitor, res.getView());
 
 	std::cout << stringVisitor->getString() << '\n';
 }
@@ -106,151 +174,560 @@ void Client::onCliReqPubKey()
 {
 	// Getting the target username from the user and extracting the target UUID from the client state.
 	auto targetUsername = getCLI().input("Enter a username: ");
-	auto targetUUID = getState().getUUID(targetUsername);
+	std::string uuid;
+	std::string targetUUID;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		targetUUID = getState().getUUID(targetUsername);
+	}
 
-	Request req{ getState().getUUIDUnhexed(),
+	Request req{ uuid,
 		RequestCodes::GET_PUB_KEY,
 		std::make_unique<GetPublicKeyReqPayload>(targetUUID) };
 
-	getConn().send(req);
-	auto res = getConn().recvResponse();
+	auto res = getConns().request(req, ConnectionManager::Retry::ALWAYS);
 
 	// Update the state with the public key of the target user.
+	std::lock_guard<std::mutex> lock{ m_stateMutex };
 	auto stateVisitor = std::make_unique<ClientStateVisitor>(getState());
-	res.getPayload().accept(*stateVisitor);
+	std::visit(*stateVisitor, res.getView());
+
+	// Two X25519 clients share a symmetric key as soon as each has the other's public key
+	if (getState().getKeyType() == KeyTypes::X25519 && getState().getKeyType(targetUsername) == KeyTypes::X25519) {
+		std::cout << "Symmetric key derived from the public key of '" << targetUsername << "'\n";
+	}
 }
 
 void Client::onCliReqPendingMsgs()
 {
-	Request req{ getState().getUUIDUnhexed(),
-		RequestCodes::POLL_MSGS,
+	auto uuid = getUUIDUnhexed();
+	Request req{ uuid,
+		RequestCodes::POLL_META,
 		std::make_unique<PollMessagesReqPayload>() };
 
-	getConn().send(req);
-	auto res = getConn().recvResponse();
-
-	// Visiting the payload using the ToStringVisitor to print the pending messages and the ClientStateVisitor to update the client state.
-	auto stringVisitor = std::make_unique<ToStringVisitor>(getState());
-	auto stateVisitor = std::make_unique<ClientStateVisitor>(getState());
-
-	res.getPayload().accept(*stateVisitor);
-	res.getPayload().accept(*stringVisitor);
-
-	std::cout << stringVisitor->getString() << '\n';
+	// The messages stay on the server until they are acknowledged, so the exchange is safe to run again.
+	// Messages that were handled before the connection broke are skipped when it does.
+	std::vector<uint32_t> doneIds;
+
+	getConns().exchange([&](Connection& conn) {
+		// Only the headers of the messages, the contents are fetched as the handler reads them.
+		conn.send(req);
+		auto res = conn.recvResponse();
+
+		if (res.getHeader().code != ResponseCodes::MSGS_META) {
+			std::lock_guard<std::mutex> lock{ m_stateMutex };
+			Metrics::Timer render{ MetricPhase::RENDER };
+			auto stringVisitor = std::make_unique<ToStringVisitor>(getState());
+			std::visit(*stringVisitor, res.getView());
+
+			std::cout << stringVisitor->getString() << '\n';
+			return;
+		}
+
+		MailboxReader reader{ conn, uuid, std::get<MessagesMetaView>(res.getView()), doneIds };
+		MessageHandler handler{ getState(), m_stateMutex, m_workers, Utils::workerCount() };
+
+		handler.handleAll(reader, std::cout);
+
+		// The messages leave the server once they were handled, one whose content couldn't be fetched stays for the next poll.
+		if (!doneIds.empty()) {
+			Request ack{ uuid,
+				RequestCodes::ACK_MSGS,
+				std::make_unique<AckMessagesReqPayload>(doneIds) };
+			conn.send(ack);
+			conn.recvResponse();
+		}
+	}, ConnectionManager::Retry::ALWAYS);
 }
 
 void Client::onCliSendTextMsg()
 {
 	// Getting the target username from the user and extracting the target UUID from the client state.
 	auto targetUsername = getCLI().input("Enter a username: ");
-	auto targetUUID = getState().getUUID(targetUsername);
 	
 	// Getting the message content from the user and the symmetric key from the client state.
 	auto msgContent = getCLI().input("Enter your message: ");
-	auto symKey = getState().getSymKey(targetUsername);
 
-	// If the symmetric key doesn't exist, throw an error.
-	if (!symKey) {
-		throw std::logic_error("Error: Can't get the symmetric key of '" + targetUsername + "' it doesn't exist yet");
+	// Get the cached cipher of the target (throws if there is no symmetric key yet).
+	std::string uuid;
+	std::string targetUUID;
+	std::shared_ptr<AESWrapper> cipher;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		targetUUID = getState().getUUID(targetUsername);
+		cipher = getState().getSymCipher(targetUsername);
 	}
 
-	// Encrypt the message content using the symmetric key and send it to the server.
-	auto symKeySz = symKey.value().size();
-	auto msgSz = msgContent.size();
-	AESWrapper aes(reinterpret_cast<const uint8_t*>(symKey.value().c_str()), static_cast<unsigned int>(symKeySz));
-	auto encryptedMsg = aes.encrypt(msgContent.c_str(), static_cast<unsigned int>(msgSz));
+	// Compress the message content if it is worth it, then encrypt it.
+	Metrics::Timer encrypt{ RequestCodes::SEND_MSG, MetricPhase::ENCRYPT };
+	uint8_t flags{ 0 };
+	auto plain = compressText(msgContent, flags);
+	auto encryptedMsg = encryptContent(*cipher, plain, flags);
+	encrypt.stop();
 
-	Request req{ getState().getUUIDUnhexed(),
+	Request req{ uuid,
 			RequestCodes::SEND_MSG,
-			std::make_unique<SendMessageReqPayload>(targetUUID, MessageTypes::SEND_TXT, encryptedMsg.size(), encryptedMsg) };
+			std::make_unique<SendMessageReqPayload>(targetUUID, MessageTypes::SEND_TXT, encryptedMsg.size(), std::move(encryptedMsg), flags) };
 
-	getConn().send(req);
-	getConn().recvResponse();
+	getConns().request(req);
 }
 
-void Client::onCliReqSymKey()
+void Client::onCliSendMultiTextMsg()
 {
-	// Getting the target username from the user and extracting the target UUID from the client state.
-	auto targetUsername = getCLI().input("Enter a username: ");
-	auto targetUUID = getState().getUUID(targetUsername);
+	// Getting the target usernames and the message content from the user.
+	auto targetUsernames = Utils::splitStr(getCLI().input("Enter usernames (comma separated): "), ',');
+	auto msgContent = getCLI().input("Enter your message: ");
 
-	// Send a request to the server to get the symmetric key of the target user.
-	Request req{ getState().getUUIDUnhexed(),
-			RequestCodes::SEND_MSG,
-			std::make_unique<SendMessageReqPayload>(targetUUID, MessageTypes::GET_SYM_KEY, 0, "") };
+	// Print the id the server gave to the message of every target.
+	auto res = sendTextToMany(targetUsernames, msgContent);
+	std::lock_guard<std::mutex> lock{ m_stateMutex };
+	Metrics::Timer render{ MetricPhase::RENDER };
+	auto stringVisitor = std::make_unique<ToStringVisitor>(getState());
+	std::visit(*stringVisitor, res.getView());
 
-	getConn().send(req);
-	getConn().recvResponse();
+	std::cout << stringVisitor->getString() << '\n';
 }
 
-void Client::onCliSendSymKey()
+void Client::onCliCreateGroup()
 {
-	// Getting the target username from the user and extracting the target UUID and public key from the client state.
-	auto targetUsername = getCLI().input("Enter a username: ");
-	auto targetUUID = getState().getUUID(targetUsername);
-	auto targetPubKey = getState().getPubKey(targetUsername);
+	// Getting the group name and its members from the user.
+	auto name = getCLI().input("Enter a group name: ");
+	if (name.empty() || name.length() >= Config::NAME_MAX_SZ) {
+		throw std::logic_error("Error: Group name length is '" + std::to_string(name.length()) + "' but it should be between 1 and '" + std::to_string(Config::NAME_MAX_SZ - 1) + "'");
+	}
+	auto memberUsernames = Utils::splitStr(getCLI().input("Enter usernames (comma separated): "), ',');
+
+	// A group is found by its name, so the name of a group of ours is never shared with another group
+	std::string uuid;
+	std::vector<std::string> memberIds;
+	std::vector<member_key_t> memberKeys;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		if (getState().hasGroup(name)) {
+			throw std::logic_error("Error: There is already a group named '" + name + "'");
+		}
+		uuid = getState().getUUIDUnhexed();
+		collectMemberKeys(memberUsernames, memberIds, memberKeys);
+	}
+
+	// Generate the key of the group.
+	unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
+	AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH);
+	std::string groupKey(std::begin(key), std::end(key));
+
+	Request req{ uuid,
+		RequestCodes::CREATE_GROUP,
+		std::make_unique<CreateGroupReqPayload>(name, memberIds) };
 
-	// If the public key doesn't exist, throw an error.
-	if (!targetPubKey) {
-		throw std::logic_error("Error: Can't get the public key of '" + targetUsername + "' it doesn't exist yet");
+	auto res = getConns().request(req);
+	if (res.getHeader().code != ResponseCodes::GROUP_CREATED) {
+		throw std::runtime_error("Error: Failed creating group '" + name + "'");
 	}
+	auto groupId = std::get<GroupCreatedView>(res.getView()).groupId;
 
-	// If the symmetric key doesn't exist, generate a new one and save it to the client state.
-	if (!getState().getSymKey(targetUsername)) {
-		unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
-		AESWrapper aes(AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH), AESWrapper::DEFAULT_KEYLENGTH);
-		std::string symKey;
-		symKey.resize(AESWrapper::DEFAULT_KEYLENGTH);
-		std::copy(std::begin(key), std::end(key), symKey.begin());
+	// The group is kept before its key goes out, so the owner can send the key again if that fails
+	std::string groupName;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		groupName = getState().setGroupKey(groupId, name, uuid, groupKey);
+	}
+	std::cout << "Group '" << groupName << "' created with ID " << groupId << '\n';
+	sendGroupKey(uuid, groupId, name, groupKey, memberIds, memberKeys);
+}
 
-		getState().setSymKey(targetUsername, symKey);
+void Client::onCliResendGroupKey()
+{
+	// The owner sends the same key again, to a member that lost it or that the key didn't reach, the messages sent so far stay readable
+	auto name = getCLI().input("Enter a group name: ");
+	auto memberUsernames = Utils::splitStr(getCLI().input("Enter usernames (comma separated): "), ',');
+
+	std::string uuid;
+	uint32_t groupId;
+	std::string groupKey;
+	std::vector<std::string> memberIds;
+	std::vector<member_key_t> memberKeys;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		groupId = getState().getGroupId(name);
+		if (getState().getGroupOwner(groupId) != uuid) {
+			throw std::logic_error("Error: Only the owner of group '" + name + "' can send its key");
+		}
+		groupKey = getState().getGroupKey(groupId);
+		collectMemberKeys(memberUsernames, memberIds, memberKeys);
 	}
 
-	// Encrypt the symmetric key using the target user's public key and send it to the server.
-	auto symKey = getState().getSymKey(targetUsername).value();
-	auto rsaPub = RSAPublicWrapper(targetPubKey.value());
-	auto encryptedSymKey = rsaPub.encrypt(symKey);
+	sendGroupKey(uuid, groupId, name, groupKey, memberIds, memberKeys);
+}
 
-	Request req{ getState().getUUIDUnhexed(),
-			RequestCodes::SEND_MSG,
-			std::make_unique<SendMessageReqPayload>(targetUUID, MessageTypes::SEND_SYM_KEY, encryptedSymKey.size(), encryptedSymKey) };
+void Client::collectMemberKeys(const std::vector<std::string>& memberUsernames, std::vector<std::string>& outIds, std::vector<member_key_t>& outKeys)
+{
+	// Every member needs a public key, the group key is wrapped once for each of them.
+	// An X25519 member gets the key under the symmetric key it shares with us instead, so it needs that key.
+	for (const auto& memberUsername : memberUsernames) {
+		if (!getState().getPubKey(memberUsername)) {
+			throw std::logic_error("Error: Can't get the public key of '" + memberUsername + "' it doesn't exist yet");
+		}
+		if (getState().getKeyType(memberUsername) == KeyTypes::X25519) {
+			if (!getState().hasSymKey(memberUsername)) {
+				throw std::logic_error("Error: Can't send the group key to '" + memberUsername + "' there is no symmetric key with it yet");
+			}
+			outKeys.emplace_back(getState().getSymCipher(memberUsername));
+		}
+		else {
+			outKeys.emplace_back(getState().getRSAPublic(memberUsername));
+		}
+		outIds.push_back(getState().getUUID(memberUsername));
+	}
+}
+
+void Client::sendGroupKey(const std::string& uuid, uint32_t groupId, const std::string& name, const std::string& groupKey,
+	const std::vector<std::string>& memberIds, const std::vector<member_key_t>& memberKeys)
+{
+	// The members learn the group ID and name with the key, all the keys go out in one frame.
+	std::vector<uint8_t> prefix(Protocol::GroupKeyPrefix::SIZE);
+	Protocol::GroupKeyPrefix::encode(prefix.data(), groupId, name);
+	auto payload = std::make_unique<MultiMessageReqPayload>();
+	for (size_t i = 0; i < memberIds.size(); i++) {
+		std::string content(prefix.begin(), prefix.end());
+		uint8_t flags{ 0 };
+		if (auto cipher = std::get_if<std::shared_ptr<AESWrapper>>(&memberKeys[i])) {
+			content += encryptContent(**cipher, groupKey, flags);
+		}
+		else {
+			content += std::get<std::shared_ptr<RSAPublicWrapper>>(memberKeys[i])->encrypt(groupKey);
+		}
+
+		if (!payload->addMessage(memberIds[i], MessageTypes::SEND_GROUP_KEY, std::move(content), flags)) {
+			throw std::length_error("Error: The group has too many members to send its key at once");
+		}
+	}
+
+	Request keysReq{ uuid,
+		RequestCodes::SEND_MULTI_MSG,
+		std::move(payload) };
+	auto res = getConns().request(keysReq);
+
+	// The server refuses all the keys if any target isn't a member of the group
+	if (res.getHeader().code != ResponseCodes::MULTI_MSG_SEND) {
+		throw std::runtime_error("Error: Failed sending the key of group '" + name + "'");
+	}
+	std::cout << "Key of group '" << name << "' sent to " << memberIds.size() << " members\n";
+}
+
+void Client::onCliSendGroupTextMsg()
+{
+	// Getting the group name from the user and extracting the group ID from the client state.
+	auto groupName = getCLI().input("Enter a group name: ");
+	auto msgContent = getCLI().input("Enter your message: ");
+
+	std::string uuid;
+	uint32_t groupId;
+	std::shared_ptr<AESWrapper> cipher;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		groupId = getState().getGroupId(groupName);
+		cipher = getState().getGroupCipher(groupId);
+	}
+
+	// The text is compressed and encrypted once with the key of the group, the server delivers it to every member.
+	Metrics::Timer encrypt{ RequestCodes::SEND_GROUP_MSG, MetricPhase::ENCRYPT };
+	uint8_t flags{ 0 };
+	auto plain = compressText(msgContent, flags);
+	auto encryptedMsg = encryptContent(*cipher, plain, flags);
+	encrypt.stop();
+
+	Request req{ uuid,
+			RequestCodes::SEND_GROUP_MSG,
+			std::make_unique<SendGroupMessageReqPayload>(groupId, MessageTypes::SEND_GROUP_TXT, std::move(encryptedMsg), flags) };
+
+	auto res = getConns().request(req);
+	std::lock_guard<std::mutex> lock{ m_stateMutex };
+	Metrics::Timer render{ MetricPhase::RENDER };
+	auto stringVisitor = std::make_unique<ToStringVisitor>(getState());
+	std::visit(*stringVisitor, res.getView());
+
+	std::cout << stringVisitor->getString() << '\n';
+}
+
+Response Client::sendTextToMany(const std::vector<std::string>& targetUsernames, const std::string& text)
+{
+	auto payload = std::make_unique<MultiMessageReqPayload>();
+
+	// Get the UUID and cached cipher of every target (throws if a target has no symmetric key yet).
+	std::string uuid;
+	std::vector<std::pair<std::string, std::shared_ptr<AESWrapper>>> targets;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		for (const auto& targetUsername : targetUsernames) {
+			targets.emplace_back(getState().getUUID(targetUsername), getState().getSymCipher(targetUsername));
+		}
+	}
+
+	// The text is compressed once, every target then gets it encrypted with its own key.
+	Metrics::Timer encrypt{ RequestCodes::SEND_MULTI_MSG, MetricPhase::ENCRYPT };
+	uint8_t flags{ 0 };
+	auto plain = compressText(text, flags);
+	for (const auto& [targetUUID, cipher] : targets) {
+		uint8_t targetFlags{ flags };
+		auto encryptedMsg = encryptContent(*cipher, plain, targetFlags);
+
+		if (!payload->addMessage(targetUUID, MessageTypes::SEND_TXT, std::move(encryptedMsg), targetFlags)) {
+			throw std::length_error("Error: The message is too large to be sent to all of the users at once");
+		}
+	}
+	encrypt.stop();
+
+	// All the messages go out in one frame and are answered by one response.
+	Request req{ uuid,
+			RequestCodes::SEND_MULTI_MSG,
+			std::move(payload) };
+
+	return getConns().request(req);
+}
+
+std::string Client::compressText(const std::string& text, uint8_t& outFlags)
+{
+	if (!IS_COMPRESSING) {
+		return text;
+	}
+
+	auto compressed = DeflateWrapper::compress(text.data(), text.size());
+	if (!compressed) {
+		return text;
+	}
+
+	outFlags |= MessageFlags::COMPRESSED;
+	return std::move(*compressed);
+}
 
-	getConn().send(req);
-	getConn().recvResponse();
+std::string Client::encryptContent(AESWrapper& cipher, const std::string& plain, uint8_t& outFlags)
+{
+	if (!IS_GCM) {
+		return cipher.encrypt(plain.c_str(), static_cast<unsigned int>(plain.size()));
+	}
+
+	outFlags |= MessageFlags::GCM;
+	return cipher.encrypt(plain.data(), plain.size(), AESWrapper::Mode::GCM);
+}
+
+void Client::onCliReqSymKey()
+{
+	// Getting the target usernames from the user, several users can be asked at once.
+	auto targetUsernames = Utils::splitStr(getCLI().input("Enter usernames (comma separated): "), ',');
+
+	std::string uuid;
+	std::vector<std::string> targetUUIDs;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		for (const auto& targetUsername : targetUsernames) {
+			targetUUIDs.push_back(getState().getUUID(targetUsername));
+		}
+	}
+
+	getConns().exchange([&](Connection& conn) {
+		// Build a request for the symmetric key of each target user, again on every attempt since sending consumes them.
+		std::vector<Connection::request_ptr_t> reqs;
+		for (const auto& targetUUID : targetUUIDs) {
+			reqs.push_back(std::make_unique<Request>(uuid,
+				RequestCodes::SEND_MSG,
+				std::make_unique<SendMessageReqPayload>(targetUUID, MessageTypes::GET_SYM_KEY, 0, "")));
+		}
+
+		// Send the requests back to back, so the whole burst costs about a single round trip.
+		conn.sendPipelined(std::move(reqs));
+	});
+}
+
+void Client::onCliSendSymKey()
+{
+	// Getting the target usernames from the user, the key can be sent to several users at once.
+	auto targetUsernames = Utils::splitStr(getCLI().input("Enter usernames (comma separated): "), ',');
+	std::vector<std::pair<std::string, std::string>> encryptedKeys; // Target UUID and the key encrypted for it
+
+	// The keys are generated and wrapped under the state lock, they are sent without it
+	std::unique_lock<std::mutex> lock{ m_stateMutex };
+	auto uuid = getState().getUUIDUnhexed();
+	for (const auto& targetUsername : targetUsernames) {
+		// Extracting the target UUID and public key from the client state.
+		auto targetUUID = getState().getUUID(targetUsername);
+		auto targetPubKey = getState().getPubKey(targetUsername);
+
+		// If the public key doesn't exist, throw an error.
+		if (!targetPubKey) {
+			throw std::logic_error("Error: Can't get the public key of '" + targetUsername + "' it doesn't exist yet");
+		}
+
+		// An X25519 target derives the same key from our public key, so nothing is sent to it.
+		if (getState().getKeyType(targetUsername) == KeyTypes::X25519) {
+			getState().setSymKey(targetUsername, getState().deriveSymKey(targetUsername));
+			std::cout << "Symmetric key derived from the public key of '" << targetUsername << "'\n";
+			continue;
+		}
+
+		// If the symmetric key doesn't exist, generate a new one and save it to the client state.
+		if (!getState().getSymKey(targetUsername)) {
+			unsigned char key[AESWrapper::DEFAULT_KEYLENGTH];
+			AESWrapper aes(AESWrapper::GenerateKey(key, AESWrapper::DEFAULT_KEYLENGTH), AESWrapper::DEFAULT_KEYLENGTH);
+			std::string symKey;
+			symKey.resize(AESWrapper::DEFAULT_KEYLENGTH);
+			std::copy(std::begin(key), std::end(key), symKey.begin());
+
+			getState().setSymKey(targetUsername, symKey);
+		}
+
+		// Encrypt the symmetric key using the target user's (cached) public key.
+		auto symKey = getState().getSymKey(targetUsername).value();
+		auto encryptedSymKey = getState().getRSAPublic(targetUsername)->encrypt(symKey);
+
+		encryptedKeys.emplace_back(targetUUID, std::move(encryptedSymKey));
+	}
+	lock.unlock();
+
+	if (encryptedKeys.empty()) {
+		return;
+	}
+
+	getConns().exchange([&](Connection& conn) {
+		std::vector<Connection::request_ptr_t> reqs;
+		for (const auto& [targetUUID, encryptedSymKey] : encryptedKeys) {
+			reqs.push_back(std::make_unique<Request>(uuid,
+				RequestCodes::SEND_MSG,
+				std::make_unique<SendMessageReqPayload>(targetUUID, MessageTypes::SEND_SYM_KEY, encryptedSymKey.size(), encryptedSymKey)));
+		}
+
+		// Send the keys back to back, so the whole burst costs about a single round trip.
+		conn.sendPipelined(std::move(reqs));
+	});
 }
 
 void Client::onCliSendFile()
 {
 	// Getting the target username from the user and extracting the target UUID and symmetric key from the client state.
 	auto targetUsername = getCLI().input("Enter a username: ");
-	auto targetUUID = getState().getUUID(targetUsername);
 
 	// Getting the file path from the user and the symmetric key from the client state.
 	auto path = getCLI().input("Enter file path: ");
-	auto symKey = getState().getSymKey(targetUsername);
 
-	// If the symmetric key doesn't exist, throw an error.
-	if (!symKey) {
-		throw std::logic_error("Error: Can't get the symmetric key of '" + targetUsername + "' it doesn't exist yet");
+	// Get the cached cipher of the target, throws if there is no symmetric key yet.
+	std::string uuid;
+	std::string targetUUID;
+	std::shared_ptr<AESWrapper> cipher;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		uuid = getState().getUUIDUnhexed();
+		targetUUID = getState().getUUID(targetUsername);
+		cipher = getState().getSymCipher(targetUsername);
 	}
 
-	// Read the file content and encrypt it using the symmetric key and send it to the server.
-	std::ifstream file{ path, std::ios::binary | std::ios::beg };
-	std::stringstream ss;
+	std::ifstream sample{ path, std::ios::binary };
+	if (!sample.is_open()) {
+		throw std::runtime_error("Error: Could not open '" + path + "'");
+	}
+
+	// Compress the file only if its first block compresses, already compressed files are sent as they are.
+	// The compressed size has to be declared up front, so a compressed file is read twice: once to measure it and once to send it.
+	std::vector<char> block(Config::FILE_BLOCK_SZ);
+	uint64_t plainSz = std::filesystem::file_size(path);
+	uint8_t flags{ 0 };
+	if (IS_COMPRESSING) {
+		sample.read(block.data(), block.size());
+		if (DeflateWrapper::isCompressible(block.data(), static_cast<size_t>(sample.gcount()))) {
+			sample.clear();
+			sample.seekg(0);
+			plainSz = DeflateWrapper::compressedSize(sample);
+			flags |= MessageFlags::COMPRESSED;
+		}
+	}
+	sample.close();
 
-	ss << file.rdbuf();
-	auto msgContent = ss.str();
-	auto symKeySz = symKey.value().size();
-	auto msgSz = msgContent.size();
-	AESWrapper aes(reinterpret_cast<const uint8_t*>(symKey.value().c_str()), static_cast<unsigned int>(symKeySz));
-	auto encryptedMsg = aes.encrypt(msgContent.c_str(), static_cast<unsigned int>(msgSz));
+	// The cipher text size of both modes is known up front, so it can be declared in the header before the content is encrypted.
+	auto mode = IS_GCM ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+	if (mode == AESWrapper::Mode::GCM) {
+		flags |= MessageFlags::GCM;
+	}
+	// A content past the 32 bit payload size can't be stored by the server, so it is refused before anything is sent.
+	auto cipherSz = AESWrapper::cipherSize(plainSz, mode);
+	if (!StreamedMessageReqPayload::fits(cipherSz)) {
+		throw std::runtime_error("Error: '" + path + "' is too large to send, a message holds up to 4 GiB");
+	}
 
-	Request req{ getState().getUUIDUnhexed(),
+	Request req{ uuid,
 			RequestCodes::SEND_MSG,
-			std::make_unique<SendMessageReqPayload>(targetUUID, MessageTypes::SEND_FILE, encryptedMsg.size(), encryptedMsg) };
+			std::make_unique<StreamedMessageReqPayload>(targetUUID, MessageTypes::SEND_FILE, cipherSz, flags) };
+
+	getConns().exchange([&](Connection& conn) {
+		// Open the file, the content is encrypted and sent block by block so the file is never loaded as a whole.
+		// The upload isn't repeated once it started, the recipient would get the file twice.
+		std::ifstream file{ path, std::ios::binary };
+		if (!file.is_open()) {
+			throw std::runtime_error("Error: Could not open '" + path + "'");
+		}
+
+		// GCM segments are sealed on the worker threads, a few at a time
+		AESWrapper::Encryptor encryptor(*cipher, mode, &m_workers, Utils::workerCount());
+		DeflateWrapper::Compressor compressor;
+		std::string compressed;
+		bool isDone{ false };
+
+		// Only the compression and encryption are timed, the file reads and the writes to the socket interleave with them
+		Metrics::Timer encrypt{ RequestCodes::SEND_MSG, MetricPhase::ENCRYPT, false };
+
+		conn.sendStreamed(req, cipherSz, [&](std::string& out) {
+			out.clear();
+			if (isDone) {
+				return false;
+			}
+
+			// Read the next block, compress and encrypt it, the last (short) block also flushes the compressor and the padding.
+			file.read(block.data(), block.size());
+			if (file.bad()) {
+				throw std::runtime_error("Error: Failed reading '" + path + "'");
+			}
+
+			auto readSz = static_cast<size_t>(file.gcount());
+			bool isLast = readSz < block.size();
+			encrypt.resume();
+			if (flags & MessageFlags::COMPRESSED) {
+				compressed.clear();
+				compressor.update(block.data(), readSz, compressed);
+				if (isLast) {
+					compressor.final(compressed);
+				}
+				encryptor.update(compressed.data(), compressed.size(), out);
+			}
+			else {
+				encryptor.update(block.data(), readSz, out);
+			}
+
+			if (isLast) {
+				encryptor.final(out);
+				isDone = true;
+			}
+			encrypt.pause();
+
+			return true;
+		});
+		conn.recvResponse();
+	});
+}
 
-	getConn().send(req);
-	getConn().recvResponse();
+void Client::onCliShowStats()
+{
+	// The statistics are lock free, so this doesn't wait for the push listener
+	Metrics::print(std::cout);
+	Metrics::dump();
+}
+
+std::string Client::getUUIDUnhexed()
+{
+	std::lock_guard<std::mutex> lock{ m_stateMutex };
+	return getState().getUUIDUnhexed();
 }
 
 CLI& Client::getCLI()
@@ -258,7 +735,7 @@ CLI& Client::getCLI()
 	return *m_cli;
 }
 
-Connection& Client::getConn()
+ConnectionManager& Client::getConns()
 {
 	return *m_conn;
 }
@@ -270,14 +747,54 @@ ClientState& Client::getState()
 
 Client::~Client() = default;
 
-ClientState::ClientState(const std::filesystem::path& path)
+ClientState::ClientState(const std::filesystem::path& path, const std::filesystem::path& legacyPath)
 {
 	// Check if the file exists, if it does, load the client state from it.
 	if (std::filesystem::exists(path)) {
-		loadFromFile(path);
+		loadIdentity(path);
+	}
+	else if (!legacyPath.empty() && std::filesystem::exists(legacyPath)) {
+		// A client of an older version, move it to the identity file once (the text file is left as it is)
+		loadFromFile(legacyPath);
+		saveIdentity(path);
+	}
+}
+
+namespace {
+	constexpr uint32_t IDENTITY_MAGIC = 0x4449554d; // "MUID"
+	constexpr uint16_t IDENTITY_FORMAT_VERSION = 1;
+
+	// Fixed-size start of the identity file, the BER private key follows it
+	struct IdentityHeader {
+		uint32_t magic;
+		uint16_t formatVersion;
+		uint8_t nameSz;
+		uint8_t keyType; // KeyTypes of the key pair, the files of older clients have 0 (RSA) here
+		uint32_t privKeySz;
+		uint8_t name[Config::NAME_MAX_SZ];
+		uint8_t uuid[Config::CLIENT_ID_SZ]; // Raw UUID
+		RSAPrivateWrapper::Params keyParams; // The RSA private key, ready to use without parsing it, unused for an X25519 key
+	};
+
+	// Builds the cached entry of a client that was read from the peer store
+	ClientState::ClientEntry toEntry(PeerStore::Peer& peer) {
+		ClientState::ClientEntry entry;
+		entry.uuid = peer.uuid;
+		entry.pubKey = std::move(peer.pubKey);
+		entry.keyType = peer.keyType;
+		entry.symKey = std::move(peer.symKey);
+		entry.identityKey = std::move(peer.identityKey);
+		return entry;
+	}
+
+	// Builds the cached entry of a group that was read from the peer store
+	ClientState::GroupEntry toGroupEntry(PeerStore::Group& group) {
+		return { std::move(group.name), std::move(group.owner), std::move(group.key), nullptr };
 	}
 }
 
+ClientState::~ClientState() = default;
+
 void ClientState::loadFromFile(const std::filesystem::path& path)
 {
 	m_isInitialized = true;
@@ -322,19 +839,95 @@ void ClientState::loadFromFile(const std::filesystem::path& path)
 	setPrivKey(decodedKey);
 }
 
-void ClientState::saveToFile(const std::filesystem::path& path)
+void ClientState::loadIdentity(const std::filesystem::path& path)
 {
 	m_isInitialized = true;
-	std::ofstream out{ path };
+	std::ifstream in{ path, std::ios::binary };
 
-	if (!out.is_open()) {
+	if (!in.is_open()) {
 		throw std::runtime_error("Error: Failed to load client state from '" + path.filename().string() + "'");
 	}
 
-	// Write the username, hexed uuid and private key to the file.
-	out << getUsername() << std::endl;
-	out << getUUID() << std::endl;
-	out << Base64Wrapper::encode(getPrivKey());
+	IdentityHeader header;
+	in.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!in || header.magic != IDENTITY_MAGIC || header.formatVersion != IDENTITY_FORMAT_VERSION) {
+		throw std::runtime_error("Error: Could not load '" + path.filename().string() + "' it is not an identity file of this version");
+	}
+
+	if (header.nameSz == 0 || header.privKeySz == 0) {
+		throw std::runtime_error("Error: Could not load '" + path.filename().string() + "' name or private key is missing");
+	}
+
+	if (header.keyType != static_cast<uint8_t>(KeyTypes::RSA) && header.keyType != static_cast<uint8_t>(KeyTypes::X25519)) {
+		throw std::runtime_error("Error: Could not load '" + path.filename().string() + "' key type '" + std::to_string(header.keyType) + "' is unknown");
+	}
+
+	// The BER private key is kept as is, the peer store key is derived from it
+	std::string privKey(header.privKeySz, '\0');
+	if (!in.read(privKey.data(), privKey.size())) {
+		throw std::runtime_error("Error: Could not load '" + path.filename().string() + "' private key is truncated");
+	}
+
+	setUsername(std::string(reinterpret_cast<const char*>(header.name), header.nameSz));
+	setUUID(boost::algorithm::hex(std::string(reinterpret_cast<const char*>(header.uuid), Config::CLIENT_ID_SZ)));
+	setPrivKey(privKey);
+	setKeyType(static_cast<KeyTypes>(header.keyType));
+
+	// Restore the key from its parameters, so the first decrypt doesn't have to parse the BER key (an X25519 key is raw already)
+	if (getKeyType() == KeyTypes::RSA) {
+		m_rsaPriv = std::make_shared<RSAPrivateWrapper>(header.keyParams);
+	}
+}
+
+void ClientState::saveIdentity(const std::filesystem::path& path)
+{
+	m_isInitialized = true;
+
+	IdentityHeader header{};
+	header.magic = IDENTITY_MAGIC;
+	header.formatVersion = IDENTITY_FORMAT_VERSION;
+	header.nameSz = static_cast<uint8_t>(getUsername().size());
+	header.keyType = static_cast<uint8_t>(getKeyType());
+	header.privKeySz = static_cast<uint32_t>(getPrivKey().size());
+	std::copy(getUsername().begin(), getUsername().end(), header.name);
+
+	auto uuid = getUUIDUnhexed();
+	std::copy(uuid.begin(), uuid.end(), header.uuid);
+	if (getKeyType() == KeyTypes::RSA) {
+		header.keyParams = getRSAPrivate()->getParams();
+	}
+
+	// Write a new file and move it over the old one, so a failed write never leaves a broken identity behind
+	auto tmpPath = path;
+	tmpPath += ".tmp";
+	{
+		std::ofstream out{ tmpPath, std::ios::binary | std::ios::trunc };
+
+		if (!out.is_open()) {
+			throw std::runtime_error("Error: Failed to save client state to '" + tmpPath.filename().string() + "'");
+		}
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(getPrivKey().data(), getPrivKey().size());
+
+		if (!out) {
+			throw std::runtime_error("Error: Failed to save client state to '" + tmpPath.filename().string() + "'");
+		}
+	}
+
+	std::filesystem::rename(tmpPath, path);
+}
+
+void ClientState::openPeerStore(const std::filesystem::path& path)
+{
+	// The cached clients belong to the previous store (or to none), from now on they are read from this one
+	m_nameToClient.clear();
+	m_uuidToName.clear();
+	m_groups.clear();
+	m_groupNameToId.clear();
+	m_peers = std::make_unique<PeerStore>(path, getUUIDUnhexed(), getPrivKey());
+	m_directoryVersion = m_peers->getDirectoryVersion();
 }
 
 bool ClientState::isInitialized()
@@ -344,25 +937,25 @@ bool ClientState::isInitialized()
 
 bool ClientState::hasSymKey(const std::string& username)
 {
-	return true;
+	return getClient(username).symKey.has_value();
 }
 
 std::string ClientState::getNameByUUID(const std::string& uuid)
 {
 	// Find the username by the uuid.
-	auto iter = m_uuidToName.find(uuid);
+	auto name = findName(uuid);
 	// If the uuid doesn't exist, throw an error.
-	if (iter == m_uuidToName.end()) {
+	if (!name) {
 		throw std::runtime_error("Error: Can't find user with uuid='" + uuid + "'");
 	}
 
-	return iter->second;
+	return *name;
 }
 
 void ClientState::addClient(const std::string& name, const std::string& uuid)
 {
 	// If the client already exists, return.
-	if (m_nameToClient.find(name) != m_nameToClient.end()) {
+	if (findClient(name)) {
 		return;
 	}
 
@@ -372,6 +965,65 @@ void ClientState::addClient(const std::string& name, const std::string& uuid)
 
 	m_nameToClient.insert({ name, other });
 	m_uuidToName.insert({ other.uuid, name });
+
+	if (m_peers) {
+		m_peers->put(name, uuid);
+	}
+}
+
+void ClientState::updateClient(const std::string& name, const std::string& uuid)
+{
+	// Bring both the client with the uuid and the one with the name from the peer store, so the maps below see them
+	findName(uuid);
+	findClient(name);
+
+	ClientEntry entry;
+	entry.uuid = uuid;
+
+	auto byUUID = m_uuidToName.find(uuid);
+	if (byUUID != m_uuidToName.end()) {
+		// A known client that changed keeps its symmetric key, its public key may be the one that changed
+		auto node = m_nameToClient.extract(byUUID->second);
+		entry = std::move(node.mapped());
+		entry.pubKey.reset();
+		entry.keyType = {};
+		entry.rsaPub.reset();
+		m_uuidToName.erase(byUUID);
+	}
+
+	// If the name now belongs to another client, the old client is gone
+	auto byName = m_nameToClient.find(name);
+	if (byName != m_nameToClient.end()) {
+		m_uuidToName.erase(byName->second.uuid);
+		m_nameToClient.erase(byName);
+	}
+
+	m_uuidToName.insert({ uuid, name });
+	m_nameToClient.insert({ name, std::move(entry) });
+
+	if (m_peers) {
+		m_peers->put(name, uuid);
+	}
+}
+
+size_t ClientState::getClientsCount()
+{
+	// With a peer store only some of the clients are cached
+	return m_peers ? m_peers->getCount() : m_nameToClient.size();
+}
+
+uint64_t ClientState::getDirectoryVersion()
+{
+	return m_directoryVersion;
+}
+
+void ClientState::setDirectoryVersion(uint64_t version)
+{
+	m_directoryVersion = version;
+
+	if (m_peers) {
+		m_peers->setDirectoryVersion(version);
+	}
 }
 
 void ClientState::setUsername(const std::string& username)
@@ -392,22 +1044,53 @@ void ClientState::setPubKey(const std::string& pubKey)
 	m_store[ClientStateKeys::PUB_KEY] = pubKey;
 }
 
-void ClientState::setPubKey(const std::string& username, const std::string& pubKey)
+void ClientState::setPubKey(const std::string& username, const std::string& pubKey, KeyTypes keyType)
 {
-	// Set the public key for another client
-	getClient(username).pubKey = pubKey;
+	// Set the public key for another client, the parsed key is rebuilt on next use
+	auto& client = getClient(username);
+
+	// The identity key is pinned the first time it is seen. A later key (or a key of another type) that it didn't sign
+	// is the server (or someone in between) swapping the client's key, so it is refused
+	if (keyType == KeyTypes::X25519 || client.identityKey) {
+		auto identityKey = keyType == KeyTypes::X25519 ? ECPublicWrapper{ pubKey }.getIdentityKey() : std::string();
+		if (client.identityKey && client.identityKey != identityKey) {
+			throw std::runtime_error("Error: The identity key of '" + username + "' changed since it was first seen, its new public key is refused");
+		}
+		client.identityKey = identityKey;
+	}
+
+	client.pubKey = pubKey;
+	client.keyType = keyType;
+	client.rsaPub.reset();
+
+	if (m_peers) {
+		m_peers->setPubKey(username, pubKey, keyType);
+	}
+}
+
+void ClientState::setKeyType(KeyTypes keyType)
+{
+	m_keyType = keyType;
 }
 
 void ClientState::setPrivKey(const std::string& privKey)
 {
-	// Set the private key of the current client
+	// Set the private key of the current client, the parsed key is rebuilt on next use
 	m_store[ClientStateKeys::PRIV_KEY] = privKey;
+	m_rsaPriv.reset();
+	m_ecPriv.reset();
 }
 
 void ClientState::setSymKey(const std::string& username, const std::string& symKey)
 {
-	// Set the symmetric key for another client
-	getClient(username).symKey = symKey;
+	// Set the symmetric key for another client, the cipher is rebuilt on next use
+	auto& client = getClient(username);
+	client.symKey = symKey;
+	client.cipher.reset();
+
+	if (m_peers) {
+		m_peers->setSymKey(username, symKey);
+	}
 }
 
 const std::string& ClientState::getUsername()
@@ -464,20 +1147,281 @@ const std::string& ClientState::getPrivKey()
 	return m_store[ClientStateKeys::PRIV_KEY];
 }
 
+KeyTypes ClientState::getKeyType()
+{
+	return m_keyType;
+}
+
+KeyTypes ClientState::getKeyType(const std::string& username)
+{
+	return getClient(username).keyType;
+}
+
 const std::optional<std::string>& ClientState::getSymKey(const std::string& username)
 {
 	// Get the symmetric key of another client
 	return getClient(username).symKey;
 }
 
+std::shared_ptr<RSAPublicWrapper> ClientState::getRSAPublic(const std::string& username)
+{
+	auto& client = getClient(username);
+	if (!client.pubKey) {
+		throw std::logic_error("Error: Can't get the public key of '" + username + "' it doesn't exist yet");
+	}
+
+	if (client.keyType != KeyTypes::RSA) {
+		throw std::logic_error("Error: The public key of '" + username + "' isn't an RSA key");
+	}
+
+	// Parse the key once, later messages to the same client reuse it
+	if (!client.rsaPub) {
+		client.rsaPub = std::make_shared<RSAPublicWrapper>(client.pubKey.value());
+	}
+
+	return client.rsaPub;
+}
+
+std::shared_ptr<RSAPrivateWrapper> ClientState::getRSAPrivate()
+{
+	// Parse the key once, it is only replaced on registration
+	if (!m_rsaPriv) {
+		m_rsaPriv = std::make_shared<RSAPrivateWrapper>(getPrivKey());
+	}
+
+	return m_rsaPriv;
+}
+
+std::shared_ptr<ECPrivateWrapper> ClientState::getECPrivate()
+{
+	if (getKeyType() != KeyTypes::X25519) {
+		throw std::logic_error("Error: The private key isn't an X25519 key");
+	}
+
+	// Same as the RSA key, restored once
+	if (!m_ecPriv) {
+		m_ecPriv = std::make_shared<ECPrivateWrapper>(getPrivKey());
+	}
+
+	return m_ecPriv;
+}
+
+std::string ClientState::deriveSymKey(const std::string& username)
+{
+	auto& client = getClient(username);
+	if (!client.pubKey) {
+		throw std::logic_error("Error: Can't get the public key of '" + username + "' it doesn't exist yet");
+	}
+
+	if (getKeyType() != KeyTypes::X25519 || client.keyType != KeyTypes::X25519) {
+		throw std::logic_error("Error: Can't derive a symmetric key with '" + username + "' both clients need an X25519 key");
+	}
+
+	// Both clients salt with the two UUIDs in the same order, so they end up with the same key
+	ECPublicWrapper peer{ client.pubKey.value() };
+	auto ownUUID = getUUIDUnhexed();
+	auto salt = std::min(ownUUID, client.uuid) + std::max(ownUUID, client.uuid);
+	return getECPrivate()->deriveSymKey(peer, salt, AESWrapper::DEFAULT_KEYLENGTH);
+}
+
+std::shared_ptr<AESWrapper> ClientState::getSymCipher(const std::string& username)
+{
+	auto& client = getClient(username);
+	if (!client.symKey) {
+		throw std::logic_error("Error: Can't get the symmetric key of '" + username + "' it doesn't exist yet");
+	}
+
+	// Expand the key schedule once, later messages with the same client reuse it
+	if (!client.cipher) {
+		const auto& symKey = client.symKey.value();
+		client.cipher = std::make_shared<AESWrapper>(reinterpret_cast<const uint8_t*>(symKey.c_str()), static_cast<unsigned int>(symKey.size()));
+	}
+
+	return client.cipher;
+}
+
+const std::string& ClientState::setGroupKey(uint32_t groupId, const std::string& name, const std::string& owner, const std::string& key)
+{
+	if (key.size() != AESWrapper::DEFAULT_KEYLENGTH) {
+		throw std::runtime_error("Error: Refused a key for group '" + name + "' it is of invalid length");
+	}
+
+	// Only the owner replaces the key of a group, anyone else could read (and write) the group's messages with a key of its own
+	auto group = findGroup(groupId);
+	if (group && group->owner != owner) {
+		throw std::runtime_error("Error: Refused a key for group '" + group->name + "' from a client that doesn't own it");
+	}
+
+	// A known group keeps the name it has here, a new one whose name another group took is told apart by its ID
+	auto localName = group ? group->name : name;
+	if (!group && findGroupId(localName)) {
+		auto suffix = "#" + std::to_string(groupId);
+		localName = name.substr(0, Config::NAME_MAX_SZ - 1 - suffix.size()) + suffix;
+		if (findGroupId(localName)) {
+			throw std::runtime_error("Error: Refused a key for group '" + name + "' its name is taken by another group");
+		}
+	}
+
+	if (m_peers) {
+		m_peers->putGroup({ groupId, localName, owner, key });
+	}
+
+	// A new key replaces the old one, the cipher is rebuilt on next use
+	if (group) {
+		group->key = key;
+		group->cipher = nullptr;
+		return group->name;
+	}
+
+	cacheGroup(groupId, { localName, owner, key, nullptr });
+	return m_groups.at(groupId).name;
+}
+
+bool ClientState::hasGroupKey(uint32_t groupId)
+{
+	return findGroup(groupId) != nullptr;
+}
+
+bool ClientState::hasGroup(const std::string& name)
+{
+	return findGroupId(name) != nullptr;
+}
+
+uint32_t ClientState::getGroupId(const std::string& name)
+{
+	auto groupId = findGroupId(name);
+	if (!groupId) {
+		throw std::runtime_error("Error: Can't find group: '" + name + "'");
+	}
+
+	return *groupId;
+}
+
+const std::string& ClientState::getGroupOwner(uint32_t groupId)
+{
+	return getGroup(groupId).owner;
+}
+
+const std::string& ClientState::getGroupKey(uint32_t groupId)
+{
+	return getGroup(groupId).key;
+}
+
+const std::string& ClientState::getGroupName(uint32_t groupId)
+{
+	return getGroup(groupId).name;
+}
+
+std::shared_ptr<AESWrapper> ClientState::getGroupCipher(uint32_t groupId)
+{
+	// Expand the key schedule once, every message of the group reuses it
+	auto& group = getGroup(groupId);
+	if (!group.cipher) {
+		group.cipher = std::make_shared<AESWrapper>(reinterpret_cast<const uint8_t*>(group.key.c_str()), static_cast<unsigned int>(group.key.size()));
+	}
+
+	return group.cipher;
+}
+
+ClientState::GroupEntry& ClientState::getGroup(uint32_t groupId)
+{
+	auto group = findGroup(groupId);
+	if (!group) {
+		throw std::runtime_error("Error: Can't find the key of group '" + std::to_string(groupId) + "'");
+	}
+
+	return *group;
+}
+
 ClientState::ClientEntry& ClientState::getClient(const std::string& username)
 {
 	// Get the client entry of another client
-	auto iter = m_nameToClient.find(username);
+	auto client = findClient(username);
 	// If the client doesn't exist, throw an error.
-	if (iter == m_nameToClient.end()) {
+	if (!client) {
 		throw std::runtime_error("Error: Can't find username: '" + username + "'");
 	}
 
-	return iter->second;
+	return *client;
+}
+
+ClientState::ClientEntry* ClientState::findClient(const std::string& username)
+{
+	auto iter = m_nameToClient.find(username);
+	if (iter != m_nameToClient.end()) {
+		return &iter->second;
+	}
+
+	// Not cached yet, the peer store may know the client from an earlier run
+	auto peer = m_peers ? m_peers->findByName(username) : std::nullopt;
+	if (!peer) {
+		return nullptr;
+	}
+
+	cacheClient(peer->name, toEntry(*peer));
+	return &m_nameToClient.at(username);
+}
+
+const std::string* ClientState::findName(const std::string& uuid)
+{
+	auto iter = m_uuidToName.find(uuid);
+	if (iter != m_uuidToName.end()) {
+		return &iter->second;
+	}
+
+	// Not cached yet, the peer store may know the client from an earlier run
+	auto peer = m_peers ? m_peers->findByUUID(uuid) : std::nullopt;
+	if (!peer) {
+		return nullptr;
+	}
+
+	cacheClient(peer->name, toEntry(*peer));
+	return &m_uuidToName.at(uuid);
+}
+
+void ClientState::cacheClient(const std::string& name, ClientEntry entry)
+{
+	m_uuidToName.insert({ entry.uuid, name });
+	m_nameToClient.insert({ name, std::move(entry) });
+}
+
+ClientState::GroupEntry* ClientState::findGroup(uint32_t groupId)
+{
+	auto iter = m_groups.find(groupId);
+	if (iter != m_groups.end()) {
+		return &iter->second;
+	}
+
+	// Not cached yet, the peer store keeps the groups of the earlier runs
+	auto group = m_peers ? m_peers->findGroup(groupId) : std::nullopt;
+	if (!group) {
+		return nullptr;
+	}
+
+	cacheGroup(groupId, toGroupEntry(*group));
+	return &m_groups.at(groupId);
+}
+
+const uint32_t* ClientState::findGroupId(const std::string& name)
+{
+	auto iter = m_groupNameToId.find(name);
+	if (iter != m_groupNameToId.end()) {
+		return &iter->second;
+	}
+
+	// Not cached yet, the peer store keeps the groups of the earlier runs
+	auto group = m_peers ? m_peers->findGroupByName(name) : std::nullopt;
+	if (!group) {
+		return nullptr;
+	}
+
+	auto groupId = group->id;
+	cacheGroup(groupId, toGroupEntry(*group));
+	return &m_groupNameToId.at(name);
+}
+
+void ClientState::cacheGroup(uint32_t groupId, GroupEntry entry)
+{
+	m_groupNameToId.insert({ entry.name, groupId });
+	m_groups.insert({ groupId, std::move(entry) });
 }
@@ -4,11 +4,23 @@
 #include <memory>
 #include <optional>
 #include <filesystem>
+#include <mutex>
+#include <variant>
 #include <boost/asio.hpp>
 
 // Forward declarations
 class CLI;
 class Connection;
+class ConnectionManager;
+struct ConnectionOptions;
+class PushListener;
+class Response;
+class AESWrapper;
+class RSAPublicWrapper;
+class RSAPrivateWrapper;
+class ECPrivateWrapper;
+class PeerStore;
+enum class KeyTypes : uint8_t;
 
 // Enum class for the client state keys
 enum class ClientStateKeys {
@@ -26,25 +38,48 @@ class ClientState
 public:
 	// Forward declaration and type aliases
 	struct ClientEntry;
+	struct GroupEntry;
 	using store_t = std::unordered_map<ClientStateKeys, std::string>;
 	using clients_map_t = std::unordered_map<std::string, ClientEntry>; // maps a username to a client entry
 	using rev_index_t = std::unordered_map<std::string, std::string>; // maps a UUID to a username
+	using groups_map_t = std::unordered_map<uint32_t, GroupEntry>; // maps a group ID to a group entry
+	using group_index_t = std::unordered_map<std::string, uint32_t>; // maps a group name to a group ID, every group has a name of its own
 
 	// Client entry for the other clients, stores their UUID, public key and symmetric key
 	struct ClientEntry {
 		std::string uuid{};
 		std::optional<std::string> pubKey;
+		KeyTypes keyType{}; // Type of 'pubKey'
 		std::optional<std::string> symKey;
+		std::optional<std::string> identityKey; // Ed25519 key of the first X25519 key of the client, its later keys must be signed by it
+		std::shared_ptr<RSAPublicWrapper> rsaPub; // Parsed 'pubKey', built on first use and dropped when the key changes
+		std::shared_ptr<AESWrapper> cipher; // Key scheduled 'symKey', built on first use and dropped when the key changes
 	};
 
-	// Constructs the client state from a file
-	ClientState(const std::filesystem::path& path);
+	// Group entry for the groups the client is a member of, every member encrypts its group messages with the same key
+	struct GroupEntry {
+		std::string name; // The name of the group here, with its ID added if another group already had the name
+		std::string owner; // Raw UUID of the client that created the group, the only one whose key for the group is taken
+		std::string key;
+		std::shared_ptr<AESWrapper> cipher; // Key scheduled 'key', built on first use
+	};
+
+	// Constructs the client state from an identity file, or migrates it from a text client info file if there is no identity file yet
+	ClientState(const std::filesystem::path& path, const std::filesystem::path& legacyPath = {});
+
+	~ClientState();
 
-	// Loads the client state from a file
+	// Loads the client state from a text client info file
 	void loadFromFile(const std::filesystem::path& path);
-	
-	// Saves the client state to a file
-	void saveToFile(const std::filesystem::path& path);
+
+	// Loads the client state from a binary identity file
+	void loadIdentity(const std::filesystem::path& path);
+
+	// Saves the client state to a binary identity file
+	void saveIdentity(const std::filesystem::path& path);
+
+	// Opens the store that keeps the other clients between runs, needs the UUID and private key of the current client
+	void openPeerStore(const std::filesystem::path& path);
 
 	// Checks if the client state is initialized
 	bool isInitialized();
@@ -58,6 +93,18 @@ public:
 	// Adds a client to the client state
 	void addClient(const std::string& name, const std::string& uuid);
 
+	// Adds a client or updates the one the server reported as changed
+	void updateClient(const std::string& name, const std::string& uuid);
+
+	// Gets the number of other clients that are known
+	size_t getClientsCount();
+
+	// Gets the version of the server's directory that the known clients are up to date with
+	uint64_t getDirectoryVersion();
+
+	// Sets the version of the server's directory that the known clients are up to date with
+	void setDirectoryVersion(uint64_t version);
+
 	// Sets the username
 	void setUsername(const std::string& username);
 
@@ -67,8 +114,11 @@ public:
 	// Sets the public keys of the current client
 	void setPubKey(const std::string& pubKey);
 
-	// Sets the public key of another client
-	void setPubKey(const std::string& username, const std::string& pubKey);
+	// Sets the public key of another client, an X25519 key is refused unless it is signed by the identity key pinned for the client
+	void setPubKey(const std::string& username, const std::string& pubKey, KeyTypes keyType);
+
+	// Sets the type of the key pair of the current client
+	void setKeyType(KeyTypes keyType);
 
 	// Sets the private key of the current client
 	void setPrivKey(const std::string& privKey);
@@ -97,17 +147,91 @@ public:
 	// Gets the private key of the current client
 	const std::string& getPrivKey();
 
+	// Gets the type of the key pair of the current client
+	KeyTypes getKeyType();
+
+	// Gets the type of the public key of another client
+	KeyTypes getKeyType(const std::string& username);
+
 	// Gets the symmetric key of another client
 	const std::optional<std::string>& getSymKey(const std::string& username);
 
+	// Gets the cached RSA wrapper of the public key of another client
+	std::shared_ptr<RSAPublicWrapper> getRSAPublic(const std::string& username);
+
+	// Gets the cached RSA wrapper of the private key of the current client
+	std::shared_ptr<RSAPrivateWrapper> getRSAPrivate();
+
+	// Gets the cached X25519 wrapper of the private key of the current client
+	std::shared_ptr<ECPrivateWrapper> getECPrivate();
+
+	// Derives the symmetric key shared with another client, both clients need an X25519 key and each derives the same key from the other's public key
+	std::string deriveSymKey(const std::string& username);
+
+	// Gets the cached AES cipher of the symmetric key of another client
+	std::shared_ptr<AESWrapper> getSymCipher(const std::string& username);
+
+	// Sets the key of a group that was created or whose owner sent its key (owner is a raw UUID), throws if a known group has another owner.
+	// Returns the name the group goes by, which has the group ID added if the name is taken by another group
+	const std::string& setGroupKey(uint32_t groupId, const std::string& name, const std::string& owner, const std::string& key);
+
+	// Checks if the key of a group is known
+	bool hasGroupKey(uint32_t groupId);
+
+	// Checks if there is a group of that name
+	bool hasGroup(const std::string& name);
+
+	// Gets the ID of a group by its name
+	uint32_t getGroupId(const std::string& name);
+
+	// Gets the raw UUID of the owner of a group
+	const std::string& getGroupOwner(uint32_t groupId);
+
+	// Gets the key of a group
+	const std::string& getGroupKey(uint32_t groupId);
+
+	// Gets the name of a group
+	const std::string& getGroupName(uint32_t groupId);
+
+	// Gets the cached AES cipher of the key of a group
+	std::shared_ptr<AESWrapper> getGroupCipher(uint32_t groupId);
+
 private:
 	// Get a client by its username
 	ClientEntry& getClient(const std::string& username);
 
+	// Get a group by its ID
+	GroupEntry& getGroup(uint32_t groupId);
+
+	// Finds a client by its username, loading it from the peer store if it isn't cached yet
+	ClientEntry* findClient(const std::string& username);
+
+	// Finds the username of a client by its uuid, loading it from the peer store if it isn't cached yet
+	const std::string* findName(const std::string& uuid);
+
+	// Caches a client that was read from the peer store
+	void cacheClient(const std::string& name, ClientEntry entry);
+
+	// Finds a group by its ID, loading it from the peer store if it isn't cached yet
+	GroupEntry* findGroup(uint32_t groupId);
+
+	// Finds the ID of a group by its name, loading it from the peer store if it isn't cached yet
+	const uint32_t* findGroupId(const std::string& name);
+
+	// Caches a group that was read from the peer store or whose key was just set
+	void cacheGroup(uint32_t groupId, GroupEntry entry);
+
 private:
 	store_t m_store; // The store that holds the current client state information
 	clients_map_t m_nameToClient; // Maps a username to a client entry
 	rev_index_t m_uuidToName; // Maps a UUID to a username
+	KeyTypes m_keyType{}; // Type of the key pair, RSA until the client registers with (or loads) an X25519 key
+	std::shared_ptr<RSAPrivateWrapper> m_rsaPriv; // Parsed private key, built on first use
+	std::shared_ptr<ECPrivateWrapper> m_ecPriv; // Same, for an X25519 key pair
+	uint64_t m_directoryVersion{ 0 }; // Directory version of the known clients, 0 until the first users request
+	std::unique_ptr<PeerStore> m_peers; // Keeps the other clients between runs, the maps above cache what is read from it
+	groups_map_t m_groups; // Caches the groups, which the peer store keeps between runs
+	group_index_t m_groupNameToId; // Maps a group name to a group ID
 
 	bool m_isInitialized{ false };
 };
@@ -118,9 +242,11 @@ class Client
 public:
 	using context_t = boost::asio::io_context;
 	using cli_t = std::unique_ptr<CLI>;
-	using connection_t = std::unique_ptr<Connection>;
+	using connection_t = std::unique_ptr<ConnectionManager>;
+	using pool_t = boost::asio::thread_pool;
+	using member_key_t = std::variant<std::shared_ptr<AESWrapper>, std::shared_ptr<RSAPublicWrapper>>; // What the group key is wrapped with for a member
 
-	Client(context_t& ctx, const std::string& addr, const std::string& port);
+	Client(context_t& ctx, const ConnectionOptions& options);
 
 	// This function runs the client
 	void run();
@@ -131,8 +257,8 @@ private:
 	// Gets the cli object
 	CLI& getCLI();
 
-	// Gets the connection object
-	Connection& getConn();
+	// Gets the manager of the connection to the server
+	ConnectionManager& getConns();
 
 	// Gets the state object
 	ClientState& getState();
@@ -140,6 +266,9 @@ private:
 	// Binds the cli handlers, the handlers are the clients logic
 	void setupCliHandlers();
 
+	// Gets the raw UUID of the current client under the state lock
+	std::string getUUIDUnhexed();
+
 	// Called on a register event.
 	void onCliRegister();
 
@@ -164,9 +293,43 @@ private:
 	// Called on sending a file
 	void onCliSendFile();
 
+	// Called on sending a text message to several users
+	void onCliSendMultiTextMsg();
+
+	// Called on creating a group, its key is sent to every member
+	void onCliCreateGroup();
+
+	// Called on sending a text message to a group
+	void onCliSendGroupTextMsg();
+
+	// Called on sending the key of a group the client owns again
+	void onCliResendGroupKey();
+
+	// Called on showing the statistics of the requests
+	void onCliShowStats();
+
+	// Gets the UUID of every member and what its group key is wrapped with, needs the state lock
+	void collectMemberKeys(const std::vector<std::string>& memberUsernames, std::vector<std::string>& outIds, std::vector<member_key_t>& outKeys);
+
+	// Sends the key of a group to its members in a single request, throws if the server refuses it
+	void sendGroupKey(const std::string& uuid, uint32_t groupId, const std::string& name, const std::string& groupKey,
+		const std::vector<std::string>& memberIds, const std::vector<member_key_t>& memberKeys);
+
+	// Encrypts the text for every target with its cached cipher and sends all of them in a single request
+	Response sendTextToMany(const std::vector<std::string>& targetUsernames, const std::string& text);
+
+	// Gets the plain text to encrypt for a text message, compressed if that makes it smaller, and adds the matching MessageFlags to 'outFlags'
+	static std::string compressText(const std::string& text, uint8_t& outFlags);
+
+	// Encrypts a content with the configured mode and adds the matching MessageFlags to 'outFlags'
+	static std::string encryptContent(AESWrapper& cipher, const std::string& plain, uint8_t& outFlags);
+
 private:
 	cli_t m_cli;
 	connection_t m_conn;
 	ClientState m_state;
+	pool_t m_workers; // Worker threads for decrypting polled messages
+	std::mutex m_stateMutex; // Guards the state, which the push listener updates in the background. The handlers only hold it while they read or update the state, never during input or network I/O
+	std::unique_ptr<PushListener> m_listener; // Keeps a long poll outstanding while the client runs
 };
 
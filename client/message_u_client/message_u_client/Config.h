@@ -4,14 +4,40 @@
 #include <string>
 
 namespace Config {
-	static constexpr uint8_t VERSION = 2; // Client version
+	static constexpr uint8_t VERSION = 4; // Protocol version the client speaks, 2 sends every request with the full header and fixed size fields, 3 registers with an RSA key
 	static constexpr uint8_t HEADER_BYTES_SZ = 23; // Number of bytes in the requet header
+	static constexpr uint8_t HEADER_MAX_BYTES_SZ = 24; // Largest request header of any version, a compact v3 header that carries the client ID
 	static constexpr uint8_t NAME_MAX_SZ = 255; // Maximum size of a client name
 	static constexpr uint8_t PUB_KEY_SZ = 160; // Size of the public key
 	static constexpr size_t CLIENT_ID_SZ = 16; // Size of the client ID
 	static constexpr size_t RES_HEADER_SZ = 7; // Number of bytes in the response header
-	static constexpr size_t CHUNK_SZ = 1024; // Chunk size for the socket buffer 
-	static constexpr const char* ME_DOT_INFO_PATH = "./me.info"; // Path of the client info file
+	static constexpr size_t FILE_BLOCK_SZ = 64 * 1024; // Block size used when streaming a file to the server
+	static constexpr uint32_t LONG_POLL_TIMEOUT_MS = 30 * 1000; // How long the server may hold a long poll before answering with no messages
+	static constexpr uint32_t LONG_POLL_RETRY_MS = 1000; // Delay before the long poll is retried after a failure, doubled on every failure in a row
+	static constexpr uint32_t LONG_POLL_MAX_RETRY_MS = 30 * 1000; // Maximal delay between long poll retries
+	static constexpr size_t DECRYPT_BATCH_SZ = 16 * 1024 * 1024; // Bytes of polled messages collected before they are decrypted as a batch
+	static constexpr uint32_t FETCH_RANGE_SZ = 1024 * 1024; // Bytes of a message content fetched by a single request, larger contents take several
+	static constexpr uint32_t POLL_PAGE_MSGS = 500; // Most messages in a page of a paged poll
+	static constexpr uint32_t POLL_PAGE_SZ = 8 * 1024 * 1024; // Content bytes in a page of a paged poll, a larger message still comes alone
+	static constexpr bool COLLECT_METRICS = true; // Time the phases of every request, false compiles the measurements out
+	static constexpr const char* STATS_FILE_ARG = "--stats-file"; // Command line option of the file the statistics are written to as JSON
+	static constexpr bool ENCRYPT_GCM = true; // Encrypt texts and files with segmented AES-GCM instead of CBC, CBC messages are still read (only from v3 on, a v2 client sends CBC)
+	static constexpr size_t GCM_SEGMENT_SZ = 64 * 1024; // Plain text bytes per GCM segment, the segments of a message are sealed independently
+	static constexpr bool COMPRESS_MESSAGES = true; // Deflate texts and files before they are encrypted, whenever that makes them smaller (only from v3 on)
+	static constexpr size_t COMPRESS_MIN_SZ = 128; // Contents smaller than this are sent as they are
+	static constexpr size_t COMPRESS_MIN_SAVING_PCT = 10; // Contents that don't shrink by at least this percentage are sent as they are
+	static constexpr size_t COMPRESS_SAMPLE_SZ = 64 * 1024; // Bytes at the start of a file that are compressed to tell if the file compresses
+	static constexpr size_t INFLATE_MAX_SZ = 64 * 1024 * 1024; // Maximal decompressed size of a text, which is held in memory
+	static constexpr const char* ME_DOT_INFO_PATH = "./me.info"; // Path of the client info file of older clients, migrated to the identity file
+	static constexpr const char* IDENTITY_PATH = "./me.id"; // Path of the binary client identity file
+	static constexpr const char* PEERS_PATH = "./peers.bin"; // Path of the store of the other clients
+	static constexpr const char* SERVERS_PATH = "./servers.info"; // Path of the optional file of server endpoints and socket options
+	static constexpr uint32_t RECONNECT_RETRY_MS = 250; // Delay before reconnecting after a failed attempt, doubled on every failure in a row
+	static constexpr uint32_t RECONNECT_MAX_RETRY_MS = 10 * 1000; // Maximal delay between reconnect attempts
+	static constexpr uint32_t RECONNECT_HOLD_MS = 30 * 1000; // How long a request waits for the connection to come back before it fails
+	static constexpr uint32_t REQUEST_MAX_ATTEMPTS = 3; // Times a request is sent before a broken connection fails it
+	static constexpr uint32_t KEEPALIVE_IDLE_S = 30; // Idle time before the first keepalive probe
+	static constexpr uint32_t KEEPALIVE_INTERVAL_S = 5; // Time between unanswered keepalive probes
 	static const std::string EMPTY_UUID = ""; // Empty UUID
 
 	static const std::string SERVER_ADDR = "localhost"; // Server address
@@ -4,130 +4,473 @@
 #include "ReqPayload.h"
 #include "Utils.h"
 #include "Config.h"
+#include "Protocol.h"
 
-#include <boost/range/combine.hpp>
 #include <string>
 
 Connection::Connection(io_ctx_t& ctx, const std::string& addr, const std::string& port)
-	: m_ctx{ ctx }, m_socket{ ctx }, m_resolver{ ctx }
+	: m_ctx{ ctx }, m_socket{ ctx }, m_resolver{ ctx }, m_pool{ BufferPool::create() }, m_headerBytes(Config::RES_HEADER_SZ)
 {
 	boost::asio::connect(m_socket, m_resolver.resolve(addr, port));
 }
 
+Connection::Connection(io_ctx_t& ctx, socket_t socket)
+	: m_ctx{ ctx }, m_resolver{ ctx }, m_socket{ std::move(socket) }, m_pool{ BufferPool::create() }, m_headerBytes(Config::RES_HEADER_SZ)
+{
+}
+
+// A view of a list of buffers. The asio write operations copy the buffer sequence they are given, copying a view doesn't allocate
+class BufferListView {
+public:
+	using value_type = boost::asio::const_buffer;
+	using const_iterator = const boost::asio::const_buffer*;
+
+	explicit BufferListView(const Connection::buffers_t& buffers)
+		: m_begin{ buffers.data() }, m_end{ buffers.data() + buffers.size() }
+	{
+	}
+
+	const_iterator begin() const {
+		return m_begin;
+	}
+
+	const_iterator end() const {
+		return m_end;
+	}
+
+private:
+	const_iterator m_begin;
+	const_iterator m_end;
+};
+
+// Time since 'start', for the asynchronous operations that can't hold a Metrics::Timer
+static uint64_t elapsedNs(Metrics::clock_t::time_point start)
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Metrics::clock_t::now() - start).count());
+}
+
+Connection::header_t Connection::parseHeader(const bytes_t& bytes)
+{
+	m_recvCode = m_headerValidator.validate(bytes);
+	Metrics::setCurrentCode(m_recvCode);
+	return Response::Header::fromBytes(bytes);
+}
+
+Request::HeaderForm Connection::nextHeaderForm(const Request& req)
+{
+	if (Config::VERSION < Protocol::VERSION_3) {
+		return Request::HeaderForm::FULL;
+	}
+
+	// The first request has the full header, its version byte switches the server to compact headers for the rest of the connection
+	if (!m_isCompact) {
+		m_isCompact = true;
+		m_declaredId = req.getId();
+		return Request::HeaderForm::FULL;
+	}
+
+	// The ID only changes when the client registers, the server keeps the last one it was given
+	if (req.getId() != m_declaredId) {
+		m_declaredId = req.getId();
+		return Request::HeaderForm::COMPACT_WITH_ID;
+	}
+
+	return Request::HeaderForm::COMPACT;
+}
+
 // Reads the header of a response and parses it to be a Response::Header object
 Connection::header_t Connection::readHeader()
 {
-	std::vector<uint8_t> headerBytes;
-	headerBytes.resize(Config::RES_HEADER_SZ);
-
-	recv(headerBytes, Config::RES_HEADER_SZ);
+	// Blocks until the server answers, the timer is tagged once the header tells which request it answers
+	Metrics::Timer firstByte{ MetricPhase::FIRST_BYTE };
+	recv(m_headerBytes, Config::RES_HEADER_SZ);
 
 	// Validate the header
-	m_headerValidator.validate(headerBytes);
+	auto header = parseHeader(m_headerBytes);
+	firstByte.stop();
 
-	return Response::Header::fromBytes(headerBytes);
+	return header;
 }
 
-// Reads the payload of a response and returns it as a vector of bytes
-Connection::bytes_t Connection::readPayload(const header_t& header)
+// Reads the payload of a response into a buffer of the pool
+Connection::buffer_t Connection::readPayload(const header_t& header)
 {
-	std::vector<uint8_t> payloadBytes;
-	payloadBytes.resize(header.payloadSz);
+	Metrics::Timer read{ MetricPhase::READ_PAYLOAD };
+	auto payload = m_pool->acquire(header.payloadSz);
 
-	recv(payloadBytes, header.payloadSz);
+	recv(payload.bytes(), header.payloadSz);
 	// Validate the payload
-	m_payloadValidator.validate(header, payloadBytes);
+	m_payloadValidator.validate(header, payload.bytes());
 
-	return payloadBytes;
+	return payload;
 }
 
 // Sends a request to the server
 void Connection::send(Request& req)
 {
-	// Sets the current request code that is being sent, so we can later use it to validate the servers response
-	m_headerValidator.setReqCode(req.getCode());
-	// Convert the req to bytes and send it
-	auto bytes = req.toBytes();
-	boost::asio::write(m_socket, boost::asio::buffer(bytes.data(), bytes.size()));
+	// Queues the code of the request that is being sent, so we can later use it to validate the servers response
+	m_headerValidator.pushReqCode(req.getCode());
+	m_requestsStarted++;
+
+	Metrics::Timer serialize{ req.getCode(), MetricPhase::SERIALIZE };
+	m_sendBuffers.clear();
+	req.toBuffers(m_sendBuffers, nextHeaderForm(req));
+	serialize.stop();
+
+	// Send the header and the payload in a single gathered write, straight from where they are stored
+	Metrics::Timer write{ req.getCode(), MetricPhase::WRITE };
+	Metrics::add(MetricCounter::BYTES_SENT, boost::asio::write(m_socket, BufferListView(m_sendBuffers)));
+}
+
+// Sends a request followed by a body that is never held in memory as a whole
+void Connection::sendStreamed(Request& req, uint64_t bodySz, const block_source_t& nextBlock)
+{
+	m_headerValidator.pushReqCode(req.getCode());
+	m_requestsStarted++;
+
+	// Gather the header, the payload and the first block of the body into a single write
+	std::string block;
+	bool hasBlock = nextBlock(block);
+	if (!hasBlock) {
+		block.clear();
+	}
+
+	Metrics::Timer serialize{ req.getCode(), MetricPhase::SERIALIZE };
+	m_sendBuffers.clear();
+	req.toBuffers(m_sendBuffers, nextHeaderForm(req));
+	m_sendBuffers.push_back(boost::asio::buffer(block.data(), block.size()));
+	serialize.stop();
+
+	// Only the writes are timed, the blocks are produced (read and encrypted) in between
+	Metrics::Timer write{ req.getCode(), MetricPhase::WRITE };
+	Metrics::add(MetricCounter::BYTES_SENT, boost::asio::write(m_socket, BufferListView(m_sendBuffers)));
+	write.pause();
+	uint64_t sentSz{ block.size() };
+
+	// Write the rest of the blocks as they are produced
+	while (hasBlock && nextBlock(block)) {
+		write.resume();
+		boost::asio::write(m_socket, boost::asio::buffer(block.data(), block.size()));
+		write.pause();
+		Metrics::add(MetricCounter::BYTES_SENT, block.size());
+		sentSz += block.size();
+	}
+
+	// The server frames the request by the declared size, a mismatch leaves the connection out of sync
+	if (sentSz != bodySz) {
+		throw std::runtime_error("Error: Streamed " + std::to_string(sentSz) + " bytes but declared " + std::to_string(bodySz));
+	}
 }
 
 // Receives a response from the server, returns a Response object
 Response Connection::recvResponse()
 {
 	auto header = readHeader();
-	auto payloadBytes = readPayload(header);
-	return Response(header, payloadBytes);
+	auto payload = readPayload(header);
+
+	Metrics::Timer parse{ MetricPhase::PARSE };
+	return Response(header, std::move(payload));
 }
 
-// Reads bytes from the server, stores the bytes in outBytes and returns the number of bytes read
-size_t Connection::recv(bytes_t& outBytes, size_t recvSz)
+// Receives the header of a response, without its payload
+Connection::header_t Connection::recvHeader()
 {
-	size_t offset{ 0 };
-	while (offset < recvSz) {
-		// Read at most CHUNK_SZ at a time
-		auto readSz = std::min(recvSz - offset, Config::CHUNK_SZ);
-		auto bytesRead = boost::asio::read(m_socket, boost::asio::buffer(outBytes.data() + offset, readSz));
-		offset += bytesRead;
+	return readHeader();
+}
+
+// Receives the payload of a response whose header was already received
+Response Connection::recvPayload(const header_t& header)
+{
+	auto payload = readPayload(header);
+
+	Metrics::Timer parse{ MetricPhase::PARSE };
+	return Response(header, std::move(payload));
+}
+
+void Connection::asyncSend(request_ptr_t req, send_handler_t handler)
+{
+	// The code is queued now, so the responses are matched in the order the requests were queued
+	m_headerValidator.pushReqCode(req->getCode());
+	m_requestsStarted++;
+	m_sendQueue.push_back({ std::move(req), std::move(handler) });
+
+	// Only one write may be in flight on the socket, the rest wait for it in the queue
+	if (m_sendQueue.size() == 1) {
+		writeNext();
 	}
+}
+
+void Connection::writeNext()
+{
+	auto code = m_sendQueue.front().req->getCode();
+	Metrics::Timer serialize{ code, MetricPhase::SERIALIZE };
+	m_asyncSendBuffers.clear();
+	m_sendQueue.front().req->toBuffers(m_asyncSendBuffers, nextHeaderForm(*m_sendQueue.front().req));
+	serialize.stop();
+
+	// The buffers point into the request, which stays at the front of the queue until the write completes, and the list isn't touched until then
+	auto start = Metrics::clock_t::now();
+	boost::asio::async_write(m_socket, BufferListView(m_asyncSendBuffers), [this, code, start](const boost::system::error_code& ec, size_t sentSz) {
+		if (ec) {
+			abortAsync(std::make_exception_ptr(boost::system::system_error(ec)));
+			return;
+		}
+
+		// Includes the time the write waited for the io context, which is what the caller sees
+		Metrics::record(code, MetricPhase::WRITE, elapsedNs(start));
+		Metrics::add(MetricCounter::BYTES_SENT, sentSz);
+
+		auto sent = std::move(m_sendQueue.front());
+		m_sendQueue.pop_front();
+		if (sent.handler) {
+			sent.handler(nullptr);
+		}
+
+		if (!m_sendQueue.empty()) {
+			writeNext();
+		}
+	});
+}
+
+void Connection::asyncRecv(recv_handler_t handler)
+{
+	m_recvQueue.push_back(std::move(handler));
+
+	// Responses are read one after the other, the rest of the handlers wait in the queue
+	if (m_recvQueue.size() == 1) {
+		readNext();
+	}
+}
+
+void Connection::readNext()
+{
+	m_asyncHeaderBytes.resize(Config::RES_HEADER_SZ);
+	m_asyncReadStart = Metrics::clock_t::now();
+	boost::asio::async_read(m_socket, boost::asio::buffer(m_asyncHeaderBytes), [this](const boost::system::error_code& ec, size_t) {
+		if (ec) {
+			abortAsync(std::make_exception_ptr(boost::system::system_error(ec)));
+			return;
+		}
+
+		// Validate the header against the request it answers, then read the payload it declares
+		header_t header{};
+		try {
+			header = parseHeader(m_asyncHeaderBytes);
+		}
+		catch (const std::exception&) {
+			abortAsync(std::current_exception());
+			return;
+		}
+
+		// The responses of a pipelined burst are waited for together, the later ones arrive while the earlier ones are read
+		Metrics::record(m_recvCode, MetricPhase::FIRST_BYTE, elapsedNs(m_asyncReadStart));
+		Metrics::add(MetricCounter::BYTES_RECEIVED, m_asyncHeaderBytes.size() + header.payloadSz);
 
-	return offset;
+		m_asyncReadStart = Metrics::clock_t::now();
+		m_asyncPayload = m_pool->acquire(header.payloadSz);
+		boost::asio::async_read(m_socket, boost::asio::buffer(m_asyncPayload.bytes()), [this, header](const boost::system::error_code& ec, size_t) {
+			if (ec) {
+				abortAsync(std::make_exception_ptr(boost::system::system_error(ec)));
+				return;
+			}
+
+			auto code = m_recvCode;
+			Metrics::record(code, MetricPhase::READ_PAYLOAD, elapsedNs(m_asyncReadStart));
+
+			std::exception_ptr error;
+			std::optional<Response> res;
+			try {
+				m_payloadValidator.validate(header, m_asyncPayload.bytes());
+
+				Metrics::Timer parse{ code, MetricPhase::PARSE };
+				res.emplace(header, std::move(m_asyncPayload));
+			}
+			catch (const std::exception&) {
+				error = std::current_exception();
+			}
+
+			auto handler = std::move(m_recvQueue.front());
+			m_recvQueue.pop_front();
+			if (!m_recvQueue.empty()) {
+				readNext();
+			}
+
+			handler(error, std::move(res));
+		});
+	});
 }
 
-HeaderValidator::MapEntry::MapEntry(const std::vector<ResponseCodes>& codes, const std::vector<std::optional<uint32_t>>& expectedSzs)
-	: expectedCodes{ codes }, expectedSzs{ expectedSzs }
+void Connection::asyncRecvHeader(header_handler_t handler)
 {
+	m_asyncHeaderBytes.resize(Config::RES_HEADER_SZ);
+	m_asyncReadStart = Metrics::clock_t::now();
+	boost::asio::async_read(m_socket, boost::asio::buffer(m_asyncHeaderBytes), [this, handler = std::move(handler)](const boost::system::error_code& ec, size_t) {
+		if (ec) {
+			handler(std::make_exception_ptr(boost::system::system_error(ec)), std::nullopt);
+			return;
+		}
+
+		std::exception_ptr error;
+		std::optional<header_t> header;
+		try {
+			header = parseHeader(m_asyncHeaderBytes);
+
+			// A long poll is held by the server, so this is mostly how long it waited for messages
+			Metrics::record(m_recvCode, MetricPhase::FIRST_BYTE, elapsedNs(m_asyncReadStart));
+			Metrics::add(MetricCounter::BYTES_RECEIVED, m_asyncHeaderBytes.size());
+		}
+		catch (const std::exception&) {
+			error = std::current_exception();
+		}
+
+		handler(error, header);
+	});
 }
 
-HeaderValidator::HeaderValidator()
-	: m_reqCode{}
+void Connection::close()
 {
-	// Initialize the map with the expected response codes and sizes for each request code
-	// std::nullopt means that the payload is of variable size
-	m_reqCodeToExpectedRes.insert({ RequestCodes::REGISTER, {{ResponseCodes::REG_OK, ResponseCodes::ERR}, {Config::CLIENT_ID_SZ, 0}} });
-	m_reqCodeToExpectedRes.insert({ RequestCodes::USRS_LIST,  {{ResponseCodes::USRS_LIST, ResponseCodes::ERR}, {std::nullopt, 0}} });
-	m_reqCodeToExpectedRes.insert({ RequestCodes::GET_PUB_KEY, {{ResponseCodes::PUB_KEY, ResponseCodes::ERR}, {Config::CLIENT_ID_SZ + Config::PUB_KEY_SZ, 0}} });
-	m_reqCodeToExpectedRes.insert({ RequestCodes::SEND_MSG,  {{ResponseCodes::MSG_SEND, ResponseCodes::ERR}, {Config::CLIENT_ID_SZ + sizeof(uint32_t), 0}}});
-	m_reqCodeToExpectedRes.insert({ RequestCodes::POLL_MSGS, {{ResponseCodes::POLL_MSGS, ResponseCodes::ERR}, {std::nullopt, 0}} });
+	boost::system::error_code ignored;
+	m_socket.close(ignored);
 }
 
-void HeaderValidator::setReqCode(RequestCodes code)
+uint64_t Connection::getRequestsStarted() const
 {
-	m_reqCode = code;
+	return m_requestsStarted;
 }
 
-void HeaderValidator::validate(const std::vector<uint8_t>& bytes)
+uint64_t Connection::getPoolAllocations() const
 {
-	// Check if the request code is in the map, if not, throw an error
-	auto itr = m_reqCodeToExpectedRes.find(m_reqCode);
-	if (itr == m_reqCodeToExpectedRes.end()) {
-		throw std::runtime_error("Error: Unexpected request code '" + std::to_string(Utils::EnumToUint16(m_reqCode)) + "'");
+	return m_pool->getAllocations();
+}
+
+void Connection::abortAsync(std::exception_ptr error)
+{
+	// Take the queues first, the handlers may queue new operations
+	auto sends = std::move(m_sendQueue);
+	auto recvs = std::move(m_recvQueue);
+	m_sendQueue.clear();
+	m_recvQueue.clear();
+
+	boost::system::error_code ignored;
+	m_socket.close(ignored);
+
+	for (auto& pending : sends) {
+		if (pending.handler) {
+			pending.handler(error);
+		}
 	}
 
-	// Get the expected response codes and sizes for the current request code
-	auto entry = itr->second;
-	size_t offset{ 1 };
+	for (auto& handler : recvs) {
+		handler(error, std::nullopt);
+	}
+}
+
+void Connection::run()
+{
+	// The context stops once it runs out of work, restart it for every batch of asynchronous operations
+	m_ctx.restart();
+	m_ctx.run();
+}
+
+std::vector<Response> Connection::sendPipelined(std::vector<request_ptr_t> reqs)
+{
+	std::vector<std::optional<Response>> responses(reqs.size());
+	std::exception_ptr error;
+
+	// Queue all the writes and all the reads, the reads complete as the responses arrive
+	for (size_t i = 0; i < reqs.size(); i++) {
+		asyncSend(std::move(reqs[i]), [&error](std::exception_ptr e) {
+			if (e && !error) {
+				error = e;
+			}
+		});
+		asyncRecv([&error, &responses, i](std::exception_ptr e, std::optional<Response> res) {
+			if (e && !error) {
+				error = e;
+			}
+			responses[i] = std::move(res);
+		});
+	}
+
+	run();
+
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	std::vector<Response> result;
+	result.reserve(responses.size());
+	for (auto& res : responses) {
+		result.push_back(std::move(res.value()));
+	}
+
+	return result;
+}
+
+// Reads bytes from the server, stores the bytes in outBytes and returns the number of bytes read
+size_t Connection::recv(bytes_t& outBytes, size_t recvSz)
+{
+	return recv(outBytes.data(), recvSz);
+}
+
+// Reads bytes from the server into a raw buffer, returns the number of bytes read
+size_t Connection::recv(uint8_t* outBytes, size_t recvSz)
+{
+	// A single read, it returns once the whole buffer is filled
+	auto bytesRead = boost::asio::read(m_socket, boost::asio::buffer(outBytes, recvSz));
+
+	Metrics::add(MetricCounter::BYTES_RECEIVED, bytesRead);
+	return bytesRead;
+}
+
+void HeaderValidator::pushReqCode(RequestCodes code)
+{
+	m_pendingCodes.push_back(code);
+}
+
+RequestCodes HeaderValidator::validate(const std::vector<uint8_t>& bytes)
+{
+	// A response always answers the oldest request that is still pending
+	if (m_nextCode == m_pendingCodes.size()) {
+		throw std::runtime_error("Error: Received a response while no request is pending");
+	}
+
+	auto reqCode = m_pendingCodes[m_nextCode++];
+	if (m_nextCode == m_pendingCodes.size()) {
+		m_pendingCodes.clear();
+		m_nextCode = 0;
+	}
+	else if (m_nextCode >= 64 && m_nextCode * 2 >= m_pendingCodes.size()) {
+		// Requests keep being sent before the earlier ones are answered, drop the answered codes so the vector doesn't grow forever
+		m_pendingCodes.erase(m_pendingCodes.begin(), m_pendingCodes.begin() + m_nextCode);
+		m_nextCode = 0;
+	}
+
+	// Check if the request code is declared, if not, throw an error
+	auto expected = Protocol::Messages::find(reqCode);
+	if (!expected) {
+		throw std::runtime_error("Error: Unexpected request code '" + std::to_string(Utils::EnumToUint16(reqCode)) + "'");
+	}
 
 	// Get the response code and payload size
-	auto code = Utils::deserializeTrivialType<uint16_t>(bytes, offset);
-	auto payloadSz = Utils::deserializeTrivialType<uint32_t>(bytes, offset);
-
-	bool isValid{ false };
-	// Iterate over the expected response codes and sizes and check if the response code and payload size match any of them
-	for (const auto& [expectedCode, expectedSz] : boost::combine(entry.expectedCodes, entry.expectedSzs)) {
-		if (ResponseCodes(code) == expectedCode && payloadSz == expectedSz) {
-			isValid = true;
-			break;
-		}
-		else if (ResponseCodes(code) == expectedCode && !expectedSz.has_value()) {
-			isValid = true;
-			break;
-		}
+	size_t offset{ 0 };
+	auto [version, code, payloadSz] = Protocol::ResponseHeader::decode(bytes, offset);
+
+	// A server answers in the version of the request or in an older one it speaks
+	if (version < Protocol::VERSION_2 || version > Config::VERSION) {
+		throw std::runtime_error("Error: Unexpected response version " + std::to_string(version));
 	}
 
+	// Any request may be answered with an empty error, otherwise the code and the size must be the ones declared for the request
+	bool isValid = (ResponseCodes(code) == ResponseCodes::ERR && payloadSz == 0) ||
+		(ResponseCodes(code) == expected->resCode && expected->resSizeOf(version).accepts(payloadSz));
+
 	// If its invalid, throw a runtime error
 	if (!isValid) {
 		throw std::runtime_error("Error: Unexpected response combination: code " + std::to_string(code) + " with payload size " + std::to_string(payloadSz));
 	}
+
+	return reqCode;
 }
 
 void PayloadValidator::validate(const header_t& header, const std::vector<uint8_t>& bytes)
@@ -138,3 +481,139 @@ void PayloadValidator::validate(const header_t& header, const std::vector<uint8_
                                  ") does not match header's declared size (" + std::to_string(header.payloadSz) + ").");
     }
 }
+
+// The v3 header of a polled message, with the longest message ID and content size
+static constexpr size_t POLL_MESSAGE_HEADER_V3_MAX_SZ = Protocol::V3::PollMessagePrefix::SIZE + 2 * Protocol::VarInt::sizeOf(std::numeric_limits<uint32_t>::max());
+
+std::string MessageReader::readContent()
+{
+	std::string content;
+	content.resize(contentLeft());
+	for (size_t offset = 0; offset < content.size();) {
+		auto readSz = readContent(content.data() + offset, content.size() - offset);
+		if (readSz == 0) {
+			throw std::runtime_error("Error: Message content ended after " + std::to_string(offset) + " of " + std::to_string(content.size()) + " bytes");
+		}
+		offset += readSz;
+	}
+	return content;
+}
+
+PollMessageReader::PollMessageReader(Connection& conn, const header_t& header)
+	: m_conn{ conn }, m_payloadLeft{ header.payloadSz }, m_isV3{ header.version >= Protocol::VERSION_3 }, m_readTimer{ MetricPhase::READ_PAYLOAD, false }
+{
+	m_headerBytes.reserve(std::max(Protocol::PollMessageHeader::SIZE, POLL_MESSAGE_HEADER_V3_MAX_SZ));
+
+	if (header.code == ResponseCodes::MSGS_PAGE) {
+		readHeaderBytes(Protocol::PollPageRes::SIZE);
+		std::tie(m_cursor) = Protocol::PollPageRes::decode(m_headerBytes.data());
+	}
+}
+
+std::optional<PollMessageReader::MessageHeader> PollMessageReader::next()
+{
+	// Make sure the socket is positioned at the start of the next message
+	skipContent();
+
+	// The messages are read until the payload ends, the count only serves the parsers that reserve the entries up front
+	if (m_isV3 && !m_hasCount) {
+		m_headerBytes.clear();
+		readVarIntBytes();
+		m_hasCount = true;
+	}
+
+	if (m_payloadLeft == 0) {
+		return std::nullopt;
+	}
+
+	// Deserialize the sender ID, message id, type and content size
+	MessageHeader msg;
+	uint8_t type{};
+	m_headerBytes.clear();
+	if (m_isV3) {
+		readHeaderBytes(Protocol::V3::PollMessagePrefix::SIZE);
+		auto [senderId, typeByte] = Protocol::V3::PollMessagePrefix::decode(m_headerBytes.data());
+		msg.senderId = senderId;
+		type = typeByte;
+
+		// The message ID and the content size
+		readVarIntBytes();
+		readVarIntBytes();
+
+		size_t offset{ Protocol::V3::PollMessagePrefix::SIZE };
+		msg.msgId = Protocol::VarInt::decode<uint32_t>(m_headerBytes, offset);
+		msg.contentSz = Protocol::VarInt::decode<uint32_t>(m_headerBytes, offset);
+	}
+	else {
+		readHeaderBytes(Protocol::PollMessageHeader::SIZE);
+		auto [senderId, msgId, typeByte, contentSz] = Protocol::PollMessageHeader::decode(m_headerBytes.data());
+		msg.senderId = senderId;
+		msg.msgId = msgId;
+		type = typeByte;
+		msg.contentSz = contentSz;
+	}
+	msg.msgType = MessageTypes(type & ~MessageFlags::MASK);
+	msg.flags = type & MessageFlags::MASK;
+
+	if (msg.contentSz > m_payloadLeft) {
+		throw std::runtime_error("Error: Message content size (" + std::to_string(msg.contentSz) +
+								 ") exceeds the rest of the payload (" + std::to_string(m_payloadLeft) + ")");
+	}
+
+	m_contentLeft = msg.contentSz;
+	return msg;
+}
+
+void PollMessageReader::readHeaderBytes(size_t size)
+{
+	if (m_payloadLeft < size) {
+		throw std::runtime_error("Error: Poll response ends in the middle of a message header");
+	}
+
+	auto offset = m_headerBytes.size();
+	m_headerBytes.resize(offset + size);
+
+	m_readTimer.resume();
+	m_conn.recv(m_headerBytes.data() + offset, size);
+	m_readTimer.pause();
+	m_payloadLeft -= static_cast<uint32_t>(size);
+}
+
+void PollMessageReader::readVarIntBytes()
+{
+	do {
+		if (m_headerBytes.size() == POLL_MESSAGE_HEADER_V3_MAX_SZ) {
+			throw std::runtime_error("Error: Poll message header is too long");
+		}
+		readHeaderBytes(1);
+	} while (m_headerBytes.back() & 0x80);
+}
+
+size_t PollMessageReader::readContent(char* out, size_t maxSz)
+{
+	auto readSz = static_cast<uint32_t>(std::min<size_t>(maxSz, m_contentLeft));
+	m_readTimer.resume();
+	m_conn.recv(reinterpret_cast<uint8_t*>(out), readSz);
+	m_readTimer.pause();
+	m_contentLeft -= readSz;
+	m_payloadLeft -= readSz;
+	return readSz;
+}
+
+void PollMessageReader::skipContent()
+{
+	char discard[DISCARD_SZ];
+	while (m_contentLeft > 0) {
+		readContent(discard, sizeof(discard));
+	}
+}
+
+uint32_t PollMessageReader::contentLeft() const
+{
+	return m_contentLeft;
+}
+
+uint32_t PollMessageReader::getCursor() const
+{
+	return m_cursor;
+}
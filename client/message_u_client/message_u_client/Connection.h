@@ -1,7 +1,7 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
+#include <deque>
 #include <memory>
 #include <optional>
 #include <functional>
@@ -10,29 +10,24 @@
 
 #include "Response.h"
 #include "Request.h"
+#include "Metrics.h"
+#include "BufferPool.h"
 
 // Class that validates the header of a response
+// The expected response of every request code comes from the message table in Protocol.h
 class HeaderValidator {
 public:
-	HeaderValidator();
+	// Queue the code of a request that was sent, responses arrive in the order of the requests
+	void pushReqCode(RequestCodes code);
 
-	// Set the current request code
-	void setReqCode(RequestCodes code);
-
-	// Validate the header
-	void validate(const std::vector<uint8_t>& bytes);
-
-	// Maps a response codes to the expected response codes and sizes
-	struct MapEntry {
-		MapEntry(const std::vector<ResponseCodes>& codes, const std::vector<std::optional<uint32_t>>& expectedSzs);
-
-		std::vector<ResponseCodes> expectedCodes;
-		std::vector<std::optional<uint32_t>> expectedSzs;
-	};
+	// Validate the header against the oldest request that wasn't answered yet, returns the code of that request
+	RequestCodes validate(const std::vector<uint8_t>& bytes);
 
 private:
-	RequestCodes m_reqCode;
-	std::unordered_map<RequestCodes, MapEntry> m_reqCodeToExpectedRes;
+	// Codes of the requests in flight, oldest first from m_nextCode on. The vector is cleared whenever every request was answered,
+	// so it keeps its capacity and a request/response cycle doesn't allocate
+	std::vector<RequestCodes> m_pendingCodes;
+	size_t m_nextCode{ 0 };
 };
 
 class PayloadValidator {
@@ -52,16 +47,88 @@ public:
 	using socket_t = boost::asio::ip::tcp::socket;
 	using header_t = Response::Header;
 	using bytes_t = std::vector<uint8_t>;
+	using buffer_t = BufferPool::Buffer;
+	using buffers_t = Request::buffers_t;
+	using block_source_t = std::function<bool(std::string&)>; // Fills the next block of a streamed body, returns false when there are no more blocks
+	using request_ptr_t = std::unique_ptr<Request>;
+	using send_handler_t = std::function<void(std::exception_ptr error)>;
+	using recv_handler_t = std::function<void(std::exception_ptr error, std::optional<Response> res)>;
+	using header_handler_t = std::function<void(std::exception_ptr error, std::optional<header_t> header)>;
 
 	Connection(io_ctx_t& ctx, const std::string& addr, const std::string& port);
+
+	// Takes over a socket that is already connected to the server
+	Connection(io_ctx_t& ctx, socket_t socket);
 	
 	void send(Request& req);
+
+	// Sends a request and then a body of 'bodySz' bytes that is pulled block by block from 'nextBlock'
+	void sendStreamed(Request& req, uint64_t bodySz, const block_source_t& nextBlock);
+
 	Response recvResponse();
 
+	// Receives only the header of a response, the payload is left on the socket for the caller to consume
+	header_t recvHeader();
+
+	// Receives the payload of a response whose header was received with recvHeader
+	Response recvPayload(const header_t& header);
+
+	// Queues a request to be written asynchronously, requests are written in order without waiting for responses
+	// The handler is called once the request was written, the connection keeps the request alive until then
+	void asyncSend(request_ptr_t req, send_handler_t handler);
+
+	// Queues an asynchronous read of the next response, the handlers are called in the order of the responses
+	void asyncRecv(recv_handler_t handler);
+
+	// Waits asynchronously for the header of the next response, the payload is left on the socket for the caller to consume
+	// Must not be mixed with asyncRecv, which reads whole responses
+	void asyncRecvHeader(header_handler_t handler);
+
+	// Closes the socket, pending asynchronous operations complete with an error
+	void close();
+
+	// Gets the number of requests that started going out, a request counts even if its write failed half way
+	uint64_t getRequestsStarted() const;
+
+	// Gets the number of payload buffers that were allocated rather than taken from the pool
+	uint64_t getPoolAllocations() const;
+
+	// Runs the io context until every queued asynchronous operation completed
+	void run();
+
+	// Writes all the requests back to back and then collects their responses, in the order of the requests
+	// A burst of requests costs about one round trip instead of one per request
+	std::vector<Response> sendPipelined(std::vector<request_ptr_t> reqs);
+
 private:
+	// A request waiting to be written asynchronously
+	struct PendingSend {
+		request_ptr_t req;
+		send_handler_t handler;
+	};
+
+	// Writes the request at the front of the send queue
+	void writeNext();
+
+	// Reads the response for the handler at the front of the receive queue
+	void readNext();
+
+	// Fails every queued operation and closes the socket, the stream can't be trusted after an error
+	void abortAsync(std::exception_ptr error);
+
+	// The reader pulls a response payload straight from the socket
+	friend class PollMessageReader;
+
+	// Validates a received header, the phases that follow on this thread are tagged with the code of its request
+	header_t parseHeader(const bytes_t& bytes);
+
+	// Picks the layout of the header of the next request that is written, in the order the requests are written
+	Request::HeaderForm nextHeaderForm(const Request& req);
+
 	header_t readHeader();
-	bytes_t readPayload(const header_t& header);
+	buffer_t readPayload(const header_t& header);
 	size_t recv(bytes_t& outBytes, size_t recvSz);
+	size_t recv(uint8_t* outBytes, size_t recvSz);
 
 private:
 	io_ctx_t& m_ctx;
@@ -70,4 +137,88 @@ private:
 
 	HeaderValidator m_headerValidator;
 	PayloadValidator m_payloadValidator;
+
+	std::shared_ptr<BufferPool> m_pool; // Payload buffers, recycled once the responses holding them are gone
+	bytes_t m_headerBytes; // Header of the response that is being read
+	buffers_t m_sendBuffers; // Views of the request that is being written, reused by every write
+	bool m_isCompact{ false }; // A v3 request was written, the server reads compact headers from then on
+	std::string m_declaredId; // Client ID of the last request header, compact headers only carry the ID when it changes
+	uint64_t m_requestsStarted{ 0 }; // Requests that were written or queued to be written
+
+	std::deque<PendingSend> m_sendQueue; // Requests waiting to be written, the front one is being written
+	std::deque<recv_handler_t> m_recvQueue; // Handlers waiting for responses, the front one is being read
+	bytes_t m_asyncHeaderBytes; // Header of the response that is being read asynchronously
+	buffer_t m_asyncPayload; // Payload of the response that is being read asynchronously
+	buffers_t m_asyncSendBuffers; // Views of the request at the front of the send queue, kept until its write completes
+	Metrics::clock_t::time_point m_asyncReadStart; // When the asynchronous read of the current response started waiting
+	RequestCodes m_recvCode{}; // Code of the request that the response being read answers
+};
+
+// Yields the messages of a poll one at a time, the header fields of a message are parsed by next() and its content is then pulled in bounded parts
+class MessageReader {
+public:
+	// The header fields of each message
+	struct MessageHeader {
+		std::string senderId;
+		uint32_t msgId{};
+		MessageTypes msgType{};
+		uint8_t flags{}; // MessageFlags of the message
+		uint32_t contentSz{};
+	};
+
+	// Moves to the next message, skipping what is left of the current one
+	// Returns std::nullopt once every message was read
+	virtual std::optional<MessageHeader> next() = 0;
+
+	// Reads at most 'maxSz' bytes of the current message content, returns 0 once the content was consumed
+	virtual size_t readContent(char* out, size_t maxSz) = 0;
+
+	// Reads the rest of the current message content into a string, for small contents only
+	std::string readContent();
+
+	// Discards the rest of the current message content
+	virtual void skipContent() = 0;
+
+	// Gets the number of content bytes of the current message that were not read yet
+	virtual uint32_t contentLeft() const = 0;
+
+	virtual ~MessageReader() = default;
+};
+
+// Pull parser over a POLL_MSGS response, yields the messages one at a time as they arrive on the socket
+class PollMessageReader : public MessageReader {
+public:
+	using header_t = Response::Header;
+	using bytes_t = std::vector<uint8_t>;
+
+	// Reads a POLL_MSGS answer, or a MSGS_PAGE one whose cursor is read right away
+	PollMessageReader(Connection& conn, const header_t& header);
+
+	std::optional<MessageHeader> next() override;
+	size_t readContent(char* out, size_t maxSz) override;
+	using MessageReader::readContent;
+	void skipContent() override;
+	uint32_t contentLeft() const override;
+
+	// Cursor of the page that follows a MSGS_PAGE answer, 0 once the page is empty (and for a POLL_MSGS answer)
+	uint32_t getCursor() const;
+
+private:
+	// Appends 'size' bytes of the current message header to m_headerBytes
+	void readHeaderBytes(size_t size);
+
+	// Appends the bytes of a VarInt to m_headerBytes, one at a time since its size is only known once it ended
+	void readVarIntBytes();
+
+private:
+	static constexpr size_t DISCARD_SZ = 16 * 1024; // Bytes read at a time when a message content is skipped
+
+	Connection& m_conn;
+	uint32_t m_payloadLeft; // Bytes of the response payload that were not read yet
+	uint32_t m_contentLeft{ 0 }; // Bytes of the current message content that were not read yet
+	bool m_isV3; // The payload starts with the message count, and the message IDs and the content sizes are VarInt
+	bool m_hasCount{ false }; // The v3 message count was read
+	uint32_t m_cursor{ 0 }; // Cursor of the next page
+	bytes_t m_headerBytes; // Reused for the header fields of each message
+	Metrics::Timer m_readTimer; // Time spent reading the payload, without the handling of the messages in between
 };
\ No newline at end of file
@@ -0,0 +1,234 @@
+#include "ConnectionManager.h"
+#include "Utils.h"
+
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <mstcpip.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+ConnectionOptions ConnectionOptions::load(const std::filesystem::path& path)
+{
+	ConnectionOptions options;
+	std::ifstream file{ path };
+	std::string line;
+
+	while (std::getline(file, line)) {
+		Utils::trimStr(line);
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+
+		auto eq = line.find('=');
+		if (eq == std::string::npos) {
+			throw std::runtime_error("Error: Invalid line '" + line + "' in '" + path.string() + "'");
+		}
+
+		auto key = line.substr(0, eq);
+		auto value = line.substr(eq + 1);
+		Utils::trimStr(key);
+		Utils::trimStr(value);
+
+		if (key == "server") {
+			// The port follows the last colon
+			auto colon = value.rfind(':');
+			if (colon == std::string::npos || colon == 0 || colon + 1 == value.size()) {
+				throw std::runtime_error("Error: Invalid server '" + value + "' in '" + path.string() + "', expected addr:port");
+			}
+			options.endpoints.push_back({ value.substr(0, colon), value.substr(colon + 1) });
+		}
+		else if (key == "nodelay") {
+			options.noDelay = Utils::strToInt(value) != 0;
+		}
+		else if (key == "sndbuf") {
+			options.sendBufSz = Utils::strToInt(value);
+		}
+		else if (key == "rcvbuf") {
+			options.recvBufSz = Utils::strToInt(value);
+		}
+		else if (key == "keepalive") {
+			options.keepAlive = Utils::strToInt(value) != 0;
+		}
+		else if (key == "keepalive_idle") {
+			options.keepAliveIdleS = static_cast<uint32_t>(Utils::strToInt(value));
+		}
+		else if (key == "keepalive_interval") {
+			options.keepAliveIntervalS = static_cast<uint32_t>(Utils::strToInt(value));
+		}
+		else {
+			throw std::runtime_error("Error: Unknown option '" + key + "' in '" + path.string() + "'");
+		}
+	}
+
+	if (options.endpoints.empty()) {
+		options.endpoints.push_back({ Config::SERVER_ADDR, Config::SERVER_PORT });
+	}
+
+	return options;
+}
+
+ConnectionManager::ConnectionManager(io_ctx_t& ctx, ConnectionOptions options)
+	: m_ctx{ ctx }, m_options{ std::move(options) }
+{
+	if (m_options.endpoints.empty()) {
+		throw std::logic_error("Error: No server endpoints to connect to");
+	}
+
+	m_thread = std::thread([this]() { reconnectLoop(); });
+}
+
+ConnectionManager::~ConnectionManager()
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_mutex };
+		m_isStopped = true;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+Response ConnectionManager::request(Request& req, Retry retry)
+{
+	return exchange([&req](Connection& conn) {
+		conn.send(req);
+		return conn.recvResponse();
+	}, retry);
+}
+
+Connection& ConnectionManager::acquire()
+{
+	std::unique_lock<std::mutex> lock{ m_mutex };
+
+	// The first request opens the connection
+	if (m_state == State::IDLE) {
+		m_state = State::RECONNECTING;
+		m_cv.notify_all();
+	}
+
+	auto isConnected = m_cv.wait_for(lock, std::chrono::milliseconds(Config::RECONNECT_HOLD_MS), [this]() {
+		return m_state == State::CONNECTED;
+	});
+
+	if (!isConnected) {
+		throw std::runtime_error("Error: The server is unreachable, still trying to reconnect (" + m_lastError + ")");
+	}
+
+	// Only the thread that holds the connection replaces it, so the reference stays valid until it drops it
+	return *m_conn;
+}
+
+void ConnectionManager::drop()
+{
+	std::lock_guard<std::mutex> lock{ m_mutex };
+
+	m_conn.reset();
+	m_state = State::RECONNECTING;
+	m_cv.notify_all();
+}
+
+void ConnectionManager::reconnectLoop()
+{
+	std::unique_lock<std::mutex> lock{ m_mutex };
+
+	while (true) {
+		m_cv.wait(lock, [this]() { return m_isStopped || m_state == State::RECONNECTING; });
+
+		auto retryMs = Config::RECONNECT_RETRY_MS;
+		while (!m_isStopped && m_state == State::RECONNECTING) {
+			// Connecting may take a while, the waiting requests only need the lock to check the state
+			auto next = m_nextEndpoint;
+			std::unique_ptr<Connection> conn;
+			std::string error;
+
+			lock.unlock();
+			try {
+				conn = connect(m_ctx, m_options, next);
+			}
+			catch (const std::exception& e) {
+				error = e.what();
+			}
+			lock.lock();
+
+			m_nextEndpoint = next;
+			if (conn) {
+				m_conn = std::move(conn);
+				m_state = State::CONNECTED;
+				m_cv.notify_all();
+				break;
+			}
+
+			m_lastError = error;
+			m_cv.wait_for(lock, std::chrono::milliseconds(retryMs), [this]() { return m_isStopped; });
+			retryMs = std::min(retryMs * 2, Config::RECONNECT_MAX_RETRY_MS);
+		}
+
+		if (m_isStopped) {
+			return;
+		}
+	}
+}
+
+std::unique_ptr<Connection> ConnectionManager::connect(io_ctx_t& ctx, const ConnectionOptions& options, size_t& nextEndpoint)
+{
+	Connection::resolver_t resolver{ ctx };
+	std::string errors;
+
+	// Start at the endpoint that worked last, a restarted server is usually back where it was
+	for (size_t i = 0; i < options.endpoints.size(); i++) {
+		auto index = (nextEndpoint + i) % options.endpoints.size();
+		const auto& endpoint = options.endpoints[index];
+
+		try {
+			socket_t socket{ ctx };
+			boost::asio::connect(socket, resolver.resolve(endpoint.addr, endpoint.port));
+			applyOptions(socket, options);
+
+			Metrics::add(MetricCounter::CONNECTS);
+			nextEndpoint = index;
+			return std::make_unique<Connection>(ctx, std::move(socket));
+		}
+		catch (const boost::system::system_error& e) {
+			errors += (errors.empty() ? "" : ", ") + endpoint.addr + ":" + endpoint.port + " " + e.code().message();
+		}
+	}
+
+	throw std::runtime_error(errors);
+}
+
+void ConnectionManager::applyOptions(socket_t& socket, const ConnectionOptions& options)
+{
+	socket.set_option(boost::asio::ip::tcp::no_delay(options.noDelay));
+	if (options.sendBufSz > 0) {
+		socket.set_option(boost::asio::socket_base::send_buffer_size(options.sendBufSz));
+	}
+	if (options.recvBufSz > 0) {
+		socket.set_option(boost::asio::socket_base::receive_buffer_size(options.recvBufSz));
+	}
+
+	socket.set_option(boost::asio::socket_base::keep_alive(options.keepAlive));
+	if (!options.keepAlive) {
+		return;
+	}
+
+	// The probe timing has no portable option, the system defaults wait hours before the first probe
+#ifdef _WIN32
+	tcp_keepalive values{ 1, options.keepAliveIdleS * 1000, options.keepAliveIntervalS * 1000 };
+	DWORD returned{ 0 };
+	WSAIoctl(socket.native_handle(), SIO_KEEPALIVE_VALS, &values, sizeof(values), nullptr, 0, &returned, nullptr, nullptr);
+#else
+	int idle = static_cast<int>(options.keepAliveIdleS);
+	int interval = static_cast<int>(options.keepAliveIntervalS);
+#ifdef TCP_KEEPIDLE
+	setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#else
+	setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(idle));
+#endif
+	setsockopt(socket.native_handle(), IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+#endif
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <filesystem>
+#include <boost/asio.hpp>
+
+#include "Connection.h"
+#include "Metrics.h"
+#include "Config.h"
+
+// The servers to connect to and the options of the sockets connected to them
+struct ConnectionOptions {
+	// A server address and port
+	struct Endpoint {
+		std::string addr;
+		std::string port;
+	};
+
+	std::vector<Endpoint> endpoints; // Tried in order, the first one that accepts the connection is used
+	bool noDelay{ true }; // Sends small requests right away instead of coalescing them
+	int sendBufSz{ 0 }; // Socket send buffer size, 0 keeps the system default
+	int recvBufSz{ 0 }; // Socket receive buffer size, 0 keeps the system default
+	bool keepAlive{ true }; // Probes an idle connection so a dead server is noticed
+	uint32_t keepAliveIdleS{ Config::KEEPALIVE_IDLE_S };
+	uint32_t keepAliveIntervalS{ Config::KEEPALIVE_INTERVAL_S };
+
+	// Loads the options from a file of 'key=value' lines, 'server=addr:port' may appear several times
+	// A missing file (or one without servers) falls back to the default server
+	static ConnectionOptions load(const std::filesystem::path& path);
+};
+
+// Owns the connection of the CLI handlers and keeps it alive.
+// The connection is opened on first use, and a broken connection is replaced by a background thread that retries with a growing delay,
+// moving on to the next endpoint whenever one refuses. Requests made meanwhile wait for the new connection, and are sent again on it if they didn't go out yet or are safe to repeat.
+class ConnectionManager
+{
+public:
+	using io_ctx_t = boost::asio::io_context;
+	using socket_t = boost::asio::ip::tcp::socket;
+
+	// When an exchange whose connection broke is run again on the next connection
+	enum class Retry {
+		UNSENT, // Only if none of its requests went out, the server may have handled a request whose response was lost (e.g. a message would be delivered twice)
+		ALWAYS, // Its requests are safe to repeat (e.g. they only read)
+	};
+
+	ConnectionManager(io_ctx_t& ctx, ConnectionOptions options);
+
+	// Runs 'fn' (requests and the reads of their responses) on the connection and returns what it returns
+	// If the connection breaks on the way, 'fn' is run again from the start on the next connection as 'retry' allows, up to Config::REQUEST_MAX_ATTEMPTS times
+	// Any failure after a request went out drops the connection, since a half-sent request or an unread response leaves it out of sync
+	template<typename Fn>
+	auto exchange(Fn fn, Retry retry = Retry::UNSENT);
+
+	// Sends a request and receives its response, see exchange
+	Response request(Request& req, Retry retry = Retry::UNSENT);
+
+	// Connects to the first endpoint that accepts, starting at 'nextEndpoint', and sets it to the one that accepted
+	static std::unique_ptr<Connection> connect(io_ctx_t& ctx, const ConnectionOptions& options, size_t& nextEndpoint);
+
+	// Stops the reconnect thread
+	~ConnectionManager();
+
+private:
+	enum class State {
+		IDLE, // Not connected yet
+		CONNECTED,
+		RECONNECTING,
+	};
+
+	// Waits for the connection, throws if it isn't back within Config::RECONNECT_HOLD_MS
+	Connection& acquire();
+
+	// Throws away the connection and wakes the reconnect thread
+	void drop();
+
+	// Body of the reconnect thread
+	void reconnectLoop();
+
+	// Applies the socket options to a connected socket
+	static void applyOptions(socket_t& socket, const ConnectionOptions& options);
+
+private:
+	io_ctx_t& m_ctx;
+	ConnectionOptions m_options;
+
+	std::mutex m_mutex; // Guards everything below, shared with the reconnect thread
+	std::condition_variable m_cv;
+	State m_state{ State::IDLE };
+	std::unique_ptr<Connection> m_conn;
+	size_t m_nextEndpoint{ 0 }; // Endpoint the next connect starts at
+	std::string m_lastError; // Why the last connect failed
+	bool m_isStopped{ false };
+	std::thread m_thread;
+};
+
+template<typename Fn>
+auto ConnectionManager::exchange(Fn fn, Retry retry)
+{
+	for (uint32_t attempt = 1;; attempt++) {
+		auto& conn = acquire();
+		auto requestsBefore = conn.getRequestsStarted();
+		try {
+			return fn(conn);
+		}
+		catch (const std::exception& e) {
+			bool isSent = conn.getRequestsStarted() != requestsBefore;
+			bool isBroken = dynamic_cast<const boost::system::system_error*>(&e) != nullptr;
+
+			// Whatever was in flight is lost with the connection
+			if (isSent || isBroken) {
+				drop();
+			}
+
+			// Only a broken connection is worth another attempt, other errors would fail the same way
+			if (!isBroken || (isSent && retry != Retry::ALWAYS) || attempt >= Config::REQUEST_MAX_ATTEMPTS) {
+				throw;
+			}
+			Metrics::add(MetricCounter::RETRIES);
+		}
+	}
+}
@@ -0,0 +1,128 @@
+#include "DeflateWrapper.h"
+
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+
+// Moves the output that is ready in a filter with no attached sink to the end of 'out'
+template<typename Filter>
+static void drainFilter(Filter& filter, std::string& out)
+{
+	size_t ready = static_cast<size_t>(filter.MaxRetrievable());
+	size_t offset = out.size();
+	out.resize(offset + ready);
+	filter.Get(reinterpret_cast<CryptoPP::byte*>(&out[offset]), ready);
+}
+
+
+std::optional<std::string> DeflateWrapper::compress(const char* plain, size_t length)
+{
+	if (length < Config::COMPRESS_MIN_SZ) {
+		return std::nullopt;
+	}
+
+	// Already compressed contents are told by their first bytes, without compressing all of them
+	if (length > Config::COMPRESS_SAMPLE_SZ && !isCompressible(plain, length)) {
+		return std::nullopt;
+	}
+
+	std::string compressed;
+	Compressor compressor;
+	compressor.update(plain, length, compressed);
+	compressor.final(compressed);
+
+	// The receiver pays for decompressing, so a small saving isn't worth it
+	if (compressed.size() > length - length * Config::COMPRESS_MIN_SAVING_PCT / 100) {
+		return std::nullopt;
+	}
+
+	return compressed;
+}
+
+std::string DeflateWrapper::decompress(const char* data, size_t length, size_t maxSz)
+{
+	std::string plain;
+	Decompressor decompressor(maxSz);
+
+	// Fed in blocks, so the limit is checked before the output of a large content piles up
+	for (size_t offset = 0; offset < length; offset += Config::FILE_BLOCK_SZ) {
+		decompressor.update(data + offset, std::min(length - offset, Config::FILE_BLOCK_SZ), plain);
+	}
+	decompressor.final(plain);
+
+	return plain;
+}
+
+bool DeflateWrapper::isCompressible(const char* sample, size_t length)
+{
+	return compress(sample, std::min(length, Config::COMPRESS_SAMPLE_SZ)).has_value();
+}
+
+uint64_t DeflateWrapper::compressedSize(std::istream& in)
+{
+	Compressor compressor;
+	std::vector<char> block(Config::FILE_BLOCK_SZ);
+	std::string out;
+	uint64_t size{ 0 };
+
+	while (in) {
+		in.read(block.data(), block.size());
+		if (in.bad()) {
+			throw std::runtime_error("Error: Failed reading the content to compress");
+		}
+
+		out.clear();
+		compressor.update(block.data(), static_cast<size_t>(in.gcount()), out);
+		size += out.size();
+	}
+
+	out.clear();
+	compressor.final(out);
+	return size + out.size();
+}
+
+DeflateWrapper::Compressor::Compressor()
+	: _deflator{ nullptr, CryptoPP::Deflator::DEFAULT_DEFLATE_LEVEL }
+{
+}
+
+void DeflateWrapper::Compressor::update(const char* plain, size_t length, std::string& out)
+{
+	_deflator.Put(reinterpret_cast<const CryptoPP::byte*>(plain), length);
+	drainFilter(_deflator, out);
+}
+
+void DeflateWrapper::Compressor::final(std::string& out)
+{
+	_deflator.MessageEnd();
+	drainFilter(_deflator, out);
+}
+
+DeflateWrapper::Decompressor::Decompressor(uint64_t maxSz)
+	: _inflator{}, _maxSz{ maxSz }, _outSz{ 0 }
+{
+}
+
+void DeflateWrapper::Decompressor::drain(std::string& out)
+{
+	// Checked before the output is copied, a small content may expand to a huge one
+	_outSz += _inflator.MaxRetrievable();
+	if (_outSz > _maxSz) {
+		throw std::length_error("Error: Decompressed content is larger than " + std::to_string(_maxSz) + " bytes");
+	}
+
+	drainFilter(_inflator, out);
+}
+
+void DeflateWrapper::Decompressor::update(const char* data, size_t length, std::string& out)
+{
+	_inflator.Put(reinterpret_cast<const CryptoPP::byte*>(data), length);
+	drain(out);
+}
+
+void DeflateWrapper::Decompressor::final(std::string& out)
+{
+	_inflator.MessageEnd();
+	drain(out);
+}
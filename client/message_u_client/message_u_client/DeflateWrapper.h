@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <optional>
+#include <istream>
+#include <cstdint>
+
+#include <zdeflate.h>
+#include <zinflate.h>
+
+#include "Config.h"
+
+
+// Raw deflate (RFC 1951) of message contents, a content is compressed before it is encrypted and decompressed after it is decrypted
+class DeflateWrapper
+{
+public:
+	// Compresses a content, returns std::nullopt if it is too small or doesn't shrink enough to be worth it
+	static std::optional<std::string> compress(const char* plain, size_t length);
+
+	// Decompresses a content, throws if it would grow past 'maxSz'
+	static std::string decompress(const char* data, size_t length, size_t maxSz = Config::INFLATE_MAX_SZ);
+
+	// Checks if a content compresses, by compressing a sample (its first bytes), already compressed contents don't
+	static bool isCompressible(const char* sample, size_t length);
+
+	// Returns the compressed size of the rest of a stream, by compressing it and throwing the output away
+	static uint64_t compressedSize(std::istream& in);
+
+	// Compresses a content incrementally, so it never has to be held in memory as a whole
+	class Compressor
+	{
+	private:
+		CryptoPP::Deflator _deflator;
+
+		Compressor(const Compressor& comp);
+		Compressor& operator=(const Compressor& comp);
+	public:
+		Compressor();
+
+		// Compresses the next part of the content, appends the output that is ready to 'out'
+		void update(const char* plain, size_t length, std::string& out);
+
+		// Compresses the rest of the content, appends it to 'out'
+		void final(std::string& out);
+	};
+
+	// Decompresses a content incrementally, so it can be processed while it is still arriving
+	class Decompressor
+	{
+	private:
+		CryptoPP::Inflator _inflator;
+		uint64_t _maxSz;
+		uint64_t _outSz;
+
+		Decompressor(const Decompressor& decomp);
+		Decompressor& operator=(const Decompressor& decomp);
+
+		// Moves the ready output to 'out', throws if the content grew past its limit
+		void drain(std::string& out);
+	public:
+		// Throws once the content decompresses to more than 'maxSz' bytes
+		explicit Decompressor(uint64_t maxSz = UINT64_MAX);
+
+		// Decompresses the next part of the content, appends the output that is ready to 'out'
+		void update(const char* data, size_t length, std::string& out);
+
+		// Checks that the content ended, appends the rest of the output to 'out'
+		void final(std::string& out);
+	};
+};
@@ -0,0 +1,129 @@
+#include "ECWrapper.h"
+
+#include <hkdf.h>
+#include <sha.h>
+
+#include <stdexcept>
+
+namespace {
+	constexpr char DERIVE_INFO[] = "MessageU X25519 symmetric key";
+
+	// The Ed25519 seed of a private key, checked before the signer reads it
+	const CryptoPP::byte* signingKey(const std::string& key) {
+		if (key.size() != ECPrivateWrapper::KEYSIZE) {
+			throw std::invalid_argument("Error: X25519 private key is '" + std::to_string(key.size()) + "' bytes but should be '" + std::to_string(ECPrivateWrapper::KEYSIZE) + "'");
+		}
+		return reinterpret_cast<const CryptoPP::byte*>(key.data() + CryptoPP::x25519::SECRET_KEYLENGTH);
+	}
+}
+
+ECPublicWrapper::ECPublicWrapper(const std::string& key)
+	: _publicKey{ key }
+{
+	if (key.size() != KEYSIZE) {
+		throw std::invalid_argument("Error: X25519 public key is '" + std::to_string(key.size()) + "' bytes but should be '" + std::to_string(KEYSIZE) + "'");
+	}
+
+	// The agreement key is only taken if the identity key signed it
+	if (!verify(key.substr(0, AGREE_KEYSIZE), key.substr(AGREE_KEYSIZE + SIGN_KEYSIZE))) {
+		throw std::invalid_argument("Error: X25519 public key isn't signed by its Ed25519 key");
+	}
+}
+
+ECPublicWrapper::~ECPublicWrapper()
+{
+}
+
+std::string ECPublicWrapper::getPublicKey() const
+{
+	return _publicKey;
+}
+
+const CryptoPP::byte* ECPublicWrapper::getAgreementKey() const
+{
+	return reinterpret_cast<const CryptoPP::byte*>(_publicKey.data());
+}
+
+std::string ECPublicWrapper::getIdentityKey() const
+{
+	return _publicKey.substr(AGREE_KEYSIZE, SIGN_KEYSIZE);
+}
+
+bool ECPublicWrapper::verify(const std::string& message, const std::string& signature) const
+{
+	CryptoPP::ed25519Verifier verifier(reinterpret_cast<const CryptoPP::byte*>(_publicKey.data() + AGREE_KEYSIZE));
+	return verifier.VerifyMessage(reinterpret_cast<const CryptoPP::byte*>(message.data()), message.size(),
+		reinterpret_cast<const CryptoPP::byte*>(signature.data()), signature.size());
+}
+
+
+
+ECPrivateWrapper::ECPrivateWrapper()
+	: _signer(_rng)
+{
+	CryptoPP::byte agreePublic[CryptoPP::x25519::PUBLIC_KEYLENGTH];
+	_domain.GenerateKeyPair(_rng, _agreeKey, agreePublic);
+	buildPublicKey();
+}
+
+ECPrivateWrapper::ECPrivateWrapper(const std::string& key)
+	: _signer(signingKey(key))
+{
+	std::copy(key.begin(), key.begin() + sizeof(_agreeKey), _agreeKey);
+	buildPublicKey();
+}
+
+ECPrivateWrapper::~ECPrivateWrapper()
+{
+}
+
+void ECPrivateWrapper::buildPublicKey()
+{
+	CryptoPP::byte agreePublic[CryptoPP::x25519::PUBLIC_KEYLENGTH];
+	_domain.GeneratePublicKey(_rng, _agreeKey, agreePublic);
+
+	const auto& signKey = dynamic_cast<const CryptoPP::ed25519PrivateKey&>(_signer.GetPrivateKey());
+	std::string agreeKey(reinterpret_cast<const char*>(agreePublic), sizeof(agreePublic));
+
+	_publicKey = agreeKey;
+	_publicKey.append(reinterpret_cast<const char*>(signKey.GetPublicKeyBytePtr()), ECPublicWrapper::SIGN_KEYSIZE);
+	_publicKey += sign(agreeKey);
+}
+
+std::string ECPrivateWrapper::getPrivateKey() const
+{
+	const auto& signKey = dynamic_cast<const CryptoPP::ed25519PrivateKey&>(_signer.GetPrivateKey());
+	std::string key(reinterpret_cast<const char*>(_agreeKey), sizeof(_agreeKey));
+	key.append(reinterpret_cast<const char*>(signKey.GetPrivateKeyBytePtr()), CryptoPP::ed25519Signer::SECRET_KEYLENGTH);
+	return key;
+}
+
+std::string ECPrivateWrapper::getPublicKey() const
+{
+	return _publicKey;
+}
+
+std::string ECPrivateWrapper::sign(const std::string& message)
+{
+	std::string signature(ECPublicWrapper::SIGNATURE_SIZE, '\0');
+	_signer.SignMessage(_rng, reinterpret_cast<const CryptoPP::byte*>(message.data()), message.size(),
+		reinterpret_cast<CryptoPP::byte*>(signature.data()));
+	return signature;
+}
+
+std::string ECPrivateWrapper::deriveSymKey(const ECPublicWrapper& peer, const std::string& salt, unsigned int length)
+{
+	CryptoPP::byte shared[CryptoPP::x25519::SHARED_KEYLENGTH];
+	if (!_domain.Agree(shared, _agreeKey, peer.getAgreementKey())) {
+		throw std::runtime_error("Error: X25519 key agreement failed");
+	}
+
+	// The raw shared secret isn't uniform, HKDF turns it into the key
+	std::string key(length, '\0');
+	CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+	hkdf.DeriveKey(reinterpret_cast<CryptoPP::byte*>(key.data()), key.size(),
+		shared, sizeof(shared),
+		reinterpret_cast<const CryptoPP::byte*>(salt.data()), salt.size(),
+		reinterpret_cast<const CryptoPP::byte*>(DERIVE_INFO), sizeof(DERIVE_INFO) - 1);
+	return key;
+}
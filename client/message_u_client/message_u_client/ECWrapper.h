@@ -0,0 +1,72 @@
+#pragma once
+
+#include <osrng.h>
+#include <xed25519.h>
+
+#include <string>
+
+
+
+// The public key of a client that registered in protocol v4: the X25519 key it agrees on symmetric keys with,
+// its Ed25519 identity key, and the Ed25519 signature of the X25519 key.
+// The signature only proves that the agreement key belongs to the identity key. Peers pin the identity key the first time they see it
+// (see ClientState::setPubKey), so the first key of a client is still taken on the server's word, but the server can't swap it later
+class ECPublicWrapper
+{
+public:
+	static const unsigned int AGREE_KEYSIZE = CryptoPP::x25519::PUBLIC_KEYLENGTH;
+	static const unsigned int SIGN_KEYSIZE = CryptoPP::ed25519Signer::PUBLIC_KEYLENGTH;
+	static const unsigned int SIGNATURE_SIZE = CryptoPP::ed25519Signer::SIGNATURE_LENGTH;
+	static const unsigned int KEYSIZE = AGREE_KEYSIZE + SIGN_KEYSIZE + SIGNATURE_SIZE;
+
+private:
+	std::string _publicKey;
+
+	ECPublicWrapper(const ECPublicWrapper& ecpublic);
+	ECPublicWrapper& operator=(const ECPublicWrapper& ecpublic);
+public:
+	// Throws if the key is of invalid length or its X25519 key isn't signed by its Ed25519 key
+	ECPublicWrapper(const std::string& key);
+	~ECPublicWrapper();
+
+	std::string getPublicKey() const;
+	const CryptoPP::byte* getAgreementKey() const;
+
+	// Gets the Ed25519 key that signed the agreement key
+	std::string getIdentityKey() const;
+
+	bool verify(const std::string& message, const std::string& signature) const;
+};
+
+
+class ECPrivateWrapper
+{
+public:
+	static const unsigned int KEYSIZE = CryptoPP::x25519::SECRET_KEYLENGTH + CryptoPP::ed25519Signer::SECRET_KEYLENGTH;
+
+private:
+	CryptoPP::AutoSeededRandomPool _rng;
+	CryptoPP::x25519 _domain;
+	CryptoPP::byte _agreeKey[CryptoPP::x25519::SECRET_KEYLENGTH];
+	CryptoPP::ed25519Signer _signer;
+	std::string _publicKey;
+
+	ECPrivateWrapper(const ECPrivateWrapper& ecprivate);
+	ECPrivateWrapper& operator=(const ECPrivateWrapper& ecprivate);
+
+	// Builds the public key from the private keys
+	void buildPublicKey();
+public:
+	ECPrivateWrapper();
+	ECPrivateWrapper(const std::string& key);
+	~ECPrivateWrapper();
+
+	std::string getPrivateKey() const;
+	std::string getPublicKey() const;
+
+	std::string sign(const std::string& message);
+
+	// Derives the symmetric key shared with the owner of 'peer', the peer derives the same key from our public key.
+	// 'salt' has to be the same on both sides, e.g. both client IDs in a fixed order
+	std::string deriveSymKey(const ECPublicWrapper& peer, const std::string& salt, unsigned int length);
+};
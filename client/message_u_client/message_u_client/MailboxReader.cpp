@@ -0,0 +1,111 @@
+#include "MailboxReader.h"
+#include "ReqPayload.h"
+#include "Config.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+MailboxReader::MailboxReader(Connection& conn, const std::string& clientId, const MessagesMetaView& meta, std::vector<uint32_t>& doneIds)
+	: m_conn{ conn }, m_clientId{ clientId }, m_doneIds{ doneIds }
+{
+	std::unordered_set<uint32_t> done{ doneIds.begin(), doneIds.end() };
+	m_msgs.reserve(meta.msgs.size());
+	for (const auto& msg : meta.msgs) {
+		if (done.count(msg.msgId) == 0) {
+			m_msgs.push_back({ std::string(msg.senderId), msg.msgId, msg.msgType, msg.flags, msg.contentSz });
+		}
+	}
+}
+
+std::optional<MailboxReader::MessageHeader> MailboxReader::next()
+{
+	finishCurrent();
+
+	if (m_connError) {
+		std::rethrow_exception(m_connError);
+	}
+
+	if (m_next == m_msgs.size()) {
+		return std::nullopt;
+	}
+
+	m_current = m_msgs[m_next++];
+	m_contentLeft = m_current->contentSz;
+	m_isFailed = false;
+	return m_current;
+}
+
+size_t MailboxReader::readContent(char* out, size_t maxSz)
+{
+	if (m_contentLeft == 0 || maxSz == 0) {
+		return 0;
+	}
+
+	if (m_rangeLeft.empty()) {
+		fetchRange();
+	}
+
+	auto readSz = std::min(maxSz, m_rangeLeft.size());
+	std::memcpy(out, m_rangeLeft.data(), readSz);
+	m_rangeLeft.remove_prefix(readSz);
+	m_contentLeft -= static_cast<uint32_t>(readSz);
+	return readSz;
+}
+
+void MailboxReader::skipContent()
+{
+	// Nothing was fetched for the rest of the content, so nothing has to be read past
+	m_contentLeft = 0;
+	m_rangeLeft = {};
+	m_range.reset();
+}
+
+uint32_t MailboxReader::contentLeft() const
+{
+	return m_contentLeft;
+}
+
+void MailboxReader::fetchRange()
+{
+	auto offset = m_current->contentSz - m_contentLeft;
+	Request req{ m_clientId,
+		RequestCodes::FETCH_MSG,
+		std::make_unique<FetchMessageReqPayload>(m_current->msgId, offset, std::min(m_contentLeft, Config::FETCH_RANGE_SZ)) };
+
+	try {
+		m_range.reset();
+		m_conn.send(req);
+		m_range.emplace(m_conn.recvResponse());
+	}
+	catch (const boost::system::system_error&) {
+		m_connError = std::current_exception();
+		m_isFailed = true;
+		throw;
+	}
+
+	// Another client of the same identity may have acknowledged the message in between
+	if (m_range->getHeader().code != ResponseCodes::MSG_CONTENT) {
+		m_isFailed = true;
+		throw std::runtime_error("Error: Message '" + std::to_string(m_current->msgId) + "' is no longer on the server");
+	}
+
+	const auto& view = std::get<MessageContentView>(m_range->getView());
+	if (view.msgId != m_current->msgId || view.offset != offset || view.contentSz != m_current->contentSz || view.range.empty()) {
+		m_isFailed = true;
+		throw std::runtime_error("Error: Server answered the fetch of message '" + std::to_string(m_current->msgId) + "' at offset " +
+								 std::to_string(offset) + " with message '" + std::to_string(view.msgId) + "' at offset " + std::to_string(view.offset));
+	}
+
+	m_rangeLeft = view.range.substr(0, m_contentLeft);
+}
+
+void MailboxReader::finishCurrent()
+{
+	if (m_current && !m_isFailed) {
+		m_doneIds.push_back(m_current->msgId);
+	}
+
+	skipContent();
+	m_current.reset();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <string_view>
+
+#include "Connection.h"
+
+// Reads the messages that a POLL_META answer listed, their content is fetched by range while it is pulled.
+// At most one range is held at a time and a message whose content is skipped is never downloaded.
+// The messages stay on the server until they are acknowledged, the reader collects the IDs of the ones it read so the caller can acknowledge them.
+class MailboxReader : public MessageReader {
+public:
+	// 'doneIds' collects the IDs of the messages that were read, the messages it already holds are skipped (an earlier connection read them)
+	MailboxReader(Connection& conn, const std::string& clientId, const MessagesMetaView& meta, std::vector<uint32_t>& doneIds);
+
+	// Also throws the connection error that failed the last fetch, the messages that follow can't be fetched either
+	std::optional<MessageHeader> next() override;
+
+	size_t readContent(char* out, size_t maxSz) override;
+	using MessageReader::readContent;
+	void skipContent() override;
+	uint32_t contentLeft() const override;
+
+private:
+	// Fetches the next range of the current message content
+	void fetchRange();
+
+	// Marks the current message as read, unless fetching its content failed
+	void finishCurrent();
+
+private:
+	Connection& m_conn;
+	std::string m_clientId;
+	std::vector<MessageHeader> m_msgs; // Messages left to read, in the order of the poll
+	size_t m_next{ 0 }; // Index of the message next() moves to
+	std::vector<uint32_t>& m_doneIds;
+
+	std::optional<MessageHeader> m_current;
+	uint32_t m_contentLeft{ 0 }; // Bytes of the current message content that were not read yet
+	bool m_isFailed{ false }; // Fetching the current message content failed, it stays on the server
+	std::exception_ptr m_connError; // The connection broke while fetching
+
+	std::optional<Response> m_range; // Response of the last fetch, it holds the range
+	std::string_view m_rangeLeft; // Bytes of the range that were not read yet
+};
@@ -0,0 +1,181 @@
+#include "MessageHandler.h"
+#include "Client.h"
+#include "Config.h"
+#include "Utils.h"
+#include "AESWrapper.h"
+#include "DeflateWrapper.h"
+#include "Metrics.h"
+
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+MessageHandler::MessageHandler(ClientState& state, std::mutex& stateMutex, pool_t& pool, size_t workers)
+	: m_state{ state }, m_stateMutex{ stateMutex }, m_pool{ pool }, m_workers{ workers }, m_batch{ state, pool, workers }
+{
+}
+
+void MessageHandler::handle(reader_t& reader, const msg_header_t& msg, std::ostream& out)
+{
+	// Everything but files is small enough to be decrypted later as part of a batch
+	if (msg.msgType != MessageTypes::SEND_FILE) {
+		addToBatch(reader, msg, out);
+		return;
+	}
+
+	// Files are streamed straight to disk, the messages before them are written first so the output keeps its order
+	flush(out);
+	onFile(reader, msg, out);
+
+	// Whatever wasn't consumed (messages that can't be decrypted) is discarded
+	reader.skipContent();
+	out << "\n-----<EOM>-----\n\n";
+}
+
+void MessageHandler::flush(std::ostream& out)
+{
+	// The batch reads the ciphers and stores the keys it unwraps as it goes
+	std::lock_guard<std::mutex> lock{ m_stateMutex };
+	m_batch.flush(out);
+}
+
+void MessageHandler::handleAll(reader_t& reader, std::ostream& out)
+{
+	while (auto msg = reader.next()) {
+		Metrics::add(MetricCounter::MESSAGES_RECEIVED);
+		try {
+			handle(reader, *msg, out);
+		}
+		catch (const std::exception& e) {
+			// Skip the rest of the failed message so the following ones are still read from the right offset
+			reader.skipContent();
+			flush(out);
+			out << e.what() << "\n\n";
+		}
+	}
+
+	// Decrypt whatever is left in the last batch
+	flush(out);
+}
+
+void MessageHandler::addToBatch(reader_t& reader, const msg_header_t& msg, std::ostream& out)
+{
+	// Only keys and texts have content worth keeping, unknown types are discarded
+	std::string content;
+	if (msg.msgType == MessageTypes::SEND_SYM_KEY || msg.msgType == MessageTypes::SEND_TXT ||
+		msg.msgType == MessageTypes::SEND_GROUP_KEY || msg.msgType == MessageTypes::SEND_GROUP_TXT) {
+		content = reader.readContent();
+	}
+	else {
+		reader.skipContent();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		m_batch.add(msg, std::move(content));
+	}
+
+	// Bound the memory held by the batch
+	if (m_batch.getContentSize() >= Config::DECRYPT_BATCH_SZ) {
+		flush(out);
+	}
+}
+
+void MessageHandler::onFile(reader_t& reader, const msg_header_t& msg, std::ostream& out)
+{
+	// Get the sender name and sym key, the content is then decrypted with the cipher without holding the state lock
+	std::shared_ptr<AESWrapper> cipher;
+	{
+		std::lock_guard<std::mutex> lock{ m_stateMutex };
+		auto username = m_state.getNameByUUID(msg.senderId);
+		out << "From: " << username << '\n';
+		out << "Content:\n";
+
+		if (m_state.hasSymKey(username)) {
+			cipher = m_state.getSymCipher(username);
+		}
+	}
+
+	// If there is no sym key, print an error message
+	if (!cipher) {
+		out << "can't decrypt message";
+		return;
+	}
+
+	// Create a unique filename in the temp directory, the content is written next to it and only takes the name once it is authenticated
+	auto path = Utils::getUniquePath(msg.msgId);
+	auto partPath = path;
+	partPath += ".part";
+	std::ofstream file{ partPath, std::ios::binary };
+
+	// If the file can't be opened, throw a runtime error
+	if (!file.is_open()) {
+		throw std::runtime_error("Error: Could not open '" + partPath.string() + "'");
+	}
+
+	// Decrypt the file content to the file while it is still arriving, a content that fails the padding or tag check leaves no file behind
+	try {
+		decryptContent(reader, *cipher, msg.flags, file);
+		file.close();
+		if (!file) {
+			throw std::runtime_error("Error: Could not write '" + partPath.string() + "'");
+		}
+		std::filesystem::rename(partPath, path);
+	}
+	catch (...) {
+		file.close();
+		std::error_code ec;
+		std::filesystem::remove(partPath, ec);
+		throw;
+	}
+
+	// Print the file path
+	out << "File saved to: " << path;
+}
+
+void MessageHandler::decryptContent(reader_t& reader, AESWrapper& cipher, uint8_t flags, std::ostream& sink)
+{
+	// The GCM segments of a file are opened on the worker threads, a few at a time
+	auto mode = (flags & MessageFlags::GCM) ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+	AESWrapper::Decryptor decryptor(cipher, mode, &m_pool, m_workers);
+	DeflateWrapper::Decompressor decompressor;
+	bool isCompressed = flags & MessageFlags::COMPRESSED;
+	std::vector<char> block(Config::FILE_BLOCK_SZ);
+	std::string plain, inflated;
+
+	// Only the decryption is timed, the reads from the socket and the writes to disk interleave with it
+	Metrics::Timer decrypt{ MetricPhase::DECRYPT, false };
+
+	// Writes a decrypted part, decompressed first if the sender compressed the content
+	auto write = [&](bool isLast) {
+		if (!isCompressed) {
+			sink.write(plain.data(), plain.size());
+			return;
+		}
+
+		inflated.clear();
+		decrypt.resume();
+		decompressor.update(plain.data(), plain.size(), inflated);
+		if (isLast) {
+			decompressor.final(inflated);
+		}
+		decrypt.pause();
+		sink.write(inflated.data(), inflated.size());
+	};
+
+	// Pull the content in bounded blocks and write the plain text as soon as it is ready
+	while (auto readSz = reader.readContent(block.data(), block.size())) {
+		plain.clear();
+		decrypt.resume();
+		decryptor.update(block.data(), readSz, plain);
+		decrypt.pause();
+		write(false);
+	}
+
+	plain.clear();
+	decrypt.resume();
+	decryptor.final(plain);
+	decrypt.pause();
+	write(true);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <mutex>
+
+#include "Connection.h"
+#include "BatchDecryptor.h"
+
+// Forward declarations
+class ClientState;
+class AESWrapper;
+
+// Handles the messages of a poll while they are pulled from the socket or fetched from the server.
+// Keys and texts are collected into batches that are decrypted on a pool of worker threads.
+// Files are decrypted in bounded blocks straight to disk, so a file is never held in memory as a whole.
+// The state lock is only held while the state is read or updated, never while a content is read from the server.
+class MessageHandler
+{
+public:
+	using reader_t = MessageReader;
+	using msg_header_t = MessageReader::MessageHeader;
+
+	using pool_t = BatchDecryptor::pool_t;
+
+	MessageHandler(ClientState& state, std::mutex& stateMutex, pool_t& pool, size_t workers);
+
+	// Handles the message the reader is positioned at and consumes its content, its description is written to 'out' (possibly on a later call)
+	void handle(reader_t& reader, const msg_header_t& msg, std::ostream& out);
+
+	// Decrypts the messages that are still batched and writes them to 'out'
+	void flush(std::ostream& out);
+
+	// Handles every message of the reader, a message that fails is reported to 'out' and skipped
+	void handleAll(reader_t& reader, std::ostream& out);
+
+private:
+	// Reads the content of a key or text message into the batch
+	void addToBatch(reader_t& reader, const msg_header_t& msg, std::ostream& out);
+
+	// Decrypts a file to a unique path in the temp directory
+	void onFile(reader_t& reader, const msg_header_t& msg, std::ostream& out);
+
+	// Decrypts (and decompresses, as 'flags' say) the rest of the current content block by block into 'sink' using the sender's cipher
+	void decryptContent(reader_t& reader, AESWrapper& cipher, uint8_t flags, std::ostream& sink);
+
+private:
+	ClientState& m_state; // Reference to the client state, reads the symmetric keys and stores new ones
+	std::mutex& m_stateMutex; // Guards the state, shared with the CLI handlers and the push listener
+	pool_t& m_pool; // Worker threads, shared with the batch
+	size_t m_workers; // Number of threads in the pool
+	BatchDecryptor m_batch; // Keys and texts waiting to be decrypted
+};
@@ -0,0 +1,366 @@
+#include "Metrics.h"
+#include "Utils.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	// Tag of the phases of this thread, the default one falls into the last slot
+	thread_local RequestCodes t_currentCode{ RequestCodes(0) };
+
+	const char* PHASE_NAMES[] = { "serialize", "encrypt", "write", "first_byte", "read_payload", "parse", "decrypt", "render" };
+	const char* COUNTER_NAMES[] = { "bytes_sent", "bytes_received", "messages_received", "retries", "connects" };
+
+	// Gets the index of the highest set bit of a non zero value
+	unsigned highestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return static_cast<unsigned>(index);
+#else
+		return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+	}
+
+	const char* codeName(RequestCodes code)
+	{
+		switch (code) {
+		case RequestCodes::REGISTER: return "REGISTER";
+		case RequestCodes::USRS_LIST: return "USRS_LIST";
+		case RequestCodes::GET_PUB_KEY: return "GET_PUB_KEY";
+		case RequestCodes::SEND_MSG: return "SEND_MSG";
+		case RequestCodes::POLL_MSGS: return "POLL_MSGS";
+		case RequestCodes::LONG_POLL: return "LONG_POLL";
+		case RequestCodes::SEND_MULTI_MSG: return "SEND_MULTI_MSG";
+		case RequestCodes::USRS_DELTA: return "USRS_DELTA";
+		case RequestCodes::POLL_META: return "POLL_META";
+		case RequestCodes::FETCH_MSG: return "FETCH_MSG";
+		case RequestCodes::ACK_MSGS: return "ACK_MSGS";
+		case RequestCodes::POLL_PAGE: return "POLL_PAGE";
+		case RequestCodes::CREATE_GROUP: return "CREATE_GROUP";
+		case RequestCodes::SEND_GROUP_MSG: return "SEND_GROUP_MSG";
+		default: return "OTHER";
+		}
+	}
+
+	double toMs(double ns)
+	{
+		return ns / 1e6;
+	}
+}
+
+static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == static_cast<size_t>(MetricPhase::COUNT), "Every phase needs a name");
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == static_cast<size_t>(MetricCounter::COUNT), "Every counter needs a name");
+
+std::atomic<bool> Metrics::s_isEnabled{ Config::COLLECT_METRICS };
+
+void Metrics::Histogram::record(uint64_t ns)
+{
+	ns = std::min(ns, (uint64_t{ 1 } << MAX_VALUE_BITS) - 1);
+
+	m_buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(ns, std::memory_order_relaxed);
+
+	auto max = m_max.load(std::memory_order_relaxed);
+	while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+	}
+}
+
+Metrics::Histogram::Summary Metrics::Histogram::summarize() const
+{
+	// The buckets are copied first, the percentiles are taken from the copy so they agree with each other
+	std::array<uint64_t, BUCKETS> buckets;
+	Summary summary;
+	for (size_t i = 0; i < BUCKETS; i++) {
+		buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+		summary.count += buckets[i];
+	}
+
+	if (summary.count == 0) {
+		return summary;
+	}
+
+	summary.max = m_max.load(std::memory_order_relaxed);
+	summary.mean = static_cast<double>(m_sum.load(std::memory_order_relaxed)) / m_count.load(std::memory_order_relaxed);
+
+	auto percentile = [&](double p) {
+		auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(p * summary.count + 0.5));
+		uint64_t seen{ 0 };
+		for (size_t i = 0; i < BUCKETS; i++) {
+			seen += buckets[i];
+			if (seen >= rank) {
+				return std::min(highestOf(i), summary.max);
+			}
+		}
+		return summary.max;
+	};
+
+	summary.p50 = percentile(0.50);
+	summary.p90 = percentile(0.90);
+	summary.p99 = percentile(0.99);
+	return summary;
+}
+
+void Metrics::Histogram::reset()
+{
+	for (auto& bucket : m_buckets) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+size_t Metrics::Histogram::bucketOf(uint64_t value)
+{
+	// Small values are exact, the rest keep SUB_BUCKET_BITS bits below their highest bit
+	if (value < SUB_BUCKETS) {
+		return static_cast<size_t>(value);
+	}
+
+	auto shift = highestBit(value) - SUB_BUCKET_BITS;
+	auto sub = static_cast<size_t>(value >> shift) - SUB_BUCKETS;
+	return SUB_BUCKETS + shift * SUB_BUCKETS + sub;
+}
+
+uint64_t Metrics::Histogram::highestOf(size_t bucket)
+{
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+
+	auto shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+	auto sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+	return ((uint64_t{ SUB_BUCKETS } + sub + 1) << shift) - 1;
+}
+
+Metrics::Timer::Timer(RequestCodes code, MetricPhase phase, bool isRunning)
+	: m_isActive{ isEnabled() }, m_hasCode{ true }, m_code{ code }, m_phase{ phase }, m_exceptions{ m_isActive ? std::uncaught_exceptions() : 0 }
+{
+	if (isRunning) {
+		resume();
+	}
+}
+
+Metrics::Timer::Timer(MetricPhase phase, bool isRunning)
+	: m_isActive{ isEnabled() }, m_hasCode{ false }, m_code{}, m_phase{ phase }, m_exceptions{ m_isActive ? std::uncaught_exceptions() : 0 }
+{
+	if (isRunning) {
+		resume();
+	}
+}
+
+void Metrics::Timer::resume()
+{
+	if (m_isActive && !m_isRunning) {
+		m_start = clock_t::now();
+		m_isRunning = true;
+	}
+}
+
+void Metrics::Timer::pause()
+{
+	if (m_isActive && m_isRunning) {
+		m_elapsedNs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - m_start).count());
+		m_isRunning = false;
+	}
+}
+
+void Metrics::Timer::stop()
+{
+	if (!m_isActive) {
+		return;
+	}
+
+	pause();
+	instance().histogram(m_hasCode ? m_code : t_currentCode, m_phase).record(m_elapsedNs);
+	m_isActive = false;
+}
+
+Metrics::Timer::~Timer()
+{
+	if (m_isActive && std::uncaught_exceptions() <= m_exceptions) {
+		stop();
+	}
+}
+
+Metrics::Metrics()
+	: m_start{ clock_t::now() }
+{
+}
+
+Metrics& Metrics::instance()
+{
+	static Metrics metrics;
+	return metrics;
+}
+
+size_t Metrics::slotOf(RequestCodes code)
+{
+	// Codes below the first one wrap around to a large index, and land in the last slot as well
+	auto slot = static_cast<size_t>(static_cast<uint16_t>(Utils::EnumToUint16(code) - Utils::EnumToUint16(RequestCodes::REGISTER)));
+	return std::min(slot, CODE_SLOTS - 1);
+}
+
+Metrics::Histogram& Metrics::histogram(RequestCodes code, MetricPhase phase)
+{
+	return m_histograms[slotOf(code)][static_cast<size_t>(phase)];
+}
+
+void Metrics::setEnabled(bool isEnabled)
+{
+	s_isEnabled.store(isEnabled, std::memory_order_relaxed);
+}
+
+void Metrics::record(RequestCodes code, MetricPhase phase, uint64_t ns)
+{
+	if (isEnabled()) {
+		instance().histogram(code, phase).record(ns);
+	}
+}
+
+void Metrics::add(MetricCounter counter, uint64_t value)
+{
+	if (isEnabled()) {
+		instance().m_counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+	}
+}
+
+void Metrics::setCurrentCode(RequestCodes code)
+{
+	t_currentCode = code;
+}
+
+void Metrics::print(std::ostream& out)
+{
+	auto& metrics = instance();
+	auto uptime = std::chrono::duration<double>(clock_t::now() - metrics.m_start).count();
+
+	out << "Statistics of the last " << std::fixed << std::setprecision(1) << uptime << " s" << (isEnabled() ? "" : " (not collecting)") << '\n';
+	for (size_t i = 0; i < COUNTERS; i++) {
+		out << "  " << std::left << std::setw(20) << COUNTER_NAMES[i] << metrics.m_counters[i].load(std::memory_order_relaxed) << '\n';
+	}
+
+	for (size_t slot = 0; slot < CODE_SLOTS; slot++) {
+		auto code = RequestCodes(Utils::EnumToUint16(RequestCodes::REGISTER) + slot);
+		bool hasHeader{ false };
+
+		for (size_t phase = 0; phase < PHASES; phase++) {
+			auto summary = metrics.m_histograms[slot][phase].summarize();
+			if (summary.count == 0) {
+				continue;
+			}
+
+			if (!hasHeader) {
+				out << '\n' << codeName(code);
+				if (slot + 1 < CODE_SLOTS) {
+					out << " (" << Utils::EnumToUint16(code) << ')';
+				}
+				out << '\n' << "  " << std::left << std::setw(14) << "phase" << std::right << std::setw(8) << "count"
+					<< std::setw(12) << "mean ms" << std::setw(12) << "p50 ms" << std::setw(12) << "p90 ms"
+					<< std::setw(12) << "p99 ms" << std::setw(12) << "max ms" << '\n';
+				hasHeader = true;
+			}
+
+			out << "  " << std::left << std::setw(14) << PHASE_NAMES[phase] << std::right << std::setw(8) << summary.count
+				<< std::setprecision(3) << std::setw(12) << toMs(summary.mean) << std::setw(12) << toMs(static_cast<double>(summary.p50))
+				<< std::setw(12) << toMs(static_cast<double>(summary.p90)) << std::setw(12) << toMs(static_cast<double>(summary.p99))
+				<< std::setw(12) << toMs(static_cast<double>(summary.max)) << '\n';
+		}
+	}
+
+	out << std::defaultfloat << std::left << '\n';
+}
+
+void Metrics::writeJson(std::ostream& out)
+{
+	auto& metrics = instance();
+	auto uptime = std::chrono::duration<double>(clock_t::now() - metrics.m_start).count();
+	auto us = [](double ns) { return ns / 1e3; };
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"uptime_s\": " << uptime << ",\n  \"enabled\": " << (isEnabled() ? "true" : "false") << ",\n  \"counters\": {";
+	for (size_t i = 0; i < COUNTERS; i++) {
+		out << (i ? "," : "") << "\n    \"" << COUNTER_NAMES[i] << "\": " << metrics.m_counters[i].load(std::memory_order_relaxed);
+	}
+	out << "\n  },\n  \"requests\": [";
+
+	bool isFirstCode{ true };
+	for (size_t slot = 0; slot < CODE_SLOTS; slot++) {
+		auto code = RequestCodes(Utils::EnumToUint16(RequestCodes::REGISTER) + slot);
+		bool isFirstPhase{ true };
+
+		for (size_t phase = 0; phase < PHASES; phase++) {
+			auto summary = metrics.m_histograms[slot][phase].summarize();
+			if (summary.count == 0) {
+				continue;
+			}
+
+			if (isFirstPhase) {
+				out << (isFirstCode ? "" : ",") << "\n    {\n      \"code\": " << (slot + 1 < CODE_SLOTS ? Utils::EnumToUint16(code) : 0)
+					<< ",\n      \"name\": \"" << codeName(code) << "\",\n      \"phases\": {";
+				isFirstCode = false;
+			}
+
+			out << (isFirstPhase ? "" : ",") << "\n        \"" << PHASE_NAMES[phase] << "\": { \"count\": " << summary.count
+				<< ", \"mean_us\": " << us(summary.mean) << ", \"p50_us\": " << us(static_cast<double>(summary.p50))
+				<< ", \"p90_us\": " << us(static_cast<double>(summary.p90)) << ", \"p99_us\": " << us(static_cast<double>(summary.p99))
+				<< ", \"max_us\": " << us(static_cast<double>(summary.max)) << " }";
+			isFirstPhase = false;
+		}
+
+		if (!isFirstPhase) {
+			out << "\n      }\n    }";
+		}
+	}
+
+	out << (isFirstCode ? "" : "\n  ") << "]\n}\n";
+	out << std::defaultfloat;
+}
+
+void Metrics::setStatsFile(const std::filesystem::path& path)
+{
+	instance().m_statsFile = path;
+}
+
+void Metrics::dump()
+{
+	const auto& path = instance().m_statsFile;
+	if (path.empty()) {
+		return;
+	}
+
+	auto tmpPath = path;
+	tmpPath += ".tmp";
+	{
+		std::ofstream file{ tmpPath, std::ios::trunc };
+		if (!file.is_open()) {
+			throw std::runtime_error("Error: Could not open '" + tmpPath.string() + "'");
+		}
+		writeJson(file);
+	}
+
+	std::filesystem::rename(tmpPath, path);
+}
+
+void Metrics::reset()
+{
+	auto& metrics = instance();
+	for (auto& phases : metrics.m_histograms) {
+		for (auto& histogram : phases) {
+			histogram.reset();
+		}
+	}
+	for (auto& counter : metrics.m_counters) {
+		counter.store(0, std::memory_order_relaxed);
+	}
+	metrics.m_start = clock_t::now();
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <string>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <ostream>
+#include <filesystem>
+
+#include "Request.h"
+#include "Config.h"
+
+// The steps a request goes through, every step is timed separately for every request code
+enum class MetricPhase : uint8_t {
+	SERIALIZE, // Building the buffers of the request
+	ENCRYPT, // Encrypting the contents that are sent
+	WRITE, // Writing the request to the socket
+	FIRST_BYTE, // Waiting for the header of the response, mostly the server's turnaround
+	READ_PAYLOAD, // Reading the payload of the response
+	PARSE, // Parsing the payload of the response
+	DECRYPT, // Decrypting the contents that were received
+	RENDER, // Formatting the response for the user
+	COUNT,
+};
+
+// Counts of events that aren't tied to a request code
+enum class MetricCounter : uint8_t {
+	BYTES_SENT,
+	BYTES_RECEIVED,
+	MESSAGES_RECEIVED,
+	RETRIES, // Requests that were sent again after their connection broke
+	CONNECTS, // Connections opened to the server, every one after the first is a reconnect
+	COUNT,
+};
+
+// Process wide latency histograms and counters.
+// Updates are lock free (relaxed atomics on preallocated slots), so they may come from any thread, and cost a single atomic load while disabled.
+// The network phases are tagged by the request code they were measured for, the later phases by the code of the last response read on the same thread.
+class Metrics
+{
+public:
+	using clock_t = std::chrono::steady_clock;
+
+	// Latency histogram with logarithmic buckets split into linear sub buckets, so every value is kept within 1/SUB_BUCKETS of itself
+	class Histogram
+	{
+	public:
+		static constexpr size_t SUB_BUCKET_BITS = 3;
+		static constexpr size_t SUB_BUCKETS = size_t{ 1 } << SUB_BUCKET_BITS;
+		static constexpr size_t MAX_VALUE_BITS = 40; // About 18 minutes in nanoseconds, longer values are clamped
+		static constexpr size_t BUCKETS = SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+		// A consistent enough copy of the histogram, the values are in nanoseconds
+		struct Summary {
+			uint64_t count{};
+			double mean{};
+			uint64_t p50{};
+			uint64_t p90{};
+			uint64_t p99{};
+			uint64_t max{};
+		};
+
+		void record(uint64_t ns);
+
+		Summary summarize() const;
+
+		void reset();
+
+	private:
+		// Gets the bucket that holds a value
+		static size_t bucketOf(uint64_t value);
+
+		// Gets the highest value that falls into a bucket
+		static uint64_t highestOf(size_t bucket);
+
+	private:
+		std::array<std::atomic<uint64_t>, BUCKETS> m_buckets{};
+		std::atomic<uint64_t> m_count{ 0 };
+		std::atomic<uint64_t> m_sum{ 0 };
+		std::atomic<uint64_t> m_max{ 0 };
+	};
+
+	// Times a phase of a request and records it once it goes out of scope.
+	// A timer may be paused and resumed to leave out the work that interleaves with the phase, the total is recorded as a single sample.
+	class Timer
+	{
+	public:
+		Timer(RequestCodes code, MetricPhase phase, bool isRunning = true);
+
+		// Tagged by the code of the last response read on this thread by the time the timer stops
+		explicit Timer(MetricPhase phase, bool isRunning = true);
+
+		void resume();
+
+		void pause();
+
+		// Records what was timed so far, the timer is done after that
+		void stop();
+
+		~Timer();
+
+	private:
+		Timer(const Timer& timer);
+		Timer& operator=(const Timer& timer);
+
+	private:
+		bool m_isActive; // False while the metrics are disabled, nothing is measured then
+		bool m_hasCode;
+		RequestCodes m_code;
+		MetricPhase m_phase;
+		clock_t::time_point m_start{};
+		uint64_t m_elapsedNs{ 0 };
+		bool m_isRunning{ false };
+		int m_exceptions; // Exceptions in flight when the timer started, a phase that throws isn't recorded
+	};
+
+	static bool isEnabled() {
+		return Config::COLLECT_METRICS && s_isEnabled.load(std::memory_order_relaxed);
+	}
+
+	static void setEnabled(bool isEnabled);
+
+	// Records a sample of a phase
+	static void record(RequestCodes code, MetricPhase phase, uint64_t ns);
+
+	static void add(MetricCounter counter, uint64_t value = 1);
+
+	// Sets the request code that the phases of this thread are tagged with from now on, the connection sets it as it reads a response
+	static void setCurrentCode(RequestCodes code);
+
+	// Prints the counters and a line for every phase that has samples
+	static void print(std::ostream& out);
+
+	// Writes the counters and the histogram summaries as JSON
+	static void writeJson(std::ostream& out);
+
+	// Sets the file that dump writes to, an empty path turns the dumps off
+	static void setStatsFile(const std::filesystem::path& path);
+
+	// Writes the JSON to the stats file, replacing it as a whole so a reader never sees half of it
+	static void dump();
+
+	static void reset();
+
+private:
+	// Request codes get a slot each from RequestCodes::REGISTER up, the last slot collects the codes past them
+	static constexpr size_t CODE_SLOTS = 16;
+	static constexpr size_t PHASES = static_cast<size_t>(MetricPhase::COUNT);
+	static constexpr size_t COUNTERS = static_cast<size_t>(MetricCounter::COUNT);
+
+	Metrics();
+
+	static Metrics& instance();
+
+	static size_t slotOf(RequestCodes code);
+
+	Histogram& histogram(RequestCodes code, MetricPhase phase);
+
+private:
+	static std::atomic<bool> s_isEnabled;
+
+	std::array<std::array<Histogram, PHASES>, CODE_SLOTS> m_histograms;
+	std::array<std::atomic<uint64_t>, COUNTERS> m_counters{};
+	clock_t::time_point m_start; // Since when the counters run
+	std::filesystem::path m_statsFile;
+};
@@ -0,0 +1,523 @@
+#include "PeerStore.h"
+#include "Request.h"
+#include "ECWrapper.h"
+
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <hkdf.h>
+#include <sha.h>
+
+namespace {
+	// FNV-1a, the keys are names and random UUIDs so a simple hash spreads them well enough
+	uint64_t hashKey(const std::string& key) {
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : key) {
+			hash ^= c;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	const std::string STORE_KEY_INFO = "MessageU peer store";
+
+	static_assert(ECPublicWrapper::KEYSIZE <= Config::PUB_KEY_SZ, "An X25519 public key doesn't fit in the public key field of a record");
+}
+
+PeerStore::PeerStore(const std::filesystem::path& path, const std::string& ownerUUID, const std::string& privKey)
+	: m_path{ path }
+{
+	if (ownerUUID.size() != Config::CLIENT_ID_SZ) {
+		throw std::logic_error("Error: Can't open the peer store without the client UUID");
+	}
+
+	// Derive the key of the stored symmetric keys from our private key, it never leaves the client
+	CryptoPP::byte storeKey[CryptoPP::SHA256::DIGESTSIZE];
+	CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+	hkdf.DeriveKey(storeKey, sizeof(storeKey),
+		reinterpret_cast<const CryptoPP::byte*>(privKey.data()), privKey.size(),
+		nullptr, 0,
+		reinterpret_cast<const CryptoPP::byte*>(STORE_KEY_INFO.data()), STORE_KEY_INFO.size());
+	m_keyEnc.SetKey(storeKey, sizeof(storeKey));
+	m_keyDec.SetKey(storeKey, sizeof(storeKey));
+
+	// Map an existing store, a store of another client (or one that is damaged) is replaced by an empty one
+	if (std::filesystem::exists(m_path) && std::filesystem::file_size(m_path) >= sizeof(Header)) {
+		map();
+		if (isValid(ownerUUID)) {
+			return;
+		}
+	}
+
+	create(INITIAL_CAPACITY);
+	std::memcpy(header().owner, ownerUUID.data(), Config::CLIENT_ID_SZ);
+	flush(&header(), sizeof(Header));
+}
+
+std::optional<PeerStore::Peer> PeerStore::findByName(const std::string& name)
+{
+	auto slot = findNameSlot(name);
+	if (!slot) {
+		return std::nullopt;
+	}
+
+	return toPeer(record(*slot - 1));
+}
+
+std::optional<PeerStore::Peer> PeerStore::findByUUID(const std::string& uuid)
+{
+	auto slot = findUUIDSlot(uuid);
+	if (!slot) {
+		return std::nullopt;
+	}
+
+	return toPeer(record(*slot - 1));
+}
+
+void PeerStore::put(const std::string& name, const std::string& uuid)
+{
+	if (name.size() > Config::NAME_MAX_SZ || uuid.size() != Config::CLIENT_ID_SZ) {
+		throw std::logic_error("Error: Can't store '" + name + "' its name or UUID is of invalid length");
+	}
+
+	auto uuidSlot = findUUIDSlot(uuid);
+	auto nameSlot = findNameSlot(name);
+	std::optional<uint32_t> byUUID = uuidSlot ? std::optional<uint32_t>(*uuidSlot - 1) : std::nullopt;
+	std::optional<uint32_t> byName = nameSlot ? std::optional<uint32_t>(*nameSlot - 1) : std::nullopt;
+
+	// If the name now belongs to another client, the old client is gone
+	if (byName && byName != byUUID) {
+		removeRecord(*byName);
+	}
+
+	// A known client that changed keeps its symmetric key, its public key may be the one that changed
+	if (byUUID) {
+		auto& rec = record(*byUUID);
+		if (byName != byUUID) {
+			*findNameSlot(std::string(reinterpret_cast<const char*>(rec.name), rec.nameSz)) = REMOVED_SLOT;
+			rec.nameSz = static_cast<uint8_t>(name.size());
+			std::memcpy(rec.name, name.data(), name.size());
+			indexName(*byUUID);
+		}
+
+		rec.flags = static_cast<uint8_t>(rec.flags & ~(HAS_PUB_KEY | EC_PUB_KEY));
+		flush(&rec, sizeof(Record));
+		return;
+	}
+
+	auto slot = addRecord();
+	auto& rec = record(slot);
+	rec.flags = IN_USE;
+	rec.nameSz = static_cast<uint8_t>(name.size());
+	std::memcpy(rec.name, name.data(), name.size());
+	std::memcpy(rec.uuid, uuid.data(), Config::CLIENT_ID_SZ);
+	header().count++;
+	indexRecord(slot);
+
+	flush(&rec, sizeof(Record));
+	flush(&header(), sizeof(Header));
+}
+
+void PeerStore::setPubKey(const std::string& name, const std::string& pubKey, KeyTypes keyType)
+{
+	auto slot = findNameSlot(name);
+	if (!slot) {
+		throw std::runtime_error("Error: Can't find username: '" + name + "'");
+	}
+
+	auto keySz = keyType == KeyTypes::X25519 ? ECPublicWrapper::KEYSIZE : Config::PUB_KEY_SZ;
+	if (pubKey.size() != keySz) {
+		throw std::logic_error("Error: Can't store the public key of '" + name + "' it is of invalid length");
+	}
+
+	auto& rec = record(*slot - 1);
+	std::memset(rec.pubKey, 0, sizeof(rec.pubKey));
+	std::memcpy(rec.pubKey, pubKey.data(), keySz);
+	rec.flags = static_cast<uint8_t>((rec.flags & ~EC_PUB_KEY) | HAS_PUB_KEY | (keyType == KeyTypes::X25519 ? EC_PUB_KEY : 0));
+
+	// The identity key follows the agreement key, only the first one is kept
+	if (keyType == KeyTypes::X25519 && !(rec.flags & HAS_IDENTITY_KEY)) {
+		std::memcpy(rec.identityKey, pubKey.data() + ECPublicWrapper::AGREE_KEYSIZE, sizeof(rec.identityKey));
+		rec.flags |= HAS_IDENTITY_KEY;
+	}
+	flush(&rec, sizeof(Record));
+}
+
+void PeerStore::setSymKey(const std::string& name, const std::string& symKey)
+{
+	auto slot = findNameSlot(name);
+	if (!slot) {
+		throw std::runtime_error("Error: Can't find username: '" + name + "'");
+	}
+
+	if (symKey.size() != sizeof(Record::symKey)) {
+		throw std::logic_error("Error: Can't store the symmetric key of '" + name + "' it is of invalid length");
+	}
+
+	// The key is a single random block, so it is encrypted as one
+	auto& rec = record(*slot - 1);
+	m_keyEnc.ProcessBlock(reinterpret_cast<const CryptoPP::byte*>(symKey.data()), rec.symKey);
+	rec.flags |= HAS_SYM_KEY;
+	flush(&rec, sizeof(Record));
+}
+
+std::optional<PeerStore::Group> PeerStore::findGroup(uint32_t id)
+{
+	auto slot = findGroupSlot(id);
+	if (!slot) {
+		return std::nullopt;
+	}
+
+	return toGroup(record(*slot - 1));
+}
+
+std::optional<PeerStore::Group> PeerStore::findGroupByName(const std::string& name)
+{
+	auto slot = findGroupNameSlot(name);
+	if (!slot) {
+		return std::nullopt;
+	}
+
+	return toGroup(record(*slot - 1));
+}
+
+void PeerStore::putGroup(const Group& group)
+{
+	if (group.name.size() > Config::NAME_MAX_SZ || group.owner.size() != Config::CLIENT_ID_SZ) {
+		throw std::logic_error("Error: Can't store group '" + group.name + "' its name or owner is of invalid length");
+	}
+
+	if (group.key.size() != sizeof(Record::symKey)) {
+		throw std::logic_error("Error: Can't store the key of group '" + group.name + "' it is of invalid length");
+	}
+
+	// A stored group keeps its name, only its owner and key are replaced
+	if (auto idSlot = findGroupSlot(group.id)) {
+		auto& rec = record(*idSlot - 1);
+		std::memcpy(rec.uuid, group.owner.data(), Config::CLIENT_ID_SZ);
+		m_keyEnc.ProcessBlock(reinterpret_cast<const CryptoPP::byte*>(group.key.data()), rec.symKey);
+		flush(&rec, sizeof(Record));
+		return;
+	}
+
+	if (findGroupNameSlot(group.name)) {
+		throw std::logic_error("Error: Can't store group '" + group.name + "' another group has its name");
+	}
+
+	auto slot = addRecord();
+	auto& rec = record(slot);
+	rec.flags = static_cast<uint8_t>(IN_USE | GROUP | HAS_SYM_KEY);
+	rec.nameSz = static_cast<uint8_t>(group.name.size());
+	std::memcpy(rec.name, group.name.data(), group.name.size());
+	std::memcpy(rec.uuid, group.owner.data(), Config::CLIENT_ID_SZ);
+	std::memcpy(rec.groupId, &group.id, sizeof(rec.groupId));
+	m_keyEnc.ProcessBlock(reinterpret_cast<const CryptoPP::byte*>(group.key.data()), rec.symKey);
+	header().groupCount++;
+	indexRecord(slot);
+
+	flush(&rec, sizeof(Record));
+	flush(&header(), sizeof(Header));
+}
+
+size_t PeerStore::getCount() const
+{
+	return header().count;
+}
+
+uint64_t PeerStore::getDirectoryVersion() const
+{
+	return header().directoryVersion;
+}
+
+void PeerStore::setDirectoryVersion(uint64_t version)
+{
+	header().directoryVersion = version;
+	flush(&header(), sizeof(Header));
+}
+
+size_t PeerStore::fileSize(uint32_t capacity)
+{
+	// Each index has twice as many slots as there are records, so a probe always ends on an empty slot
+	return indexOffset(capacity) + 2 * (2 * static_cast<size_t>(capacity) * sizeof(uint32_t));
+}
+
+size_t PeerStore::indexOffset(uint32_t capacity)
+{
+	// The records are byte arrays, so the indexes that follow them are aligned explicitly
+	auto end = sizeof(Header) + static_cast<size_t>(capacity) * sizeof(Record);
+	return (end + alignof(uint64_t) - 1) & ~(alignof(uint64_t) - 1);
+}
+
+void PeerStore::create(uint32_t capacity)
+{
+	m_region.reset();
+	m_file.reset();
+
+	{
+		std::ofstream out{ m_path, std::ios::binary | std::ios::trunc };
+		if (!out.is_open()) {
+			throw std::runtime_error("Error: Could not create '" + m_path.string() + "'");
+		}
+	}
+
+	// The file is zero filled, so every record and index slot starts empty
+	std::filesystem::resize_file(m_path, fileSize(capacity));
+	map();
+
+	auto& h = header();
+	h.magic = MAGIC;
+	h.formatVersion = FORMAT_VERSION;
+	h.capacity = capacity;
+}
+
+void PeerStore::map()
+{
+	m_region.reset();
+	m_file = std::make_unique<boost::interprocess::file_mapping>(m_path.string().c_str(), boost::interprocess::read_write);
+	m_region = std::make_unique<boost::interprocess::mapped_region>(*m_file, boost::interprocess::read_write);
+}
+
+bool PeerStore::isValid(const std::string& ownerUUID)
+{
+	const auto& h = header();
+	bool isPowerOfTwo = h.capacity >= INITIAL_CAPACITY && (h.capacity & (h.capacity - 1)) == 0;
+
+	return h.magic == MAGIC
+		&& h.formatVersion == FORMAT_VERSION
+		&& isPowerOfTwo
+		&& m_region->get_size() == fileSize(h.capacity)
+		&& h.used <= h.capacity
+		&& static_cast<uint64_t>(h.count) + h.groupCount <= h.used
+		&& std::memcmp(h.owner, ownerUUID.data(), Config::CLIENT_ID_SZ) == 0;
+}
+
+void PeerStore::grow()
+{
+	auto oldCapacity = header().capacity;
+	auto newCapacity = oldCapacity * 2;
+
+	m_region.reset();
+	m_file.reset();
+	std::filesystem::resize_file(m_path, fileSize(newCapacity));
+	map();
+
+	// The new records take the place of the old indexes, clear them before the indexes are rebuilt further on
+	auto base = static_cast<uint8_t*>(m_region->get_address());
+	auto newRecords = reinterpret_cast<uint8_t*>(&record(oldCapacity));
+	std::memset(newRecords, 0, m_region->get_size() - (newRecords - base));
+
+	header().capacity = newCapacity;
+	rebuildIndexes();
+	flush(base, m_region->get_size());
+}
+
+uint32_t PeerStore::addRecord()
+{
+	if (header().used == header().capacity) {
+		grow();
+	}
+
+	auto slot = header().used++;
+	std::memset(&record(slot), 0, sizeof(Record));
+	return slot;
+}
+
+void PeerStore::rebuildIndexes()
+{
+	auto slots = 2 * static_cast<size_t>(header().capacity);
+	std::memset(nameIndex(), 0, slots * sizeof(uint32_t));
+	std::memset(uuidIndex(), 0, slots * sizeof(uint32_t));
+
+	for (uint32_t slot = 0; slot < header().used; slot++) {
+		if (record(slot).flags & IN_USE) {
+			indexRecord(slot);
+		}
+	}
+}
+
+PeerStore::Header& PeerStore::header()
+{
+	return *static_cast<Header*>(m_region->get_address());
+}
+
+const PeerStore::Header& PeerStore::header() const
+{
+	return *static_cast<const Header*>(m_region->get_address());
+}
+
+PeerStore::Record& PeerStore::record(uint32_t slot)
+{
+	auto records = static_cast<uint8_t*>(m_region->get_address()) + sizeof(Header);
+	return *reinterpret_cast<Record*>(records + static_cast<size_t>(slot) * sizeof(Record));
+}
+
+uint32_t* PeerStore::nameIndex()
+{
+	return reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(m_region->get_address()) + indexOffset(header().capacity));
+}
+
+uint32_t* PeerStore::uuidIndex()
+{
+	return nameIndex() + 2 * static_cast<size_t>(header().capacity);
+}
+
+template<typename Matches>
+uint32_t& PeerStore::probe(uint32_t* index, const std::string& key, Matches matches)
+{
+	uint32_t mask = 2 * header().capacity - 1;
+	uint32_t pos = static_cast<uint32_t>(hashKey(key)) & mask;
+	uint32_t* reusable = nullptr;
+
+	// Linear probing, a removed slot may be reused by an insert but the probe goes on past it
+	for (uint32_t i = 0; i <= mask; i++, pos = (pos + 1) & mask) {
+		auto& entry = index[pos];
+		if (entry == EMPTY_SLOT) {
+			return reusable ? *reusable : entry;
+		}
+
+		if (entry == REMOVED_SLOT) {
+			if (!reusable) {
+				reusable = &entry;
+			}
+		}
+		else if (matches(record(entry - 1))) {
+			return entry;
+		}
+	}
+
+	if (!reusable) {
+		throw std::runtime_error("Error: Peer store index is full");
+	}
+
+	return *reusable;
+}
+
+uint32_t* PeerStore::findNameSlot(const std::string& name)
+{
+	auto& entry = probe(nameIndex(), name, [&](const Record& rec) {
+		return (rec.flags & IN_USE) && !(rec.flags & GROUP) && rec.nameSz == name.size() && std::memcmp(rec.name, name.data(), name.size()) == 0;
+	});
+
+	return entry == EMPTY_SLOT || entry == REMOVED_SLOT ? nullptr : &entry;
+}
+
+uint32_t* PeerStore::findUUIDSlot(const std::string& uuid)
+{
+	if (uuid.size() != Config::CLIENT_ID_SZ) {
+		return nullptr;
+	}
+
+	auto& entry = probe(uuidIndex(), uuid, [&](const Record& rec) {
+		return (rec.flags & IN_USE) && !(rec.flags & GROUP) && std::memcmp(rec.uuid, uuid.data(), Config::CLIENT_ID_SZ) == 0;
+	});
+
+	return entry == EMPTY_SLOT || entry == REMOVED_SLOT ? nullptr : &entry;
+}
+
+uint32_t* PeerStore::findGroupNameSlot(const std::string& name)
+{
+	auto& entry = probe(nameIndex(), name, [&](const Record& rec) {
+		return (rec.flags & IN_USE) && (rec.flags & GROUP) && rec.nameSz == name.size() && std::memcmp(rec.name, name.data(), name.size()) == 0;
+	});
+
+	return entry == EMPTY_SLOT || entry == REMOVED_SLOT ? nullptr : &entry;
+}
+
+uint32_t* PeerStore::findGroupSlot(uint32_t id)
+{
+	// A group is indexed under its ID in the UUID index, its owner is no key of its own
+	std::string key(reinterpret_cast<const char*>(&id), sizeof(id));
+	auto& entry = probe(uuidIndex(), key, [&](const Record& rec) {
+		return (rec.flags & IN_USE) && (rec.flags & GROUP) && std::memcmp(rec.groupId, &id, sizeof(id)) == 0;
+	});
+
+	return entry == EMPTY_SLOT || entry == REMOVED_SLOT ? nullptr : &entry;
+}
+
+std::string PeerStore::idKey(const Record& rec)
+{
+	if (rec.flags & GROUP) {
+		return std::string(reinterpret_cast<const char*>(rec.groupId), sizeof(rec.groupId));
+	}
+
+	return std::string(reinterpret_cast<const char*>(rec.uuid), Config::CLIENT_ID_SZ);
+}
+
+void PeerStore::indexRecord(uint32_t slot)
+{
+	indexName(slot);
+	indexUUID(slot);
+}
+
+void PeerStore::indexName(uint32_t slot)
+{
+	const auto& rec = record(slot);
+	std::string name(reinterpret_cast<const char*>(rec.name), rec.nameSz);
+
+	// The record is not indexed under its name yet, so the probe ends on the slot it goes to
+	auto& entry = probe(nameIndex(), name, [](const Record&) { return false; });
+	entry = slot + 1;
+	flush(&entry, sizeof(entry));
+}
+
+void PeerStore::indexUUID(uint32_t slot)
+{
+	// The record is not indexed under its UUID (or group ID) yet, so the probe ends on the slot it goes to
+	auto& entry = probe(uuidIndex(), idKey(record(slot)), [](const Record&) { return false; });
+	entry = slot + 1;
+	flush(&entry, sizeof(entry));
+}
+
+void PeerStore::removeRecord(uint32_t slot)
+{
+	auto& rec = record(slot);
+	*findNameSlot(std::string(reinterpret_cast<const char*>(rec.name), rec.nameSz)) = REMOVED_SLOT;
+	*findUUIDSlot(std::string(reinterpret_cast<const char*>(rec.uuid), Config::CLIENT_ID_SZ)) = REMOVED_SLOT;
+
+	rec.flags = 0;
+	header().count--;
+	flush(&rec, sizeof(Record));
+	flush(&header(), sizeof(Header));
+}
+
+PeerStore::Peer PeerStore::toPeer(const Record& rec)
+{
+	Peer peer;
+	peer.name.assign(reinterpret_cast<const char*>(rec.name), rec.nameSz);
+	peer.uuid.assign(reinterpret_cast<const char*>(rec.uuid), Config::CLIENT_ID_SZ);
+
+	if (rec.flags & HAS_PUB_KEY) {
+		peer.keyType = (rec.flags & EC_PUB_KEY) ? KeyTypes::X25519 : KeyTypes::RSA;
+		peer.pubKey.emplace(reinterpret_cast<const char*>(rec.pubKey), peer.keyType == KeyTypes::X25519 ? ECPublicWrapper::KEYSIZE : Config::PUB_KEY_SZ);
+	}
+
+	if (rec.flags & HAS_SYM_KEY) {
+		std::string symKey(sizeof(rec.symKey), '\0');
+		m_keyDec.ProcessBlock(rec.symKey, reinterpret_cast<CryptoPP::byte*>(symKey.data()));
+		peer.symKey = std::move(symKey);
+	}
+
+	if (rec.flags & HAS_IDENTITY_KEY) {
+		peer.identityKey.emplace(reinterpret_cast<const char*>(rec.identityKey), sizeof(rec.identityKey));
+	}
+
+	return peer;
+}
+
+PeerStore::Group PeerStore::toGroup(const Record& rec)
+{
+	Group group;
+	std::memcpy(&group.id, rec.groupId, sizeof(group.id));
+	group.name.assign(reinterpret_cast<const char*>(rec.name), rec.nameSz);
+	group.owner.assign(reinterpret_cast<const char*>(rec.uuid), Config::CLIENT_ID_SZ);
+	group.key.assign(sizeof(rec.symKey), '\0');
+	m_keyDec.ProcessBlock(rec.symKey, reinterpret_cast<CryptoPP::byte*>(group.key.data()));
+	return group;
+}
+
+void PeerStore::flush(const void* addr, size_t size)
+{
+	// Schedule the write of the changed pages, the mapping itself is already up to date
+	auto offset = static_cast<const uint8_t*>(addr) - static_cast<const uint8_t*>(m_region->get_address());
+	m_region->flush(static_cast<size_t>(offset), size, true);
+}
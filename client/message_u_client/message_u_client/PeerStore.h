@@ -0,0 +1,189 @@
+#pragma once
+
+#include <string>
+#include <optional>
+#include <filesystem>
+#include <memory>
+#include <cstdint>
+#include <aes.h>
+#include <xed25519.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "Config.h"
+
+// Forward declaration of the key types enum
+enum class KeyTypes : uint8_t;
+
+// Persistent store of the other clients and of our groups, kept in a memory-mapped file of fixed-size records.
+// Lookups by name and by UUID go through hash indexes that live in the file as well, so opening the store doesn't depend on the number of peers,
+// and every change is written in place to the record it touches. Symmetric and group keys are stored encrypted under a key derived from our private key.
+// A group takes a record of its own, found by its name and by its ID through the same indexes.
+class PeerStore
+{
+public:
+	// A peer as it is read from the store
+	struct Peer {
+		std::string name;
+		std::string uuid; // Raw UUID
+		std::optional<std::string> pubKey;
+		KeyTypes keyType{}; // Type of 'pubKey'
+		std::optional<std::string> symKey;
+		std::optional<std::string> identityKey; // Ed25519 key of the first X25519 key that was stored, kept when the public key changes
+	};
+
+	// A group as it is read from the store
+	struct Group {
+		uint32_t id{};
+		std::string name;
+		std::string owner; // Raw UUID of the client that created the group
+		std::string key;
+	};
+
+	// Opens the store of the client with the given (raw) UUID and private key, a missing store or one of another client starts empty
+	PeerStore(const std::filesystem::path& path, const std::string& ownerUUID, const std::string& privKey);
+
+	// Finds a peer by its name
+	std::optional<Peer> findByName(const std::string& name);
+
+	// Finds a peer by its (raw) UUID
+	std::optional<Peer> findByUUID(const std::string& uuid);
+
+	// Adds a peer or updates the one that changed, same as ClientState::updateClient
+	void put(const std::string& name, const std::string& uuid);
+
+	// Sets the public key of a stored peer, the identity key of an X25519 key is pinned if the peer has none yet
+	void setPubKey(const std::string& name, const std::string& pubKey, KeyTypes keyType);
+
+	// Sets the symmetric key of a stored peer
+	void setSymKey(const std::string& name, const std::string& symKey);
+
+	// Finds a group by its ID
+	std::optional<Group> findGroup(uint32_t id);
+
+	// Finds a group by its name
+	std::optional<Group> findGroupByName(const std::string& name);
+
+	// Adds a group, or replaces the owner and key of a stored one (it keeps its name). The name of a new group must not be taken by another group
+	void putGroup(const Group& group);
+
+	// Gets the number of stored peers
+	size_t getCount() const;
+
+	// Gets the directory version the stored peers are up to date with
+	uint64_t getDirectoryVersion() const;
+
+	// Sets the directory version the stored peers are up to date with
+	void setDirectoryVersion(uint64_t version);
+
+private:
+	static constexpr uint32_t MAGIC = 0x5350554d; // "MUPS"
+	static constexpr uint32_t FORMAT_VERSION = 3;
+	static constexpr uint32_t INITIAL_CAPACITY = 64; // Records in a new store, doubled whenever it is full
+	static constexpr uint32_t EMPTY_SLOT = 0; // Index slot that was never used
+	static constexpr uint32_t REMOVED_SLOT = UINT32_MAX; // Index slot of a removed record, probing continues past it
+
+	// Flags of a record
+	enum RecordFlags : uint8_t {
+		IN_USE = 1,
+		HAS_PUB_KEY = 2,
+		HAS_SYM_KEY = 4,
+		EC_PUB_KEY = 8, // The public key is an X25519 key, it takes the start of the public key field
+		HAS_IDENTITY_KEY = 16,
+		GROUP = 32, // The record is a group: its name, its owner in the UUID field and its key in the symmetric key field
+	};
+
+	// Header at the start of the file
+	struct Header {
+		uint32_t magic;
+		uint32_t formatVersion;
+		uint32_t capacity; // Number of records the file has room for
+		uint32_t used; // Number of records handed out, removed ones included
+		uint32_t count; // Number of peer records in use
+		uint32_t groupCount; // Number of group records in use
+		uint64_t directoryVersion;
+		uint8_t owner[Config::CLIENT_ID_SZ];
+	};
+
+	// A peer on disk, every field has a fixed size so a record is updated in place
+	struct Record {
+		uint8_t flags;
+		uint8_t nameSz;
+		uint8_t name[Config::NAME_MAX_SZ];
+		uint8_t uuid[Config::CLIENT_ID_SZ];
+		uint8_t pubKey[Config::PUB_KEY_SZ];
+		uint8_t symKey[CryptoPP::AES::BLOCKSIZE]; // Encrypted with the store key
+		uint8_t identityKey[CryptoPP::ed25519Signer::PUBLIC_KEYLENGTH]; // Pinned Ed25519 key, not cleared with the public key
+		uint8_t groupId[sizeof(uint32_t)]; // ID of a group record
+	};
+
+	// Gets the size of a file with room for 'capacity' records
+	static size_t fileSize(uint32_t capacity);
+
+	// Gets the offset of the indexes in a file with room for 'capacity' records
+	static size_t indexOffset(uint32_t capacity);
+
+	// Creates an empty store with room for 'capacity' records
+	void create(uint32_t capacity);
+
+	// Maps the file into memory
+	void map();
+
+	// Checks that the mapped file is a store of the owner
+	bool isValid(const std::string& ownerUUID);
+
+	// Doubles the capacity of the store and rebuilds its indexes
+	void grow();
+
+	// Hands out an empty record, growing the store if it is full
+	uint32_t addRecord();
+
+	// Clears the indexes and adds every record in use to them
+	void rebuildIndexes();
+
+	Header& header();
+	const Header& header() const;
+	Record& record(uint32_t slot);
+	uint32_t* nameIndex();
+	uint32_t* uuidIndex();
+
+	// Finds the index slot that holds 'key' (or the empty slot that ends its probe), 'matches' tells if a record has the key
+	template<typename Matches>
+	uint32_t& probe(uint32_t* index, const std::string& key, Matches matches);
+
+	uint32_t* findNameSlot(const std::string& name);
+	uint32_t* findUUIDSlot(const std::string& uuid);
+	uint32_t* findGroupNameSlot(const std::string& name);
+	uint32_t* findGroupSlot(uint32_t id);
+
+	// Gets the key a record has in the UUID index, the UUID of a peer or the ID of a group
+	static std::string idKey(const Record& rec);
+
+	// Adds a record to both indexes
+	void indexRecord(uint32_t slot);
+
+	// Adds a record to the name index, a renamed record keeps its UUID entry
+	void indexName(uint32_t slot);
+
+	// Adds a record to the UUID index
+	void indexUUID(uint32_t slot);
+
+	// Removes a peer record and its index entries
+	void removeRecord(uint32_t slot);
+
+	// Builds a peer from a record
+	Peer toPeer(const Record& rec);
+
+	// Builds a group from a record
+	Group toGroup(const Record& rec);
+
+	// Writes the bytes of the given range of the mapping to the file
+	void flush(const void* addr, size_t size);
+
+private:
+	std::filesystem::path m_path;
+	std::unique_ptr<boost::interprocess::file_mapping> m_file;
+	std::unique_ptr<boost::interprocess::mapped_region> m_region;
+	CryptoPP::AES::Encryption m_keyEnc; // Encrypts the stored symmetric keys
+	CryptoPP::AES::Decryption m_keyDec; // Decrypts the stored symmetric keys
+};
@@ -0,0 +1,412 @@
+#pragma once
+
+#include <array>
+#include <tuple>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <limits>
+#include <boost/endian/conversion.hpp>
+
+#include "Config.h"
+#include "Request.h"
+#include "Response.h"
+
+// The wire format, declared once.
+// A layout is a list of fixed size fields, its size and the offset of every field are known at compile time, so encoding and decoding
+// are straight line copies at constant offsets. The variable fields of v3 (VarInt and VarString) are read in place after the fixed part
+// of a record. Every request code is declared once in Messages, with the size rules of its payload
+// and of the payload of its response, and the header validator looks the request code up in a table generated from those declarations.
+namespace Protocol {
+	// A little endian integer
+	template<typename T>
+	struct Int {
+		using value_t = T;
+		static constexpr size_t SIZE = sizeof(T);
+
+		static void encode(uint8_t* out, T value) {
+			auto little = boost::endian::native_to_little(value);
+			std::memcpy(out, &little, SIZE);
+		}
+
+		static T decode(const uint8_t* in) {
+			T value;
+			std::memcpy(&value, in, SIZE);
+			return boost::endian::little_to_native(value);
+		}
+	};
+
+	// A fixed number of raw bytes, a shorter value is padded with zeros and a longer one is cut
+	template<size_t N>
+	struct Bytes {
+		using value_t = std::string_view;
+		static constexpr size_t SIZE = N;
+
+		static void encode(uint8_t* out, std::string_view value) {
+			auto valueSz = std::min(value.size(), N);
+			std::memcpy(out, value.data(), valueSz);
+			std::memset(out + valueSz, 0, N - valueSz);
+		}
+
+		// Points into 'in', nothing is copied
+		static std::string_view decode(const uint8_t* in) {
+			return { reinterpret_cast<const char*>(in), N };
+		}
+	};
+
+	// A zero padded string, it ends at the first zero
+	template<size_t N>
+	struct ZString : Bytes<N> {
+		static std::string_view decode(const uint8_t* in) {
+			auto value = Bytes<N>::decode(in);
+			return value.substr(0, value.find('\0'));
+		}
+	};
+
+	// Fields laid out back to back
+	template<typename... Fields>
+	struct Layout {
+		using values_t = std::tuple<typename Fields::value_t...>;
+		static constexpr size_t SIZE = (size_t{ 0 } + ... + Fields::SIZE);
+
+		// Gets the offset of the I-th field
+		template<size_t I>
+		static constexpr size_t offsetOf() {
+			constexpr size_t sizes[] = { Fields::SIZE..., 0 };
+			size_t offset{ 0 };
+			for (size_t i = 0; i < I; i++) {
+				offset += sizes[i];
+			}
+			return offset;
+		}
+
+		// Writes the fields to 'out', which has room for SIZE bytes
+		static void encode(uint8_t* out, const typename Fields::value_t&... values) {
+			encodeFields(out, std::index_sequence_for<Fields...>{}, values...);
+		}
+
+		// Reads the fields from 'in', which holds at least SIZE bytes
+		static values_t decode(const uint8_t* in) {
+			return decodeFields(in, std::index_sequence_for<Fields...>{});
+		}
+
+		// Reads the fields at 'offset' and moves it past them, throws if the bytes end before the layout does
+		static values_t decode(const std::vector<uint8_t>& bytes, size_t& offset) {
+			if (offset > bytes.size() || bytes.size() - offset < SIZE) {
+				throw std::runtime_error("Error: Expected " + std::to_string(SIZE) + " bytes at offset " + std::to_string(offset) +
+										 " but there are only " + std::to_string(bytes.size() - std::min(offset, bytes.size())));
+			}
+
+			auto values = decode(bytes.data() + offset);
+			offset += SIZE;
+			return values;
+		}
+
+	private:
+		template<size_t... I>
+		static void encodeFields(uint8_t* out, std::index_sequence<I...>, const typename Fields::value_t&... values) {
+			(Fields::encode(out + offsetOf<I>(), values), ...);
+		}
+
+		template<size_t... I>
+		static values_t decodeFields(const uint8_t* in, std::index_sequence<I...>) {
+			return values_t{ Fields::decode(in + offsetOf<I>())... };
+		}
+	};
+
+	// An unsigned LEB128 integer, 7 bits a byte with the low bits first and the high bit set on every byte but the last.
+	// Lengths and sizes below 128 take a single byte
+	struct VarInt {
+		static constexpr size_t MAX_SIZE = 10; // Bytes of the largest 64 bit value
+
+		static constexpr size_t sizeOf(uint64_t value) {
+			size_t size{ 1 };
+			while (value >= 0x80) {
+				value >>= 7;
+				size++;
+			}
+			return size;
+		}
+
+		// Writes the value to 'out', which has room for sizeOf(value) bytes, returns the number of bytes written
+		static size_t encode(uint8_t* out, uint64_t value) {
+			size_t size{ 0 };
+			while (value >= 0x80) {
+				out[size++] = static_cast<uint8_t>(value | 0x80);
+				value >>= 7;
+			}
+			out[size++] = static_cast<uint8_t>(value);
+			return size;
+		}
+
+		// Reads the value at 'in' and moves it past it, the bytes must hold the whole value (a checked decode of the same bytes proves it)
+		static uint64_t decode(const uint8_t*& in) {
+			uint64_t value{ 0 };
+			for (size_t shift = 0;; shift += 7) {
+				uint8_t byte = *in++;
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) {
+					return value;
+				}
+			}
+		}
+
+		// Reads the value at 'offset' and moves it past it, throws if the bytes end before it does or it doesn't fit in a T
+		template<typename T = uint64_t>
+		static T decode(const std::vector<uint8_t>& bytes, size_t& offset) {
+			// Most lengths and ids fit in one byte, which is always in range
+			if (offset < bytes.size() && bytes[offset] < 0x80) {
+				return static_cast<T>(bytes[offset++]);
+			}
+
+			// A T takes at most 'maxSz' bytes, so a single bound covers both the end of the bytes and an overlong value
+			constexpr size_t maxSz = sizeOf(std::numeric_limits<T>::max());
+			auto end = offset + std::min(maxSz, bytes.size() - std::min(offset, bytes.size()));
+
+			uint64_t value{ 0 };
+			for (size_t i = offset, shift = 0; i < end; i++, shift += 7) {
+				value |= static_cast<uint64_t>(bytes[i] & 0x7F) << shift;
+				if ((bytes[i] & 0x80) == 0) {
+					if (value > std::numeric_limits<T>::max()) {
+						throwInvalid(offset);
+					}
+					offset = i + 1;
+					return static_cast<T>(value);
+				}
+			}
+
+			throwInvalid(offset);
+		}
+
+	private:
+		[[noreturn]] static void throwInvalid(size_t offset) {
+			throw std::runtime_error("Error: VarInt at offset " + std::to_string(offset) + " is truncated, too long or out of range");
+		}
+	};
+
+	// Bytes prefixed by their VarInt length
+	struct VarString {
+		static constexpr size_t sizeOf(std::string_view value) {
+			return VarInt::sizeOf(value.size()) + value.size();
+		}
+
+		// Writes the length and the bytes to 'out', which has room for sizeOf(value) bytes, returns the number of bytes written
+		static size_t encode(uint8_t* out, std::string_view value) {
+			auto prefixSz = VarInt::encode(out, value.size());
+			std::memcpy(out + prefixSz, value.data(), value.size());
+			return prefixSz + value.size();
+		}
+
+		// Reads the string at 'offset' and moves it past it, it points into 'bytes' and nothing is copied
+		static std::string_view decode(const std::vector<uint8_t>& bytes, size_t& offset) {
+			auto size = VarInt::decode<size_t>(bytes, offset);
+			if (bytes.size() - offset < size) {
+				throw std::runtime_error("Error: String of " + std::to_string(size) + " bytes at offset " + std::to_string(offset) +
+										 " but there are only " + std::to_string(bytes.size() - offset));
+			}
+
+			std::string_view value{ reinterpret_cast<const char*>(bytes.data() + offset), size };
+			offset += size;
+			return value;
+		}
+	};
+
+	static constexpr uint8_t VERSION_2 = 2; // Every field has a fixed size, names and keys are padded to their maximum size
+	static constexpr uint8_t VERSION_3 = 3; // Names and keys are VarString, sizes are VarInt, and request headers are compact
+	static constexpr uint8_t VERSION_4 = 4; // v3 framing, a client registers with an X25519 key and public keys carry their KeyTypes
+
+	using ClientId = Bytes<Config::CLIENT_ID_SZ>;
+
+	using RequestHeader = Layout<ClientId, Int<uint8_t>, Int<uint16_t>, Int<uint32_t>>; // Client ID, version, code and payload size
+	using ResponseHeader = Layout<Int<uint8_t>, Int<uint16_t>, Int<uint32_t>>; // Version, code and payload size
+
+	// Request payloads
+	using RegisterReq = Layout<ZString<Config::NAME_MAX_SZ>, Bytes<Config::PUB_KEY_SZ>>; // Name and public key
+	using UsersDeltaReq = Layout<Int<uint64_t>>; // Directory version the client has
+	using GetPubKeyReq = Layout<ClientId>; // Target ID
+	using MessagePrefix = Layout<ClientId, Int<uint8_t>, Int<uint32_t>>; // Target ID, type (and MessageFlags) and content size, the content follows
+	using LongPollReq = Layout<Int<uint32_t>>; // Timeout in milliseconds
+	using FetchMsgReq = Layout<Int<uint32_t>, Int<uint64_t>, Int<uint32_t>>; // Message ID, offset and size of the range, a size of 0 takes as much as the server sends at once
+	using AckMsgEntry = Layout<Int<uint32_t>>; // Message ID, repeated
+	using PollPageReq = Layout<Int<uint32_t>, Int<uint32_t>, Int<uint32_t>>; // Cursor, most messages and most content bytes of the page, 0 leaves them to the server
+	using CreateGroupPrefix = Layout<ZString<Config::NAME_MAX_SZ>>; // Group name, the member IDs follow
+	using GroupMemberEntry = Layout<ClientId>; // Member ID, repeated
+	using GroupMessagePrefix = Layout<Int<uint32_t>, Int<uint8_t>, Int<uint32_t>>; // Group ID, type (and MessageFlags) and content size, the content follows
+
+	// Response payloads
+	using RegisteredRes = Layout<ClientId>; // ID of the new client
+	using UserEntry = Layout<ClientId, ZString<Config::NAME_MAX_SZ>>; // ID and name, repeated
+	using UsersDeltaRes = Layout<Int<uint64_t>>; // Directory version, followed by the changed users
+	using UserDeltaEntry = Layout<ClientId, Int<uint8_t>>; // ID and name length, the name follows
+	using PublicKeyRes = Layout<ClientId, Bytes<Config::PUB_KEY_SZ>>; // ID and public key
+	using MessageSentRes = Layout<ClientId, Int<uint32_t>>; // Target ID and message ID
+	using PollMessageHeader = Layout<ClientId, Int<uint32_t>, Int<uint8_t>, Int<uint32_t>>; // Sender ID, message ID, type (and MessageFlags) and content size, the content follows
+	using MessageContentRes = Layout<Int<uint32_t>, Int<uint64_t>, Int<uint64_t>>; // Message ID, offset of the range and size of the whole content, the range follows
+	using MessagesAckedRes = Layout<Int<uint32_t>>; // Number of messages that were deleted
+	using PollPageRes = Layout<Int<uint32_t>>; // Cursor of the next page, 0 once the page is empty, the messages follow as in a poll
+	using GroupCreatedRes = Layout<Int<uint32_t>>; // ID of the new group
+	using GroupMessageSentRes = Layout<Int<uint32_t>, Int<uint32_t>>; // Group ID and the number of members the message was delivered to
+
+	// Message contents
+	using GroupKeyPrefix = Layout<Int<uint32_t>, ZString<Config::NAME_MAX_SZ>>; // SEND_GROUP_KEY, group ID and name, the wrapped key follows
+	using GroupTextPrefix = Layout<Int<uint32_t>>; // SEND_GROUP_TXT as it is delivered, the server puts the group ID before the cipher text
+
+	// The v3 records that differ from v2, the variable fields follow the fixed part of each record
+	namespace V3 {
+		// The first request of a connection has the full RequestHeader, its version byte tells the server to read compact headers from then on.
+		// A compact header is the version (with ID_FOLLOWS) and the code, then the client ID if ID_FOLLOWS is set, then the VarInt payload size
+		using CompactHeader = Layout<Int<uint8_t>, Int<uint16_t>>;
+		static constexpr uint8_t ID_FOLLOWS = 0x80; // The client ID changed since the last header of the connection (after registration)
+		static constexpr size_t COMPACT_HEADER_MAX_SZ = CompactHeader::SIZE + ClientId::SIZE + VarInt::sizeOf(std::numeric_limits<uint32_t>::max());
+
+		// RegisterReq is the name and the public key, both VarString.
+		// The users list, the entries of the users delta (after its version), the polled messages and their metadata start with their VarInt count,
+		// so a parser reserves the entries once and reads them in a single pass
+		using UserEntryPrefix = Layout<ClientId>; // ID, followed by the name as VarString
+		using PublicKeyPrefix = Layout<ClientId>; // ID, followed by the public key as VarString
+		using PollMessagePrefix = Layout<ClientId, Int<uint8_t>>; // Sender ID and type (and MessageFlags), followed by the message ID and the content size as VarInt and then the content
+		// A MSGS_META entry is a polled message without its content
+	}
+
+	// The v4 records that differ from v3, the sizes of v3 apply
+	namespace V4 {
+		// RegisterReq is the name and the key as in v3, the key is an X25519 key (see ECPublicWrapper)
+		using PublicKeyPrefix = Layout<ClientId, Int<uint8_t>>; // ID and KeyTypes, followed by the public key as VarString
+	}
+
+	static_assert(RequestHeader::SIZE == Config::HEADER_BYTES_SZ, "Config::HEADER_BYTES_SZ doesn't match the request header");
+	static_assert(ResponseHeader::SIZE == Config::RES_HEADER_SZ, "Config::RES_HEADER_SZ doesn't match the response header");
+	static_assert(std::max(RequestHeader::SIZE, V3::COMPACT_HEADER_MAX_SZ) == Config::HEADER_MAX_BYTES_SZ, "Config::HEADER_MAX_BYTES_SZ doesn't match the largest request header");
+
+	// The sizes a payload may have
+	struct SizeRule {
+		enum class Kind : uint8_t {
+			FIXED, // Exactly 'size' bytes
+			REPEATED, // Any number of records of 'size' bytes
+			AT_LEAST, // A fixed part of 'size' bytes followed by variable data
+		};
+
+		Kind kind{ Kind::FIXED };
+		uint32_t size{ 0 };
+
+		constexpr bool accepts(uint64_t payloadSz) const {
+			switch (kind) {
+			case Kind::FIXED:
+				return payloadSz == size;
+			case Kind::REPEATED:
+				return size == 0 ? payloadSz == 0 : payloadSz % size == 0;
+			default:
+				return payloadSz >= size;
+			}
+		}
+	};
+
+	template<typename L>
+	struct Fixed {
+		static constexpr SizeRule RULE{ SizeRule::Kind::FIXED, L::SIZE };
+	};
+
+	template<typename L>
+	struct Repeated {
+		static constexpr SizeRule RULE{ SizeRule::Kind::REPEATED, L::SIZE };
+	};
+
+	template<typename L>
+	struct Prefixed {
+		static constexpr SizeRule RULE{ SizeRule::Kind::AT_LEAST, L::SIZE };
+	};
+
+	using Empty = Fixed<Layout<>>;
+	using Variable = Prefixed<Layout<>>;
+
+	// A request code, the shape of its payload, and the code and shape of its response (besides an empty ResponseCodes::ERR).
+	// The v3 shapes are only given for the payloads whose v3 records differ
+	template<RequestCodes REQ, typename Req, ResponseCodes RES, typename Res, typename ReqV3 = Req, typename ResV3 = Res>
+	struct Message {
+		static constexpr RequestCodes REQ_CODE = REQ;
+		static constexpr ResponseCodes RES_CODE = RES;
+		static constexpr SizeRule REQ_SIZE = Req::RULE;
+		static constexpr SizeRule RES_SIZE = Res::RULE;
+		static constexpr SizeRule REQ_SIZE_V3 = ReqV3::RULE;
+		static constexpr SizeRule RES_SIZE_V3 = ResV3::RULE;
+	};
+
+	// What a request must look like and what answers it
+	struct Expectation {
+		bool isKnown{ false };
+		SizeRule reqSize{};
+		ResponseCodes resCode{};
+		SizeRule resSize{};
+		SizeRule reqSizeV3{};
+		SizeRule resSizeV3{};
+
+		// Gets the size rule of the request payload in a protocol version
+		constexpr SizeRule reqSizeOf(uint8_t version) const {
+			return version >= VERSION_3 ? reqSizeV3 : reqSize;
+		}
+
+		// Gets the size rule of the response payload in a protocol version
+		constexpr SizeRule resSizeOf(uint8_t version) const {
+			return version >= VERSION_3 ? resSizeV3 : resSize;
+		}
+	};
+
+	// Places the expectation of every message at its request code, less 'first'
+	template<size_t N, typename... Msgs>
+	constexpr std::array<Expectation, N> buildTable(uint16_t first) {
+		std::array<Expectation, N> table{};
+		((table[static_cast<uint16_t>(Msgs::REQ_CODE) - first] = Expectation{ true, Msgs::REQ_SIZE, Msgs::RES_CODE, Msgs::RES_SIZE, Msgs::REQ_SIZE_V3, Msgs::RES_SIZE_V3 }), ...);
+		return table;
+	}
+
+	template<size_t N>
+	constexpr size_t countKnown(const std::array<Expectation, N>& table) {
+		size_t known{ 0 };
+		for (const auto& entry : table) {
+			known += entry.isKnown ? 1 : 0;
+		}
+		return known;
+	}
+
+	// Table of the declared messages, indexed by request code
+	template<typename... Msgs>
+	struct MessageTable {
+		static constexpr uint16_t FIRST = std::min({ static_cast<uint16_t>(Msgs::REQ_CODE)... });
+		static constexpr uint16_t LAST = std::max({ static_cast<uint16_t>(Msgs::REQ_CODE)... });
+		static constexpr auto TABLE = buildTable<LAST - FIRST + 1, Msgs...>(FIRST);
+
+		static_assert(countKnown(TABLE) == sizeof...(Msgs), "A request code is declared twice");
+
+		// Gets the expectation of a request code, nullptr if the code isn't declared
+		static constexpr const Expectation* find(RequestCodes code) {
+			auto value = static_cast<uint16_t>(code);
+			if (value < FIRST || value > LAST || !TABLE[value - FIRST].isKnown) {
+				return nullptr;
+			}
+			return &TABLE[value - FIRST];
+		}
+	};
+
+	// Every request the client sends, adding a request code means adding a line here
+	using Messages = MessageTable<
+		Message<RequestCodes::REGISTER, Fixed<RegisterReq>, ResponseCodes::REG_OK, Fixed<RegisteredRes>, Variable>,
+		Message<RequestCodes::USRS_LIST, Empty, ResponseCodes::USRS_LIST, Repeated<UserEntry>, Empty, Variable>,
+		Message<RequestCodes::GET_PUB_KEY, Fixed<GetPubKeyReq>, ResponseCodes::PUB_KEY, Fixed<PublicKeyRes>, Fixed<GetPubKeyReq>, Prefixed<V3::PublicKeyPrefix>>,
+		Message<RequestCodes::SEND_MSG, Prefixed<MessagePrefix>, ResponseCodes::MSG_SEND, Fixed<MessageSentRes>>,
+		Message<RequestCodes::POLL_MSGS, Empty, ResponseCodes::POLL_MSGS, Variable>,
+		Message<RequestCodes::LONG_POLL, Fixed<LongPollReq>, ResponseCodes::POLL_MSGS, Variable>,
+		Message<RequestCodes::SEND_MULTI_MSG, Variable, ResponseCodes::MULTI_MSG_SEND, Repeated<MessageSentRes>>,
+		Message<RequestCodes::USRS_DELTA, Fixed<UsersDeltaReq>, ResponseCodes::USRS_DELTA, Prefixed<UsersDeltaRes>>,
+		Message<RequestCodes::POLL_META, Empty, ResponseCodes::MSGS_META, Repeated<PollMessageHeader>, Empty, Variable>,
+		Message<RequestCodes::FETCH_MSG, Fixed<FetchMsgReq>, ResponseCodes::MSG_CONTENT, Prefixed<MessageContentRes>>,
+		Message<RequestCodes::ACK_MSGS, Repeated<AckMsgEntry>, ResponseCodes::MSGS_ACKED, Fixed<MessagesAckedRes>>,
+		Message<RequestCodes::POLL_PAGE, Fixed<PollPageReq>, ResponseCodes::MSGS_PAGE, Prefixed<PollPageRes>>,
+		Message<RequestCodes::CREATE_GROUP, Prefixed<CreateGroupPrefix>, ResponseCodes::GROUP_CREATED, Fixed<GroupCreatedRes>>,
+		Message<RequestCodes::SEND_GROUP_MSG, Prefixed<GroupMessagePrefix>, ResponseCodes::GROUP_MSG_SENT, Fixed<GroupMessageSentRes>>
+	>;
+}
@@ -0,0 +1,164 @@
+#include "PushListener.h"
+#include "Client.h"
+#include "ReqPayload.h"
+#include "MessageHandler.h"
+#include "Utils.h"
+#include "Config.h"
+
+#include <iostream>
+#include <algorithm>
+
+PushListener::PushListener(const ConnectionOptions& options, ClientState& state, std::mutex& stateMutex, pool_t& workers)
+	: m_options{ options }, m_state{ state }, m_stateMutex{ stateMutex }, m_workers{ workers },
+	m_strand{ m_ctx.get_executor() }, m_retryTimer{ m_ctx }, m_retryMs{ Config::LONG_POLL_RETRY_MS }
+{
+}
+
+void PushListener::start()
+{
+	if (m_thread.joinable()) {
+		return;
+	}
+
+	m_isStopped = false;
+	m_ctx.restart();
+	m_work.emplace(m_ctx.get_executor());
+	boost::asio::post(m_strand, [this]() { poll(); });
+
+	m_thread = std::thread([this]() { m_ctx.run(); });
+}
+
+void PushListener::stop()
+{
+	if (!m_thread.joinable()) {
+		return;
+	}
+
+	// Closing the connection fails the outstanding long poll, the context then runs out of work
+	boost::asio::post(m_strand, [this]() {
+		m_isStopped = true;
+		m_retryTimer.cancel();
+		if (m_conn) {
+			m_conn->close();
+		}
+	});
+
+	m_work.reset();
+	m_thread.join();
+}
+
+PushListener::~PushListener()
+{
+	stop();
+}
+
+void PushListener::poll()
+{
+	if (m_isStopped) {
+		return;
+	}
+
+	try {
+		// The handlers of a failed connection already ran by the time of the retry, so it can be replaced now
+		if (m_isBroken) {
+			m_conn.reset();
+			m_isBroken = false;
+		}
+
+		if (!m_conn) {
+			m_conn = ConnectionManager::connect(m_ctx, m_options, m_nextEndpoint);
+		}
+
+		std::string uuid;
+		{
+			std::lock_guard<std::mutex> lock{ m_stateMutex };
+			uuid = m_state.getUUIDUnhexed();
+		}
+
+		drain(uuid);
+
+		// A failed write closes the socket, so errors are only handled once, by the header read
+		m_conn->asyncSend(std::make_unique<Request>(uuid,
+			RequestCodes::LONG_POLL,
+			std::make_unique<LongPollReqPayload>(Config::LONG_POLL_TIMEOUT_MS)), nullptr);
+
+		m_conn->asyncRecvHeader([this](std::exception_ptr error, std::optional<header_t> header) {
+			boost::asio::post(m_strand, [this, error, header]() {
+				if (error) {
+					retry();
+					return;
+				}
+
+				onAnswer(*header);
+			});
+		});
+	}
+	catch (const std::exception&) {
+		retry();
+	}
+}
+
+void PushListener::onAnswer(const header_t& header)
+{
+	try {
+		// An error answer (e.g. we are not registered) is consumed and retried later
+		if (header.code != ResponseCodes::POLL_MSGS) {
+			m_conn->recvPayload(header);
+			retry();
+			return;
+		}
+
+		// The rest of the answer is already on its way, stream it like a regular poll
+		PollMessageReader reader{ *m_conn, header };
+		MessageHandler handler{ m_state, m_stateMutex, m_workers, Utils::workerCount() };
+		handler.handleAll(reader, std::cout);
+	}
+	catch (const std::exception&) {
+		retry();
+		return;
+	}
+
+	m_retryMs = Config::LONG_POLL_RETRY_MS;
+	poll();
+}
+
+void PushListener::drain(const std::string& uuid)
+{
+	do {
+		Request req{ uuid, RequestCodes::POLL_PAGE, std::make_unique<PollPageReqPayload>(m_cursor, Config::POLL_PAGE_MSGS, Config::POLL_PAGE_SZ) };
+		m_conn->send(req);
+		auto header = m_conn->recvHeader();
+
+		if (header.code != ResponseCodes::MSGS_PAGE) {
+			m_conn->recvPayload(header);
+			throw std::runtime_error("Error: Server didn't answer with a page of messages");
+		}
+
+		// The page streams from the socket, so it is the most the listener ever holds of the mailbox
+		PollMessageReader reader{ *m_conn, header };
+		MessageHandler handler{ m_state, m_stateMutex, m_workers, Utils::workerCount() };
+		handler.handleAll(reader, std::cout);
+		m_cursor = reader.getCursor();
+	} while (m_cursor != 0);
+}
+
+void PushListener::retry()
+{
+	if (m_isStopped) {
+		return;
+	}
+
+	if (m_conn) {
+		m_conn->close();
+		m_isBroken = true;
+	}
+
+	m_retryTimer.expires_after(std::chrono::milliseconds(m_retryMs));
+	m_retryTimer.async_wait(boost::asio::bind_executor(m_strand, [this](const boost::system::error_code& ec) {
+		if (!ec) {
+			poll();
+		}
+	}));
+
+	m_retryMs = std::min(m_retryMs * 2, Config::LONG_POLL_MAX_RETRY_MS);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <optional>
+#include <boost/asio.hpp>
+
+#include "Connection.h"
+#include "ConnectionManager.h"
+
+// Forward declaration
+class ClientState;
+
+// Keeps one long poll outstanding on a connection of its own, so messages are delivered as soon as the server has them.
+// The messages that already wait are paged through before each long poll, so a single answer never holds a whole backlog.
+// The listener runs on a background thread, its steps are serialized on a strand.
+// Delivered messages are written to the standard output, the state lock (the CLI handlers take it too) is only held while they read or update the state.
+class PushListener
+{
+public:
+	using io_ctx_t = boost::asio::io_context;
+	using strand_t = boost::asio::strand<io_ctx_t::executor_type>;
+	using work_guard_t = boost::asio::executor_work_guard<io_ctx_t::executor_type>;
+	using timer_t = boost::asio::steady_timer;
+	using pool_t = boost::asio::thread_pool;
+	using header_t = Response::Header;
+
+	PushListener(const ConnectionOptions& options, ClientState& state, std::mutex& stateMutex, pool_t& workers);
+
+	// Starts listening on the background thread, does nothing if it is already running
+	void start();
+
+	// Stops listening and joins the background thread
+	void stop();
+
+	~PushListener();
+
+private:
+	// Connects if needed, pages through the waiting messages, sends the next long poll and waits for its answer
+	void poll();
+
+	// Polls page after page until an empty one comes back, each page is handled before the next is asked for
+	void drain(const std::string& uuid);
+
+	// Handles the messages of a long poll answer and sends the next one
+	void onAnswer(const header_t& header);
+
+	// Drops the connection and polls again after a growing delay
+	void retry();
+
+private:
+	ConnectionOptions m_options;
+	size_t m_nextEndpoint{ 0 }; // Endpoint the next connect starts at, fails over like the CLI connection
+	ClientState& m_state;
+	std::mutex& m_stateMutex; // Guards the state, shared with the CLI handlers
+	pool_t& m_workers; // Worker threads for decrypting the messages
+
+	io_ctx_t m_ctx;
+	strand_t m_strand;
+	std::optional<work_guard_t> m_work; // Keeps the context running between polls
+	timer_t m_retryTimer;
+	std::unique_ptr<Connection> m_conn;
+	std::thread m_thread;
+
+	uint32_t m_retryMs; // Delay before the next retry
+	uint32_t m_cursor{ 0 }; // Cursor of the next page, the next page request deletes the handled pages before it (kept across a retry)
+	bool m_isBroken{ false }; // The connection failed and is replaced on the next poll
+	bool m_isStopped{ false };
+};
@@ -67,10 +67,38 @@ RSAPrivateWrapper::RSAPrivateWrapper(const std::string& key)
 	_privateKey.Load(ss);
 }
 
+RSAPrivateWrapper::RSAPrivateWrapper(const Params& params)
+{
+	auto toInteger = [](const CryptoPP::byte* param) { return CryptoPP::Integer(param, PARAM_SZ); };
+	_privateKey.Initialize(
+		toInteger(params.modulus),
+		toInteger(params.publicExponent),
+		toInteger(params.privateExponent),
+		toInteger(params.prime1),
+		toInteger(params.prime2),
+		toInteger(params.modPrime1PrivateExponent),
+		toInteger(params.modPrime2PrivateExponent),
+		toInteger(params.multiplicativeInverseOfPrime2ModPrime1));
+}
+
 RSAPrivateWrapper::~RSAPrivateWrapper()
 {
 }
 
+RSAPrivateWrapper::Params RSAPrivateWrapper::getParams() const
+{
+	Params params;
+	_privateKey.GetModulus().Encode(params.modulus, PARAM_SZ);
+	_privateKey.GetPublicExponent().Encode(params.publicExponent, PARAM_SZ);
+	_privateKey.GetPrivateExponent().Encode(params.privateExponent, PARAM_SZ);
+	_privateKey.GetPrime1().Encode(params.prime1, PARAM_SZ);
+	_privateKey.GetPrime2().Encode(params.prime2, PARAM_SZ);
+	_privateKey.GetModPrime1PrivateExponent().Encode(params.modPrime1PrivateExponent, PARAM_SZ);
+	_privateKey.GetModPrime2PrivateExponent().Encode(params.modPrime2PrivateExponent, PARAM_SZ);
+	_privateKey.GetMultiplicativeInverseOfPrime2ModPrime1().Encode(params.multiplicativeInverseOfPrime2ModPrime1, PARAM_SZ);
+	return params;
+}
+
 std::string RSAPrivateWrapper::getPrivateKey() const
 {
 	std::string key;
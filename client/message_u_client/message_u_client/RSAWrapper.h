@@ -37,6 +37,20 @@ class RSAPrivateWrapper
 {
 public:
 	static const unsigned int BITS = 1024;
+	static const unsigned int PARAM_SZ = BITS / 8;
+
+	// The parameters of the key as fixed-size big endian numbers, a key restored from them skips the BER decoding
+	struct Params
+	{
+		CryptoPP::byte modulus[PARAM_SZ];
+		CryptoPP::byte publicExponent[PARAM_SZ];
+		CryptoPP::byte privateExponent[PARAM_SZ];
+		CryptoPP::byte prime1[PARAM_SZ];
+		CryptoPP::byte prime2[PARAM_SZ];
+		CryptoPP::byte modPrime1PrivateExponent[PARAM_SZ];
+		CryptoPP::byte modPrime2PrivateExponent[PARAM_SZ];
+		CryptoPP::byte multiplicativeInverseOfPrime2ModPrime1[PARAM_SZ];
+	};
 
 private:
 	CryptoPP::AutoSeededRandomPool _rng;
@@ -48,8 +62,11 @@ public:
 	RSAPrivateWrapper();
 	RSAPrivateWrapper(const char* key, unsigned int length);
 	RSAPrivateWrapper(const std::string& key);
+	RSAPrivateWrapper(const Params& params);
 	~RSAPrivateWrapper();
 
+	Params getParams() const;
+
 	std::string getPrivateKey() const;
 	char* getPrivateKey(char* keyout, unsigned int length) const;
 
@@ -3,11 +3,19 @@
 #include "Config.h"
 #include "Utils.h"
 
+#include <limits>
+#include <stdexcept>
 #include <boost/endian/conversion.hpp>
 
+// Zeros that pad the fixed size fields, shared by all the payloads
+static const std::array<uint8_t, Config::NAME_MAX_SZ> ZERO_PADDING{};
+
 RegisterReqPayload::RegisterReqPayload(const name_t& name, const pub_key_t& pubKey)
-	: m_name{ name }, m_pubKey{ pubKey }
+	: m_name{ name.substr(0, Config::NAME_MAX_SZ) }, m_pubKey{ pubKey.substr(0, Config::PUB_KEY_SZ) }
 {
+	// The fields are cut to their maximum size in both versions, v3 sends them with their lengths instead of padded
+	m_nameLengthSz = Protocol::VarInt::encode(m_lengths.data(), m_name.size());
+	m_lengthsSz = m_nameLengthSz + Protocol::VarInt::encode(m_lengths.data() + m_nameLengthSz, m_pubKey.size());
 }
 
 RegisterReqPayload::bytes_t RegisterReqPayload::toBytes()
@@ -15,16 +23,43 @@ RegisterReqPayload::bytes_t RegisterReqPayload::toBytes()
 	bytes_t bytes;
 	bytes.resize(getSize());
 
-	// Copy the name and public key into the bytes buffer
-	std::copy(m_name.begin(), m_name.end(), bytes.begin());
-	std::copy(m_pubKey.begin(), m_pubKey.end(), bytes.begin() + Config::NAME_MAX_SZ);
+	if (Config::VERSION >= Protocol::VERSION_3) {
+		auto nameSz = Protocol::VarString::encode(bytes.data(), m_name);
+		Protocol::VarString::encode(bytes.data() + nameSz, m_pubKey);
+		return bytes;
+	}
+
+	// Copy the name and public key into the bytes buffer, each padded with zeros to its fixed size
+	Protocol::RegisterReq::encode(bytes.data(), m_name, m_pubKey);
 
 	return bytes;
 }
 
+void RegisterReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	if (Config::VERSION >= Protocol::VERSION_3) {
+		// Point at each length followed by its field
+		outBuffers.push_back(boost::asio::buffer(m_lengths.data(), m_nameLengthSz));
+		outBuffers.push_back(boost::asio::buffer(m_name.data(), m_name.size()));
+		outBuffers.push_back(boost::asio::buffer(m_lengths.data() + m_nameLengthSz, m_lengthsSz - m_nameLengthSz));
+		outBuffers.push_back(boost::asio::buffer(m_pubKey.data(), m_pubKey.size()));
+		return;
+	}
+
+	// Point at the name and public key, each padded with zeros to its fixed size
+	outBuffers.push_back(boost::asio::buffer(m_name.data(), m_name.size()));
+	outBuffers.push_back(boost::asio::buffer(ZERO_PADDING.data(), Config::NAME_MAX_SZ - m_name.size()));
+	outBuffers.push_back(boost::asio::buffer(m_pubKey.data(), m_pubKey.size()));
+	outBuffers.push_back(boost::asio::buffer(ZERO_PADDING.data(), Config::PUB_KEY_SZ - m_pubKey.size()));
+}
+
 uint32_t RegisterReqPayload::getSize()
 {
-	return Config::NAME_MAX_SZ + Config::PUB_KEY_SZ;
+	if (Config::VERSION >= Protocol::VERSION_3) {
+		return static_cast<uint32_t>(m_lengthsSz + m_name.size() + m_pubKey.size());
+	}
+
+	return Protocol::RegisterReq::SIZE;
 }
 
 
@@ -33,11 +68,36 @@ UsersListReqPayload::bytes_t UsersListReqPayload::toBytes()
 	return bytes_t();
 }
 
+void UsersListReqPayload::toBuffers(buffers_t& outBuffers)
+{
+}
+
 uint32_t UsersListReqPayload::getSize()
 {
 	return 0;
 }
 
+UsersDeltaReqPayload::UsersDeltaReqPayload(uint64_t sinceVersion)
+	: m_sinceVersion{ sinceVersion }
+{
+	Protocol::UsersDeltaReq::encode(m_bytes.data(), m_sinceVersion);
+}
+
+UsersDeltaReqPayload::bytes_t UsersDeltaReqPayload::toBytes()
+{
+	return bytes_t(m_bytes.begin(), m_bytes.end());
+}
+
+void UsersDeltaReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	outBuffers.push_back(boost::asio::buffer(m_bytes));
+}
+
+uint32_t UsersDeltaReqPayload::getSize()
+{
+	return Protocol::UsersDeltaReq::SIZE;
+}
+
 GetPublicKeyReqPayload::GetPublicKeyReqPayload(const std::string& targetId)
 	: m_targetId{ targetId }
 {
@@ -49,43 +109,197 @@ GetPublicKeyReqPayload::bytes_t GetPublicKeyReqPayload::toBytes()
 	bytes.resize(getSize());
 
 	// Copy the target ID into the bytes buffer
-	std::copy(m_targetId.begin(), m_targetId.end(), bytes.begin());
+	Protocol::GetPubKeyReq::encode(bytes.data(), m_targetId);
 
 	return bytes;
 }
 
+void GetPublicKeyReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	outBuffers.push_back(boost::asio::buffer(m_targetId.data(), m_targetId.size()));
+}
+
 uint32_t GetPublicKeyReqPayload::getSize()
 {
-	return Config::CLIENT_ID_SZ;
+	return Protocol::GetPubKeyReq::SIZE;
 }
 
 
-SendMessageReqPayload::SendMessageReqPayload(const std::string& targetId, MessageTypes type, uint32_t msgSz, const std::string& msg)
-	: m_targetId{ targetId }, m_type{ type }, m_msgSz{ msgSz }, m_msg{ msg }
+SendMessageReqPayload::SendMessageReqPayload(const std::string& targetId, MessageTypes type, uint32_t msgSz, std::string msg, uint8_t flags)
+	: m_targetId{ targetId }, m_type{ type }, m_flags{ flags }, m_msgSz{ msgSz }, m_msg{ std::move(msg) }
+{
+}
+
+void SendMessageReqPayload::serializePrefix()
 {
+	// Copy the target ID, message type and message size into the prefix buffer
+	Protocol::MessagePrefix::encode(m_prefix.data(), m_targetId, static_cast<uint8_t>(Utils::EnumToUint8(m_type) | m_flags), m_msgSz);
 }
 
 SendMessageReqPayload::bytes_t SendMessageReqPayload::toBytes()
 {
 	bytes_t bytes;
-	size_t offset{ 0 };
 	bytes.resize(getSize());
 
 	// Copy the target ID, message type, message size and message into the bytes buffer
-	std::copy(m_targetId.begin(), m_targetId.end(), bytes.begin());
-	offset += Config::CLIENT_ID_SZ;
+	serializePrefix();
+	std::copy(m_prefix.begin(), m_prefix.end(), bytes.begin());
+	std::copy(m_msg.begin(), m_msg.end(), bytes.begin() + PREFIX_SZ);
+
+	return bytes;
+}
+
+void SendMessageReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	// Only the fixed fields are serialized, the message is sent from where it is stored
+	serializePrefix();
+	outBuffers.push_back(boost::asio::buffer(m_prefix));
+	outBuffers.push_back(boost::asio::buffer(m_msg.data(), m_msg.size()));
+}
+
+uint32_t SendMessageReqPayload::getSize()
+{
+	return static_cast<uint32_t>(PREFIX_SZ) + m_msgSz;
+}
 
-	Utils::serializeTrivialType(bytes, offset, Utils::EnumToUint8(m_type));
-	Utils::serializeTrivialType(bytes, offset, m_msgSz);
+CreateGroupReqPayload::CreateGroupReqPayload(const std::string& name, const std::vector<std::string>& memberIds)
+	: m_bytes(Protocol::CreateGroupPrefix::SIZE + memberIds.size() * Protocol::GroupMemberEntry::SIZE)
+{
+	Protocol::CreateGroupPrefix::encode(m_bytes.data(), name);
+	for (size_t i = 0; i < memberIds.size(); i++) {
+		Protocol::GroupMemberEntry::encode(m_bytes.data() + Protocol::CreateGroupPrefix::SIZE + i * Protocol::GroupMemberEntry::SIZE, memberIds[i]);
+	}
+}
+
+CreateGroupReqPayload::bytes_t CreateGroupReqPayload::toBytes()
+{
+	return m_bytes;
+}
 
-	std::copy(m_msg.begin(), m_msg.end(), bytes.begin() + offset);
+void CreateGroupReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	outBuffers.push_back(boost::asio::buffer(m_bytes));
+}
 
+uint32_t CreateGroupReqPayload::getSize()
+{
+	return static_cast<uint32_t>(m_bytes.size());
+}
+
+SendGroupMessageReqPayload::SendGroupMessageReqPayload(uint32_t groupId, MessageTypes type, std::string msg, uint8_t flags)
+	: m_msg{ std::move(msg) }
+{
+	Protocol::GroupMessagePrefix::encode(m_prefix.data(), groupId, static_cast<uint8_t>(Utils::EnumToUint8(type) | flags), static_cast<uint32_t>(m_msg.size()));
+}
+
+SendGroupMessageReqPayload::bytes_t SendGroupMessageReqPayload::toBytes()
+{
+	bytes_t bytes(getSize());
+	std::copy(m_prefix.begin(), m_prefix.end(), bytes.begin());
+	std::copy(m_msg.begin(), m_msg.end(), bytes.begin() + PREFIX_SZ);
 	return bytes;
 }
 
-uint32_t SendMessageReqPayload::getSize()
+void SendGroupMessageReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	// The message is sent from where it is stored
+	outBuffers.push_back(boost::asio::buffer(m_prefix));
+	outBuffers.push_back(boost::asio::buffer(m_msg.data(), m_msg.size()));
+}
+
+uint32_t SendGroupMessageReqPayload::getSize()
+{
+	return static_cast<uint32_t>(PREFIX_SZ + m_msg.size());
+}
+
+StreamedMessageReqPayload::StreamedMessageReqPayload(const std::string& targetId, MessageTypes type, uint64_t contentSz, uint8_t flags)
+	: m_targetId{ targetId }, m_type{ type }, m_flags{ flags }, m_contentSz{ contentSz }
+{
+}
+
+bool StreamedMessageReqPayload::fits(uint64_t contentSz)
+{
+	// The server stores a content as a single row, so there is no request for a content past the 32 bit payload size
+	uint64_t maxSz = std::numeric_limits<uint32_t>::max() - PREFIX_SZ;
+	return contentSz <= maxSz;
+}
+
+void StreamedMessageReqPayload::serializePrefix()
+{
+	// Copy the target ID, message type and content size into the prefix buffer, the content is sent separately
+	if (!fits(m_contentSz)) {
+		throw std::logic_error("Error: A content of " + std::to_string(m_contentSz) + " bytes doesn't fit a message");
+	}
+
+	auto type = static_cast<uint8_t>(Utils::EnumToUint8(m_type) | m_flags);
+	Protocol::MessagePrefix::encode(m_prefix.data(), m_targetId, type, static_cast<uint32_t>(m_contentSz));
+}
+
+StreamedMessageReqPayload::bytes_t StreamedMessageReqPayload::toBytes()
+{
+	serializePrefix();
+	return bytes_t(m_prefix.begin(), m_prefix.end());
+}
+
+void StreamedMessageReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	serializePrefix();
+	outBuffers.push_back(boost::asio::buffer(m_prefix));
+}
+
+uint32_t StreamedMessageReqPayload::getSize()
+{
+	return static_cast<uint32_t>(PREFIX_SZ + m_contentSz);
+}
+
+bool MultiMessageReqPayload::addMessage(const std::string& targetId, MessageTypes type, std::string msg, uint8_t flags)
+{
+	auto recordSz = static_cast<uint64_t>(PREFIX_SZ) + msg.size();
+	if (m_size + recordSz > std::numeric_limits<uint32_t>::max()) {
+		return false;
+	}
+
+	// The fixed fields are serialized once, when the record is added
+	Record record;
+	Protocol::MessagePrefix::encode(record.prefix.data(), targetId, static_cast<uint8_t>(Utils::EnumToUint8(type) | flags), static_cast<uint32_t>(msg.size()));
+	record.msg = std::move(msg);
+
+	m_records.push_back(std::move(record));
+	m_size += static_cast<uint32_t>(recordSz);
+	return true;
+}
+
+size_t MultiMessageReqPayload::getCount() const
+{
+	return m_records.size();
+}
+
+MultiMessageReqPayload::bytes_t MultiMessageReqPayload::toBytes()
+{
+	bytes_t bytes;
+	bytes.reserve(getSize());
+
+	for (const auto& record : m_records) {
+		bytes.insert(bytes.end(), record.prefix.begin(), record.prefix.end());
+		bytes.insert(bytes.end(), record.msg.begin(), record.msg.end());
+	}
+
+	return bytes;
+}
+
+void MultiMessageReqPayload::toBuffers(buffers_t& outBuffers)
 {
-	return m_msgSz + sizeof(MessageTypes) + Config::CLIENT_ID_SZ + sizeof(m_msgSz);
+	// Every record is referenced where it is stored, nothing is copied
+	outBuffers.reserve(outBuffers.size() + m_records.size() * 2);
+	for (const auto& record : m_records) {
+		outBuffers.push_back(boost::asio::buffer(record.prefix));
+		outBuffers.push_back(boost::asio::buffer(record.msg.data(), record.msg.size()));
+	}
+}
+
+uint32_t MultiMessageReqPayload::getSize()
+{
+	return m_size;
 }
 
 PollMessagesReqPayload::bytes_t PollMessagesReqPayload::toBytes()
@@ -93,7 +307,96 @@ PollMessagesReqPayload::bytes_t PollMessagesReqPayload::toBytes()
 	return bytes_t();
 }
 
+void PollMessagesReqPayload::toBuffers(buffers_t& outBuffers)
+{
+}
+
 uint32_t PollMessagesReqPayload::getSize()
 {
 	return 0;
 }
+
+
+LongPollReqPayload::LongPollReqPayload(uint32_t timeoutMs)
+	: m_timeoutMs{ timeoutMs }
+{
+	Protocol::LongPollReq::encode(m_bytes.data(), m_timeoutMs);
+}
+
+LongPollReqPayload::bytes_t LongPollReqPayload::toBytes()
+{
+	return bytes_t(m_bytes.begin(), m_bytes.end());
+}
+
+void LongPollReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	outBuffers.push_back(boost::asio::buffer(m_bytes));
+}
+
+uint32_t LongPollReqPayload::getSize()
+{
+	return Protocol::LongPollReq::SIZE;
+}
+
+FetchMessageReqPayload::FetchMessageReqPayload(uint32_t msgId, uint64_t offset, uint32_t size)
+{
+	Protocol::FetchMsgReq::encode(m_bytes.data(), msgId, offset, size);
+}
+
+FetchMessageReqPayload::bytes_t FetchMessageReqPayload::toBytes()
+{
+	return bytes_t(m_bytes.begin(), m_bytes.end());
+}
+
+void FetchMessageReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	outBuffers.push_back(boost::asio::buffer(m_bytes));
+}
+
+uint32_t FetchMessageReqPayload::getSize()
+{
+	return Protocol::FetchMsgReq::SIZE;
+}
+
+PollPageReqPayload::PollPageReqPayload(uint32_t cursor, uint32_t maxCount, uint32_t maxSz)
+{
+	Protocol::PollPageReq::encode(m_bytes.data(), cursor, maxCount, maxSz);
+}
+
+PollPageReqPayload::bytes_t PollPageReqPayload::toBytes()
+{
+	return bytes_t(m_bytes.begin(), m_bytes.end());
+}
+
+void PollPageReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	outBuffers.push_back(boost::asio::buffer(m_bytes));
+}
+
+uint32_t PollPageReqPayload::getSize()
+{
+	return Protocol::PollPageReq::SIZE;
+}
+
+AckMessagesReqPayload::AckMessagesReqPayload(const std::vector<uint32_t>& msgIds)
+	: m_bytes(msgIds.size() * Protocol::AckMsgEntry::SIZE)
+{
+	for (size_t i = 0; i < msgIds.size(); i++) {
+		Protocol::AckMsgEntry::encode(m_bytes.data() + i * Protocol::AckMsgEntry::SIZE, msgIds[i]);
+	}
+}
+
+AckMessagesReqPayload::bytes_t AckMessagesReqPayload::toBytes()
+{
+	return m_bytes;
+}
+
+void AckMessagesReqPayload::toBuffers(buffers_t& outBuffers)
+{
+	outBuffers.push_back(boost::asio::buffer(m_bytes));
+}
+
+uint32_t AckMessagesReqPayload::getSize()
+{
+	return static_cast<uint32_t>(m_bytes.size());
+}
@@ -4,6 +4,11 @@
 #include <cstdint>
 #include <fstream>
 #include <string>
+#include <array>
+#include <boost/asio/buffer.hpp>
+
+#include "Config.h"
+#include "Protocol.h"
 
 // Forward declarations for the message types and request codes enums
 enum class MessageTypes : uint8_t;
@@ -13,10 +18,14 @@ enum class RequestCodes : uint16_t;
 class ReqPayload {
 public:
 	using bytes_t = std::vector<uint8_t>;
+	using buffers_t = std::vector<boost::asio::const_buffer>;
 
 	// Converts the payload to a byte array
 	virtual bytes_t toBytes() = 0;
 
+	// Appends buffers that point into the payload's own storage to 'outBuffers', nothing is copied
+	virtual void toBuffers(buffers_t& outBuffers) = 0;
+
 	// Returns the size of the payload in bytes
 	virtual uint32_t getSize() = 0;
 };
@@ -31,18 +40,38 @@ public:
 	RegisterReqPayload(const name_t& name, const pub_key_t& pubKey);
 
 	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
 	uint32_t getSize() override;
 
 private:
 	name_t m_name;
 	pub_key_t m_pubKey;
+	std::array<uint8_t, 2 * Protocol::VarInt::MAX_SIZE> m_lengths{}; // v3 VarInt lengths of the name and of the public key, back to back
+	size_t m_nameLengthSz{ 0 }; // Bytes of the name length, the public key length follows it
+	size_t m_lengthsSz{ 0 };
 };
 
 // Request payload for the login request
 class UsersListReqPayload : public ReqPayload {
 public:
 	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+};
+
+// Request payload for the users delta request, holds the directory version the client already has
+class UsersDeltaReqPayload : public ReqPayload
+{
+public:
+	explicit UsersDeltaReqPayload(uint64_t sinceVersion);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
 	uint32_t getSize() override;
+
+private:
+	uint64_t m_sinceVersion;
+	std::array<uint8_t, Protocol::UsersDeltaReq::SIZE> m_bytes{}; // Storage for the serialized version
 };
 
 // Request payload for the get public key request
@@ -51,31 +80,180 @@ public:
 	GetPublicKeyReqPayload(const std::string& targetId);
 
 	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
 	uint32_t getSize() override;
 
 private:
 	std::string m_targetId;
 };
 
+// Request payload for creating a group, its name and the IDs of its members
+class CreateGroupReqPayload : public ReqPayload {
+public:
+	CreateGroupReqPayload(const std::string& name, const std::vector<std::string>& memberIds);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	bytes_t m_bytes; // Storage for the serialized name and member IDs
+};
+
+// Request payload for sending a message to a group, the content is sent once whatever the number of members
+class SendGroupMessageReqPayload : public ReqPayload {
+public:
+	SendGroupMessageReqPayload(uint32_t groupId, MessageTypes type, std::string msg, uint8_t flags = 0);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	static constexpr size_t PREFIX_SZ = Protocol::GroupMessagePrefix::SIZE;
+
+	std::string m_msg;
+	std::array<uint8_t, PREFIX_SZ> m_prefix{}; // Storage for the serialized group ID, type and size
+};
+
 // Request payload for the send message request
 class SendMessageReqPayload : public ReqPayload {
 public:
-	SendMessageReqPayload(const std::string& targetId, MessageTypes type, uint32_t msgSz, const std::string& msg);
+	SendMessageReqPayload(const std::string& targetId, MessageTypes type, uint32_t msgSz, std::string msg, uint8_t flags = 0);
 
 	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
 	uint32_t getSize() override;
 
 private:
+	// Serializes the target ID, message type and message size into m_prefix
+	void serializePrefix();
+
+	static constexpr size_t PREFIX_SZ = Protocol::MessagePrefix::SIZE;
+
 	std::string m_targetId;
 	MessageTypes m_type;
+	uint8_t m_flags; // MessageFlags of the message
 	uint32_t m_msgSz;
 	std::string m_msg;
+	std::array<uint8_t, PREFIX_SZ> m_prefix{}; // Storage for the serialized fields that precede the message
 };
 
-// Request payload for the poll messages request
+// Request payload for a message whose content is streamed right after the payload
+// Only the target ID, type and size are serialized, the content itself is written by Connection::sendStreamed
+class StreamedMessageReqPayload : public ReqPayload {
+public:
+	StreamedMessageReqPayload(const std::string& targetId, MessageTypes type, uint64_t contentSz, uint8_t flags = 0);
+
+	// Checks if a content of this size fits the 32 bit payload size of the request header
+	static bool fits(uint64_t contentSz);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	// Serializes the payload into m_prefix
+	void serializePrefix();
+
+	static constexpr size_t PREFIX_SZ = Protocol::MessagePrefix::SIZE;
+
+	std::string m_targetId;
+	MessageTypes m_type;
+	uint8_t m_flags; // MessageFlags of the message
+	uint64_t m_contentSz;
+	std::array<uint8_t, PREFIX_SZ> m_prefix{}; // Storage for the serialized payload
+};
+
+// Request payload for sending messages to several targets at once
+// Each record has the fields of a SEND_MSG payload, the records are sent back to back
+class MultiMessageReqPayload : public ReqPayload {
+public:
+	// Adds a message to a target, returns false (and adds nothing) if the payload would grow past its 32 bit size
+	bool addMessage(const std::string& targetId, MessageTypes type, std::string msg, uint8_t flags = 0);
+
+	// Gets the number of messages in the payload
+	size_t getCount() const;
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	static constexpr size_t PREFIX_SZ = Protocol::MessagePrefix::SIZE;
+
+	// A message and its serialized target ID, type and size
+	struct Record {
+		std::array<uint8_t, PREFIX_SZ> prefix{};
+		std::string msg;
+	};
+
+	std::vector<Record> m_records;
+	uint32_t m_size{ 0 };
+};
+
+// Request payload for the poll messages request, and for the metadata poll which is empty as well
 class PollMessagesReqPayload : public ReqPayload
 {
 public:
 	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
 	uint32_t getSize() override;
+};
+
+// Request payload for the long poll request, holds the number of milliseconds the server may wait for messages
+class LongPollReqPayload : public ReqPayload
+{
+public:
+	explicit LongPollReqPayload(uint32_t timeoutMs);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	uint32_t m_timeoutMs;
+	std::array<uint8_t, Protocol::LongPollReq::SIZE> m_bytes{}; // Storage for the serialized timeout
+};
+
+// Request payload for fetching a range of the content of a polled message
+class FetchMessageReqPayload : public ReqPayload
+{
+public:
+	FetchMessageReqPayload(uint32_t msgId, uint64_t offset, uint32_t size);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	std::array<uint8_t, Protocol::FetchMsgReq::SIZE> m_bytes{}; // Storage for the serialized message ID and range
+};
+
+// Request payload for a page of a paged poll, the cursor of the previous page (0 for the first) and the bounds of the page
+class PollPageReqPayload : public ReqPayload
+{
+public:
+	PollPageReqPayload(uint32_t cursor, uint32_t maxCount, uint32_t maxSz);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	std::array<uint8_t, Protocol::PollPageReq::SIZE> m_bytes{}; // Storage for the serialized cursor and bounds
+};
+
+// Request payload for acknowledging polled messages, the server deletes them
+class AckMessagesReqPayload : public ReqPayload
+{
+public:
+	explicit AckMessagesReqPayload(const std::vector<uint32_t>& msgIds);
+
+	bytes_t toBytes() override;
+	void toBuffers(buffers_t& outBuffers) override;
+	uint32_t getSize() override;
+
+private:
+	bytes_t m_bytes; // Storage for the serialized message IDs
 };
\ No newline at end of file
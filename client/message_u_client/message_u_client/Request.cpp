@@ -2,6 +2,7 @@
 #include "Config.h"
 #include "Utils.h"
 #include "ReqPayload.h"
+#include "Protocol.h"
 
 #include <iostream>
 
@@ -12,44 +13,70 @@ Request::Header::Header(const std::string& id, char version, RequestCodes code,
 
 Request::bytes_t Request::Header::toBytes()
 {
-	bytes_t bytes;
-	size_t offset{ 0 };
-	
-	// Resize the bytes vector to the size of the header
-	bytes.resize(Config::HEADER_BYTES_SZ);
-	// Copy the client id
-	std::copy(id.begin(), id.end(), bytes.begin());
-	offset += Config::CLIENT_ID_SZ;
+	header_bytes_t headerBytes;
+	auto headerSz = toBytes(headerBytes);
 
-	// Serialize the version, request code and payload size
-	Utils::serializeTrivialType(bytes, offset, version);
-	Utils::serializeTrivialType(bytes, offset, Utils::EnumToUint16(code));
-	Utils::serializeTrivialType(bytes, offset, payloadSz);
+	return bytes_t(headerBytes.begin(), headerBytes.begin() + headerSz);
+}
 
-	return bytes;
+size_t Request::Header::toBytes(header_bytes_t& outBytes, HeaderForm form)
+{
+	// An empty id (before registration) is sent as zeros
+	if (form == HeaderForm::FULL) {
+		Protocol::RequestHeader::encode(outBytes.data(), id, static_cast<uint8_t>(version), Utils::EnumToUint16(code), payloadSz);
+		return Protocol::RequestHeader::SIZE;
+	}
+
+	bool withId = form == HeaderForm::COMPACT_WITH_ID;
+	uint8_t versionByte = static_cast<uint8_t>(version) | (withId ? Protocol::V3::ID_FOLLOWS : 0);
+	Protocol::V3::CompactHeader::encode(outBytes.data(), versionByte, Utils::EnumToUint16(code));
+
+	size_t size{ Protocol::V3::CompactHeader::SIZE };
+	if (withId) {
+		Protocol::ClientId::encode(outBytes.data() + size, id);
+		size += Protocol::ClientId::SIZE;
+	}
+
+	return size + Protocol::VarInt::encode(outBytes.data() + size, payloadSz);
 }
 
 Request::Request(const std::string& id, RequestCodes code, payload_t payload)
 	: m_payload{std::move(payload)}, m_header{id, Config::VERSION, code, payload->getSize()}
 {
+	// The server frames the payload by the rules of the request code, a payload that breaks them would leave it out of sync
+	auto expected = Protocol::Messages::find(code);
+	if (!expected || !expected->reqSizeOf(Config::VERSION).accepts(m_header.payloadSz)) {
+		throw std::logic_error("Error: A payload of " + std::to_string(m_header.payloadSz) + " bytes doesn't fit request code '" +
+							   std::to_string(Utils::EnumToUint16(code)) + "'");
+	}
 }
 
 Request::bytes_t Request::toBytes()
 {
-	// Get the bytes of the header and the payload
-	auto headerBytes = m_header.toBytes();
-	auto payloadBytes = m_payload->toBytes();
-	bytes_t bytes;
-	size_t offset{ 0 };
+	// Copy the header and the views of the payload into a single buffer, the payload isn't serialized on its own
+	auto buffers = toBuffers();
+	bytes_t bytes(boost::asio::buffer_size(buffers));
+	boost::asio::buffer_copy(boost::asio::buffer(bytes), buffers);
+
+	return bytes;
+}
 
-	// Resize the bytes vector to be of their combined size, copy the header and then the payload
-	bytes.resize(headerBytes.size() + payloadBytes.size());
-	std::copy(headerBytes.begin(), headerBytes.end(), bytes.begin());
-	offset += headerBytes.size();
+Request::buffers_t Request::toBuffers()
+{
+	// Room for the header and the few views any payload adds, so the list is allocated once
+	buffers_t buffers;
+	buffers.reserve(8);
+	toBuffers(buffers);
 
-	std::copy(payloadBytes.begin(), payloadBytes.end(), bytes.begin() + offset);
+	return buffers;
+}
 
-	return bytes;
+void Request::toBuffers(buffers_t& outBuffers, HeaderForm form)
+{
+	// Serialize the header into the request's own buffer, the payload adds views of its storage
+	auto headerSz = m_header.toBytes(m_headerBytes, form);
+	outBuffers.push_back(boost::asio::buffer(m_headerBytes.data(), headerSz));
+	m_payload->toBuffers(outBuffers);
 }
 
 RequestCodes Request::getCode()
@@ -57,6 +84,11 @@ RequestCodes Request::getCode()
 	return m_header.code;
 }
 
+const std::string& Request::getId() const
+{
+	return m_header.id;
+}
+
 Request::~Request()
 {
 }
@@ -4,6 +4,8 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include <array>
+#include <boost/asio/buffer.hpp>
 
 #include "Config.h"
 
@@ -17,6 +19,15 @@ enum class RequestCodes: uint16_t {
 	GET_PUB_KEY = 602,
 	SEND_MSG = 603,
 	POLL_MSGS = 604,
+	LONG_POLL = 606, // Same as POLL_MSGS, but the server holds the request until there are messages or the timeout passes
+	SEND_MULTI_MSG = 607, // Several SEND_MSG records (to different targets) in a single request
+	USRS_DELTA = 608, // Same as USRS_LIST, but only the users that were added or changed after the given directory version
+	POLL_META = 609, // Same as POLL_MSGS, but only the header of each message, and the messages stay on the server until ACK_MSGS
+	FETCH_MSG = 610, // A range of the content of a message that POLL_META listed
+	ACK_MSGS = 611, // Deletes messages that POLL_META listed, once the client is done with them
+	POLL_PAGE = 612, // Same as POLL_MSGS, but a page of bounded count and size after a cursor, the messages up to the cursor are deleted
+	CREATE_GROUP = 613, // A group of the requester and the given members
+	SEND_GROUP_MSG = 614, // Same as SEND_MSG, but to a group, the server delivers the single content to every other member
 };
 
 // Enum for the different message types
@@ -25,14 +36,38 @@ enum class MessageTypes : uint8_t {
 	SEND_SYM_KEY = 2,
 	SEND_TXT = 3,
 	SEND_FILE = 4,
+	SEND_GROUP_KEY = 5, // The key of a group, wrapped with the RSA key of the member or encrypted with the symmetric key shared with an X25519 member
+	SEND_GROUP_TXT = 6, // A text encrypted with the key of a group
 };
 
+// Enum for the different public key types
+enum class KeyTypes : uint8_t {
+	RSA = 0, // An RSA-1024 key, symmetric keys are sent wrapped with it
+	X25519 = 1, // An X25519 key signed with an Ed25519 identity key that peers pin, two X25519 clients derive their symmetric key without sending it
+};
+
+// Flags carried in the high bits of the message type, the server stores and relays them with the message
+namespace MessageFlags {
+	static constexpr uint8_t COMPRESSED = 0x80; // The content was deflated before it was encrypted
+	static constexpr uint8_t GCM = 0x40; // The content was encrypted with segmented AES-GCM, CBC otherwise
+	static constexpr uint8_t MASK = COMPRESSED | GCM; // Every flag bit, the rest of the byte is the MessageTypes value
+}
+
 // This class wraps the request header and payload
 class Request {
 public:
 	// Type aliases
 	using payload_t = std::unique_ptr<ReqPayload>;
 	using bytes_t = std::vector<uint8_t>;
+	using buffers_t = std::vector<boost::asio::const_buffer>;
+	using header_bytes_t = std::array<uint8_t, Config::HEADER_MAX_BYTES_SZ>;
+
+	// How the header is laid out, the connection picks it (see Protocol::V3)
+	enum class HeaderForm : uint8_t {
+		FULL, // The client ID, version, code and payload size, the first request of a connection and every v2 request
+		COMPACT, // v3, the version, code and payload size, the server takes the client ID from the earlier headers of the connection
+		COMPACT_WITH_ID, // v3, same with the client ID, which changed since the earlier headers
+	};
 	
 	struct Header {
 		std::string id;
@@ -44,19 +79,33 @@ public:
 		
 		// Converts a header to bytes
 		bytes_t toBytes();
+
+		// Serializes a header into a fixed size buffer, returns the number of bytes used
+		size_t toBytes(header_bytes_t& outBytes, HeaderForm form = HeaderForm::FULL);
 	};
 
 	explicit Request(const std::string& id, RequestCodes code, payload_t payload);
 
-	// Converts a request object to bytes
+	// Converts a request object to bytes, with the full header
 	bytes_t toBytes();
 
+	// Converts a request object to a list of buffers for a gathered write, only the header is serialized,
+	// the rest of the buffers point into the payload. They are valid as long as the request is alive and unchanged
+	buffers_t toBuffers();
+
+	// Same, appends the buffers to 'outBuffers' so a caller that reuses the list doesn't allocate, and lays the header out in 'form'
+	void toBuffers(buffers_t& outBuffers, HeaderForm form = HeaderForm::FULL);
+
 	// Gets the request code
 	RequestCodes getCode();
+
+	// Gets the ID of the client that sends the request
+	const std::string& getId() const;
 	
 	~Request();
 
 private:
 	Header m_header;
 	payload_t m_payload;
+	header_bytes_t m_headerBytes{}; // Storage for the serialized header that toBuffers points at
 };
\ No newline at end of file
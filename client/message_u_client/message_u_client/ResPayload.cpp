@@ -4,8 +4,10 @@
 #include "Client.h"
 #include "Utils.h"
 #include "Config.h"
+#include "Protocol.h"
 #include "RSAWrapper.h"
 #include "AESWrapper.h"
+#include "DeflateWrapper.h"
 
 #include <stdexcept>
 #include <string>
@@ -14,79 +16,63 @@
 #include <filesystem>
 #include <chrono>
 #include <limits>
+#include <iterator>
+#include <variant>
 #include <boost/algorithm/hex.hpp>
 
-ResPayload::payload_t ResPayload::fromBytes(const bytes_t& bytes, ResponseCodes code)
-{
-	// Create the appropriate payload object based on the response code
-	switch (code)
-	{
-	case ResponseCodes::REG_OK:
-		return std::make_unique<RegistrationResPayload>(bytes);
-	case ResponseCodes::USRS_LIST:
-		return std::make_unique<UsersListResPayload>(bytes);
-	case ResponseCodes::PUB_KEY:
-		return std::make_unique<PublicKeyResPayload>(bytes);
-	case ResponseCodes::MSG_SEND:
-		return std::make_unique<MessageSentResPayload>(bytes);
-	case ResponseCodes::POLL_MSGS:
-		return std::make_unique<PollMessageResPayload>(bytes);
-	case ResponseCodes::ERR:
-		return std::make_unique<ErrorPayload>();
-	}
+// Copies every view into the payload object of its type
+struct PayloadFactory {
+	ResPayload::payload_t operator()(const RegistrationView& view) const { return std::make_unique<RegistrationResPayload>(view); }
+	ResPayload::payload_t operator()(const UsersListView& view) const { return std::make_unique<UsersListResPayload>(view); }
+	ResPayload::payload_t operator()(const UsersDeltaView& view) const { return std::make_unique<UsersDeltaResPayload>(view); }
+	ResPayload::payload_t operator()(const PublicKeyView& view) const { return std::make_unique<PublicKeyResPayload>(view); }
+	ResPayload::payload_t operator()(const MessageSentView& view) const { return std::make_unique<MessageSentResPayload>(view); }
+	ResPayload::payload_t operator()(const MultiMessageSentView& view) const { return std::make_unique<MultiMessageSentResPayload>(view); }
+	ResPayload::payload_t operator()(const PollMessagesView& view) const { return std::make_unique<PollMessageResPayload>(view); }
+	ResPayload::payload_t operator()(const MessagesPageView& view) const { return std::make_unique<MessagesPageResPayload>(view); }
+	ResPayload::payload_t operator()(const MessagesMetaView& view) const { return std::make_unique<MessagesMetaResPayload>(view); }
+	ResPayload::payload_t operator()(const MessageContentView& view) const { return std::make_unique<MessageContentResPayload>(view); }
+	ResPayload::payload_t operator()(const MessagesAckedView& view) const { return std::make_unique<MessagesAckedResPayload>(view); }
+	ResPayload::payload_t operator()(const GroupCreatedView& view) const { return std::make_unique<GroupCreatedResPayload>(view); }
+	ResPayload::payload_t operator()(const GroupMessageSentView& view) const { return std::make_unique<GroupMessageSentResPayload>(view); }
+	ResPayload::payload_t operator()(const ErrorView& view) const { return std::make_unique<ErrorPayload>(); }
+};
 
-	// In case there is no match, throw a runtime error
-	throw std::runtime_error("Error: '" + std::to_string(Utils::EnumToUint16(code)) + "' is not a valid code");
+// Converts raw bytes (an ID or a key) to a hex string
+static std::string toHex(std::string_view bytes)
+{
+	std::string hex;
+	boost::algorithm::hex(bytes.begin(), bytes.end(), std::back_inserter(hex));
+	return hex;
 }
 
-RegistrationResPayload::RegistrationResPayload(const bytes_t& bytes)
-	: m_uuid{}
+ResPayload::payload_t ResPayload::fromBytes(const bytes_t& bytes, ResponseCodes code, uint8_t version)
 {
-	// Copy the UUID from the byte array
-	m_uuid.resize(Config::CLIENT_ID_SZ);
-	std::copy(bytes.begin(), bytes.end(), m_uuid.begin());
+	// Parse the view that matches the response code, then copy it
+	return fromView(parseResView(bytes, code, version));
 }
 
-const std::string& RegistrationResPayload::getUUID() const
+ResPayload::payload_t ResPayload::fromView(const ResView& view)
 {
-	return m_uuid;
+	return std::visit(PayloadFactory{}, view);
 }
 
-void RegistrationResPayload::accept(Visitor& visitor)
+RegistrationResPayload::RegistrationResPayload(const RegistrationView& view)
+	: m_uuid{ view.uuid }
 {
-	visitor.visit(*this);
 }
 
-UsersListResPayload::UsersListResPayload(const bytes_t& bytes)
+const std::string& RegistrationResPayload::getUUID() const
 {
-	// Calculate the number of users in the list
-	size_t numUsers = bytes.size() / (Config::CLIENT_ID_SZ + Config::NAME_MAX_SZ);
-	size_t offset{ 0 };
-	m_users.resize(numUsers);
-	
-	// Parse the byte array to extract the user entries
-	for (size_t i = 0; i < numUsers; i++) {
-		UserEntry& curr = m_users[i];
-		curr.id.resize(Config::CLIENT_ID_SZ);
-		curr.name.resize(Config::NAME_MAX_SZ);
-
-		std::copy(bytes.begin() + offset, bytes.begin() + offset + Config::CLIENT_ID_SZ, curr.id.begin());
-		offset += Config::CLIENT_ID_SZ;
-
-		std::copy(bytes.begin() + offset, bytes.begin() + offset + Config::NAME_MAX_SZ, curr.name.begin());
-		offset += Config::NAME_MAX_SZ;
-
-		// Find the string terminator and resize the string to the appropriate length
-		auto pos = std::find(curr.name.begin(), curr.name.end(), '\0');
-		if (pos != curr.name.end()) {
-			curr.name.resize(std::distance(curr.name.begin(), pos));
-		}
-	}
+	return m_uuid;
 }
 
-void UsersListResPayload::accept(Visitor& visitor)
+UsersListResPayload::UsersListResPayload(const UsersListView& view)
 {
-	visitor.visit(*this);
+	m_users.reserve(view.users.size());
+	for (const auto& user : view.users) {
+		m_users.push_back({ std::string(user.id), std::string(user.name) });
+	}
 }
 
 const std::vector<UsersListResPayload::UserEntry>& UsersListResPayload::getUsers() const
@@ -94,19 +80,28 @@ const std::vector<UsersListResPayload::UserEntry>& UsersListResPayload::getUsers
 	return m_users;
 }
 
-PublicKeyResPayload::PublicKeyResPayload(const bytes_t& bytes)
+UsersDeltaResPayload::UsersDeltaResPayload(const UsersDeltaView& view)
+	: m_version{ view.version }
 {
-	// Copy the client ID and public key from the byte array
-	m_entry.id.resize(Config::CLIENT_ID_SZ);
-	m_entry.pubKey.resize(Config::PUB_KEY_SZ);
+	m_users.reserve(view.users.size());
+	for (const auto& user : view.users) {
+		m_users.push_back({ std::string(user.id), std::string(user.name) });
+	}
+}
 
-	std::copy(bytes.begin(), bytes.begin() + Config::CLIENT_ID_SZ, m_entry.id.begin());
-	std::copy(bytes.begin() + Config::CLIENT_ID_SZ, bytes.end(), m_entry.pubKey.begin());
+uint64_t UsersDeltaResPayload::getVersion() const
+{
+	return m_version;
 }
 
-void PublicKeyResPayload::accept(Visitor& visitor)
+const std::vector<UsersDeltaResPayload::UserEntry>& UsersDeltaResPayload::getUsers() const
+{
+	return m_users;
+}
+
+PublicKeyResPayload::PublicKeyResPayload(const PublicKeyView& view)
+	: m_entry{ std::string(view.id), std::string(view.pubKey), view.keyType }
 {
-	visitor.visit(*this);
 }
 
 const PublicKeyResPayload::PublicKeyEntry& PublicKeyResPayload::getPubKeyEntry() const
@@ -114,14 +109,9 @@ const PublicKeyResPayload::PublicKeyEntry& PublicKeyResPayload::getPubKeyEntry()
 	return m_entry;
 }
 
-MessageSentResPayload::MessageSentResPayload(const bytes_t& bytes)
+MessageSentResPayload::MessageSentResPayload(const MessageSentView& view)
+	: m_entry{ std::string(view.targetId), view.msgId }
 {
-	// Copy the target ID and message ID from the byte array
-	m_entry.targetId.resize(Config::CLIENT_ID_SZ);
-	std::copy(bytes.begin(), bytes.begin() + Config::CLIENT_ID_SZ, m_entry.targetId.begin());
-
-	size_t offset{ Config::CLIENT_ID_SZ };
-	m_entry.msgId = Utils::deserializeTrivialType<uint32_t>(bytes, offset);
 }
 
 const MessageSentResPayload::MsgEntry& MessageSentResPayload::getMessage() const
@@ -129,50 +119,113 @@ const MessageSentResPayload::MsgEntry& MessageSentResPayload::getMessage() const
 	return m_entry;
 }
 
-void MessageSentResPayload::accept(Visitor& visitor)
+MultiMessageSentResPayload::MultiMessageSentResPayload(const MultiMessageSentView& view)
 {
-	visitor.visit(*this);
+	m_entries.reserve(view.entries.size());
+	for (const auto& entry : view.entries) {
+		m_entries.push_back({ std::string(entry.targetId), entry.msgId });
+	}
 }
 
-PollMessageResPayload::PollMessageResPayload(const bytes_t& bytes)
+const std::vector<MultiMessageSentResPayload::MsgEntry>& MultiMessageSentResPayload::getMessages() const
 {
-	// Parse the byte array to extract the message entries
-	size_t offset{ 0 };
-	while (offset < bytes.size()) {
-		MessageEntry msg;
-		msg.senderId.resize(Config::CLIENT_ID_SZ);
+	return m_entries;
+}
 
-		// Copy the sender ID from the byte array
-		std::copy(bytes.begin() + offset, bytes.begin() + offset + Config::CLIENT_ID_SZ, msg.senderId.begin());
-		offset += Config::CLIENT_ID_SZ;
+PollMessageResPayload::PollMessageResPayload(const PollMessagesView& view)
+{
+	m_msgs.reserve(view.msgs.size());
+	for (const auto& msg : view.msgs) {
+		m_msgs.push_back({ std::string(msg.senderId), msg.msgId, msg.msgType, msg.flags, static_cast<uint32_t>(msg.content.size()), std::string(msg.content) });
+	}
+}
 
-		// Deserialize the message id, type and content size
-		msg.msgId = Utils::deserializeTrivialType<uint32_t>(bytes, offset);
-		msg.msgType = MessageTypes(Utils::deserializeTrivialType<uint8_t>(bytes, offset));
-		msg.contentSz = Utils::deserializeTrivialType<uint32_t>(bytes, offset);
+const std::vector<PollMessageResPayload::MessageEntry>& PollMessageResPayload::getMessages() const
+{
+	return m_msgs;
+}
+
+MessagesPageResPayload::MessagesPageResPayload(const MessagesPageView& view)
+	: PollMessageResPayload(view.page), m_cursor{ view.cursor }
+{
+}
 
-		// Resize the content string and copy the content from the byte array
-		msg.content.resize(msg.contentSz);
-		std::copy(bytes.begin() + offset, bytes.begin() + offset + msg.contentSz, msg.content.begin());
-		offset += msg.contentSz;
+uint32_t MessagesPageResPayload::getCursor() const
+{
+	return m_cursor;
+}
 
-		m_msgs.push_back(msg);
+MessagesMetaResPayload::MessagesMetaResPayload(const MessagesMetaView& view)
+{
+	m_msgs.reserve(view.msgs.size());
+	for (const auto& msg : view.msgs) {
+		m_msgs.push_back({ std::string(msg.senderId), msg.msgId, msg.msgType, msg.flags, msg.contentSz });
 	}
 }
 
-const std::vector<PollMessageResPayload::MessageEntry>& PollMessageResPayload::getMessages() const
+const std::vector<MessagesMetaResPayload::MetaEntry>& MessagesMetaResPayload::getMessages() const
 {
 	return m_msgs;
 }
 
-void PollMessageResPayload::accept(Visitor& visitor)
+MessageContentResPayload::MessageContentResPayload(const MessageContentView& view)
+	: m_msgId{ view.msgId }, m_offset{ view.offset }, m_contentSz{ view.contentSz }, m_range{ view.range }
+{
+}
+
+uint32_t MessageContentResPayload::getMsgId() const
+{
+	return m_msgId;
+}
+
+uint64_t MessageContentResPayload::getOffset() const
+{
+	return m_offset;
+}
+
+uint64_t MessageContentResPayload::getContentSz() const
 {
-	visitor.visit(*this);
+	return m_contentSz;
 }
 
-void ErrorPayload::accept(Visitor& visitor)
+const std::string& MessageContentResPayload::getRange() const
 {
-	visitor.visit(*this);
+	return m_range;
+}
+
+MessagesAckedResPayload::MessagesAckedResPayload(const MessagesAckedView& view)
+	: m_count{ view.count }
+{
+}
+
+uint32_t MessagesAckedResPayload::getCount() const
+{
+	return m_count;
+}
+
+GroupCreatedResPayload::GroupCreatedResPayload(const GroupCreatedView& view)
+	: m_groupId{ view.groupId }
+{
+}
+
+uint32_t GroupCreatedResPayload::getGroupId() const
+{
+	return m_groupId;
+}
+
+GroupMessageSentResPayload::GroupMessageSentResPayload(const GroupMessageSentView& view)
+	: m_groupId{ view.groupId }, m_count{ view.count }
+{
+}
+
+uint32_t GroupMessageSentResPayload::getGroupId() const
+{
+	return m_groupId;
+}
+
+uint32_t GroupMessageSentResPayload::getCount() const
+{
+	return m_count;
 }
 
 ToStringVisitor::ToStringVisitor(ClientState& state)
@@ -188,65 +241,84 @@ std::string ToStringVisitor::getString()
 	return result;
 }
 
-void ToStringVisitor::visit(const RegistrationResPayload& payload)
+void ToStringVisitor::operator()(const RegistrationView& view)
 {
 	// Convert the UUID to a hex string, later it'll be save to the client data file
-	m_ss << boost::algorithm::hex(payload.getUUID());
+	m_ss << toHex(view.uuid);
 }
 
-void ToStringVisitor::visit(const UsersListResPayload& payload)
+void ToStringVisitor::operator()(const UsersListView& view)
 {
 	// If there are no other clients that a registered
-	if (payload.getUsers().empty()) {
+	if (view.users.empty()) {
 		m_ss << "There are no other registered clients at the moment";
 		return;
 	}
 
 	// Iterate over the user list and print the client ID and name
-	for (const auto& user : payload.getUsers()) {
-		m_ss << boost::algorithm::hex(user.id) << '\t' << user.name << '\n';
+	for (const auto& user : view.users) {
+		m_ss << toHex(user.id) << '\t' << user.name << '\n';
 	}
 }
 
-void ToStringVisitor::visit(const PublicKeyResPayload& payload)
+void ToStringVisitor::operator()(const UsersDeltaView& view)
+{
+	// Only the changed clients are printed, the rest are already known from earlier requests
+	for (const auto& user : view.users) {
+		m_ss << toHex(user.id) << '\t' << user.name << '\n';
+	}
+
+	if (m_state.getClientsCount() == 0) {
+		m_ss << "There are no other registered clients at the moment";
+		return;
+	}
+
+	m_ss << view.users.size() << " changed since the last request, " << m_state.getClientsCount() << " clients known";
+}
+
+void ToStringVisitor::operator()(const PublicKeyView& view)
 {
 	// For debugging
-	m_ss << boost::algorithm::hex(payload.getPubKeyEntry().id) << '\t' << payload.getPubKeyEntry().pubKey << '\n';
+	m_ss << toHex(view.id) << '\t' << view.pubKey << '\n';
 }
 
-void ToStringVisitor::visit(const MessageSentResPayload& payload)
+void ToStringVisitor::operator()(const MessageSentView& view)
 {
 	// For debugging
-	m_ss << boost::algorithm::hex(payload.getMessage().targetId) << '\t' << payload.getMessage().msgId;
+	m_ss << toHex(view.targetId) << '\t' << view.msgId;
+}
+
+void ToStringVisitor::operator()(const MultiMessageSentView& view)
+{
+	// One line per message, the target name is known since the message was encrypted for it
+	for (const auto& entry : view.entries) {
+		m_ss << m_state.getNameByUUID(std::string(entry.targetId)) << '\t' << entry.msgId << '\n';
+	}
 }
 
-void ToStringVisitor::visit(const PollMessageResPayload& payload)
+void ToStringVisitor::operator()(const PollMessagesView& view)
 {
 	// Iterate over the messages and print the sender name and message content
-	auto messages = payload.getMessages();
-	for (size_t i = 0; i < messages.size(); i++) {
-		m_ss << "From: " << m_state.getNameByUUID(messages[i].senderId) << '\n';
+	for (const auto& msg : view.msgs) {
+		auto username = m_state.getNameByUUID(std::string(msg.senderId));
+		m_ss << "From: " << username << '\n';
 		m_ss << "Content:\n";
 
-		switch (messages[i].msgType) {
+		switch (msg.msgType) {
 		case MessageTypes::SEND_TXT: {
-			// Get the sender name and sym key
-			auto username = m_state.getNameByUUID(messages[i].senderId);
-			auto symKey = m_state.getSymKey(username);
-
 			// If there is no sym key, print an error message
-			if (!symKey) {
+			if (!m_state.hasSymKey(username)) {
 				m_ss << "can't decrypt message";
 				break;
 			}
 
-			// Get the content and decrypt it using the sym key
-			auto msg = messages[i].content;
-			auto msgSz = msg.size();
-			auto keySz = symKey.value().size();
-			AESWrapper aes(reinterpret_cast<const uint8_t*>(symKey.value().c_str()), static_cast<unsigned int>(keySz));
-
-			m_ss << aes.decrypt(msg.c_str(), static_cast<unsigned int>(msgSz));
+			// Decrypt the content using the cached cipher of the sender, then decompress it if the sender compressed it
+			auto mode = (msg.flags & MessageFlags::GCM) ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+			auto plain = m_state.getSymCipher(username)->decrypt(msg.content.data(), msg.content.size(), mode);
+			if (msg.flags & MessageFlags::COMPRESSED) {
+				plain = DeflateWrapper::decompress(plain.data(), plain.size());
+			}
+			m_ss << plain;
 			break;
 		}
 		case MessageTypes::GET_SYM_KEY:
@@ -255,19 +327,39 @@ void ToStringVisitor::visit(const PollMessageResPayload& payload)
 		case MessageTypes::SEND_SYM_KEY:
 			m_ss << "Symmetric key received";
 			break;
-		case MessageTypes::SEND_FILE: {
-			// Get the sender name and sym key
-			auto username = m_state.getNameByUUID(messages[i].senderId);
-			auto symKey = m_state.getSymKey(username);
+		case MessageTypes::SEND_GROUP_KEY:
+			m_ss << "Group key received";
+			break;
+		case MessageTypes::SEND_GROUP_TXT: {
+			// The server put the group ID before the cipher text, every member decrypts it with the key of the group
+			if (msg.content.size() < Protocol::GroupTextPrefix::SIZE) {
+				throw std::runtime_error("Error: Group message '" + std::to_string(msg.msgId) + "' is too short");
+			}
 
+			auto [groupId] = Protocol::GroupTextPrefix::decode(reinterpret_cast<const uint8_t*>(msg.content.data()));
+			if (!m_state.hasGroupKey(groupId)) {
+				m_ss << "can't decrypt message";
+				break;
+			}
+
+			auto cipherText = msg.content.substr(Protocol::GroupTextPrefix::SIZE);
+			auto mode = (msg.flags & MessageFlags::GCM) ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+			auto plain = m_state.getGroupCipher(groupId)->decrypt(cipherText.data(), cipherText.size(), mode);
+			if (msg.flags & MessageFlags::COMPRESSED) {
+				plain = DeflateWrapper::decompress(plain.data(), plain.size());
+			}
+			m_ss << "[" << m_state.getGroupName(groupId) << "] " << plain;
+			break;
+		}
+		case MessageTypes::SEND_FILE: {
 			// If there is no sym key, print an error message
-			if (!symKey) {
+			if (!m_state.hasSymKey(username)) {
 				m_ss << "can't decrypt message";
 				break;
 			}
 
 			// Create a unique filename and save the file to the temp directory
-			auto path = Utils::getUniquePath(messages[i].msgId);
+			auto path = Utils::getUniquePath(msg.msgId);
 			std::ofstream file{ path, std::ios::binary };
 
 			// If the file can't be opened, throw a runtime error
@@ -275,13 +367,13 @@ void ToStringVisitor::visit(const PollMessageResPayload& payload)
 				throw std::runtime_error("Error: Could not open '" + path.string() + "'");
 			}
 
-			// Decrypt the file content and save it to the file
-			const auto& msg = messages[i].content;
-			auto msgSz = msg.size();
-			auto keySz = symKey.value().size();
-			AESWrapper aes(reinterpret_cast<const uint8_t*>(symKey.value().c_str()), static_cast<unsigned int>(keySz));
-
-			file << aes.decrypt(msg.c_str(), static_cast<unsigned int>(msgSz));
+			// Decrypt (and decompress) the file content and save it to the file
+			auto mode = (msg.flags & MessageFlags::GCM) ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+			auto plain = m_state.getSymCipher(username)->decrypt(msg.content.data(), msg.content.size(), mode);
+			if (msg.flags & MessageFlags::COMPRESSED) {
+				plain = DeflateWrapper::decompress(plain.data(), plain.size(), SIZE_MAX);
+			}
+			file << plain;
 			file.close();
 
 			// Print the file path
@@ -296,7 +388,44 @@ void ToStringVisitor::visit(const PollMessageResPayload& payload)
 	}
 }
 
-void ToStringVisitor::visit(const ErrorPayload& payload)
+void ToStringVisitor::operator()(const MessagesPageView& view)
+{
+	// A page prints like a poll
+	(*this)(view.page);
+}
+
+void ToStringVisitor::operator()(const MessagesMetaView& view)
+{
+	// One line per pending message, the contents are fetched separately
+	for (const auto& msg : view.msgs) {
+		m_ss << msg.msgId << '\t' << m_state.getNameByUUID(std::string(msg.senderId)) << '\t' << msg.contentSz << " bytes\n";
+	}
+}
+
+void ToStringVisitor::operator()(const MessageContentView& view)
+{
+	// For debugging
+	m_ss << view.msgId << '\t' << view.offset << '+' << view.range.size() << '/' << view.contentSz;
+}
+
+void ToStringVisitor::operator()(const MessagesAckedView& view)
+{
+	// For debugging
+	m_ss << view.count << " messages deleted";
+}
+
+void ToStringVisitor::operator()(const GroupCreatedView& view)
+{
+	// For debugging
+	m_ss << "Group " << view.groupId << " created";
+}
+
+void ToStringVisitor::operator()(const GroupMessageSentView& view)
+{
+	m_ss << "Delivered to " << view.count << " members of group " << view.groupId;
+}
+
+void ToStringVisitor::operator()(const ErrorView& view)
 {
 	// Print a generic error message
 	m_ss << std::string("Server responded with a generic error");
@@ -307,33 +436,68 @@ ClientStateVisitor::ClientStateVisitor(ClientState& state)
 {
 }
 
-void ClientStateVisitor::visit(const UsersListResPayload& payload)
+void ClientStateVisitor::operator()(const UsersListView& view)
+{
+	for (const auto& entry : view.users) {
+		m_state.addClient(std::string(entry.name), std::string(entry.id));
+	}
+}
+
+void ClientStateVisitor::operator()(const UsersDeltaView& view)
 {
-	for (const auto& entry : payload.getUsers()) {
-		m_state.addClient(entry.name, entry.id);
+	for (const auto& entry : view.users) {
+		m_state.updateClient(std::string(entry.name), std::string(entry.id));
 	}
+
+	m_state.setDirectoryVersion(view.version);
 }
 
-void ClientStateVisitor::visit(const PublicKeyResPayload& payload)
+void ClientStateVisitor::operator()(const PublicKeyView& view)
 {
-	// Get the public key entry and set the public key for the client
-	auto entry = payload.getPubKeyEntry();
-	auto name = m_state.getNameByUUID(entry.id);
-	m_state.setPubKey(name, entry.pubKey);
+	// Set the public key for the client the key belongs to
+	auto name = m_state.getNameByUUID(std::string(view.id));
+	m_state.setPubKey(name, std::string(view.pubKey), view.keyType);
+
+	// Two X25519 clients derive their symmetric key from each other's public key, nothing is sent for it
+	if (view.keyType == KeyTypes::X25519 && m_state.getKeyType() == KeyTypes::X25519) {
+		m_state.setSymKey(name, m_state.deriveSymKey(name));
+	}
 }
 
-void ClientStateVisitor::visit(const PollMessageResPayload& payload)
+void ClientStateVisitor::operator()(const PollMessagesView& view)
 {
 	// Iterate over the messages, if the message is a symmetric key, decrypt it and save it in the client state so messages/files could also be decrypted
-	auto messages = payload.getMessages();
-	for (size_t i = 0; i < messages.size(); i++) {
-		switch (messages[i].msgType) {
+	for (const auto& msg : view.msgs) {
+		switch (msg.msgType) {
 		case MessageTypes::SEND_SYM_KEY: {
-			auto privKey = m_state.getPrivKey();
-			auto rsaprive = RSAPrivateWrapper(privKey);
-			auto username = m_state.getNameByUUID(messages[i].senderId);
+			// Only an RSA key can unwrap it, an X25519 client derives its symmetric keys
+			if (m_state.getKeyType() != KeyTypes::RSA) {
+				break;
+			}
+
+			auto username = m_state.getNameByUUID(std::string(msg.senderId));
 
-			m_state.setSymKey(username, rsaprive.decrypt(messages[i].content));
+			m_state.setSymKey(username, m_state.getRSAPrivate()->decrypt(msg.content.data(), static_cast<unsigned int>(msg.content.size())));
+			break;
+		}
+		case MessageTypes::SEND_GROUP_KEY: {
+			// The group ID and name are in the clear, only the key is wrapped
+			if (msg.content.size() < Protocol::GroupKeyPrefix::SIZE) {
+				throw std::runtime_error("Error: Group key message '" + std::to_string(msg.msgId) + "' is too short");
+			}
+
+			auto [groupId, name] = Protocol::GroupKeyPrefix::decode(reinterpret_cast<const uint8_t*>(msg.content.data()));
+			auto wrappedKey = msg.content.substr(Protocol::GroupKeyPrefix::SIZE);
+			auto owner = std::string(msg.senderId);
+			if (m_state.getKeyType() == KeyTypes::RSA) {
+				m_state.setGroupKey(groupId, std::string(name), owner, m_state.getRSAPrivate()->decrypt(wrappedKey.data(), static_cast<unsigned int>(wrappedKey.size())));
+			}
+			else {
+				// An X25519 member gets the key encrypted with the symmetric key it shares with the group's owner
+				auto mode = (msg.flags & MessageFlags::GCM) ? AESWrapper::Mode::GCM : AESWrapper::Mode::CBC;
+				auto cipher = m_state.getSymCipher(m_state.getNameByUUID(std::string(msg.senderId)));
+				m_state.setGroupKey(groupId, std::string(name), owner, cipher->decrypt(wrappedKey.data(), wrappedKey.size(), mode));
+			}
 			break;
 		}
 		default:
@@ -342,14 +506,7 @@ void ClientStateVisitor::visit(const PollMessageResPayload& payload)
 	}
 }
 
-void ClientStateVisitor::visit(const RegistrationResPayload& payload)
-{
-}
-
-void ClientStateVisitor::visit(const MessageSentResPayload& payload)
-{
-}
-
-void ClientStateVisitor::visit(const ErrorPayload& payload)
+void ClientStateVisitor::operator()(const MessagesPageView& view)
 {
+	(*this)(view.page);
 }
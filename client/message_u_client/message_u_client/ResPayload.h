@@ -5,25 +5,22 @@
 #include <string>
 #include <sstream>
 
-// Foward declarations, for the client state and the visitor classes
-class Visitor;
-class ClientState;
+#include "ResView.h"
 
-// Forward declarations for the response codes and message types enums
-enum class ResponseCodes : uint16_t;
-enum class MessageTypes : uint8_t;
+// Foward declaration, for the client state
+class ClientState;
 
-// Base class for the response payloads
+// Base class for the owning response payloads, copies of the views that outlive the response they came from
 class ResPayload {
 public:
 	using payload_t = std::unique_ptr<ResPayload>;
 	using bytes_t = std::vector<uint8_t>;
 
 	// Converts the byte array to a payload object
-	static payload_t fromBytes(const bytes_t& bytes, ResponseCodes code);
+	static payload_t fromBytes(const bytes_t& bytes, ResponseCodes code, uint8_t version);
 
-	// Accepts a visitor
-	virtual void accept(Visitor& visitor) = 0;
+	// Copies a view into the matching payload object
+	static payload_t fromView(const ResView& view);
 
 	virtual ~ResPayload() = default;
 };
@@ -31,9 +28,8 @@ public:
 // Class to represent the registration response payload
 class RegistrationResPayload : public ResPayload {
 public:
-	RegistrationResPayload(const bytes_t& bytes);
+	explicit RegistrationResPayload(const RegistrationView& view);
 
-	void accept(Visitor& visitor) override;
 	const std::string& getUUID() const;
 
 	~RegistrationResPayload() = default;
@@ -45,7 +41,7 @@ private:
 // Class to represent the users list response payload
 class UsersListResPayload : public ResPayload {
 public:
-	UsersListResPayload(const bytes_t& bytes);
+	explicit UsersListResPayload(const UsersListView& view);
 
 	// Entry for each user in the user list
 	struct UserEntry {
@@ -53,7 +49,6 @@ public:
 		std::string name;
 	};
 
-	void accept(Visitor& visitor) override;
 	const std::vector<UserEntry>& getUsers() const;
 
 	~UsersListResPayload() = default;
@@ -62,18 +57,35 @@ private:
 	std::vector<UserEntry> m_users;
 };
 
+// Class to represent the users delta response payload, the current directory version and the users that changed before it
+class UsersDeltaResPayload : public ResPayload {
+public:
+	using UserEntry = UsersListResPayload::UserEntry;
+
+	explicit UsersDeltaResPayload(const UsersDeltaView& view);
+
+	uint64_t getVersion() const;
+	const std::vector<UserEntry>& getUsers() const;
+
+	~UsersDeltaResPayload() = default;
+
+private:
+	uint64_t m_version;
+	std::vector<UserEntry> m_users;
+};
+
 // Class to represent the public key response payload
 class PublicKeyResPayload : public ResPayload {
 public:
-	PublicKeyResPayload(const bytes_t& bytes);
+	explicit PublicKeyResPayload(const PublicKeyView& view);
 
 	// Entry for the parsed payload
 	struct PublicKeyEntry {
 		std::string id;
 		std::string pubKey;
+		KeyTypes keyType;
 	};
 
-	void accept(Visitor& visitor) override;
 	const PublicKeyEntry& getPubKeyEntry() const;
 
 	~PublicKeyResPayload() = default;
@@ -85,7 +97,7 @@ private:
 // Class to represent the message sent response payload
 class MessageSentResPayload : public ResPayload {
 public:
-	MessageSentResPayload(const bytes_t& bytes);
+	explicit MessageSentResPayload(const MessageSentView& view);
 
 	// Entry for the parsed payload
 	struct MsgEntry {
@@ -94,7 +106,6 @@ public:
 	};
 
 	const MsgEntry& getMessage() const;
-	void accept(Visitor& visitor) override;
 
 	~MessageSentResPayload() = default;
 
@@ -102,22 +113,37 @@ private:
 	MsgEntry m_entry;
 };
 
+// Class to represent the response payload of a multi message send, one entry per message in the order of the request
+class MultiMessageSentResPayload : public ResPayload {
+public:
+	explicit MultiMessageSentResPayload(const MultiMessageSentView& view);
+
+	using MsgEntry = MessageSentResPayload::MsgEntry;
+
+	const std::vector<MsgEntry>& getMessages() const;
+
+	~MultiMessageSentResPayload() = default;
+
+private:
+	std::vector<MsgEntry> m_entries;
+};
+
 // Class to represent the poll message response payload
 class PollMessageResPayload : public ResPayload {
 public:
-	PollMessageResPayload(const bytes_t& bytes);
+	explicit PollMessageResPayload(const PollMessagesView& view);
 
 	// Entry for each message in the message list
 	struct MessageEntry {
 		std::string senderId;
 		uint32_t msgId{};
 		MessageTypes msgType;
+		uint8_t flags{}; // MessageFlags of the message
 		uint32_t contentSz{};
 		std::string content;
 	};
 
 	const std::vector<MessageEntry>& getMessages() const;
-	void accept(Visitor& visitor) override;
 
 	~PollMessageResPayload() = default;
 
@@ -125,56 +151,149 @@ private:
 	std::vector<MessageEntry> m_msgs;
 };
 
-// Class to represent the error response payload
-class ErrorPayload : public ResPayload {
+// Class to represent the response payload of a paged poll, the messages of the page and the cursor of the next one
+class MessagesPageResPayload : public PollMessageResPayload {
 public:
-	void accept(Visitor& visitor) override;
+	explicit MessagesPageResPayload(const MessagesPageView& view);
 
-	~ErrorPayload() = default;
+	uint32_t getCursor() const;
+
+	~MessagesPageResPayload() = default;
+
+private:
+	uint32_t m_cursor;
+};
+
+// Class to represent the response payload of a metadata poll, the header of every pending message without its content
+class MessagesMetaResPayload : public ResPayload {
+public:
+	explicit MessagesMetaResPayload(const MessagesMetaView& view);
+
+	// Entry for each message in the message list
+	struct MetaEntry {
+		std::string senderId;
+		uint32_t msgId{};
+		MessageTypes msgType;
+		uint8_t flags{}; // MessageFlags of the message
+		uint32_t contentSz{};
+	};
+
+	const std::vector<MetaEntry>& getMessages() const;
+
+	~MessagesMetaResPayload() = default;
+
+private:
+	std::vector<MetaEntry> m_msgs;
+};
+
+// Class to represent the response payload of a fetch, a range of the content of a message
+class MessageContentResPayload : public ResPayload {
+public:
+	explicit MessageContentResPayload(const MessageContentView& view);
+
+	uint32_t getMsgId() const;
+	uint64_t getOffset() const;
+	uint64_t getContentSz() const;
+	const std::string& getRange() const;
+
+	~MessageContentResPayload() = default;
+
+private:
+	uint32_t m_msgId;
+	uint64_t m_offset;
+	uint64_t m_contentSz;
+	std::string m_range;
+};
+
+// Class to represent the response payload of an acknowledge, the number of messages that were deleted
+class MessagesAckedResPayload : public ResPayload {
+public:
+	explicit MessagesAckedResPayload(const MessagesAckedView& view);
+
+	uint32_t getCount() const;
+
+	~MessagesAckedResPayload() = default;
+
+private:
+	uint32_t m_count;
 };
 
-// Visitor class to visit the response payloads
-class Visitor 
-{
+// Class to represent the response payload of a created group
+class GroupCreatedResPayload : public ResPayload {
 public:
-	virtual void visit(const RegistrationResPayload& payload) = 0;
-	virtual void visit(const UsersListResPayload& payload) = 0;
-	virtual void visit(const PublicKeyResPayload& payload) = 0;
-	virtual void visit(const MessageSentResPayload& payload) = 0;
-	virtual void visit(const PollMessageResPayload& payload) = 0;
-	virtual void visit(const ErrorPayload& payload) = 0;
+	explicit GroupCreatedResPayload(const GroupCreatedView& view);
+
+	uint32_t getGroupId() const;
+
+	~GroupCreatedResPayload() = default;
+
+private:
+	uint32_t m_groupId;
+};
+
+// Class to represent the response payload of a message sent to a group, the number of members it was delivered to
+class GroupMessageSentResPayload : public ResPayload {
+public:
+	explicit GroupMessageSentResPayload(const GroupMessageSentView& view);
+
+	uint32_t getGroupId() const;
+	uint32_t getCount() const;
+
+	~GroupMessageSentResPayload() = default;
+
+private:
+	uint32_t m_groupId;
+	uint32_t m_count;
 };
 
-// Visitor class to convert the response payloads to string
-class ToStringVisitor : public Visitor {
+// Class to represent the error response payload
+class ErrorPayload : public ResPayload {
+public:
+	~ErrorPayload() = default;
+};
+
+// Visitor that converts the response views to string, used with std::visit
+class ToStringVisitor {
 public:
 	explicit ToStringVisitor(ClientState& state);
 
 	std::string getString();
 
-	void visit(const RegistrationResPayload& payload) override;
-	void visit(const UsersListResPayload& payload) override;
-	void visit(const PublicKeyResPayload& payload) override;
-	void visit(const MessageSentResPayload& payload) override;
-	void visit(const PollMessageResPayload& payload) override;
-	void visit(const ErrorPayload& payload) override;
+	void operator()(const RegistrationView& view);
+	void operator()(const UsersListView& view);
+	void operator()(const UsersDeltaView& view);
+	void operator()(const PublicKeyView& view);
+	void operator()(const MessageSentView& view);
+	void operator()(const MultiMessageSentView& view);
+	void operator()(const PollMessagesView& view);
+	void operator()(const MessagesPageView& view);
+	void operator()(const MessagesMetaView& view);
+	void operator()(const MessageContentView& view);
+	void operator()(const MessagesAckedView& view);
+	void operator()(const GroupCreatedView& view);
+	void operator()(const GroupMessageSentView& view);
+	void operator()(const ErrorView& view);
 
 private:
 	ClientState& m_state; // Reference to the client state, may use it for getting a clients info
 	std::stringstream m_ss;
 };
 
-// Visitor class to update the client state
-class ClientStateVisitor : public Visitor {
+// Visitor that updates the client state from the response views, used with std::visit
+class ClientStateVisitor {
 public:
 	explicit ClientStateVisitor(ClientState& state);
 
-	void visit(const RegistrationResPayload& payload) override;
-	void visit(const UsersListResPayload& payload) override;
-	void visit(const PublicKeyResPayload& payload) override;
-	void visit(const MessageSentResPayload& payload) override;
-	void visit(const PollMessageResPayload& payload) override;
-	void visit(const ErrorPayload& payload) override;
+	void operator()(const UsersListView& view);
+	void operator()(const UsersDeltaView& view);
+	void operator()(const PublicKeyView& view);
+	void operator()(const PollMessagesView& view);
+	void operator()(const MessagesPageView& view);
+
+	// The rest of the responses don't change the state
+	template<typename View>
+	void operator()(const View& view) {
+	}
 
 private:
 	ClientState& m_state; // Reference to the client state, updates it
@@ -0,0 +1,344 @@
+#include "ResView.h"
+#include "Response.h"
+#include "Request.h"
+#include "Protocol.h"
+#include "Utils.h"
+
+#include <stdexcept>
+#include <string>
+
+RegistrationView RegistrationView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [uuid] = Protocol::RegisteredRes::decode(bytes, offset);
+	return { uuid };
+}
+
+UsersListView UsersListView::parse(const view_bytes_t& bytes)
+{
+	// Every entry is a fixed size record, the name ends at its terminator
+	UsersListView view;
+	size_t offset{ 0 };
+	view.users.reserve(bytes.size() / Protocol::UserEntry::SIZE);
+	while (offset < bytes.size()) {
+		auto [id, name] = Protocol::UserEntry::decode(bytes, offset);
+		view.users.push_back({ id, name });
+	}
+
+	return view;
+}
+
+// Reads the VarInt entry count that starts a v3 list. Every entry takes at least 'minEntrySz' bytes,
+// so a count the bytes can't hold is rejected before anything is reserved
+static size_t parseCountV3(const view_bytes_t& bytes, size_t& offset, size_t minEntrySz)
+{
+	auto count = Protocol::VarInt::decode<size_t>(bytes, offset);
+	if (count > (bytes.size() - offset) / minEntrySz) {
+		throw std::runtime_error("Error: " + std::to_string(count) + " entries don't fit in " + std::to_string(bytes.size() - offset) + " bytes");
+	}
+
+	return count;
+}
+
+// Throws if a v3 list left bytes after its last entry
+static void checkEndV3(const view_bytes_t& bytes, size_t offset)
+{
+	if (offset != bytes.size()) {
+		throw std::runtime_error("Error: " + std::to_string(bytes.size() - offset) + " bytes follow the last entry");
+	}
+}
+
+// Reads the v3 user entries from 'offset' to the end of the bytes, the names are VarString
+static std::vector<UserView> parseUserEntriesV3(const view_bytes_t& bytes, size_t offset)
+{
+	// The count comes first, so the entries are reserved once and read in a single pass
+	std::vector<UserView> users;
+	auto count = parseCountV3(bytes, offset, Protocol::V3::UserEntryPrefix::SIZE + 1);
+	users.reserve(count);
+	for (size_t i = 0; i < count; i++) {
+		auto [id] = Protocol::V3::UserEntryPrefix::decode(bytes, offset);
+		users.push_back({ id, Protocol::VarString::decode(bytes, offset) });
+	}
+
+	checkEndV3(bytes, offset);
+	return users;
+}
+
+UsersListView UsersListView::parseV3(const view_bytes_t& bytes)
+{
+	return { parseUserEntriesV3(bytes, 0) };
+}
+
+UsersDeltaView UsersDeltaView::parse(const view_bytes_t& bytes)
+{
+	UsersDeltaView view;
+	size_t offset{ 0 };
+	std::tie(view.version) = Protocol::UsersDeltaRes::decode(bytes, offset);
+
+	// Each entry is the client ID and the name length followed by the name itself, count them first so the entries take a single allocation
+	size_t count{ 0 };
+	for (size_t pos = offset; pos < bytes.size(); count++) {
+		auto [id, nameSz] = Protocol::UserDeltaEntry::decode(bytes, pos);
+		if (bytes.size() - pos < nameSz) {
+			throw std::runtime_error("Error: Users delta entry name is shorter than declared");
+		}
+		pos += nameSz;
+	}
+
+	view.users.reserve(count);
+	while (offset < bytes.size()) {
+		auto [id, nameSz] = Protocol::UserDeltaEntry::decode(bytes.data() + offset);
+		offset += Protocol::UserDeltaEntry::SIZE;
+
+		view.users.push_back({ id, { reinterpret_cast<const char*>(bytes.data() + offset), nameSz } });
+		offset += nameSz;
+	}
+
+	return view;
+}
+
+UsersDeltaView UsersDeltaView::parseV3(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [version] = Protocol::UsersDeltaRes::decode(bytes, offset);
+	return { version, parseUserEntriesV3(bytes, offset) };
+}
+
+PublicKeyView PublicKeyView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [id, pubKey] = Protocol::PublicKeyRes::decode(bytes, offset);
+	return { id, pubKey, KeyTypes::RSA };
+}
+
+PublicKeyView PublicKeyView::parseV3(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [id] = Protocol::V3::PublicKeyPrefix::decode(bytes, offset);
+	auto pubKey = Protocol::VarString::decode(bytes, offset);
+	if (offset != bytes.size()) {
+		throw std::runtime_error("Error: Public key payload has " + std::to_string(bytes.size() - offset) + " trailing bytes");
+	}
+
+	return { id, pubKey, KeyTypes::RSA };
+}
+
+PublicKeyView PublicKeyView::parseV4(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [id, keyType] = Protocol::V4::PublicKeyPrefix::decode(bytes, offset);
+	if (keyType != static_cast<uint8_t>(KeyTypes::RSA) && keyType != static_cast<uint8_t>(KeyTypes::X25519)) {
+		throw std::runtime_error("Error: Unknown public key type '" + std::to_string(keyType) + "'");
+	}
+
+	auto pubKey = Protocol::VarString::decode(bytes, offset);
+	if (offset != bytes.size()) {
+		throw std::runtime_error("Error: Public key payload has " + std::to_string(bytes.size() - offset) + " trailing bytes");
+	}
+
+	return { id, pubKey, static_cast<KeyTypes>(keyType) };
+}
+
+MessageSentView MessageSentView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [targetId, msgId] = Protocol::MessageSentRes::decode(bytes, offset);
+	return { targetId, msgId };
+}
+
+MultiMessageSentView MultiMessageSentView::parse(const view_bytes_t& bytes)
+{
+	MultiMessageSentView view;
+	size_t offset{ 0 };
+	view.entries.reserve(bytes.size() / Protocol::MessageSentRes::SIZE);
+	while (offset < bytes.size()) {
+		auto [targetId, msgId] = Protocol::MessageSentRes::decode(bytes, offset);
+		view.entries.push_back({ targetId, msgId });
+	}
+
+	return view;
+}
+
+PollMessagesView PollMessagesView::parse(const view_bytes_t& bytes, size_t offset)
+{
+	// The messages have variable sizes, walk their headers first so the entries take a single allocation
+	size_t count{ 0 };
+	for (size_t pos = offset; pos < bytes.size(); count++) {
+		auto [senderId, msgId, type, contentSz] = Protocol::PollMessageHeader::decode(bytes, pos);
+		if (bytes.size() - pos < contentSz) {
+			throw std::runtime_error("Error: Message '" + std::to_string(msgId) + "' content is shorter than declared");
+		}
+		pos += contentSz;
+	}
+
+	// The walk checked every bound, the headers are read unchecked from here on
+	PollMessagesView view;
+	view.msgs.reserve(count);
+	while (offset < bytes.size()) {
+		auto [senderId, msgId, type, contentSz] = Protocol::PollMessageHeader::decode(bytes.data() + offset);
+		offset += Protocol::PollMessageHeader::SIZE;
+
+		MessageView& msg = view.msgs.emplace_back();
+		msg.senderId = senderId;
+		msg.msgId = msgId;
+		msg.msgType = MessageTypes(type & ~MessageFlags::MASK);
+		msg.flags = type & MessageFlags::MASK;
+		msg.content = { reinterpret_cast<const char*>(bytes.data() + offset), contentSz };
+		offset += contentSz;
+	}
+
+	return view;
+}
+
+PollMessagesView PollMessagesView::parseV3(const view_bytes_t& bytes, size_t offset)
+{
+	// The count comes first, so the entries are reserved once and read in a single pass
+	PollMessagesView view;
+	auto count = parseCountV3(bytes, offset, Protocol::V3::PollMessagePrefix::SIZE + 2);
+	view.msgs.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		auto [senderId, type] = Protocol::V3::PollMessagePrefix::decode(bytes, offset);
+
+		MessageView& msg = view.msgs.emplace_back();
+		msg.senderId = senderId;
+		msg.msgId = Protocol::VarInt::decode<uint32_t>(bytes, offset);
+		msg.msgType = MessageTypes(type & ~MessageFlags::MASK);
+		msg.flags = type & MessageFlags::MASK;
+
+		auto contentSz = Protocol::VarInt::decode<uint32_t>(bytes, offset);
+		if (bytes.size() - offset < contentSz) {
+			throw std::runtime_error("Error: Message '" + std::to_string(msg.msgId) + "' content is shorter than declared");
+		}
+		msg.content = { reinterpret_cast<const char*>(bytes.data() + offset), contentSz };
+		offset += contentSz;
+	}
+
+	checkEndV3(bytes, offset);
+	return view;
+}
+
+MessagesPageView MessagesPageView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [cursor] = Protocol::PollPageRes::decode(bytes, offset);
+	return { cursor, PollMessagesView::parse(bytes, offset) };
+}
+
+MessagesPageView MessagesPageView::parseV3(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [cursor] = Protocol::PollPageRes::decode(bytes, offset);
+	return { cursor, PollMessagesView::parseV3(bytes, offset) };
+}
+
+MessagesMetaView MessagesMetaView::parse(const view_bytes_t& bytes)
+{
+	MessagesMetaView view;
+	size_t offset{ 0 };
+	view.msgs.reserve(bytes.size() / Protocol::PollMessageHeader::SIZE);
+	while (offset < bytes.size()) {
+		auto [senderId, msgId, type, contentSz] = Protocol::PollMessageHeader::decode(bytes, offset);
+		view.msgs.push_back({ senderId, msgId, MessageTypes(type & ~MessageFlags::MASK), static_cast<uint8_t>(type & MessageFlags::MASK), contentSz });
+	}
+
+	return view;
+}
+
+MessagesMetaView MessagesMetaView::parseV3(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	MessagesMetaView view;
+	auto count = parseCountV3(bytes, offset, Protocol::V3::PollMessagePrefix::SIZE + 2);
+	view.msgs.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		auto [senderId, type] = Protocol::V3::PollMessagePrefix::decode(bytes, offset);
+		auto msgId = Protocol::VarInt::decode<uint32_t>(bytes, offset);
+		auto contentSz = Protocol::VarInt::decode<uint32_t>(bytes, offset);
+		view.msgs.push_back({ senderId, msgId, MessageTypes(type & ~MessageFlags::MASK), static_cast<uint8_t>(type & MessageFlags::MASK), contentSz });
+	}
+
+	checkEndV3(bytes, offset);
+	return view;
+}
+
+MessageContentView MessageContentView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [msgId, rangeOffset, contentSz] = Protocol::MessageContentRes::decode(bytes, offset);
+
+	// The range is the rest of the payload, it can't run past the end of the content
+	auto rangeSz = bytes.size() - offset;
+	if (rangeOffset > contentSz || contentSz - rangeOffset < rangeSz) {
+		throw std::runtime_error("Error: Range of " + std::to_string(rangeSz) + " bytes at offset " + std::to_string(rangeOffset) +
+								 " doesn't fit in message '" + std::to_string(msgId) + "' of " + std::to_string(contentSz) + " bytes");
+	}
+
+	return { msgId, rangeOffset, contentSz, { reinterpret_cast<const char*>(bytes.data() + offset), rangeSz } };
+}
+
+MessagesAckedView MessagesAckedView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [count] = Protocol::MessagesAckedRes::decode(bytes, offset);
+	return { count };
+}
+
+GroupCreatedView GroupCreatedView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [groupId] = Protocol::GroupCreatedRes::decode(bytes, offset);
+	return { groupId };
+}
+
+GroupMessageSentView GroupMessageSentView::parse(const view_bytes_t& bytes)
+{
+	size_t offset{ 0 };
+	auto [groupId, count] = Protocol::GroupMessageSentRes::decode(bytes, offset);
+	return { groupId, count };
+}
+
+ResView parseResView(const view_bytes_t& bytes, ResponseCodes code, uint8_t version)
+{
+	bool isV3 = version >= Protocol::VERSION_3;
+
+	// Parse the view that matches the response code
+	switch (code)
+	{
+	case ResponseCodes::REG_OK:
+		return RegistrationView::parse(bytes);
+	case ResponseCodes::USRS_LIST:
+		return isV3 ? UsersListView::parseV3(bytes) : UsersListView::parse(bytes);
+	case ResponseCodes::USRS_DELTA:
+		return isV3 ? UsersDeltaView::parseV3(bytes) : UsersDeltaView::parse(bytes);
+	case ResponseCodes::PUB_KEY:
+		if (version >= Protocol::VERSION_4) {
+			return PublicKeyView::parseV4(bytes);
+		}
+		return isV3 ? PublicKeyView::parseV3(bytes) : PublicKeyView::parse(bytes);
+	case ResponseCodes::MSG_SEND:
+		return MessageSentView::parse(bytes);
+	case ResponseCodes::MULTI_MSG_SEND:
+		return MultiMessageSentView::parse(bytes);
+	case ResponseCodes::POLL_MSGS:
+		return isV3 ? PollMessagesView::parseV3(bytes) : PollMessagesView::parse(bytes);
+	case ResponseCodes::MSGS_PAGE:
+		return isV3 ? MessagesPageView::parseV3(bytes) : MessagesPageView::parse(bytes);
+	case ResponseCodes::MSGS_META:
+		return isV3 ? MessagesMetaView::parseV3(bytes) : MessagesMetaView::parse(bytes);
+	case ResponseCodes::MSG_CONTENT:
+		return MessageContentView::parse(bytes);
+	case ResponseCodes::MSGS_ACKED:
+		return MessagesAckedView::parse(bytes);
+	case ResponseCodes::GROUP_CREATED:
+		return GroupCreatedView::parse(bytes);
+	case ResponseCodes::GROUP_MSG_SENT:
+		return GroupMessageSentView::parse(bytes);
+	case ResponseCodes::ERR:
+		return ErrorView{};
+	}
+
+	// In case there is no match, throw a runtime error
+	throw std::runtime_error("Error: '" + std::to_string(Utils::EnumToUint16(code)) + "' is not a valid code");
+}
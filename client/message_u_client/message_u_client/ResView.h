@@ -0,0 +1,151 @@
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <variant>
+#include <cstdint>
+
+// Forward declarations for the response codes and message types enums
+enum class ResponseCodes : uint16_t;
+enum class MessageTypes : uint8_t;
+enum class KeyTypes : uint8_t;
+
+// Views of the response payloads, parsed without copying any field.
+// The string_view fields point into the payload bytes they were parsed from, Response keeps those bytes alive (and in place) for as long as it lives.
+// A list is a single vector that is reserved once, so a payload costs at most one allocation however many entries it has.
+// The payloads whose v3 records differ from v2 have a parseV3 as well, and the ones whose v4 records differ from v3 a parseV4.
+using view_bytes_t = std::vector<uint8_t>;
+
+struct RegistrationView {
+	std::string_view uuid;
+
+	static RegistrationView parse(const view_bytes_t& bytes);
+};
+
+struct UserView {
+	std::string_view id;
+	std::string_view name;
+};
+
+struct UsersListView {
+	std::vector<UserView> users;
+
+	static UsersListView parse(const view_bytes_t& bytes);
+	static UsersListView parseV3(const view_bytes_t& bytes);
+};
+
+// The current directory version and the users that changed before it
+struct UsersDeltaView {
+	uint64_t version{};
+	std::vector<UserView> users;
+
+	static UsersDeltaView parse(const view_bytes_t& bytes);
+	static UsersDeltaView parseV3(const view_bytes_t& bytes);
+};
+
+// The key is RSA before v4
+struct PublicKeyView {
+	std::string_view id;
+	std::string_view pubKey;
+	KeyTypes keyType{};
+
+	static PublicKeyView parse(const view_bytes_t& bytes);
+	static PublicKeyView parseV3(const view_bytes_t& bytes);
+	static PublicKeyView parseV4(const view_bytes_t& bytes);
+};
+
+struct MessageSentView {
+	std::string_view targetId;
+	uint32_t msgId{};
+
+	static MessageSentView parse(const view_bytes_t& bytes);
+};
+
+// One entry per message, in the order of the request
+struct MultiMessageSentView {
+	std::vector<MessageSentView> entries;
+
+	static MultiMessageSentView parse(const view_bytes_t& bytes);
+};
+
+struct MessageView {
+	std::string_view senderId;
+	uint32_t msgId{};
+	MessageTypes msgType{};
+	uint8_t flags{}; // MessageFlags of the message
+	std::string_view content;
+};
+
+struct PollMessagesView {
+	std::vector<MessageView> msgs;
+
+	// The messages start at 'offset' and run to the end of the bytes
+	static PollMessagesView parse(const view_bytes_t& bytes, size_t offset = 0);
+	static PollMessagesView parseV3(const view_bytes_t& bytes, size_t offset = 0);
+};
+
+// A page of a paged poll, the next page request carries the cursor and deletes the messages up to it
+struct MessagesPageView {
+	uint32_t cursor{}; // ID of the last message of the page, 0 once the page is empty
+	PollMessagesView page;
+
+	static MessagesPageView parse(const view_bytes_t& bytes);
+	static MessagesPageView parseV3(const view_bytes_t& bytes);
+};
+
+// The header of a polled message, its content is fetched separately
+struct MessageMetaView {
+	std::string_view senderId;
+	uint32_t msgId{};
+	MessageTypes msgType{};
+	uint8_t flags{}; // MessageFlags of the message
+	uint32_t contentSz{};
+};
+
+struct MessagesMetaView {
+	std::vector<MessageMetaView> msgs;
+
+	static MessagesMetaView parse(const view_bytes_t& bytes);
+	static MessagesMetaView parseV3(const view_bytes_t& bytes);
+};
+
+// A range of the content of a message, at 'offset' in a content of 'contentSz' bytes
+struct MessageContentView {
+	uint32_t msgId{};
+	uint64_t offset{};
+	uint64_t contentSz{};
+	std::string_view range;
+
+	static MessageContentView parse(const view_bytes_t& bytes);
+};
+
+struct MessagesAckedView {
+	uint32_t count{};
+
+	static MessagesAckedView parse(const view_bytes_t& bytes);
+};
+
+struct GroupCreatedView {
+	uint32_t groupId{};
+
+	static GroupCreatedView parse(const view_bytes_t& bytes);
+};
+
+// A message sent to a group, 'count' is the number of members it was delivered to
+struct GroupMessageSentView {
+	uint32_t groupId{};
+	uint32_t count{};
+
+	static GroupMessageSentView parse(const view_bytes_t& bytes);
+};
+
+struct ErrorView {
+};
+
+using ResView = std::variant<RegistrationView, UsersListView, UsersDeltaView, PublicKeyView, MessageSentView,
+	MultiMessageSentView, PollMessagesView, MessagesPageView, MessagesMetaView, MessageContentView, MessagesAckedView,
+	GroupCreatedView, GroupMessageSentView, ErrorView>;
+
+// Parses the view of a payload by its response code and the protocol version of the response,
+// throws if the code is unknown or the bytes end before the payload does
+ResView parseResView(const view_bytes_t& bytes, ResponseCodes code, uint8_t version);
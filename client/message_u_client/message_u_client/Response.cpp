@@ -1,6 +1,7 @@
 #include "Response.h"
 #include "ResPayload.h"
 #include "Utils.h"
+#include "Protocol.h"
 
 // Static method to create a header from bytes
 Response::Header Response::Header::fromBytes(const bytes_t& bytes)
@@ -8,27 +9,42 @@ Response::Header Response::Header::fromBytes(const bytes_t& bytes)
     size_t offset{ 0 };
 
     // Read the version, code and payload size from the raw bytes
-    auto version = Utils::deserializeTrivialType<uint8_t>(bytes, offset);
-    auto code = Utils::deserializeTrivialType<uint16_t>(bytes, offset);
-    auto payloadSz = Utils::deserializeTrivialType<uint32_t>(bytes, offset);
+    auto [version, code, payloadSz] = Protocol::ResponseHeader::decode(bytes, offset);
 
     return {version, static_cast<ResponseCodes>(code), payloadSz};
 }
 
-Response::Response(const Header& header, const bytes_t& payloadBytes)
-    : m_header{header}
+Response::Response(const Header& header, bytes_t payloadBytes)
+    : Response(header, buffer_t(std::move(payloadBytes)))
 {
-    // Create the payload from the bytes
-    m_payload = ResPayload::fromBytes(payloadBytes, m_header.code);
 }
 
+Response::Response(const Header& header, buffer_t payload)
+    : m_header{header}, m_payloadBytes{std::move(payload)}, m_view{parseResView(m_payloadBytes.bytes(), m_header.code, m_header.version)}
+{
+}
+
+Response::Response(Response&& other) noexcept = default;
+
+Response& Response::operator=(Response&& other) noexcept = default;
+
 Response::Header& Response::getHeader()
 {
     return m_header;
 }
 
+const ResView& Response::getView() const
+{
+    return m_view;
+}
+
 ResPayload& Response::getPayload()
 {
+    // Create the payload from the view
+    if (!m_payload) {
+        m_payload = ResPayload::fromView(m_view);
+    }
+
     return *m_payload;
 }
 
@@ -4,6 +4,9 @@
 #include <vector>
 #include <memory>
 
+#include "ResView.h"
+#include "BufferPool.h"
+
 // Enum for the different response codes
 enum class ResponseCodes : uint16_t {
 	REG_OK = 2100,
@@ -11,17 +14,27 @@ enum class ResponseCodes : uint16_t {
 	PUB_KEY = 2102,
 	MSG_SEND = 2103,
 	POLL_MSGS = 2104,
+	MULTI_MSG_SEND = 2105,
+	USRS_DELTA = 2106,
+	MSGS_META = 2107,
+	MSG_CONTENT = 2108,
+	MSGS_ACKED = 2109,
+	MSGS_PAGE = 2110,
+	GROUP_CREATED = 2111,
+	GROUP_MSG_SENT = 2112,
 	ERR = 9000,
 };
 
 // Fowrad declaration of the response payload
 class ResPayload;
 
-// This class wraps the response header and payload     
+// This class wraps the response header and payload.
+// The payload is parsed into a view as the response is built, an owning ResPayload is only built if it is asked for.
 class Response {
 public:
 	using payload_t = std::unique_ptr<ResPayload>;
 	using bytes_t = std::vector<uint8_t>;
+	using buffer_t = BufferPool::Buffer;
 
 	struct Header {
 		uint8_t version;
@@ -32,17 +45,28 @@ public:
 		static Header fromBytes(const bytes_t& bytes);
 	};
 
-	Response(const Header& header, const bytes_t& payloadBytes);
+	// Takes the payload bytes, the fields of the view point into them
+	Response(const Header& header, bytes_t payloadBytes);
+
+	// Takes a pooled payload buffer, it goes back to its pool with the response
+	Response(const Header& header, buffer_t payload);
+	Response(Response&& other) noexcept;
+	Response& operator=(Response&& other) noexcept;
 
 	// Gets the header
 	Header& getHeader();
 
-	// Gets the payload
+	// Gets the view of the payload, valid for as long as the response lives (moving the response keeps it valid)
+	const ResView& getView() const;
+
+	// Gets the payload as owning objects, they are copied from the view on the first call
 	ResPayload& getPayload();
 
 	~Response();
 
 private:
 	Header m_header;
+	buffer_t m_payloadBytes;
+	ResView m_view;
 	payload_t m_payload;
 };
\ No newline at end of file
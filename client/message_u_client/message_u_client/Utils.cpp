@@ -1,6 +1,7 @@
 #include "Utils.h"
 
 #include <chrono>
+#include <algorithm>
 #include  <sstream>
 
 namespace Utils {
@@ -20,6 +21,21 @@ namespace Utils {
 		}).base(), str.end());
 	}
 
+	std::vector<std::string> splitStr(const std::string& str, char delim) {
+		std::vector<std::string> parts;
+		std::stringstream ss{ str };
+		std::string part;
+
+		while (std::getline(ss, part, delim)) {
+			trimStr(part);
+			if (!part.empty()) {
+				parts.push_back(part);
+			}
+		}
+
+		return parts;
+	}
+
 	std::filesystem::path getUniquePath(uint32_t msgId) {
 		auto now = std::chrono::system_clock::now();
 		auto timeT = std::chrono::system_clock::to_time_t(now);
@@ -30,4 +46,9 @@ namespace Utils {
 
 		return std::filesystem::temp_directory_path() / filename;
 	}
-}
\ No newline at end of file
+
+	size_t workerCount() {
+		// hardware_concurrency may return 0 when it can't be determined
+		return std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+}
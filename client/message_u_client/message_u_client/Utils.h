@@ -4,20 +4,35 @@
 #include <cstdint>
 #include <string>
 #include <filesystem>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 #include <boost/endian/conversion.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
 
 namespace Utils {
 
 	/**
-	 * Serializes a trivial type into a vector of bytes
+	 * Serializes a trivial type into a raw buffer of bytes
 	 */
 	template<typename T>
-	void serializeTrivialType(std::vector<uint8_t>& outVec, size_t& outOffset, T toSerialize) {
+	void serializeTrivialType(uint8_t* outBytes, size_t& outOffset, T toSerialize) {
 		auto inNetOrder = boost::endian::native_to_little(toSerialize);
-		std::memcpy(outVec.data() + outOffset, &toSerialize, sizeof(T));
+		std::memcpy(outBytes + outOffset, &inNetOrder, sizeof(T));
 		outOffset += sizeof(T);
 	}
 
+	/**
+	 * Serializes a trivial type into a vector of bytes
+	 */
+	template<typename T>
+	void serializeTrivialType(std::vector<uint8_t>& outVec, size_t& outOffset, T toSerialize) {
+		serializeTrivialType(outVec.data(), outOffset, toSerialize);
+	}
+
 	/**
 	 * Deserializes a trivial type from a vector of bytes
 	 */
@@ -26,7 +41,7 @@ namespace Utils {
 		T res;
 		std::memcpy(&res, bytes.data() + outOffset, sizeof(T));
 		outOffset += sizeof(T);
-		return res;
+		return boost::endian::little_to_native(res);
 	}
 
 	/**
@@ -54,9 +69,57 @@ namespace Utils {
 	 * Trims a string on both ends.
 	 */
 	void trimStr(std::string& str);
+
+	/**
+	 * Splits a string by a delimiter, trims the parts and drops the empty ones.
+	 */
+	std::vector<std::string> splitStr(const std::string& str, char delim);
 	
 	/**
 	 * Generates a unique file path
 	 */
 	std::filesystem::path getUniquePath(uint32_t msgId);
+
+	/**
+	 * Gets the number of worker threads to use, one per hardware thread
+	 */
+	size_t workerCount();
+
+	/**
+	 * Calls fn(index, worker) for every index in [0, count) on up to 'workers' threads of the pool and waits for all of them.
+	 * Indices are handed out one at a time so uneven items are balanced, the first exception thrown by 'fn' is rethrown.
+	 */
+	template<typename Fn>
+	void parallelFor(boost::asio::thread_pool& pool, size_t workers, size_t count, Fn&& fn) {
+		std::atomic<size_t> next{ 0 };
+		std::vector<std::future<void>> done;
+
+		for (size_t worker = 0; worker < std::min(workers, count); worker++) {
+			// Posted through a plain handler, asio takes a packaged_task as a completion token and gets its future a second time
+			auto task = std::make_shared<std::packaged_task<void()>>([&, worker]() {
+				for (auto i = next++; i < count; i = next++) {
+					fn(i, worker);
+				}
+			});
+			done.push_back(task->get_future());
+			boost::asio::post(pool, [task]() { (*task)(); });
+		}
+
+		// Wait for every worker before rethrowing, they all reference this frame
+		std::exception_ptr error;
+		for (auto& worker : done) {
+			try {
+				worker.get();
+			}
+			catch (...) {
+				if (!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
 }
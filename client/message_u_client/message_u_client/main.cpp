@@ -1,16 +1,31 @@
 ﻿#include "Client.h"
+#include "ConnectionManager.h"
+#include "Metrics.h"
 #include "Config.h"
 
 #include <iostream>
+#include <string>
 
 
-int main()
+int main(int argc, char* argv[])
 {
 	try {
+		// The statistics are written to the stats file on every 'Show statistics' and once more on exit
+		for (int i = 1; i < argc; i++) {
+			if (argv[i] == std::string(Config::STATS_FILE_ARG) && i + 1 < argc) {
+				Metrics::setStatsFile(argv[++i]);
+			}
+			else {
+				std::cout << "Usage: message_u_client [" << Config::STATS_FILE_ARG << " <path>]\n";
+				return 1;
+			}
+		}
+
 		boost::asio::io_context ctx;
-		Client client{ ctx, Config::SERVER_ADDR, Config::SERVER_PORT };
+		Client client{ ctx, ConnectionOptions::load(Config::SERVERS_PATH) };
 
 		client.run();
+		Metrics::dump();
 	}
 	catch (const std::exception& e) {
 		std::cout << e.what() << '\n';
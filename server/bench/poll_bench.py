@@ -0,0 +1,188 @@
+"""Measures the latency of MessagesService.poll_msgs as the messages table grows.
+
+Usage (from the server directory): python3 bench/poll_bench.py [--sizes 1000,10000,...] [--polls N] [--content-sz N] [--scan]
+                                  [--backlog N] [--backlog-sz N]
+Every size is filled into a fresh database in the temp directory. The polled client has a handful of messages and
+the rest belong to other recipients, so a flat latency means the poll doesn't depend on the size of the table.
+The metadata poll and the acknowledge that follows it are measured next to the poll, --content-sz sets the size of the polled messages.
+--scan also measures the old find_all + filter poll, which is only practical for the small sizes.
+--backlog polls a mailbox of that many messages (of --backlog-sz bytes) whole and page by page, and reports the peak of the
+memory the poll allocated, the messages and the response bytes that are built from them.
+"""
+
+import argparse
+import os
+import sqlite3
+import statistics
+import sys
+import tempfile
+import time
+import tracemalloc
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+
+from entities.message_entity import MessageEntity  # noqa: E402
+from proto.request import MessageTypes  # noqa: E402
+from proto.response import MessagesPagePayload, PollMessagePayload  # noqa: E402
+from repository.message_repository import MessageRepository  # noqa: E402
+from services.message_service import MessagesService  # noqa: E402
+
+_RECIPIENTS = 10000
+_MSGS_PER_POLL = 10
+_FILL_BATCH = 100000
+
+
+def _client_id(n):
+    return n.to_bytes(16, "little")
+
+
+def _fill(db_path, rows):
+    """Fills the table with 'rows' small messages spread over many recipients"""
+    conn = sqlite3.connect(db_path)
+    with conn:
+        for start in range(0, rows, _FILL_BATCH):
+            conn.executemany(
+                "INSERT INTO messages (ToClient, FromClient, Type, Content) VALUES (?, ?, ?, ?)",
+                (
+                    (_client_id(1 + i % _RECIPIENTS), _client_id(0), 3, b"x" * 32)
+                    for i in range(start, min(rows, start + _FILL_BATCH))
+                ),
+            )
+    conn.close()
+
+
+def _scan_poll(repo, client_id):
+    """The poll as it was before the ToClient index, kept for comparison"""
+    msgs = repo.find(lambda msg: client_id == msg.get_to_client())
+    for msg in msgs:
+        repo.delete(msg.get_id())
+    return msgs
+
+
+def _ack(service, client_id, msgs):
+    """Deletes the messages of a metadata poll, as the client does once it handled them"""
+    service.ack(client_id, [msg.get_id() for msg in msgs])
+
+
+def _measure(service, repo, polls, poll, content_sz, after_poll=None):
+    """Gives the polled client fresh messages before every poll and returns the poll latencies in ms,
+    and the latencies of 'after_poll' (which gets the client and the polled messages) if there is one"""
+    target = _client_id(_RECIPIENTS + 1)
+    content = b"y" * content_sz
+    latencies = []
+    after_latencies = []
+    for _ in range(polls):
+        for _ in range(_MSGS_PER_POLL):
+            repo.save(
+                None,
+                MessageEntity(None, _client_id(0), target, MessageTypes.SEND_TXT, content),
+            )
+
+        start = time.perf_counter()
+        msgs = poll(target)
+        latencies.append((time.perf_counter() - start) * 1000)
+        assert len(msgs) == _MSGS_PER_POLL
+
+        if after_poll is not None:
+            start = time.perf_counter()
+            after_poll(target, msgs)
+            after_latencies.append((time.perf_counter() - start) * 1000)
+    return latencies if after_poll is None else (latencies, after_latencies)
+
+
+def _poll_backlog(service, repo, backlog, content_sz, paged):
+    """Fills the mailbox of a client with 'backlog' messages and polls them all, whole or page by page.
+    Returns the time it took in ms and the peak of the memory that was allocated meanwhile"""
+    target = _client_id(_RECIPIENTS + 2)
+    content = b"z" * content_sz
+    repo.save_many(
+        [MessageEntity(None, _client_id(0), target, MessageTypes.SEND_TXT, content) for _ in range(backlog)]
+    )
+
+    tracemalloc.start()
+    start = time.perf_counter()
+    if paged:
+        cursor = 0
+        while True:
+            msgs = service.poll_page(target, cursor, 0, 0)
+            MessagesPagePayload(cursor, msgs).to_bytes()
+            if not msgs:
+                break
+            cursor = msgs[-1].get_id()
+            del msgs
+    else:
+        PollMessagePayload(service.poll_msgs(target)).to_bytes()
+    elapsed = (time.perf_counter() - start) * 1000
+    _, peak = tracemalloc.get_traced_memory()
+    tracemalloc.stop()
+    return elapsed, peak
+
+
+def _report(label, rows, latencies):
+    latencies = sorted(latencies)
+    p99 = latencies[min(len(latencies) - 1, int(len(latencies) * 0.99))]
+    print(
+        f"{rows:>10}  {label:<8} median {statistics.median(latencies):9.3f} ms   p99 {p99:9.3f} ms"
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--sizes", default="1000,10000,100000,1000000,10000000")
+    parser.add_argument("--polls", type=int, default=200)
+    parser.add_argument("--content-sz", type=int, default=32)
+    parser.add_argument("--scan", action="store_true")
+    parser.add_argument("--backlog", type=int, default=0)
+    parser.add_argument("--backlog-sz", type=int, default=64 * 1024)
+    args = parser.parse_args()
+
+    for rows in [int(size) for size in args.sizes.split(",")]:
+        with tempfile.TemporaryDirectory() as tmp:
+            db_path = os.path.join(tmp, "bench.db")
+            repo = MessageRepository(db_path)
+            service = MessagesService(repo)
+
+            start = time.perf_counter()
+            _fill(db_path, rows)
+            print(f"filled {rows} rows in {time.perf_counter() - start:.1f} s")
+
+            # The server acknowledges the polled messages itself once the response was sent
+            poll_latencies, _ = _measure(
+                service,
+                repo,
+                args.polls,
+                service.poll_msgs,
+                args.content_sz,
+                lambda target, msgs: _ack(service, target, msgs),
+            )
+            _report("indexed", rows, poll_latencies)
+            # The metadata poll leaves the messages until they are acknowledged, the acknowledge is measured on its own
+            meta_latencies, ack_latencies = _measure(
+                service,
+                repo,
+                args.polls,
+                service.poll_meta,
+                args.content_sz,
+                lambda target, msgs: _ack(service, target, msgs),
+            )
+            _report("meta", rows, meta_latencies)
+            _report("ack", rows, ack_latencies)
+            if args.scan:
+                polls = max(1, min(args.polls, 1000000 // max(rows, 1)))
+                _report(
+                    "scan",
+                    rows,
+                    _measure(service, repo, polls, lambda target: _scan_poll(repo, target), args.content_sz),
+                )
+            if args.backlog:
+                for label, paged in (("whole", False), ("paged", True)):
+                    elapsed, peak = _poll_backlog(service, repo, args.backlog, args.backlog_sz, paged)
+                    print(
+                        f"{rows:>10}  {label:<8} {args.backlog} msgs in {elapsed:9.1f} ms   peak {peak / (1024 * 1024):8.1f} MiB"
+                    )
+
+            repo._conn.close()
+
+
+if __name__ == "__main__":
+    main()
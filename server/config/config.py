@@ -8,10 +8,17 @@ logger = logging.getLogger(__name__)
 class Config:
     _PORT_PATH = "myport.info"
     PORT = 1357
-    VERSION = 2
+    VERSION = 4  # Highest protocol version, v3 has compact headers and variable length fields, v4 adds X25519 keys
+    MIN_VERSION = 2  # Version of the clients that ask for an older one, they keep the fixed size fields
     DATABASE_PATH = "defensive.db"
     REQ_HEADER_SZ = 23
     READ_SZ = 1024
+    MAX_READ_PER_EVENT = 1024 * 1024  # Most bytes read from a connection at once, its requests are framed (or refused) while it still sends
+    MAX_LONG_POLL_MS = 60 * 1000
+    MAX_FETCH_SZ = 1024 * 1024  # Largest content range a single fetch answers with, a larger or open range is cut to it
+    MAX_PAGE_MSGS = 1000  # Most messages in a page of a paged poll, a larger or unbounded count is cut to it
+    MAX_PAGE_SZ = 16 * 1024 * 1024  # Content bytes in a page of a paged poll, a page still holds one message that is larger
+    MAX_GROUP_MEMBERS = 1000  # Most members of a group, its owner included
 
     def load():
         try:
@@ -6,11 +6,24 @@ from proto.request import (
     RegistrationPayload,
     GetPublicKeyPayload,
     SendMessagePayload,
+    SendMultiMessagePayload,
+    UsersDeltaPayload,
+    LongPollPayload,
+    FetchMessagePayload,
+    AckMessagesPayload,
+    PollPagePayload,
+    CreateGroupPayload,
+    SendGroupMessagePayload,
+    KeyTypes,
 )
+from config.config import Config
+from exceptions.exceptions import InvalidKeyTypeError
 from services.client_service import ClientService
 from services.message_service import MessagesService
+from services.group_service import GroupService
 import logging
 import binascii
+import time
 
 logger = logging.getLogger(__name__)
 
@@ -19,6 +32,12 @@ def hexify(id: bytes) -> str:
     return binascii.hexlify(id).decode("utf-8")
 
 
+def is_plain_only(ctx: Context) -> bool:
+    """Tells if the messages with flags (compressed or GCM contents) have to be held back from the client of the request.
+    Before v3 a client reads every content as plain CBC, they wait on the server for a newer client"""
+    return ctx.get_req().get_version() < 3
+
+
 class Controller:
     """Business layer for the server"""
 
@@ -26,10 +45,14 @@ class Controller:
         self,
         client_service: ClientService,
         messages_service: MessagesService,
+        group_service: GroupService,
     ):
         self._client_service = client_service
         self._messages_service = messages_service
+        self._group_service = group_service
         self._hanlders = dict()
+        # Long polls waiting for messages, maps a client id to its context and deadline
+        self._waiters = dict()
         self._install_handlers()
 
     def _install_handlers(self):
@@ -39,17 +62,30 @@ class Controller:
         self._hanlders[RequestCodes.GET_PUB_KEY.value] = self._get_pub_key
         self._hanlders[RequestCodes.SEND_MSG.value] = self._send_msg
         self._hanlders[RequestCodes.POLL_MSGS.value] = self._poll_msgs
+        self._hanlders[RequestCodes.LONG_POLL.value] = self._long_poll
+        self._hanlders[RequestCodes.SEND_MULTI_MSG.value] = self._send_multi_msg
+        self._hanlders[RequestCodes.USERS_DELTA.value] = self._users_delta
+        self._hanlders[RequestCodes.POLL_META.value] = self._poll_meta
+        self._hanlders[RequestCodes.FETCH_MSG.value] = self._fetch_msg
+        self._hanlders[RequestCodes.ACK_MSGS.value] = self._ack_msgs
+        self._hanlders[RequestCodes.POLL_PAGE.value] = self._poll_page
+        self._hanlders[RequestCodes.CREATE_GROUP.value] = self._create_group
+        self._hanlders[RequestCodes.SEND_GROUP_MSG.value] = self._send_group_msg
 
-    def dispatch(self, conn, packet):
+    def dispatch(self, outbox, packet, session):
         """Receives a packet, parses the header and payload and dispatches the appropriate handler"""
         try:
-            ctx = Context(conn, Request(packet))
+            ctx = Context(outbox, Request(packet, session))
             code = ctx.get_req().get_header().code
             payload = ctx.get_req().get_payload()
             self._hanlders[code](ctx, payload)
         except Exception as e:
             logger.exception(e)
-            conn.send(ResponseFactory.create_response(ResponseCodes.ERROR).to_bytes())
+            outbox.write(
+                ResponseFactory.create_response(ResponseCodes.ERROR).to_bytes(
+                    session.version
+                )
+            )
 
     def _register(
         self, ctx: Context, register_payload: RegistrationPayload
@@ -67,8 +103,7 @@ class Controller:
     def _list_users(self, ctx: Context, _) -> Response:
         """Router handler for fetching all registered users except for the user who made the request"""
         client_id = ctx.get_req().get_header().client_id
-        users_list = self._client_service.find_all(client_id)
-        users_list = list(filter(lambda x: x.get_uuid() != client_id, users_list))
+        users_list = self._client_service.find_all_except(client_id)
         logger.info(f"Sending users list to {hexify(client_id)}")
         ctx.write(
             ResponseFactory.create_response(
@@ -77,11 +112,36 @@ class Controller:
             )
         )
 
+    def _users_delta(self, ctx: Context, users_delta_payload: UsersDeltaPayload) -> Response:
+        """Router handler for fetching the users that changed since the directory version the client has"""
+        client_id = ctx.get_req().get_header().client_id
+        version, users_list = self._client_service.find_changed_since(
+            client_id, users_delta_payload.since_version
+        )
+        logger.info(
+            f"Sending {len(users_list)} changed users up to version {version} to {hexify(client_id)}"
+        )
+        ctx.write(
+            ResponseFactory.create_response(
+                ResponseCodes.USERS_DELTA,
+                version,
+                users_list,
+            )
+        )
+
     def _get_pub_key(
         self, ctx: Context, get_pub_key_payload: GetPublicKeyPayload
     ) -> Response:
         """Handler for fetching the public key of a user"""
         user = self._client_service.find_by_id(get_pub_key_payload.user_id)
+        # Before v4 a key is taken to be an RSA key, an older client can't be given another type
+        if (
+            user.get_key_type() != KeyTypes.RSA
+            and ctx.get_req().get_version() < 4
+        ):
+            raise InvalidKeyTypeError(
+                f"Error: The key of {hexify(user.get_uuid())} needs protocol v4"
+            )
         logger.info(
             f"Sending public key to {hexify(ctx.get_req().get_header().client_id)}"
         )
@@ -90,12 +150,14 @@ class Controller:
                 ResponseCodes.PUB_KEY,
                 user.get_uuid(),
                 user.get_public_key(),
+                user.get_key_type(),
             )
         )
 
     def _send_msg(self, ctx: Context, send_msg_payload: SendMessagePayload) -> Response:
         """Handler for sending a message"""
         client_id = ctx.get_req().get_header().client_id
+        self._group_service.check_direct(client_id, send_msg_payload)
         msg = self._messages_service.create(client_id, send_msg_payload)
         logger.info(
             f"Message sent from {hexify(client_id)} to {hexify(msg.get_to_client())}"
@@ -107,15 +169,193 @@ class Controller:
                 msg.get_id(),
             )
         )
+        self._wake(msg.get_to_client())
+
+    def _send_multi_msg(
+        self, ctx: Context, send_multi_msg_payload: SendMultiMessagePayload
+    ) -> Response:
+        """Handler for sending messages to several clients in one request"""
+        client_id = ctx.get_req().get_header().client_id
+        for payload in send_multi_msg_payload.messages:
+            self._group_service.check_direct(client_id, payload)
+        msgs = self._messages_service.create_many(
+            client_id, send_multi_msg_payload.messages
+        )
+        logger.info(f"{len(msgs)} messages sent from {hexify(client_id)}")
+        ctx.write(
+            ResponseFactory.create_response(
+                ResponseCodes.MULTI_MSG_SENT,
+                msgs,
+            )
+        )
+        for to_client in dict.fromkeys(msg.get_to_client() for msg in msgs):
+            self._wake(to_client)
+
+    def _create_group(self, ctx: Context, create_group_payload: CreateGroupPayload) -> Response:
+        """Handler for creating a group, the requester owns it and is one of its members"""
+        client_id = ctx.get_req().get_header().client_id
+        group = self._group_service.create(client_id, create_group_payload)
+        logger.info(f"Group {group.get_id()} of {len(group.get_members())} members created by {hexify(client_id)}")
+        ctx.write(
+            ResponseFactory.create_response(
+                ResponseCodes.GROUP_CREATED,
+                group.get_id(),
+            )
+        )
+
+    def _send_group_msg(self, ctx: Context, send_group_msg_payload: SendGroupMessagePayload) -> Response:
+        """Handler for sending a message to a group, it is uploaded once and delivered to every other member"""
+        client_id = ctx.get_req().get_header().client_id
+        recipients = self._group_service.recipients(client_id, send_group_msg_payload.group_id)
+        msgs = self._messages_service.create_for_group(client_id, recipients, send_group_msg_payload)
+        logger.info(
+            f"Group message sent from {hexify(client_id)} to {len(msgs)} members of group {send_group_msg_payload.group_id}"
+        )
+        ctx.write(
+            ResponseFactory.create_response(
+                ResponseCodes.GROUP_MSG_SENT,
+                send_group_msg_payload.group_id,
+                len(msgs),
+            )
+        )
+        for recipient in recipients:
+            self._wake(recipient)
 
     def _poll_msgs(self, ctx: Context, _) -> Response:
         """Handler for polling pending messages"""
         client_id = ctx.get_req().get_header().client_id
-        msgs = self._messages_service.poll_msgs(client_id)
+        msgs = self._messages_service.poll_msgs(client_id, is_plain_only(ctx))
         logger.info(f"Polling messages({len(msgs)}) for {hexify(client_id)}")
+        self._deliver(ctx, client_id, msgs)
+
+    def _deliver(self, ctx: Context, client_id, msgs):
+        """Answers a poll with the messages, they are deleted once the connection took the whole response.
+        If the connection fails first, they stay for the next poll"""
+        msg_ids = [msg.get_id() for msg in msgs]
+
+        def on_sent():
+            try:
+                self._messages_service.ack(client_id, msg_ids)
+            except Exception as e:
+                logger.exception(f"Failed deleting the delivered messages of {hexify(client_id)}: {e}")
+
+        ctx.write(
+            ResponseFactory.create_response(ResponseCodes.POLL_MSGS, msgs),
+            on_sent if msg_ids else None,
+        )
+
+    def _poll_page(self, ctx: Context, poll_page_payload: PollPagePayload) -> Response:
+        """Handler for polling a page of messages, the request acknowledges the previous page by its cursor"""
+        client_id = ctx.get_req().get_header().client_id
+        msgs = self._messages_service.poll_page(
+            client_id,
+            poll_page_payload.cursor,
+            poll_page_payload.max_count,
+            poll_page_payload.max_sz,
+            is_plain_only(ctx),
+        )
+        logger.info(f"Polling a page of messages({len(msgs)}) for {hexify(client_id)}")
+
+        # The next page starts after the last message of this one, an empty page ends the poll
+        cursor = msgs[-1].get_id() if msgs else 0
         ctx.write(
             ResponseFactory.create_response(
-                ResponseCodes.POLL_MSGS,
+                ResponseCodes.MSGS_PAGE,
+                cursor,
                 msgs,
             )
         )
+
+    def _poll_meta(self, ctx: Context, _) -> Response:
+        """Handler for polling the metadata of the pending messages, they stay on the server until they are acknowledged"""
+        client_id = ctx.get_req().get_header().client_id
+        msgs = self._messages_service.poll_meta(client_id, is_plain_only(ctx))
+        logger.info(f"Polling metadata of messages({len(msgs)}) for {hexify(client_id)}")
+        ctx.write(
+            ResponseFactory.create_response(
+                ResponseCodes.MSGS_META,
+                msgs,
+            )
+        )
+
+    def _fetch_msg(self, ctx: Context, fetch_payload: FetchMessagePayload) -> Response:
+        """Handler for fetching a range of the content of a pending message"""
+        client_id = ctx.get_req().get_header().client_id
+        content_sz, content = self._messages_service.fetch(
+            client_id, fetch_payload.msg_id, fetch_payload.offset, fetch_payload.size
+        )
+        ctx.write(
+            ResponseFactory.create_response(
+                ResponseCodes.MSG_CONTENT,
+                fetch_payload.msg_id,
+                min(fetch_payload.offset, content_sz),
+                content_sz,
+                content,
+            )
+        )
+
+    def _ack_msgs(self, ctx: Context, ack_payload: AckMessagesPayload) -> Response:
+        """Handler for acknowledging pending messages, which deletes them"""
+        client_id = ctx.get_req().get_header().client_id
+        count = self._messages_service.ack(client_id, ack_payload.msg_ids)
+        logger.info(f"Acknowledged messages({count}) for {hexify(client_id)}")
+        ctx.write(
+            ResponseFactory.create_response(
+                ResponseCodes.MSGS_ACKED,
+                count,
+            )
+        )
+
+    def _long_poll(self, ctx: Context, long_poll_payload: LongPollPayload) -> Response:
+        """Handler for long polling, answers once there are messages for the client or the timeout passes"""
+        client_id = ctx.get_req().get_header().client_id
+        msgs = self._messages_service.poll_msgs(client_id, is_plain_only(ctx))
+        if msgs:
+            logger.info(f"Long poll answered with {len(msgs)} messages for {hexify(client_id)}")
+            self._deliver(ctx, client_id, msgs)
+            return
+
+        # A client keeps a single long poll, an older one is answered with no messages
+        self._answer_waiter(client_id, [])
+        timeout_ms = min(long_poll_payload.timeout_ms, Config.MAX_LONG_POLL_MS)
+        self._waiters[client_id] = (ctx, time.monotonic() + timeout_ms / 1000)
+
+    def _wake(self, client_id):
+        """Answers the long poll of a client that just got a message, unless it is a message the client can't read"""
+        waiter = self._waiters.get(client_id)
+        if waiter is None:
+            return
+
+        msgs = self._messages_service.poll_msgs(client_id, is_plain_only(waiter[0]))
+        if msgs:
+            self._answer_waiter(client_id, msgs)
+
+    def _answer_waiter(self, client_id, msgs):
+        """Answers and removes the long poll of a client, if it has one"""
+        waiter = self._waiters.pop(client_id, None)
+        if waiter is None:
+            return
+
+        # The answer is only queued, a connection that fails to take it is closed by the server and the messages stay
+        ctx, _ = waiter
+        logger.info(f"Long poll answered with {len(msgs)} messages for {hexify(client_id)}")
+        self._deliver(ctx, client_id, msgs)
+
+    def expire_waiters(self):
+        """Answers the long polls whose timeout passed with no messages"""
+        now = time.monotonic()
+        expired = [
+            client_id
+            for client_id, (_, deadline) in self._waiters.items()
+            if deadline <= now
+        ]
+        for client_id in expired:
+            self._answer_waiter(client_id, [])
+
+    def drop_connection(self, conn):
+        """Forgets the long polls that wait on a closed connection"""
+        self._waiters = {
+            client_id: waiter
+            for client_id, waiter in self._waiters.items()
+            if waiter[0].get_socket() is not conn
+        }
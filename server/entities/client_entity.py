@@ -5,12 +5,18 @@ class ClientEntity:
     """A class to represent a client entity."""
 
     def __init__(
-        self, uuid: bytes, username: str, public_key: str, last_seen: datetime = None
+        self,
+        uuid: bytes,
+        username: str,
+        public_key: str,
+        last_seen: datetime = None,
+        key_type: int = 0,
     ):
         self._uuid = uuid
         self._username = username
         self._public_key = public_key
         self._last_seen = last_seen or datetime.now()
+        self._key_type = key_type  # KeyTypes of the public key
 
     def get_uuid(self):
         return self._uuid
@@ -30,6 +36,12 @@ class ClientEntity:
     def set_public_key(self, public_key):
         self._public_key = public_key
 
+    def get_key_type(self):
+        return self._key_type
+
+    def set_key_type(self, key_type):
+        self._key_type = key_type
+
     def get_last_seen(self):
         return self._last_seen
 
@@ -38,4 +50,4 @@ class ClientEntity:
 
     def __repr__(self):
         uuid_hex = self._uuid.hex()
-        return f"ClientEntity({uuid_hex}, {self._username}, {self._public_key}, {self._last_seen})"
+        return f"ClientEntity({uuid_hex}, {self._username}, {self._public_key}, {self._last_seen}, {self._key_type})"
@@ -0,0 +1,26 @@
+class GroupEntity:
+    """A class to represent a group, the clients its messages are delivered to."""
+
+    def __init__(self, id, name, owner, members: list):
+        self._id = id
+        self._name = name
+        self._owner = owner
+        self._members = members
+
+    def get_id(self):
+        return self._id
+
+    def set_id(self, id):
+        self._id = id
+
+    def get_name(self):
+        return self._name
+
+    def get_owner(self):
+        return self._owner
+
+    def get_members(self):
+        return self._members
+
+    def __repr__(self):
+        return f"GroupEntity({self._id}, {self._name}, {self._owner.hex()}, {len(self._members)} members)"
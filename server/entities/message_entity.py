@@ -1,15 +1,18 @@
-from proto.request import MessageTypes
+from proto.request import MessageTypes, MessageFlags
 
 
 class MessageEntity:
     """A class to represent a message entity."""
 
-    def __init__(self, id, from_client, to_client, msg_type, content):
+    def __init__(self, id, from_client, to_client, msg_type, content, msg_flags=MessageFlags.NONE, content_sz=None):
         self._id = id
         self._from_client = from_client
         self._to_client = to_client
         self._msg_type = msg_type
         self._content = content
+        self._msg_flags = msg_flags
+        # The metadata of a message is read without its content, it only has the size
+        self._content_sz = len(content) if content is not None else content_sz
 
     def get_id(self):
         return self._id
@@ -35,11 +38,25 @@ class MessageEntity:
     def set_msg_type(self, msg_type: MessageTypes):
         self._msg_type = msg_type
 
+    def get_msg_flags(self) -> MessageFlags:
+        return self._msg_flags
+
+    def set_msg_flags(self, msg_flags: MessageFlags):
+        self._msg_flags = msg_flags
+
+    def get_type_code(self):
+        """Gets the message type byte as it is sent, the type and its flags"""
+        return self._msg_type.value | int(self._msg_flags)
+
     def get_content(self):
         return self._content
 
     def set_content(self, content):
         self._content = content
+        self._content_sz = len(content)
+
+    def get_content_sz(self):
+        return self._content_sz
 
     def __repr__(self):
         return f"Message({self._id}, {self._from_client}, {self._to_client})"
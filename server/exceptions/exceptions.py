@@ -45,3 +45,10 @@ class InvalidUUID(Exception):
 
     def __init__(self, msg):
         super().__init__(msg)
+
+
+class InvalidKeyTypeError(Exception):
+    """Exception for a public key of a type the requester's protocol version can't carry"""
+
+    def __init__(self, msg):
+        super().__init__(msg)
@@ -2,9 +2,13 @@ from config.config import Config
 from controller.controller import Controller
 from repository.client_repository import ClientRepository
 from repository.message_repository import MessageRepository
+from repository.group_repository import GroupRepository
 from services.client_service import ClientService
 from services.message_service import MessagesService
+from services.group_service import GroupService
 from proto.request import Request
+from proto.session import Session
+from proto.outbox import Outbox
 
 import selectors
 import socket
@@ -29,6 +33,10 @@ class MessageUServer:
         self._backlog = backlog
         self._sock = socket.socket()
         self._buffers = dict()
+        self._sessions = dict()
+        self._outboxes = dict()
+        # The connections whose outbox may hold bytes, they are flushed at the end of every loop
+        self._unsent = set()
 
         self._setup()
         self._install_sig_handler()
@@ -42,12 +50,17 @@ class MessageUServer:
             for key, mask in events:
                 cb = key.data
                 cb(key.fileobj, mask)
+            self._controller.expire_waiters()
+            for conn in list(self._unsent):
+                self._write(conn)
 
     def _setup_controller(self):
         """Initializes the controller with the required services"""
+        client_repo = ClientRepository(Config.DATABASE_PATH)
         self._controller = Controller(
-            client_service=ClientService(ClientRepository(Config.DATABASE_PATH)),
+            client_service=ClientService(client_repo),
             messages_service=MessagesService(MessageRepository(Config.DATABASE_PATH)),
+            group_service=GroupService(GroupRepository(Config.DATABASE_PATH), client_repo),
         )
 
     def _setup(self):
@@ -62,47 +75,89 @@ class MessageUServer:
         conn, addr = sock.accept()
         logger.info(f"Accepted {conn} from {addr}")
         conn.setblocking(False)
-        self._sel.register(conn, selectors.EVENT_READ, self._read)
+        self._sessions[conn] = Session()
+        self._outboxes[conn] = Outbox(conn, lambda: self._unsent.add(conn))
+        self._sel.register(conn, selectors.EVENT_READ, self._serve_conn)
+
+    def _serve_conn(self, conn, mask):
+        """Flushes and reads a connection, whichever it is ready for"""
+        if mask & selectors.EVENT_WRITE:
+            self._write(conn)
+        if mask & selectors.EVENT_READ and conn in self._sessions:
+            self._read(conn, mask)
+
+    def _write(self, conn):
+        """Sends what the socket takes of the outbox of the connection, and waits until it is writable for the rest"""
+        outbox = self._outboxes.get(conn)
+        if outbox is None:
+            return
+
+        try:
+            outbox.flush()
+        except Exception as e:
+            # The bytes that weren't sent are dropped with the connection, so their callbacks never run
+            logger.error(f"Failed writing to {conn}: {e!r}")
+            self._close(conn)
+            return
+
+        events = selectors.EVENT_READ
+        if outbox.is_pending():
+            events |= selectors.EVENT_WRITE
+        else:
+            self._unsent.discard(conn)
+        if self._sel.get_key(conn).events != events:
+            self._sel.modify(conn, events, self._serve_conn)
 
     def _read(self, conn, mask):
         """Reads incoming data from the connection"""
         try:
-            # We get the buffer of the current connection
-            buffer = self._buffers.get(conn, b"")
-
-            # Read the data until there is no more data to read
-            while True:
+            # We get the buffer and the framing state of the current connection
+            buffer = self._buffers.setdefault(conn, bytearray())
+            session = self._sessions[conn]
+
+            # Read the data until there is no more data to read, or until a bounded amount was read so the requests are framed early
+            is_closed = False
+            read_sz = 0
+            while read_sz < Config.MAX_READ_PER_EVENT:
                 try:
                     chunk = conn.recv(Config.READ_SZ)
                     if not chunk:
+                        is_closed = True
                         break
+                    # Extended in place, a request that arrives in many chunks isn't copied again for every one of them
                     buffer += chunk
+                    read_sz += len(chunk)
                 except BlockingIOError:
                     break
 
-            # Update the buffer
-            self._buffers[conn] = buffer
-            # If we dont have enough data to read the header, return
-            if len(buffer) < Config.REQ_HEADER_SZ:
-                return
-
-            # Parse the header.
-            header = Request.Header.from_bytes(buffer[: Request._HEADER_SZ])
-            total_length = Config.REQ_HEADER_SZ + header.payload_sz
-            if len(buffer) < total_length:
-                return
-
-            # Extract the data from the buffer
-            data = buffer[:total_length]
-            # Advance the buffer (maybe there is more data)
-            self._buffers[conn] = buffer[total_length:]
-            self._controller.dispatch(conn, data)
+            # Dispatch every complete request, a pipelining client may send several at once
+            while True:
+                # If we dont have enough data to read the whole request, wait for more (unless the peer is gone)
+                total_length = Request.frame_sz(buffer, session)
+                if total_length is None or len(buffer) < total_length:
+                    if is_closed:
+                        self._close(conn)
+                    return
+
+                # Extract the data from the buffer
+                data = bytes(buffer[:total_length])
+                # Advance the buffer (maybe there is more data), removing from the front of a bytearray doesn't move the rest
+                del buffer[:total_length]
+                self._controller.dispatch(self._outboxes[conn], data, session)
         except Exception as e:
             logger.exception(f"{e}")
-            self._sel.unregister(conn)
-            if conn in self._buffers:
-                del self._buffers[conn]
-            conn.close()
+            self._close(conn)
+
+    def _close(self, conn):
+        """Unregisters and closes a connection, dropping its buffer, its unsent bytes and its long polls"""
+        self._sel.unregister(conn)
+        if conn in self._buffers:
+            del self._buffers[conn]
+        self._sessions.pop(conn, None)
+        self._outboxes.pop(conn, None)
+        self._unsent.discard(conn)
+        self._controller.drop_connection(conn)
+        conn.close()
 
     def _install_sig_handler(self):
         """Setup the sig handler for SIGINT"""
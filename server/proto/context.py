@@ -1,3 +1,4 @@
+from proto.outbox import Outbox
 from proto.request import Request
 from proto.response import Response
 
@@ -5,15 +6,20 @@ from proto.response import Response
 class Context:
     """Represents the context of a request"""
 
-    # Initializes the Context with the current socket and request
-    def __init__(self, socket, request: Request):
-        self._socket = socket
+    # Initializes the Context with the outbox of the current connection and the request
+    def __init__(self, outbox: Outbox, request: Request):
+        self._outbox = outbox
         self._request = request
 
+    def get_socket(self):
+        """Gets the socket the request arrived on"""
+        return self._outbox.get_socket()
+
     def get_req(self) -> Request:
         """Gets the request"""
         return self._request
 
-    def write(self, response: Response):
-        """Writes the response to the socket"""
-        self._socket.send(response.to_bytes())
+    def write(self, response: Response, on_sent=None):
+        """Queues the response on the connection, in the protocol version of the request.
+        'on_sent' is called once the connection took all of it"""
+        self._outbox.write(response.to_bytes(self._request.get_version()), on_sent)
@@ -0,0 +1,49 @@
+import collections
+
+
+class Outbox:
+    """The bytes written to a non-blocking connection that it didn't take yet.
+
+    Writes only queue the bytes, the server flushes them when the socket is writable. A write can carry a callback
+    that runs once all of its bytes were handed to the socket, so a caller can keep state (e.g. messages) until then.
+    """
+
+    # 'on_pending' is called when a write is queued on an empty outbox, so the server knows it has to flush it
+    def __init__(self, socket, on_pending=None):
+        self._socket = socket
+        self._on_pending = on_pending
+        # The queued writes as (bytes, callback), and how much of the first one was sent
+        self._chunks = collections.deque()
+        self._offset = 0
+
+    def get_socket(self):
+        """Gets the socket the bytes are written to"""
+        return self._socket
+
+    def is_pending(self):
+        """Tells if there are bytes the socket didn't take yet"""
+        return bool(self._chunks)
+
+    def write(self, data, on_sent=None):
+        """Queues the bytes, 'on_sent' is called once they are all handed to the socket"""
+        was_empty = not self._chunks
+        self._chunks.append((memoryview(data), on_sent))
+        if was_empty and self._on_pending is not None:
+            self._on_pending()
+
+    def flush(self):
+        """Sends as much as the socket takes without blocking, raises if the connection failed"""
+        while self._chunks:
+            chunk, on_sent = self._chunks[0]
+            try:
+                self._offset += self._socket.send(chunk[self._offset :])
+            except BlockingIOError:
+                return
+
+            if self._offset < len(chunk):
+                continue
+
+            self._chunks.popleft()
+            self._offset = 0
+            if on_sent is not None:
+                on_sent()
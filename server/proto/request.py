@@ -1,8 +1,10 @@
 import struct
 from dataclasses import dataclass
-from enum import Enum
+from enum import Enum, IntEnum, IntFlag
 from abc import ABC, abstractmethod
 
+from proto.varint import decode_varint, decode_str
+from proto.session import Session
 from exceptions.exceptions import (
     InvalidCodeError,
     InvalidPayloadError,
@@ -19,14 +21,33 @@ class ReqPayload(ABC):
         """Converts bytes to payload class"""
         pass
 
+    @classmethod
+    def from_bytes_v3(cls, data, data_len=0):
+        """Converts v3 bytes to payload class, the payloads whose v3 layout differs override it"""
+        return cls.from_bytes(data, data_len)
+
+    @classmethod
+    def from_bytes_v4(cls, data, data_len=0):
+        """Converts v4 bytes to payload class, the payloads whose v4 layout differs from v3 override it"""
+        return cls.from_bytes_v3(data, data_len)
+
+
+class KeyTypes(IntEnum):
+    """Enum for the public key types"""
+
+    RSA = 0  # RSA-1024, the only type before v4
+    X25519 = 1  # X25519 agreement key, Ed25519 signing key and the signature that binds them
+
 
 @dataclass
 class RegistrationPayload(ReqPayload):
     """Registration payload"""
 
     _PAYLOAD_FMT = "<255B160B"
+    _X25519_KEY_SZ = 128
     username: str
     public_key: str
+    key_type: KeyTypes = KeyTypes.RSA
 
     @classmethod
     def from_bytes(cls, data, data_len=0):
@@ -39,6 +60,28 @@ class RegistrationPayload(ReqPayload):
         except Exception as e:
             raise InvalidPayloadError(e)
 
+    @classmethod
+    def from_bytes_v3(cls, data, data_len=0):
+        # The name and the key are sent with their lengths instead of padded
+        username, offset = decode_str(data)
+        key, offset = decode_str(data, offset)
+        if offset != len(data):
+            raise InvalidPayloadError(
+                f"Error: {len(data) - offset} trailing bytes after the public key"
+            )
+        return cls(username, key)
+
+    @classmethod
+    def from_bytes_v4(cls, data, data_len=0):
+        # Same layout as v3, a v4 client registers with an X25519 key
+        payload = cls.from_bytes_v3(data, data_len)
+        if len(payload.public_key) != RegistrationPayload._X25519_KEY_SZ:
+            raise InvalidPayloadError(
+                f"Error: X25519 public key is {len(payload.public_key)} bytes but should be {RegistrationPayload._X25519_KEY_SZ}"
+            )
+        payload.key_type = KeyTypes.X25519
+        return payload
+
 
 @dataclass
 class ListUsersPayload(ReqPayload):
@@ -51,6 +94,22 @@ class ListUsersPayload(ReqPayload):
         return cls()
 
 
+@dataclass
+class UsersDeltaPayload(ReqPayload):
+    """Request payload to list the users that changed after the directory version the client has"""
+
+    _PAYLOAD_FMT = "<Q"
+    since_version: int
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        try:
+            (since_version,) = struct.unpack(UsersDeltaPayload._PAYLOAD_FMT, data)
+            return cls(since_version)
+        except Exception as e:
+            raise InvalidPayloadError(e)
+
+
 @dataclass
 class PollMessagesPayload(ReqPayload):
     """Request payload to poll messages"""
@@ -62,6 +121,74 @@ class PollMessagesPayload(ReqPayload):
         return cls()
 
 
+@dataclass
+class PollPagePayload(ReqPayload):
+    """Request payload to poll a page of messages, the messages up to the cursor are deleted and the page follows them.
+    A count or a size of 0 leaves it to the server"""
+
+    _PAYLOAD_FMT = "<III"
+    cursor: int
+    max_count: int
+    max_sz: int
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        try:
+            cursor, max_count, max_sz = struct.unpack(PollPagePayload._PAYLOAD_FMT, data)
+            return cls(cursor, max_count, max_sz)
+        except Exception as e:
+            raise InvalidPayloadError(e)
+
+
+@dataclass
+class LongPollPayload(ReqPayload):
+    """Request payload to long poll messages, holds how long the server may wait for messages"""
+
+    _PAYLOAD_FMT = "<I"
+    timeout_ms: int
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        try:
+            (timeout_ms,) = struct.unpack(LongPollPayload._PAYLOAD_FMT, data)
+            return cls(timeout_ms)
+        except Exception as e:
+            raise InvalidPayloadError(e)
+
+
+@dataclass
+class FetchMessagePayload(ReqPayload):
+    """Request payload to fetch a range of the content of a polled message, a size of 0 asks for as much as the server sends at once"""
+
+    _PAYLOAD_FMT = "<IQI"
+    msg_id: int
+    offset: int
+    size: int
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        try:
+            msg_id, offset, size = struct.unpack(FetchMessagePayload._PAYLOAD_FMT, data)
+            return cls(msg_id, offset, size)
+        except Exception as e:
+            raise InvalidPayloadError(e)
+
+
+@dataclass
+class AckMessagesPayload(ReqPayload):
+    """Request payload to delete polled messages, a list of message ids"""
+
+    _ID_FMT = "<I"
+    _ID_SZ = struct.calcsize(_ID_FMT)
+    msg_ids: list[int]
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        if not data or len(data) % AckMessagesPayload._ID_SZ != 0:
+            raise InvalidPayloadError(f"Error: {len(data)} bytes are not a list of message ids")
+        return cls([msg_id for (msg_id,) in struct.iter_unpack(AckMessagesPayload._ID_FMT, data)])
+
+
 @dataclass
 class GetPublicKeyPayload(ReqPayload):
     """Request payload to get public key"""
@@ -86,6 +213,8 @@ class MessageTypes(Enum):
     SEND_SYM_KEY = 2
     SEND_TXT = 3
     SEND_FILE = 4
+    SEND_GROUP_KEY = 5
+    SEND_GROUP_TXT = 6
 
     @staticmethod
     def code_to_enum(code):
@@ -98,9 +227,27 @@ class MessageTypes(Enum):
             return MessageTypes.SEND_TXT
         elif code == 4:
             return MessageTypes.SEND_FILE
+        elif code == 5:
+            return MessageTypes.SEND_GROUP_KEY
+        elif code == 6:
+            return MessageTypes.SEND_GROUP_TXT
 
         raise InvalidMessageTypeError(f"Error: '{code}' is not a valid message type")
 
+    @staticmethod
+    def split_code(code):
+        """Splits a message type byte into the message type and its flags"""
+        return MessageTypes.code_to_enum(code & ~int(MessageFlags.MASK)), MessageFlags(code & MessageFlags.MASK)
+
+
+class MessageFlags(IntFlag):
+    """Flags in the high bits of the message type byte, they are only meaningful to the clients and are stored and relayed as they are"""
+
+    NONE = 0
+    COMPRESSED = 0x80
+    GCM = 0x40
+    MASK = COMPRESSED | GCM
+
 
 @dataclass
 class SendMessagePayload(ReqPayload):
@@ -113,6 +260,7 @@ class SendMessagePayload(ReqPayload):
     msg_type: MessageTypes
     content_sz: int
     content: bytes
+    msg_flags: MessageFlags = MessageFlags.NONE
 
     @classmethod
     def from_bytes(cls, data, data_len=0):
@@ -126,13 +274,110 @@ class SendMessagePayload(ReqPayload):
                 SendMessagePayload._PAYLOAD_SZ : SendMessagePayload._PAYLOAD_SZ
                 + content_sz
             ]
-            return cls(
-                client_id, MessageTypes.code_to_enum(msg_type), content_sz, raw_content
-            )
+            msg_type, msg_flags = MessageTypes.split_code(msg_type)
+            return cls(client_id, msg_type, content_sz, raw_content, msg_flags)
+
+        except Exception as e:
+            raise InvalidPayloadError(e)
+
+
+@dataclass
+class SendMultiMessagePayload(ReqPayload):
+    """Request payload to send messages to several clients, a list of send message records"""
+
+    messages: list[SendMessagePayload]
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        messages = []
+        offset = 0
+        while offset < len(data):
+            if len(data) - offset < SendMessagePayload._PAYLOAD_SZ:
+                raise InvalidPayloadError("Error: record ends in the middle of its header")
+
+            # Only the record is sliced, slicing the rest of the payload for every record copies it over and over
+            _, _, content_sz = struct.unpack_from(SendMessagePayload._PAYLOAD_FMT, data, offset)
+            record_end = offset + SendMessagePayload._PAYLOAD_SZ + content_sz
+            if record_end > len(data):
+                raise InvalidPayloadError("Error: record content is shorter than declared")
+
+            messages.append(SendMessagePayload.from_bytes(data[offset:record_end]))
+            offset = record_end
+
+        if not messages:
+            raise InvalidPayloadError("Error: payload has no records")
+        return cls(messages)
+
+
+@dataclass
+class CreateGroupPayload(ReqPayload):
+    """Request payload to create a group, its name followed by the IDs of its members"""
+
+    _NAME_FMT = "<255s"
+    _NAME_SZ = struct.calcsize(_NAME_FMT)
+    _MEMBER_SZ = 16
+
+    name: bytes
+    members: list[bytes]
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        if len(data) < CreateGroupPayload._NAME_SZ:
+            raise InvalidPayloadError("Error: payload ends in the middle of the group name")
+
+        (name,) = struct.unpack(CreateGroupPayload._NAME_FMT, data[: CreateGroupPayload._NAME_SZ])
+        name = name.rstrip(b"\x00")
+        if not name:
+            raise InvalidPayloadError("Error: the group has no name")
+
+        ids = data[CreateGroupPayload._NAME_SZ :]
+        if not ids or len(ids) % CreateGroupPayload._MEMBER_SZ:
+            raise InvalidPayloadError(f"Error: {len(ids)} bytes are not a list of member IDs")
+        members = [
+            bytes(ids[i : i + CreateGroupPayload._MEMBER_SZ])
+            for i in range(0, len(ids), CreateGroupPayload._MEMBER_SZ)
+        ]
+        return cls(name, members)
 
+
+@dataclass
+class SendGroupMessagePayload(ReqPayload):
+    """Request payload to send a message to every member of a group, the content is uploaded once"""
+
+    _PAYLOAD_FMT = "<IBI"
+    _PAYLOAD_SZ = struct.calcsize(_PAYLOAD_FMT)
+    # The members get the content after the group ID, it tells them which key opens it
+    _GROUP_ID_FMT = "<I"
+
+    group_id: int
+    msg_type: MessageTypes
+    content: bytes
+    msg_flags: MessageFlags = MessageFlags.NONE
+
+    @classmethod
+    def from_bytes(cls, data, data_len=0):
+        try:
+            group_id, msg_type, content_sz = struct.unpack(
+                SendGroupMessagePayload._PAYLOAD_FMT, data[: SendGroupMessagePayload._PAYLOAD_SZ]
+            )
+            content = data[SendGroupMessagePayload._PAYLOAD_SZ :]
+            if len(content) != content_sz:
+                raise InvalidPayloadError("Error: content size doesn't match the payload")
+            msg_type, msg_flags = MessageTypes.split_code(msg_type)
+        except InvalidPayloadError:
+            raise
         except Exception as e:
             raise InvalidPayloadError(e)
 
+        # Only group texts are encrypted with the group key, the rest of the types go to each member on its own
+        if msg_type != MessageTypes.SEND_GROUP_TXT:
+            raise InvalidMessageTypeError(f"Error: '{msg_type}' can't be sent to a group")
+        return cls(group_id, msg_type, content, msg_flags)
+
+    def member_content(self):
+        """Gets the content as the members receive it, prefixed with the group ID"""
+        return struct.pack(SendGroupMessagePayload._GROUP_ID_FMT, self.group_id) + self.content
+
 
 class RequestCodes(Enum):
     """Enum for request codes"""
@@ -142,6 +387,16 @@ class RequestCodes(Enum):
     GET_PUB_KEY = 602
     SEND_MSG = 603
     POLL_MSGS = 604
+    SEND_LARGE_MSG = 605  # Refused as soon as its header arrives, a content past 4 GiB can't be stored
+    LONG_POLL = 606
+    SEND_MULTI_MSG = 607
+    USERS_DELTA = 608
+    POLL_META = 609
+    FETCH_MSG = 610
+    ACK_MSGS = 611
+    POLL_PAGE = 612
+    CREATE_GROUP = 613
+    SEND_GROUP_MSG = 614
     INVALID = 0xFFFF
 
     @staticmethod
@@ -157,6 +412,26 @@ class RequestCodes(Enum):
             return RequestCodes.SEND_MSG
         elif code == 604:
             return RequestCodes.POLL_MSGS
+        elif code == 605:
+            return RequestCodes.SEND_LARGE_MSG
+        elif code == 606:
+            return RequestCodes.LONG_POLL
+        elif code == 607:
+            return RequestCodes.SEND_MULTI_MSG
+        elif code == 608:
+            return RequestCodes.USERS_DELTA
+        elif code == 609:
+            return RequestCodes.POLL_META
+        elif code == 610:
+            return RequestCodes.FETCH_MSG
+        elif code == 611:
+            return RequestCodes.ACK_MSGS
+        elif code == 612:
+            return RequestCodes.POLL_PAGE
+        elif code == 613:
+            return RequestCodes.CREATE_GROUP
+        elif code == 614:
+            return RequestCodes.SEND_GROUP_MSG
         return code
 
 
@@ -165,6 +440,11 @@ class Request:
 
     _HEADER_FMT = "<16sBHI"
     _HEADER_SZ = struct.calcsize(_HEADER_FMT)
+    # The compact v3 header: version (with _ID_FOLLOWS) and code, then the client ID if _ID_FOLLOWS is set, then the VarInt payload size
+    _COMPACT_FMT = "<BH"
+    _COMPACT_SZ = struct.calcsize(_COMPACT_FMT)
+    _ID_FOLLOWS = 0x80
+    _ID_SZ = 16
     _PAYLOAD_CLASSES = {}
 
     @dataclass
@@ -175,14 +455,46 @@ class Request:
         payload_sz: int
 
         @staticmethod
-        def from_bytes(packet):
-            data = struct.unpack(Request._HEADER_FMT, packet[: Request._HEADER_SZ])
-            client_id, version, code, payload_size = data
-            return Request.Header(client_id, version, code, payload_size)
-
-    def __init__(self, packet):
-        # Construct the header
-        self._header = Request.Header.from_bytes(packet)
+        def from_bytes(packet, session=None):
+            """Parses the header at the start of the packet, returns it with its size, None if more bytes are needed"""
+            if session is None or not session.is_compact():
+                if len(packet) < Request._HEADER_SZ:
+                    return None
+                data = struct.unpack(
+                    Request._HEADER_FMT, packet[: Request._HEADER_SZ]
+                )
+                client_id, version, code, payload_size = data
+                header = Request.Header(client_id, version, code, payload_size)
+                return header, Request._HEADER_SZ
+
+            if len(packet) < Request._COMPACT_SZ:
+                return None
+            version, code = struct.unpack(
+                Request._COMPACT_FMT, packet[: Request._COMPACT_SZ]
+            )
+            offset = Request._COMPACT_SZ
+
+            # The client ID is only sent when it changed, after a registration
+            client_id = session.client_id
+            if version & Request._ID_FOLLOWS:
+                if len(packet) < offset + Request._ID_SZ:
+                    return None
+                client_id = bytes(packet[offset : offset + Request._ID_SZ])
+                offset += Request._ID_SZ
+
+            decoded = decode_varint(packet, offset)
+            if decoded is None:
+                return None
+            payload_size, offset = decoded
+            version &= ~Request._ID_FOLLOWS
+            return Request.Header(client_id, version, code, payload_size), offset
+
+    def __init__(self, packet, session=None):
+        # Construct the header, the session takes its version and client ID before anything else can fail
+        session = session if session is not None else Session()
+        self._header, header_sz = Request.Header.from_bytes(packet, session)
+        session.accept(self._header)
+        self._version = session.version
 
         # Extract the request code
         code = RequestCodes.code_to_enum(self._header.code)
@@ -192,11 +504,32 @@ class Request:
         if payload_cls is None:
             raise InvalidCodeError(f"Error: request '{code}' is invalid")
 
-        raw_payload = packet[
-            Request._HEADER_SZ : Request._HEADER_SZ + self._header.payload_sz
-        ]
+        raw_payload = packet[header_sz : header_sz + self._header.payload_sz]
         # Construct the payload
-        self._payload = payload_cls.from_bytes(raw_payload, self._header.payload_sz)
+        if self._version >= 4:
+            parse = payload_cls.from_bytes_v4
+        elif self._version >= 3:
+            parse = payload_cls.from_bytes_v3
+        else:
+            parse = payload_cls.from_bytes
+        self._payload = parse(raw_payload, self._header.payload_sz)
+
+    @staticmethod
+    def frame_sz(buffer, session=None):
+        """Gets the total size of the request at the start of the buffer, None if more bytes are needed to tell"""
+        parsed = Request.Header.from_bytes(buffer, session)
+        if parsed is None:
+            return None
+
+        header, header_sz = parsed
+        # A large message is refused before its content is read, the connection is dropped instead of taking gigabytes it can't store
+        if header.code == RequestCodes.SEND_LARGE_MSG.value:
+            raise InvalidCodeError(f"Error: request '{RequestCodes.SEND_LARGE_MSG}' is refused, a content past 4 GiB can't be stored")
+
+        total_length = header_sz + header.payload_sz
+        if len(buffer) < total_length:
+            return None
+        return total_length
 
     def get_header(self):
         """Gets the header"""
@@ -206,6 +539,10 @@ class Request:
         """Gets the payload"""
         return self._payload
 
+    def get_version(self):
+        """Gets the protocol version the request is answered in"""
+        return self._version
+
 
 # Register the payload classes to the appropriate request codes (maps the request code to the correct payload class)
 Request._PAYLOAD_CLASSES[RequestCodes.REGISTER] = RegistrationPayload
@@ -213,3 +550,12 @@ Request._PAYLOAD_CLASSES[RequestCodes.LIST_USERS] = ListUsersPayload
 Request._PAYLOAD_CLASSES[RequestCodes.GET_PUB_KEY] = GetPublicKeyPayload
 Request._PAYLOAD_CLASSES[RequestCodes.SEND_MSG] = SendMessagePayload
 Request._PAYLOAD_CLASSES[RequestCodes.POLL_MSGS] = PollMessagesPayload
+Request._PAYLOAD_CLASSES[RequestCodes.LONG_POLL] = LongPollPayload
+Request._PAYLOAD_CLASSES[RequestCodes.SEND_MULTI_MSG] = SendMultiMessagePayload
+Request._PAYLOAD_CLASSES[RequestCodes.USERS_DELTA] = UsersDeltaPayload
+Request._PAYLOAD_CLASSES[RequestCodes.POLL_META] = PollMessagesPayload
+Request._PAYLOAD_CLASSES[RequestCodes.FETCH_MSG] = FetchMessagePayload
+Request._PAYLOAD_CLASSES[RequestCodes.ACK_MSGS] = AckMessagesPayload
+Request._PAYLOAD_CLASSES[RequestCodes.POLL_PAGE] = PollPagePayload
+Request._PAYLOAD_CLASSES[RequestCodes.CREATE_GROUP] = CreateGroupPayload
+Request._PAYLOAD_CLASSES[RequestCodes.SEND_GROUP_MSG] = SendGroupMessagePayload
@@ -2,6 +2,7 @@ from abc import ABC, abstractmethod
 from dataclasses import dataclass
 from config.config import Config
 from entities.message_entity import MessageEntity
+from proto.varint import encode_varint, encode_str
 from exceptions.exceptions import InvalidPayloadResponseError, InvalidUUID
 from enum import Enum
 import struct
@@ -20,6 +21,14 @@ class ResPayload(ABC):
         """Converts the payload to bytes"""
         pass
 
+    def to_bytes_v3(self):
+        """Converts the payload to v3 bytes, the payloads whose v3 layout differs override it"""
+        return self.to_bytes()
+
+    def to_bytes_v4(self):
+        """Converts the payload to v4 bytes, the payloads whose v4 layout differs from v3 override it"""
+        return self.to_bytes_v3()
+
 
 class RegistrationOkPayload(ResPayload):
     """Response payload for registration success"""
@@ -67,17 +76,68 @@ class ListUsersPayload(ResPayload):
             ]
         )
 
+    def to_bytes_v3(self):
+        # The count comes first, names are sent with their length instead of padded to the maximum size
+        return encode_varint(len(self._users_list)) + b"".join(
+            user.get_uuid() + encode_str(user.get_username())
+            for user in self._users_list
+        )
+
+
+class UsersDeltaPayload(ResPayload):
+    """Response payload for the users that changed since a directory version, the current version followed by an entry per user"""
+
+    _VERSION_FMT = "<Q"
+    _ENTRY_FMT = "<16sB"
+
+    def __init__(self, version, users_list):
+        super().__init__()
+        self._version = version
+        self._users_list = users_list
+
+    def size(self):
+        return struct.calcsize(UsersDeltaPayload._VERSION_FMT) + sum(
+            struct.calcsize(UsersDeltaPayload._ENTRY_FMT) + len(user.get_username())
+            for user in self._users_list
+        )
+
+    def to_bytes(self):
+        # Names are sent with their length instead of padded to the maximum size
+        return struct.pack(UsersDeltaPayload._VERSION_FMT, self._version) + b"".join(
+            [
+                struct.pack(
+                    UsersDeltaPayload._ENTRY_FMT,
+                    user.get_uuid(),
+                    len(user.get_username()),
+                )
+                + user.get_username()
+                for user in self._users_list
+            ]
+        )
+
+    def to_bytes_v3(self):
+        return (
+            struct.pack(UsersDeltaPayload._VERSION_FMT, self._version)
+            + encode_varint(len(self._users_list))
+            + b"".join(
+                user.get_uuid() + encode_str(user.get_username())
+                for user in self._users_list
+            )
+        )
+
 
 class PublicKeyPayload(ResPayload):
     """Response payload for public key"""
 
     _RES_FMT = "<16s160s"
     _FMT_SZ = struct.calcsize(_RES_FMT)
+    _KEY_TYPE_FMT = "<B"
 
-    def __init__(self, client_id, public_key):
+    def __init__(self, client_id, public_key, key_type):
         super().__init__()
         self._client_id = client_id
         self._public_key = public_key
+        self._key_type = key_type
 
     def size(self):
         return PublicKeyPayload._FMT_SZ
@@ -89,6 +149,17 @@ class PublicKeyPayload(ResPayload):
             self._public_key.ljust(160, b"\x00"),
         )
 
+    def to_bytes_v3(self):
+        return self._client_id + encode_str(self._public_key)
+
+    def to_bytes_v4(self):
+        # The key type follows the ID, so the client knows how to use the key
+        return (
+            self._client_id
+            + struct.pack(PublicKeyPayload._KEY_TYPE_FMT, self._key_type)
+            + encode_str(self._public_key)
+        )
+
 
 class MessageSentPayload(ResPayload):
     """Response payload for message sent from a client to another client"""
@@ -110,6 +181,23 @@ class MessageSentPayload(ResPayload):
         )
 
 
+class MultiMessageSentPayload(ResPayload):
+    """Response payload for messages sent from a client to several clients, an entry per message"""
+
+    def __init__(self, msgs: list[MessageEntity]):
+        super().__init__()
+        self._msgs = msgs
+
+    def size(self):
+        return len(self._msgs) * MessageSentPayload._FMT_SZ
+
+    def to_bytes(self):
+        return b"".join(
+            struct.pack(MessageSentPayload._RES_FMT, msg.get_to_client(), msg.get_id())
+            for msg in self._msgs
+        )
+
+
 class PollMessagePayload(ResPayload):
     """Response payload for polling messages"""
 
@@ -126,20 +214,159 @@ class PollMessagePayload(ResPayload):
         )
 
     def to_bytes(self):
-        to_send = b""
-        for msg in self._msgs:
-            to_send += (
-                struct.pack(
-                    PollMessagePayload._RES_FMT,
-                    msg.get_from_client(),
-                    msg.get_id(),
-                    msg.get_msg_type().value,
-                    len(msg.get_content()),
-                )
-                + msg.get_content()
+        # Joined once, appending to the bytes message by message copies the whole payload every time
+        return b"".join(
+            struct.pack(
+                PollMessagePayload._RES_FMT,
+                msg.get_from_client(),
+                msg.get_id(),
+                msg.get_type_code(),
+                len(msg.get_content()),
             )
+            + msg.get_content()
+            for msg in self._msgs
+        )
+
+    def to_bytes_v3(self):
+        # The count comes first, then every message with its sender and type, and its ID and content size as VarInt
+        return encode_varint(len(self._msgs)) + b"".join(
+            msg.get_from_client()
+            + struct.pack("<B", msg.get_type_code())
+            + encode_varint(msg.get_id())
+            + encode_varint(len(msg.get_content()))
+            + msg.get_content()
+            for msg in self._msgs
+        )
+
+
+class MessagesPagePayload(ResPayload):
+    """Response payload for polling a page of messages, the cursor of the next page followed by the messages as in PollMessagePayload"""
+
+    _CURSOR_FMT = "<I"
+
+    def __init__(self, cursor, msgs: list[MessageEntity]):
+        super().__init__()
+        self._cursor = cursor
+        self._msgs = PollMessagePayload(msgs)
+
+    def size(self):
+        return struct.calcsize(MessagesPagePayload._CURSOR_FMT) + self._msgs.size()
 
-        return to_send
+    def to_bytes(self):
+        return struct.pack(MessagesPagePayload._CURSOR_FMT, self._cursor) + self._msgs.to_bytes()
+
+    def to_bytes_v3(self):
+        return struct.pack(MessagesPagePayload._CURSOR_FMT, self._cursor) + self._msgs.to_bytes_v3()
+
+
+class MessagesMetaPayload(ResPayload):
+    """Response payload for polling the metadata of the messages, the header of every message of a poll without its content"""
+
+    def __init__(self, msgs: list[MessageEntity]):
+        super().__init__()
+        self._msgs = msgs
+
+    def size(self):
+        return len(self._msgs) * PollMessagePayload._FMT_SZ
+
+    def to_bytes(self):
+        return b"".join(
+            struct.pack(
+                PollMessagePayload._RES_FMT,
+                msg.get_from_client(),
+                msg.get_id(),
+                msg.get_type_code(),
+                msg.get_content_sz(),
+            )
+            for msg in self._msgs
+        )
+
+    def to_bytes_v3(self):
+        return encode_varint(len(self._msgs)) + b"".join(
+            msg.get_from_client()
+            + struct.pack("<B", msg.get_type_code())
+            + encode_varint(msg.get_id())
+            + encode_varint(msg.get_content_sz())
+            for msg in self._msgs
+        )
+
+
+class MessageContentPayload(ResPayload):
+    """Response payload for fetching a range of a message content, the message id, the offset of the range and the size
+    of the whole content, followed by the range"""
+
+    _RES_FMT = "<IQQ"
+    _FMT_SZ = struct.calcsize(_RES_FMT)
+
+    def __init__(self, msg_id, offset, content_sz, content):
+        super().__init__()
+        self._msg_id = msg_id
+        self._offset = offset
+        self._content_sz = content_sz
+        self._content = content
+
+    def size(self):
+        return MessageContentPayload._FMT_SZ + len(self._content)
+
+    def to_bytes(self):
+        return (
+            struct.pack(
+                MessageContentPayload._RES_FMT,
+                self._msg_id,
+                self._offset,
+                self._content_sz,
+            )
+            + self._content
+        )
+
+
+class MessagesAckedPayload(ResPayload):
+    """Response payload for acknowledging messages, the number of messages that were deleted"""
+
+    _RES_FMT = "<I"
+
+    def __init__(self, count):
+        super().__init__()
+        self._count = count
+
+    def size(self):
+        return struct.calcsize(MessagesAckedPayload._RES_FMT)
+
+    def to_bytes(self):
+        return struct.pack(MessagesAckedPayload._RES_FMT, self._count)
+
+
+class GroupCreatedPayload(ResPayload):
+    """Response payload for creating a group, the id of the new group"""
+
+    _RES_FMT = "<I"
+
+    def __init__(self, group_id):
+        super().__init__()
+        self._group_id = group_id
+
+    def size(self):
+        return struct.calcsize(GroupCreatedPayload._RES_FMT)
+
+    def to_bytes(self):
+        return struct.pack(GroupCreatedPayload._RES_FMT, self._group_id)
+
+
+class GroupMessageSentPayload(ResPayload):
+    """Response payload for sending a message to a group, the group id and the number of members it was delivered to"""
+
+    _RES_FMT = "<II"
+
+    def __init__(self, group_id, count):
+        super().__init__()
+        self._group_id = group_id
+        self._count = count
+
+    def size(self):
+        return struct.calcsize(GroupMessageSentPayload._RES_FMT)
+
+    def to_bytes(self):
+        return struct.pack(GroupMessageSentPayload._RES_FMT, self._group_id, self._count)
 
 
 class ErrorResponse(ResPayload):
@@ -163,6 +390,14 @@ class ResponseCodes(Enum):
     PUB_KEY = 2102
     MSG_SENT = 2103
     POLL_MSGS = 2104
+    MULTI_MSG_SENT = 2105
+    USERS_DELTA = 2106
+    MSGS_META = 2107
+    MSG_CONTENT = 2108
+    MSGS_ACKED = 2109
+    MSGS_PAGE = 2110
+    GROUP_CREATED = 2111
+    GROUP_MSG_SENT = 2112
     ERROR = 9000
 
     @staticmethod
@@ -177,6 +412,22 @@ class ResponseCodes(Enum):
             return ResponseCodes.MSG_SENT
         elif code == 2104:
             return ResponseCodes.POLL_MSGS
+        elif code == 2105:
+            return ResponseCodes.MULTI_MSG_SENT
+        elif code == 2106:
+            return ResponseCodes.USERS_DELTA
+        elif code == 2107:
+            return ResponseCodes.MSGS_META
+        elif code == 2108:
+            return ResponseCodes.MSG_CONTENT
+        elif code == 2109:
+            return ResponseCodes.MSGS_ACKED
+        elif code == 2110:
+            return ResponseCodes.MSGS_PAGE
+        elif code == 2111:
+            return ResponseCodes.GROUP_CREATED
+        elif code == 2112:
+            return ResponseCodes.GROUP_MSG_SENT
         return ResponseCodes.ERROR
 
 
@@ -206,13 +457,21 @@ class Response:
             raise InvalidPayloadResponseError("Invalid payload or code")
 
         # Create the header
-        self._header = Response.Header(Config.VERSION, code, payload.size())
+        self._header = Response.Header(Config.MIN_VERSION, code, payload.size())
         # Store the payload
         self._payload = payload
 
-    def to_bytes(self):
-        """Convert the header and payload to bytes"""
-        return self._header.to_bytes() + self._payload.to_bytes()
+    def to_bytes(self, version=Config.MIN_VERSION):
+        """Convert the header and payload to bytes, in the protocol version of the request"""
+        if version < 3:
+            return self._header.to_bytes() + self._payload.to_bytes()
+
+        if version >= 4:
+            payload = self._payload.to_bytes_v4()
+        else:
+            payload = self._payload.to_bytes_v3()
+        header = Response.Header(version, self._header.code, len(payload))
+        return header.to_bytes() + payload
 
 
 class ResponseFactory:
@@ -222,13 +481,25 @@ class ResponseFactory:
     _builders = {
         ResponseCodes.REG_OK: lambda uuid: RegistrationOkPayload(uuid),
         ResponseCodes.LIST_USRS: lambda users_list: ListUsersPayload(users_list),
-        ResponseCodes.PUB_KEY: lambda client_id, public_key: PublicKeyPayload(
-            client_id, public_key
+        ResponseCodes.USERS_DELTA: lambda version, users_list: UsersDeltaPayload(
+            version, users_list
+        ),
+        ResponseCodes.PUB_KEY: lambda client_id, public_key, key_type: PublicKeyPayload(
+            client_id, public_key, key_type
         ),
         ResponseCodes.MSG_SENT: lambda dst_client_id, msg_id: MessageSentPayload(
             dst_client_id, msg_id
         ),
         ResponseCodes.POLL_MSGS: lambda msgs: PollMessagePayload(msgs),
+        ResponseCodes.MULTI_MSG_SENT: lambda msgs: MultiMessageSentPayload(msgs),
+        ResponseCodes.MSGS_META: lambda msgs: MessagesMetaPayload(msgs),
+        ResponseCodes.MSG_CONTENT: lambda msg_id, offset, content_sz, content: MessageContentPayload(
+            msg_id, offset, content_sz, content
+        ),
+        ResponseCodes.MSGS_ACKED: lambda count: MessagesAckedPayload(count),
+        ResponseCodes.MSGS_PAGE: lambda cursor, msgs: MessagesPagePayload(cursor, msgs),
+        ResponseCodes.GROUP_CREATED: lambda group_id: GroupCreatedPayload(group_id),
+        ResponseCodes.GROUP_MSG_SENT: lambda group_id, count: GroupMessageSentPayload(group_id, count),
         ResponseCodes.ERROR: lambda: ErrorResponse(),
     }
 
@@ -0,0 +1,22 @@
+from config.config import Config
+
+
+class Session:
+    """The framing state of a connection.
+
+    Every connection starts with the full v2 header. A request with version 3 (or later) switches the connection to compact headers, which carry
+    the client ID only when it changes, so the session keeps the last one it was given.
+    """
+
+    def __init__(self):
+        self.version = Config.MIN_VERSION
+        self.client_id = bytes(16)
+
+    def is_compact(self):
+        """Tells if the requests of the connection have compact headers"""
+        return self.version >= 3
+
+    def accept(self, header):
+        """Takes the version and the client ID of a request header, the responses are sent in that version"""
+        self.version = max(Config.MIN_VERSION, min(header.version, Config.VERSION))
+        self.client_id = header.client_id
@@ -0,0 +1,44 @@
+"""Variable length fields of protocol v3, unsigned LEB128 integers and strings prefixed by their length"""
+
+from exceptions.exceptions import InvalidPayloadError
+
+_MAX_SZ = 10
+
+
+def encode_varint(value):
+    """Encodes an unsigned integer, 7 bits a byte with the low bits first and the high bit set on every byte but the last"""
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def decode_varint(data, offset=0):
+    """Decodes the integer at offset, returns it with the offset that follows it, None if the data ends before it does"""
+    value = 0
+    for i in range(_MAX_SZ):
+        if offset + i >= len(data):
+            return None
+        byte = data[offset + i]
+        value |= (byte & 0x7F) << (7 * i)
+        if not byte & 0x80:
+            return value, offset + i + 1
+    raise InvalidPayloadError(f"Error: VarInt at offset {offset} is too long")
+
+
+def encode_str(value):
+    """Encodes bytes prefixed by their length"""
+    return encode_varint(len(value)) + value
+
+
+def decode_str(data, offset=0):
+    """Decodes the string at offset, returns it with the offset that follows it"""
+    decoded = decode_varint(data, offset)
+    if decoded is None:
+        raise InvalidPayloadError(f"Error: string length at offset {offset} is truncated")
+    size, offset = decoded
+    if len(data) - offset < size:
+        raise InvalidPayloadError(f"Error: string of {size} bytes at offset {offset} is truncated")
+    return bytes(data[offset : offset + size]), offset + size
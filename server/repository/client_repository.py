@@ -1,4 +1,3 @@
-import sqlite3
 from repository.repository import Repository
 from entities.client_entity import ClientEntity
 
@@ -9,67 +8,125 @@ class ClientRepository(Repository):
     def __init__(self, db_path):
         super().__init__()
         self._db_path = db_path
+        self._conn = self._connect(db_path)
         self._ensure_table()
 
     def _ensure_table(self):
-        with sqlite3.connect(self._db_path) as conn:
-            conn.text_factory = bytes
-            conn.executescript(
+        with self._conn:
+            self._conn.executescript(
                 f"""
                 CREATE TABLE IF NOT EXISTS {self.__tablename__} (
                     ID CHAR(16) NOT NULL PRIMARY KEY,
                     UserName CHAR(255) UNIQUE NOT NULL,
                     PublicKey CHAR(160) NOT NULL,
-                    LastSeen DATETIME DEFAULT CURRENT_TIMESTAMP
+                    LastSeen DATETIME DEFAULT CURRENT_TIMESTAMP,
+                    Version INTEGER NOT NULL DEFAULT 0,
+                    KeyType INTEGER NOT NULL DEFAULT 0
                 );
                 """
             )
-            conn.commit()
+            # Databases created before the directory was versioned get the column, every existing client counts as a change
+            columns = [row[1] for row in self._conn.execute(f"PRAGMA table_info({self.__tablename__})")]
+            if "Version" not in columns:
+                self._conn.execute(
+                    f"ALTER TABLE {self.__tablename__} ADD COLUMN Version INTEGER NOT NULL DEFAULT 0"
+                )
+                self._conn.execute(f"UPDATE {self.__tablename__} SET Version = rowid")
+            # Databases created before X25519 keys get the column, every existing key is an RSA key
+            if "KeyType" not in columns:
+                self._conn.execute(
+                    f"ALTER TABLE {self.__tablename__} ADD COLUMN KeyType INTEGER NOT NULL DEFAULT 0"
+                )
+            self._conn.execute(
+                f"CREATE INDEX IF NOT EXISTS idx_{self.__tablename__}_version ON {self.__tablename__} (Version)"
+            )
+
+    @staticmethod
+    def _to_entity(row):
+        return ClientEntity(row[0], row[1], row[2], row[3], row[4])
 
     def find_all(self):
-        with sqlite3.connect(self._db_path) as conn:
-            cursor = conn.cursor()
-            cursor.execute("SELECT ID, UserName, PublicKey, LastSeen FROM clients")
-            return [
-                ClientEntity(row[0], row[1], row[2], row[3])
-                for row in cursor.fetchall()
-            ]
+        cursor = self._conn.execute(
+            f"SELECT ID, UserName, PublicKey, LastSeen, KeyType FROM {self.__tablename__}"
+        )
+        return [self._to_entity(row) for row in cursor]
+
+    def find_all_except(self, id):
+        """Finds every client but the given one"""
+        cursor = self._conn.execute(
+            f"SELECT ID, UserName, PublicKey, LastSeen, KeyType FROM {self.__tablename__} WHERE ID != ?",
+            (id,),
+        )
+        return [self._to_entity(row) for row in cursor]
+
+    def current_version(self):
+        """Gets the version of the directory, the version of the latest change to any client"""
+        (version,) = self._conn.execute(
+            f"SELECT COALESCE(MAX(Version), 0) FROM {self.__tablename__}"
+        ).fetchone()
+        return version
+
+    def find_changed_since(self, version, id):
+        """Finds the clients but the given one that were added or changed after the given version (uses the version index)"""
+        cursor = self._conn.execute(
+            f"""
+            SELECT ID, UserName, PublicKey, LastSeen, KeyType FROM {self.__tablename__}
+            WHERE Version > ? AND ID != ? ORDER BY Version
+            """,
+            (version, id),
+        )
+        return [self._to_entity(row) for row in cursor]
 
     def find(self, filter_cb):
         return list(filter(filter_cb, self.find_all()))
 
+    def find_by_id(self, id):
+        """Finds a client by its UUID (uses the primary key), None if there is no such client"""
+        row = self._conn.execute(
+            f"SELECT ID, UserName, PublicKey, LastSeen, KeyType FROM {self.__tablename__} WHERE ID = ?",
+            (id,),
+        ).fetchone()
+        return self._to_entity(row) if row else None
+
+    def find_by_username(self, username):
+        """Finds a client by its username (uses the unique index), None if there is no such client"""
+        row = self._conn.execute(
+            f"SELECT ID, UserName, PublicKey, LastSeen, KeyType FROM {self.__tablename__} WHERE UserName = ?",
+            (username,),
+        ).fetchone()
+        return self._to_entity(row) if row else None
+
     def save(self, id: str, obj: ClientEntity):
-        with sqlite3.connect(self._db_path) as conn:
-            cursor = conn.cursor()
-            cursor.execute(
-                """
-                INSERT INTO clients (ID, UserName, PublicKey, LastSeen) 
-                VALUES (?, ?, ?, ?) 
+        with self._conn:
+            self._conn.execute(
+                f"""
+                INSERT INTO {self.__tablename__} (ID, UserName, PublicKey, LastSeen, KeyType, Version) 
+                VALUES (?, ?, ?, ?, ?, (SELECT COALESCE(MAX(Version), 0) + 1 FROM {self.__tablename__})) 
                 ON CONFLICT(ID) DO UPDATE SET 
                 UserName=excluded.UserName, 
                 PublicKey=excluded.PublicKey, 
-                LastSeen=excluded.LastSeen
+                KeyType=excluded.KeyType, 
+                LastSeen=excluded.LastSeen,
+                Version=excluded.Version
             """,
                 (
                     id,
                     obj.get_username(),
                     obj.get_public_key(),
                     obj.get_last_seen().isoformat(),
+                    obj.get_key_type(),
                 ),
             )
-            conn.commit()
 
     def update_last_seen(self, uuid):
-        with sqlite3.connect(self._db_path) as conn:
-            cursor = conn.cursor()
-            cursor.execute(
+        with self._conn:
+            self._conn.execute(
                 f"UPDATE {self.__tablename__} SET LastSeen = CURRENT_TIMESTAMP WHERE ID = ?",
                 (uuid,),
             )
-            conn.commit()
 
     def delete(self, id: str):
-        with sqlite3.connect(self._db_path) as conn:
-            cursor = conn.cursor()
-            cursor.execute("DELETE FROM clients WHERE id = ?", (id,))
-            conn.commit()
+        with self._conn:
+            self._conn.execute(
+                f"DELETE FROM {self.__tablename__} WHERE ID = ?", (id,)
+            )
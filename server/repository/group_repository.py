@@ -0,0 +1,69 @@
+from repository.repository import Repository
+from entities.group_entity import GroupEntity
+
+
+class GroupRepository(Repository):
+    __tablename__ = "groups"
+    __memberstable__ = "group_members"
+
+    def __init__(self, db_path):
+        super().__init__()
+        self._db_path = db_path
+        self._conn = self._connect(db_path)
+        self._ensure_table()
+
+    def _ensure_table(self):
+        with self._conn:
+            self._conn.executescript(
+                f"""
+                CREATE TABLE IF NOT EXISTS {self.__tablename__} (
+                    ID INTEGER PRIMARY KEY AUTOINCREMENT,
+                    Name CHAR(255) NOT NULL,
+                    Owner CHAR(16) NOT NULL
+                );
+                CREATE TABLE IF NOT EXISTS {self.__memberstable__} (
+                    GroupID INTEGER NOT NULL,
+                    ClientID CHAR(16) NOT NULL,
+                    PRIMARY KEY (GroupID, ClientID)
+                );
+                """
+            )
+
+    def _members(self, id):
+        cursor = self._conn.execute(
+            f"SELECT ClientID FROM {self.__memberstable__} WHERE GroupID = ?", (id,)
+        )
+        return [row[0] for row in cursor]
+
+    def find_all(self):
+        cursor = self._conn.execute(f"SELECT ID, Name, Owner FROM {self.__tablename__}")
+        return [GroupEntity(row[0], row[1], row[2], self._members(row[0])) for row in cursor.fetchall()]
+
+    def find(self, filter_cb):
+        return list(filter(filter_cb, self.find_all()))
+
+    def find_by_id(self, id):
+        """Finds a group and its members by its id (uses the primary keys), None if there is no such group"""
+        row = self._conn.execute(
+            f"SELECT ID, Name, Owner FROM {self.__tablename__} WHERE ID = ?", (id,)
+        ).fetchone()
+        return GroupEntity(row[0], row[1], row[2], self._members(id)) if row else None
+
+    def save(self, id, obj: GroupEntity):
+        """Saves a new group and its members in a single transaction, returns its id"""
+        with self._conn:
+            cursor = self._conn.execute(
+                f"INSERT INTO {self.__tablename__} (Name, Owner) VALUES (?, ?)",
+                (obj.get_name(), obj.get_owner()),
+            )
+            group_id = cursor.lastrowid
+            self._conn.executemany(
+                f"INSERT OR IGNORE INTO {self.__memberstable__} (GroupID, ClientID) VALUES (?, ?)",
+                ((group_id, member) for member in obj.get_members()),
+            )
+        return group_id
+
+    def delete(self, id):
+        with self._conn:
+            self._conn.execute(f"DELETE FROM {self.__memberstable__} WHERE GroupID = ?", (id,))
+            self._conn.execute(f"DELETE FROM {self.__tablename__} WHERE ID = ?", (id,))
@@ -1,21 +1,25 @@
-import sqlite3
 from repository.repository import Repository
 from entities.message_entity import MessageEntity
-from proto.request import MessageTypes
+from proto.request import MessageTypes, MessageFlags
 
 
 class MessageRepository(Repository):
     __tablename__ = "messages"
 
+    # SQLite limits the number of bound parameters of a statement, larger deletes are split
+    _MAX_IDS_PER_DELETE = 500
+    # Leaves out the messages whose type byte carries MessageFlags, for the clients that can't read them
+    _PLAIN_ONLY = f"AND (Type & {int(MessageFlags.MASK)}) = 0"
+
     def __init__(self, db_path):
         super().__init__()
         self._db_path = db_path
+        self._conn = self._connect(db_path)
         self._ensure_table()
 
     def _ensure_table(self):
-        with sqlite3.connect(self._db_path) as conn:
-            conn.text_factory = bytes
-            conn.executescript(
+        with self._conn:
+            self._conn.executescript(
                 f"""
                 CREATE TABLE IF NOT EXISTS {self.__tablename__} (
                     ID INTEGER PRIMARY KEY AUTOINCREMENT,
@@ -25,34 +29,141 @@ class MessageRepository(Repository):
                     Content BLOB NOT NULL,
                     FOREIGN KEY (ToClient) REFERENCES clients(ID),
                     FOREIGN KEY (FromClient) REFERENCES clients(ID)
-                )"""
+                );
+                CREATE INDEX IF NOT EXISTS idx_{self.__tablename__}_to_client
+                    ON {self.__tablename__} (ToClient, ID);
+                """
             )
-            conn.commit()
+
+    @staticmethod
+    def _plain_only(plain_only):
+        """Gets the condition that leaves out the messages with flags, if it is asked for"""
+        return MessageRepository._PLAIN_ONLY if plain_only else ""
+
+    @staticmethod
+    def _to_entity(row):
+        # The Type column holds the type byte as it was sent, flags included
+        msg_type, msg_flags = MessageTypes.split_code(int(row[3]))
+        return MessageEntity(
+            row[0],
+            row[1],
+            row[2],
+            msg_type,
+            row[4],
+            msg_flags,
+        )
 
     def find_all(self):
-        with sqlite3.connect(self._db_path) as conn:
-            cursor = conn.cursor()
-            cursor.execute(
-                "SELECT ID, FromClient, ToClient, Type, Content FROM messages"
-            )
-            return [
-                MessageEntity(
-                    row[0],
-                    row[1],
-                    row[2],
-                    MessageTypes.code_to_enum(int(row[3])),
-                    row[4],
-                )
-                for row in cursor.fetchall()
-            ]
+        cursor = self._conn.execute(
+            f"SELECT ID, FromClient, ToClient, Type, Content FROM {self.__tablename__}"
+        )
+        return [self._to_entity(row) for row in cursor]
 
     def find(self, filter_cb):
         return list(filter(filter_cb, self.find_all()))
 
+    def find_by_recipient(self, to_client, plain_only=False):
+        """Finds the messages sent to a client, oldest first (uses the ToClient index).
+        'plain_only' leaves out the messages with flags"""
+        cursor = self._conn.execute(
+            f"""
+            SELECT ID, FromClient, ToClient, Type, Content FROM {self.__tablename__}
+            WHERE ToClient = ? {self._plain_only(plain_only)} ORDER BY ID
+            """,
+            (to_client,),
+        )
+        return [self._to_entity(row) for row in cursor]
+
+    def find_meta_by_recipient(self, to_client, plain_only=False):
+        """Finds the messages sent to a client without their content, oldest first (uses the ToClient index).
+        'plain_only' leaves out the messages with flags"""
+        cursor = self._conn.execute(
+            f"""
+            SELECT ID, FromClient, ToClient, Type, length(Content) FROM {self.__tablename__}
+            WHERE ToClient = ? {self._plain_only(plain_only)} ORDER BY ID
+            """,
+            (to_client,),
+        )
+        msgs = []
+        for row in cursor:
+            msg_type, msg_flags = MessageTypes.split_code(int(row[3]))
+            msgs.append(MessageEntity(row[0], row[1], row[2], msg_type, None, msg_flags, row[4]))
+        return msgs
+
+    def read_content(self, to_client, id, offset, size):
+        """Reads a range of the content of a message sent to a client, returns the size of the whole content and the range,
+        None if the client has no such message. Only the range is read from the database"""
+        row = self._conn.execute(
+            f"SELECT length(Content) FROM {self.__tablename__} WHERE ID = ? AND ToClient = ?",
+            (id, to_client),
+        ).fetchone()
+        if row is None:
+            return None
+
+        content_sz = row[0]
+        offset = min(offset, content_sz)
+        with self._conn.blobopen(self.__tablename__, "Content", id, readonly=True) as blob:
+            blob.seek(offset)
+            return content_sz, blob.read(min(size, content_sz - offset))
+
+    def delete_by_recipient(self, to_client, ids):
+        """Deletes the messages of a client by their ids in a single transaction, ids of other clients are ignored.
+        Returns the number of messages that were deleted"""
+        deleted = 0
+        with self._conn:
+            for start in range(0, len(ids), MessageRepository._MAX_IDS_PER_DELETE):
+                chunk = ids[start : start + MessageRepository._MAX_IDS_PER_DELETE]
+                placeholders = ",".join("?" * len(chunk))
+                cursor = self._conn.execute(
+                    f"DELETE FROM {self.__tablename__} WHERE ToClient = ? AND ID IN ({placeholders})",
+                    (to_client, *chunk),
+                )
+                deleted += cursor.rowcount
+        return deleted
+
+    def take_page_by_recipient(self, to_client, cursor, max_count, max_sz, plain_only=False):
+        """Deletes the messages of a client up to the cursor (an ID) and finds the ones that follow it in a single transaction, oldest first.
+        The page ends after 'max_count' messages or before the content passes 'max_sz' bytes, but it holds at least one message.
+        'plain_only' leaves out the messages with flags, they aren't deleted either"""
+        plain_only = self._plain_only(plain_only)
+        with self._conn:
+            self._conn.execute(
+                f"DELETE FROM {self.__tablename__} WHERE ToClient = ? AND ID <= ? {plain_only}",
+                (to_client, cursor),
+            )
+
+            # The sizes are read first so the contents past the budget are never loaded
+            sizes = self._conn.execute(
+                f"""
+                SELECT ID, length(Content) FROM {self.__tablename__}
+                WHERE ToClient = ? AND ID > ? {plain_only} ORDER BY ID LIMIT ?
+                """,
+                (to_client, cursor, max_count),
+            ).fetchall()
+
+            last_id = None
+            page_sz = 0
+            for id, content_sz in sizes:
+                if last_id is not None and page_sz + content_sz > max_sz:
+                    break
+                last_id = id
+                page_sz += content_sz
+
+            if last_id is None:
+                return []
+
+            rows = self._conn.execute(
+                f"""
+                SELECT ID, FromClient, ToClient, Type, Content FROM {self.__tablename__}
+                WHERE ToClient = ? AND ID > ? AND ID <= ? {plain_only} ORDER BY ID
+                """,
+                (to_client, cursor, last_id),
+            )
+            return [self._to_entity(row) for row in rows]
+
     def save(self, id, obj: MessageEntity):
-        with sqlite3.connect(self._db_path) as conn:
-            cursor = conn.cursor()
-            cursor.execute(
+        with self._conn:
+            cursor = self._conn.execute(
                 f"""
                 INSERT INTO {self.__tablename__} (ToClient, FromClient, Type, Content) 
                 VALUES (?, ?, ?, ?) 
@@ -60,15 +171,33 @@ class MessageRepository(Repository):
                 (
                     obj.get_to_client(),
                     obj.get_from_client(),
-                    obj.get_msg_type().value,
+                    obj.get_type_code(),
                     obj.get_content(),
                 ),
             )
-            conn.commit()
             return cursor.lastrowid
 
+    def save_many(self, objs: list[MessageEntity]):
+        """Saves several messages in a single transaction, returns their ids in order"""
+        ids = []
+        with self._conn:
+            for obj in objs:
+                cursor = self._conn.execute(
+                    f"""
+                    INSERT INTO {self.__tablename__} (ToClient, FromClient, Type, Content) 
+                    VALUES (?, ?, ?, ?) 
+                    """,
+                    (
+                        obj.get_to_client(),
+                        obj.get_from_client(),
+                        obj.get_type_code(),
+                        obj.get_content(),
+                    ),
+                )
+                ids.append(cursor.lastrowid)
+        return ids
+
     def delete(self, id):
-        with sqlite3.connect(self._db_path) as conn:
-            cursor = conn.cursor()
-            cursor.execute(f"DELETE FROM {self.__tablename__} WHERE ID=?", (id,))
-            conn.commit()
+        with self._conn:
+            self._conn.execute(f"DELETE FROM {self.__tablename__} WHERE ID=?", (id,))
+
@@ -1,4 +1,5 @@
 from abc import ABC, abstractmethod
+import sqlite3
 
 
 class Repository(ABC):
@@ -7,6 +8,15 @@ class Repository(ABC):
     Provides an interface for the repository classes to implement.
     """
 
+    @staticmethod
+    def _connect(db_path):
+        """Opens the connection a repository keeps for its whole lifetime"""
+        conn = sqlite3.connect(db_path)
+        # WAL lets the writes commit without rewriting the main database file every time
+        conn.execute("PRAGMA journal_mode=WAL")
+        conn.execute("PRAGMA synchronous=NORMAL")
+        return conn
+
     @abstractmethod
     def find_all(self):
         pass
@@ -15,28 +15,39 @@ class ClientService:
     def find_by_id(self, uuid: bytes) -> ClientEntity:
         """Find a client by its UUID"""
         self._client_repo.update_last_seen(uuid)
-        result = self._client_repo.find(filter_cb=lambda user: uuid == user.get_uuid())
-        if not result:
-            return None
-        return next(iter(result))
+        return self._client_repo.find_by_id(uuid)
 
     def find_all(self, uuid: bytes):
         """Find all clients"""
         self._client_repo.update_last_seen(uuid)
         return self._client_repo.find_all()
 
+    def find_all_except(self, uuid: bytes):
+        """Find all clients but the one with the given UUID"""
+        self._client_repo.update_last_seen(uuid)
+        return self._client_repo.find_all_except(uuid)
+
+    def find_changed_since(self, uuid: bytes, version: int):
+        """Find the clients but the one with the given UUID that changed after the given directory version, returns the current version with them"""
+        self._client_repo.update_last_seen(uuid)
+        current = self._client_repo.current_version()
+        # A version from the future means the directory was reset, the client has to start over
+        if version > current:
+            version = 0
+        return current, self._client_repo.find_changed_since(version, uuid)
+
     def create(self, payload: RegistrationPayload):
         """Create a new client"""
 
         # if the username already exists, raise an exception
-        if self._client_repo.find(
-            filter_cb=lambda user: payload.username == user.get_username()
-        ):
+        if self._client_repo.find_by_username(payload.username):
             raise UniqueKeyViolationException(
                 f"Error: '{payload.username}' already exists"
             )
 
         new_uuid = uuid.uuid4().bytes
-        user = ClientEntity(new_uuid, payload.username, payload.public_key)
+        user = ClientEntity(
+            new_uuid, payload.username, payload.public_key, key_type=payload.key_type
+        )
         self._client_repo.save(new_uuid, user)
         return user
@@ -0,0 +1,57 @@
+from config.config import Config
+from entities.group_entity import GroupEntity
+from exceptions.exceptions import NotFoundError, InvalidPayloadError, InvalidMessageTypeError
+from proto.request import CreateGroupPayload, SendMessagePayload, SendGroupMessagePayload, MessageTypes
+from repository.repository import Repository
+
+import struct
+
+
+class GroupService:
+    """Service layer for the groups, a group message is stored once per member so every mailbox stays independent"""
+
+    def __init__(self, repo: Repository, client_repo: Repository):
+        self._groups_repo = repo
+        self._client_repo = client_repo
+
+    def create(self, owner_id, payload: CreateGroupPayload) -> GroupEntity:
+        """Creates a group of the owner and the given members, every member must be a registered client"""
+        members = list(dict.fromkeys([owner_id, *payload.members]))
+        if len(members) > Config.MAX_GROUP_MEMBERS:
+            raise InvalidPayloadError(
+                f"Error: a group has at most {Config.MAX_GROUP_MEMBERS} members, got {len(members)}"
+            )
+
+        for member in members:
+            if self._client_repo.find_by_id(member) is None:
+                raise NotFoundError(f"Error: there is no client '{member.hex()}' to add to the group")
+
+        group = GroupEntity(None, payload.name, owner_id, members)
+        group.set_id(self._groups_repo.save(None, group))
+        return group
+
+    def check_direct(self, sender_id, payload: SendMessagePayload):
+        """Checks the group messages among the messages sent to a single client. A group text is only delivered by SEND_GROUP_MSG,
+        and a group key only by the group's owner to one of its members, so no one else can replace the key of a group"""
+        if payload.msg_type == MessageTypes.SEND_GROUP_TXT:
+            raise InvalidMessageTypeError(f"Error: '{payload.msg_type}' can only be sent to a group")
+        if payload.msg_type != MessageTypes.SEND_GROUP_KEY:
+            return
+
+        # The key is sent after the ID of its group
+        if len(payload.content) < struct.calcsize(SendGroupMessagePayload._GROUP_ID_FMT):
+            raise InvalidPayloadError("Error: group key is too short for the group ID")
+        (group_id,) = struct.unpack_from(SendGroupMessagePayload._GROUP_ID_FMT, payload.content)
+
+        group = self._groups_repo.find_by_id(group_id)
+        if group is None or group.get_owner() != sender_id or payload.client_id not in group.get_members():
+            raise NotFoundError(
+                f"Error: there is no group '{group_id}' the client owns with '{payload.client_id.hex()}' as a member"
+            )
+
+    def recipients(self, sender_id, group_id) -> list:
+        """Gets the members a message of the sender to the group is delivered to, every member but the sender"""
+        group = self._groups_repo.find_by_id(group_id)
+        if group is None or sender_id not in group.get_members():
+            raise NotFoundError(f"Error: there is no group '{group_id}' the client is a member of")
+        return [member for member in group.get_members() if member != sender_id]
@@ -1,5 +1,7 @@
+from config.config import Config
 from entities.message_entity import MessageEntity
-from proto.request import SendMessagePayload
+from exceptions.exceptions import NotFoundError
+from proto.request import SendMessagePayload, SendGroupMessagePayload
 from repository.repository import Repository
 
 
@@ -14,16 +16,62 @@ class MessagesService:
             payload.client_id,
             payload.msg_type,
             payload.content,
+            payload.msg_flags,
         )
         msg_id = self._messages_repo.save(None, msg)
         msg.set_id(msg_id)
         return msg
 
-    def poll_msgs(self, client_id) -> list[MessageEntity]:
-        self._messages_repo.find(lambda msg: client_id == msg.get_to_client())
-        msgs = self._messages_repo.find(lambda msg: client_id == msg.get_to_client())
-
-        for msg in msgs:
-            self._messages_repo.delete(msg.get_id())
+    def create_many(self, sender_id, payloads: list[SendMessagePayload]) -> list[MessageEntity]:
+        msgs = [
+            MessageEntity(
+                None,
+                sender_id,
+                payload.client_id,
+                payload.msg_type,
+                payload.content,
+                payload.msg_flags,
+            )
+            for payload in payloads
+        ]
+        for msg, msg_id in zip(msgs, self._messages_repo.save_many(msgs)):
+            msg.set_id(msg_id)
+        return msgs
 
+    def create_for_group(self, sender_id, recipients, payload: SendGroupMessagePayload) -> list[MessageEntity]:
+        """Delivers a group message to every recipient in a single transaction, the content was uploaded (and encrypted) once"""
+        content = payload.member_content()
+        msgs = [
+            MessageEntity(None, sender_id, recipient, payload.msg_type, content, payload.msg_flags)
+            for recipient in recipients
+        ]
+        for msg, msg_id in zip(msgs, self._messages_repo.save_many(msgs)):
+            msg.set_id(msg_id)
         return msgs
+
+    def poll_msgs(self, client_id, plain_only=False) -> list[MessageEntity]:
+        # The messages are read by the ToClient index, they are acknowledged once the response that carries them was sent
+        return self._messages_repo.find_by_recipient(client_id, plain_only)
+
+    def poll_page(self, client_id, cursor, max_count, max_sz, plain_only=False) -> list[MessageEntity]:
+        """Deletes the messages up to the cursor, which the client is done with, and gets the page that follows.
+        The count and the size are cut to the server's limits, 0 takes the limit"""
+        max_count = Config.MAX_PAGE_MSGS if max_count == 0 else min(max_count, Config.MAX_PAGE_MSGS)
+        max_sz = Config.MAX_PAGE_SZ if max_sz == 0 else min(max_sz, Config.MAX_PAGE_SZ)
+        return self._messages_repo.take_page_by_recipient(client_id, cursor, max_count, max_sz, plain_only)
+
+    def poll_meta(self, client_id, plain_only=False) -> list[MessageEntity]:
+        # Only the sender, id, type and size of the messages, they stay until they are acknowledged
+        return self._messages_repo.find_meta_by_recipient(client_id, plain_only)
+
+    def fetch(self, client_id, msg_id, offset, size):
+        """Gets the size of the content of a message and a range of it, a range of size 0 or past Config.MAX_FETCH_SZ is cut to it"""
+        size = Config.MAX_FETCH_SZ if size == 0 else min(size, Config.MAX_FETCH_SZ)
+        found = self._messages_repo.read_content(client_id, msg_id, offset, size)
+        if found is None:
+            raise NotFoundError(f"Error: there is no message '{msg_id}' for the client")
+        return found
+
+    def ack(self, client_id, msg_ids) -> int:
+        # Deleting is the only way the polled messages leave the server
+        return self._messages_repo.delete_by_recipient(client_id, msg_ids)